@@ -0,0 +1,300 @@
+/***************************************
+ The area (bounding box or polygon) that the parsed data is clipped to.
+
+ Part of the Routino routing software.
+ ******************/ /******************
+ This file Copyright 2008-2011 Andrew M. Bishop
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************/
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "types.h"
+
+#include "typesx.h"
+#include "areax.h"
+
+
+/* Local functions */
+
+static int is_end_line(const char *line);
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Create an area from a bounding box given as 'left,bottom,right,top' (the
+  minimum longitude, minimum latitude, maximum longitude and maximum latitude in
+  degrees).
+
+  AreaX *NewAreaBBox Returns the area or NULL if the bounding box is not valid.
+
+  const char *bbox The bounding box.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+AreaX *NewAreaBBox(const char *bbox)
+{
+ AreaX *areax;
+ double left,bottom,right,top;
+ char dummy;
+
+ if(sscanf(bbox,"%lf,%lf,%lf,%lf%c",&left,&bottom,&right,&top,&dummy)!=4)
+    return(NULL);
+
+ if(left>=right || bottom>=top || bottom<-90 || top>90 || left<-180 || right>180)
+    return(NULL);
+
+ areax=(AreaX*)calloc(1,sizeof(AreaX));
+
+ assert(areax); /* Check calloc() worked */
+
+ areax->latmin=degrees_to_radians(bottom);
+ areax->latmax=degrees_to_radians(top);
+ areax->lonmin=degrees_to_radians(left);
+ areax->lonmax=degrees_to_radians(right);
+
+ return(areax);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Create an area from a polygon file in the Osmosis '.poly' format (a name line
+  followed by one or more rings of 'longitude latitude' lines, each ring starts
+  with a name line and ends with an 'END' line and the file ends with another
+  'END' line).  The rings are combined using the even-odd rule so that the rings
+  for holes (names starting with '!') are excluded.
+
+  AreaX *NewAreaPolygon Returns the area or NULL if there is an error.
+
+  const char *filename The name of the polygon file.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+AreaX *NewAreaPolygon(const char *filename)
+{
+ AreaX *areax;
+ FILE *file;
+ char line[256];
+ int lineno=0,inring=0,finished=0,eof;
+
+ file=fopen(filename,"r");
+
+ if(!file)
+   {
+    fprintf(stderr,"Error: Cannot open polygon file '%s' for reading [%s].\n",filename,strerror(errno));
+    return(NULL);
+   }
+
+ areax=(AreaX*)calloc(1,sizeof(AreaX));
+
+ assert(areax); /* Check calloc() worked */
+
+ areax->rings=(int*)malloc(16*sizeof(int));
+
+ assert(areax->rings); /* Check malloc() worked */
+
+ areax->rings[0]=0;
+
+ /* The first line is the name of the polygon */
+
+ if(fgets(line,sizeof(line),file))
+    lineno++;
+
+ /* Read the rings */
+
+ while(!finished && fgets(line,sizeof(line),file))
+   {
+    char *p=line;
+
+    lineno++;
+
+    while(isspace(*p))
+       p++;
+
+    if(!*p)
+       continue;
+
+    if(!inring)
+      {
+       if(is_end_line(p))
+          finished=1;
+       else
+          inring=1;
+      }
+    else if(is_end_line(p))
+      {
+       if((areax->npoints-areax->rings[areax->nrings])<3)
+          break;
+
+       areax->nrings++;
+
+       if((areax->nrings%16)==15)
+         {
+          areax->rings=(int*)realloc((void*)areax->rings,(areax->nrings+1+16)*sizeof(int));
+
+          assert(areax->rings); /* Check realloc() worked */
+         }
+
+       areax->rings[areax->nrings]=areax->npoints;
+
+       inring=0;
+      }
+    else
+      {
+       double longitude,latitude;
+
+       if(sscanf(p,"%lf %lf",&longitude,&latitude)!=2)
+          break;
+
+       if((areax->npoints%256)==0)
+         {
+          areax->latitude =(double*)realloc((void*)areax->latitude ,(areax->npoints+256)*sizeof(double));
+          areax->longitude=(double*)realloc((void*)areax->longitude,(areax->npoints+256)*sizeof(double));
+
+          assert(areax->latitude && areax->longitude); /* Check realloc() worked */
+         }
+
+       areax->latitude [areax->npoints]=degrees_to_radians(latitude);
+       areax->longitude[areax->npoints]=degrees_to_radians(longitude);
+
+       if(areax->npoints==0 || areax->latitude[areax->npoints]<areax->latmin)
+          areax->latmin=areax->latitude[areax->npoints];
+       if(areax->npoints==0 || areax->latitude[areax->npoints]>areax->latmax)
+          areax->latmax=areax->latitude[areax->npoints];
+       if(areax->npoints==0 || areax->longitude[areax->npoints]<areax->lonmin)
+          areax->lonmin=areax->longitude[areax->npoints];
+       if(areax->npoints==0 || areax->longitude[areax->npoints]>areax->lonmax)
+          areax->lonmax=areax->longitude[areax->npoints];
+
+       areax->npoints++;
+      }
+   }
+
+ eof=feof(file);
+
+ fclose(file);
+
+ if(!finished || areax->nrings==0)
+   {
+    if(!finished && !eof)
+       fprintf(stderr,"Error: The polygon file '%s' is not valid at line %d.\n",filename,lineno);
+    else
+       fprintf(stderr,"Error: The polygon file '%s' does not contain a complete polygon.\n",filename);
+
+    FreeArea(areax);
+
+    return(NULL);
+   }
+
+ return(areax);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Free an area.
+
+  AreaX *areax The area to be freed.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void FreeArea(AreaX *areax)
+{
+ if(areax->latitude)
+    free(areax->latitude);
+ if(areax->longitude)
+    free(areax->longitude);
+
+ if(areax->rings)
+    free(areax->rings);
+
+ free(areax);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Check if a location is inside an area (a location on the edge of the area is
+  inside it for both a bounding box and a polygon).
+
+  int InsideArea Returns true if the location is inside the area.
+
+  AreaX *areax The area.
+
+  double latitude The latitude of the location (radians).
+
+  double longitude The longitude of the location (radians).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int InsideArea(AreaX *areax,double latitude,double longitude)
+{
+ int inside=0;
+ int r,i,j;
+
+ if(latitude<areax->latmin || latitude>areax->latmax ||
+    longitude<areax->lonmin || longitude>areax->lonmax)
+    return(0);
+
+ if(areax->npoints==0)
+    return(1);
+
+ /* Count the ring edges crossed by a line from the location towards increasing longitude */
+
+ for(r=0;r<areax->nrings;r++)
+    for(i=areax->rings[r],j=areax->rings[r+1]-1;i<areax->rings[r+1];j=i++)
+      {
+       double lati=areax->latitude[i],latj=areax->latitude[j];
+       double loni=areax->longitude[i],lonj=areax->longitude[j];
+
+       /* A location exactly on the edge is inside whichever way the edges are crossed */
+
+       if(((latitude>=lati && latitude<=latj) || (latitude>=latj && latitude<=lati)) &&
+          ((longitude>=loni && longitude<=lonj) || (longitude>=lonj && longitude<=loni)) &&
+          (longitude-loni)*(latj-lati)==(latitude-lati)*(lonj-loni))
+          return(1);
+
+       if((lati>latitude)!=(latj>latitude))
+         {
+          double crossing=loni+(lonj-loni)*(latitude-lati)/(latj-lati);
+
+          if(longitude<crossing)
+             inside=!inside;
+         }
+      }
+
+ return(inside);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Check if a line from a polygon file is an 'END' line.
+
+  int is_end_line Returns true if it is an 'END' line.
+
+  const char *line The line (with the leading whitespace removed).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int is_end_line(const char *line)
+{
+ if(strncmp(line,"END",3))
+    return(0);
+
+ line+=3;
+
+ while(isspace(*line))
+    line++;
+
+ return(!*line);
+}
@@ -0,0 +1,58 @@
+/***************************************
+ A header file for the area (bounding box or polygon) that the parsed data is clipped to.
+
+ Part of the Routino routing software.
+ ******************/ /******************
+ This file Copyright 2008-2011 Andrew M. Bishop
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************/
+
+
+#ifndef AREAX_H
+#define AREAX_H    /*+ To stop multiple inclusions. +*/
+
+#include "typesx.h"
+
+
+/* Data structures */
+
+
+/*+ An area that is either a bounding box or a polygon made from one or more rings (in memory). +*/
+struct _AreaX
+{
+ double  latmin;                /*+ The minimum latitude of the bounding box (radians). +*/
+ double  latmax;                /*+ The maximum latitude of the bounding box (radians). +*/
+ double  lonmin;                /*+ The minimum longitude of the bounding box (radians). +*/
+ double  lonmax;                /*+ The maximum longitude of the bounding box (radians). +*/
+
+ int     npoints;               /*+ The number of polygon points (zero for a bounding box). +*/
+ double *latitude;              /*+ The latitudes of the polygon points (radians). +*/
+ double *longitude;             /*+ The longitudes of the polygon points (radians). +*/
+
+ int     nrings;                /*+ The number of polygon rings. +*/
+ int    *rings;                 /*+ The index of the first point of each ring (and the number of points at the end). +*/
+};
+
+
+/* Functions in areax.c */
+
+AreaX *NewAreaBBox(const char *bbox);
+AreaX *NewAreaPolygon(const char *filename);
+void FreeArea(AreaX *areax);
+
+int InsideArea(AreaX *areax,double latitude,double longitude);
+
+
+#endif /* AREAX_H */
@@ -0,0 +1,186 @@
+/***************************************
+ The list of items that are changed by OSM change files.
+
+ Part of the Routino routing software.
+ ******************/ /******************
+ This file Copyright 2008-2011 Andrew M. Bishop
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************/
+
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "types.h"
+
+#include "typesx.h"
+#include "changesx.h"
+
+
+/* Local functions */
+
+static int sort_by_id_and_order(const ChangeX *a,const ChangeX *b);
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Allocate a new list of changes.
+
+  ChangesX *NewChangeList Returns the change list.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+ChangesX *NewChangeList(void)
+{
+ ChangesX *changesx;
+
+ changesx=(ChangesX*)calloc(1,sizeof(ChangesX));
+
+ assert(changesx); /* Check calloc() worked */
+
+ return(changesx);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Free a list of changes.
+
+  ChangesX *changesx The list of changes to be freed.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void FreeChangeList(ChangesX *changesx)
+{
+ if(changesx->data)
+    free(changesx->data);
+
+ free(changesx);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Append a change to the list.  The new version of the item (if it is not
+  deleted) must be the next one that is stored.
+
+  ChangesX *changesx The list of changes.
+
+  uint32_t id The OSM id of the item.
+
+  index_t index1 The number of items of the first kind stored so far.
+
+  index_t index2 The number of items of the second kind stored so far.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void AppendChange(ChangesX *changesx,uint32_t id,index_t index1,index_t index2)
+{
+ if(changesx->number==changesx->size)
+   {
+    changesx->size+=256;
+    changesx->data=(ChangeX*)realloc((void*)changesx->data,changesx->size*sizeof(ChangeX));
+
+    assert(changesx->data); /* Check realloc() worked */
+   }
+
+ changesx->data[changesx->number].id=id;
+ changesx->data[changesx->number].index[0]=index1;
+ changesx->data[changesx->number].index[1]=index2;
+
+ changesx->number++;
+
+ changesx->sorted=0;
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Sort the list of changes by id and keep only the latest change for each item.
+
+  ChangesX *changesx The list of changes.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void SortChangeList(ChangesX *changesx)
+{
+ index_t i,j;
+
+ if(changesx->sorted)
+    return;
+
+ qsort(changesx->data,changesx->number,sizeof(ChangeX),(int (*)(const void*,const void*))sort_by_id_and_order);
+
+ for(i=0,j=0;i<changesx->number;i++)
+   {
+    if(j>0 && changesx->data[j-1].id==changesx->data[i].id)
+       j--;
+
+    changesx->data[j++]=changesx->data[i];
+   }
+
+ changesx->number=j;
+
+ changesx->sorted=1;
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the latest change for an item (the list must be sorted).
+
+  ChangeX *FindChange Returns the change or NULL if the item was not changed.
+
+  ChangesX *changesx The list of changes.
+
+  uint32_t id The OSM id of the item.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+ChangeX *FindChange(ChangesX *changesx,uint32_t id)
+{
+ index_t start=0,end=changesx->number;
+
+ assert(changesx->sorted);
+
+ while(start<end)
+   {
+    index_t mid=start+(end-start)/2;
+
+    if(changesx->data[mid].id<id)
+       start=mid+1;
+    else if(changesx->data[mid].id>id)
+       end=mid;
+    else
+       return(&changesx->data[mid]);
+   }
+
+ return(NULL);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Sort the changes into id order and then into the order that they were seen.
+
+  int sort_by_id_and_order Returns the comparison of the id and index fields.
+
+  const ChangeX *a The first change.
+
+  const ChangeX *b The second change.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int sort_by_id_and_order(const ChangeX *a,const ChangeX *b)
+{
+ if(a->id<b->id)
+    return(-1);
+ else if(a->id>b->id)
+    return(1);
+ else if(a->index[0]!=b->index[0])
+    return((a->index[0]<b->index[0])?-1:1);
+ else if(a->index[1]!=b->index[1])
+    return((a->index[1]<b->index[1])?-1:1);
+ else
+    return(0);
+}
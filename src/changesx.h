@@ -0,0 +1,69 @@
+/***************************************
+ A header file for the list of items that are changed by OSM change files.
+
+ Part of the Routino routing software.
+ ******************/ /******************
+ This file Copyright 2008-2011 Andrew M. Bishop
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************/
+
+
+#ifndef CHANGESX_H
+#define CHANGESX_H    /*+ To stop multiple inclusions. +*/
+
+#include <stdint.h>
+
+#include "types.h"
+
+#include "typesx.h"
+
+
+/* Data structures */
+
+
+/*+ An item that has been created, modified or deleted by a change file. +*/
+struct _ChangeX
+{
+ uint32_t id;                   /*+ The OSM id of the item. +*/
+
+ index_t  index[2];             /*+ The number of items (of up to two kinds) that had been stored when the change was seen. +*/
+};
+
+
+/*+ A list of the items that have been changed by the change files (in memory). +*/
+struct _ChangesX
+{
+ ChangeX *data;                 /*+ The changes (in the order seen until sorted, then by id). +*/
+
+ index_t  number;               /*+ The number of changes. +*/
+ index_t  size;                 /*+ The allocated number of changes. +*/
+
+ int      sorted;               /*+ Set to true when the list has been sorted. +*/
+};
+
+
+/* Functions in changesx.c */
+
+ChangesX *NewChangeList(void);
+void FreeChangeList(ChangesX *changesx);
+
+void AppendChange(ChangesX *changesx,uint32_t id,index_t index1,index_t index2);
+
+void SortChangeList(ChangesX *changesx);
+
+ChangeX *FindChange(ChangesX *changesx,uint32_t id);
+
+
+#endif /* CHANGESX_H */
@@ -26,6 +26,7 @@
 #include <string.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/types.h>
@@ -49,6 +50,71 @@ static struct mmapinfo *mappedfiles;
 static int nmappedfiles=0;
 
 
+/*+ A structure to contain the buffer for a file opened using one of the *FileBuffered* functions. +*/
+struct filebuffer
+{
+ char   *buffer;                /*+ The data buffer. +*/
+ size_t  pointer;               /*+ The read or write position within the buffer. +*/
+ size_t  length;                /*+ The amount of valid data in the buffer (when reading). +*/
+ int     reading;               /*+ Set to true if the buffer holds data read from the file. +*/
+
+ int     fd;                    /*+ The file descriptor. +*/
+
+ int     async;                 /*+ Set to true if the file is being read or written in the background. +*/
+ char   *spare;                 /*+ The second buffer that is filled or emptied in the background. +*/
+ off_t   position;              /*+ The position in the file of the data in the second buffer. +*/
+ size_t  iolength;              /*+ The amount of data in the second buffer to write. +*/
+ ssize_t ioresult;              /*+ The result of the last background read or write. +*/
+ int     iopending;             /*+ Set to true while a background read or write is queued or running. +*/
+
+ struct filebuffer *next;       /*+ The next file in the queue of background reads and writes. +*/
+};
+
+/*+ The list of file buffers (indexed by file descriptor). +*/
+static struct filebuffer **filebuffers=NULL;
+
+/*+ The number of allocated file buffer pointers. +*/
+static int nfilebuffers=0;
+
+/*+ A mutex to protect the list of file buffers (files may be opened in more than one thread). +*/
+static pthread_mutex_t filebuffers_mutex=PTHREAD_MUTEX_INITIALIZER;
+
+/*+ The queue of files waiting for a background read or write (first and last). +*/
+static struct filebuffer *asyncqueue_head=NULL,*asyncqueue_tail=NULL;
+
+/*+ A mutex to protect the queue of background reads and writes. +*/
+static pthread_mutex_t asyncqueue_mutex=PTHREAD_MUTEX_INITIALIZER;
+
+/*+ A condition that is signalled when a file is added to the queue. +*/
+static pthread_cond_t asyncqueue_cond=PTHREAD_COND_INITIALIZER;
+
+/*+ A condition that is signalled when a background read or write has finished. +*/
+static pthread_cond_t asyncdone_cond=PTHREAD_COND_INITIALIZER;
+
+/*+ Used to start the thread that performs the background reads and writes only once. +*/
+static pthread_once_t asyncthread_once=PTHREAD_ONCE_INIT;
+
+
+/* Local functions */
+
+static void CreateFileBuffer(int fd,int reading);
+static int FlushFileBuffer(int fd);
+
+static void StartAsyncThread(void);
+static void *AsyncThread(void *arg);
+static void QueueAsync(struct filebuffer *filebuffer);
+static void WaitAsync(struct filebuffer *filebuffer);
+
+
+/* Global variables */
+
+/*+ The number of bytes read using ReadFile(). +*/
+uint64_t file_bytes_read=0;
+
+/*+ The number of bytes written using WriteFile(). +*/
+uint64_t file_bytes_written=0;
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Return a filename composed of the dirname, prefix and name.
 
@@ -310,6 +376,277 @@ int ReOpenFileWriteable(const char *filename)
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Open a new file on disk for buffered writing.
+
+  int OpenFileBufferedNew Returns the file descriptor if OK or exits in case of an error.
+
+  const char *filename The name of the file to create.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int OpenFileBufferedNew(const char *filename)
+{
+ int fd=OpenFileNew(filename);
+
+ CreateFileBuffer(fd,0);
+
+ return(fd);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Open a new or existing file on disk for buffered appending.
+
+  int OpenFileBufferedAppend Returns the file descriptor if OK or exits in case of an error.
+
+  const char *filename The name of the file to create or open.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int OpenFileBufferedAppend(const char *filename)
+{
+ int fd=OpenFileAppend(filename);
+
+ CreateFileBuffer(fd,0);
+
+ return(fd);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Open an existing file on disk for buffered reading.
+
+  int ReOpenFileBuffered Returns the file descriptor if OK or exits in case of an error.
+
+  const char *filename The name of the file to open.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int ReOpenFileBuffered(const char *filename)
+{
+ int fd=ReOpenFile(filename);
+
+ CreateFileBuffer(fd,1);
+
+ return(fd);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Write data to a file descriptor opened for buffered writing.
+
+  int WriteFileBuffered Returns 0 if OK or something else in case of an error.
+
+  int fd The file descriptor to write to.
+
+  const void *address The address of the data to be written.
+
+  size_t length The length of data to write.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int WriteFileBuffered(int fd,const void *address,size_t length)
+{
+ struct filebuffer *filebuffer;
+
+ assert(fd!=-1 && fd<nfilebuffers && filebuffers[fd]);
+
+ filebuffer=filebuffers[fd];
+
+ assert(!filebuffer->reading);
+
+ /* Write large amounts of data directly (unless writing in the background) */
+
+ if(length>=FILEBUFFER_SIZE && !filebuffer->async)
+   {
+    if(FlushFileBuffer(fd))
+       return(-1);
+
+    return(WriteFile(fd,address,length));
+   }
+
+ /* Copy the data into the buffer, writing it out each time that it is full */
+
+ while(length>0)
+   {
+    size_t copy=FILEBUFFER_SIZE-filebuffer->pointer;
+
+    if(copy>length)
+       copy=length;
+
+    memcpy(filebuffer->buffer+filebuffer->pointer,address,copy);
+
+    filebuffer->pointer+=copy;
+
+    address=(const char*)address+copy;
+    length-=copy;
+
+    if(filebuffer->pointer==FILEBUFFER_SIZE)
+       if(FlushFileBuffer(fd))
+          return(-1);
+   }
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Read data from a file descriptor opened for buffered reading.
+
+  int ReadFileBuffered Returns 0 if OK or something else in case of an error.
+
+  int fd The file descriptor to read from.
+
+  void *address The address the data is to be read into.
+
+  size_t length The length of data to read.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int ReadFileBuffered(int fd,void *address,size_t length)
+{
+ struct filebuffer *filebuffer;
+
+ assert(fd!=-1 && fd<nfilebuffers && filebuffers[fd]);
+
+ filebuffer=filebuffers[fd];
+
+ assert(filebuffer->reading);
+
+ /* Copy the data from the buffer, refilling it as required */
+
+ while(length>0)
+   {
+    size_t copy;
+
+    if(filebuffer->pointer==filebuffer->length && filebuffer->async)
+      {
+       char *temp;
+
+       /* Swap to the buffer that was filled in the background and start filling the other one */
+
+       WaitAsync(filebuffer);
+
+       if(filebuffer->ioresult<=0)
+          return(-1);
+
+       temp=filebuffer->buffer;
+       filebuffer->buffer=filebuffer->spare;
+       filebuffer->spare=temp;
+
+       filebuffer->pointer=0;
+       filebuffer->length=filebuffer->ioresult;
+
+       filebuffer->position+=filebuffer->ioresult;
+
+       QueueAsync(filebuffer);
+      }
+    else if(filebuffer->pointer==filebuffer->length)
+      {
+       ssize_t n=read(fd,filebuffer->buffer,FILEBUFFER_SIZE);
+
+       if(n<=0)
+          return(-1);
+
+#ifdef __GNUC__
+       __sync_fetch_and_add(&file_bytes_read,n); /* may be called from more than one thread */
+#else
+       file_bytes_read+=n;
+#endif
+
+       filebuffer->pointer=0;
+       filebuffer->length=n;
+      }
+
+    copy=filebuffer->length-filebuffer->pointer;
+
+    if(copy>length)
+       copy=length;
+
+    memcpy(address,filebuffer->buffer+filebuffer->pointer,copy);
+
+    filebuffer->pointer+=copy;
+
+    address=(char*)address+copy;
+    length-=copy;
+   }
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Seek to a position in a file descriptor opened for buffered reading or writing.
+
+  int SeekFileBuffered Returns 0 if OK or something else in case of an error.
+
+  int fd The file descriptor to seek within.
+
+  off_t position The position to seek to.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int SeekFileBuffered(int fd,off_t position)
+{
+ struct filebuffer *filebuffer;
+
+ assert(fd!=-1 && fd<nfilebuffers && filebuffers[fd]);
+
+ filebuffer=filebuffers[fd];
+
+ if(filebuffer->async)
+    SyncFileBuffered(fd);
+
+ /* Flush any data to be written or discard any data that has been read */
+
+ if(filebuffer->reading)
+    filebuffer->pointer=filebuffer->length=0;
+ else
+    if(FlushFileBuffer(fd))
+       return(-1);
+
+ return(SeekFile(fd,position));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Skip forward over data in a file descriptor opened for buffered reading.
+
+  int SkipFileBuffered Returns 0 if OK or something else in case of an error.
+
+  int fd The file descriptor to skip within.
+
+  off_t skip The amount of data to skip over.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int SkipFileBuffered(int fd,off_t skip)
+{
+ struct filebuffer *filebuffer;
+
+ assert(fd!=-1 && fd<nfilebuffers && filebuffers[fd]);
+
+ filebuffer=filebuffers[fd];
+
+ assert(filebuffer->reading);
+
+ if(filebuffer->async)
+    SyncFileBuffered(fd);
+
+ /* Skip within the buffer if possible or else seek past the end of it */
+
+ if((off_t)(filebuffer->length-filebuffer->pointer)>=skip)
+   {
+    filebuffer->pointer+=skip;
+
+    return(0);
+   }
+
+ skip-=filebuffer->length-filebuffer->pointer;
+
+ filebuffer->pointer=filebuffer->length=0;
+
+ if(lseek(fd,skip,SEEK_CUR)==-1)
+    return(-1);
+
+ return(0);
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Get the size of a file.
 
@@ -351,6 +688,62 @@ int ExistsFile(const char *filename)
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Make sure that all of the data written to a file has reached the disk (so
+  that it survives a crash once this returns).
+
+  int SyncFileToDisk Returns 0 if OK or exits in case of an error.
+
+  int fd The file descriptor (opened for unbuffered writing).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int SyncFileToDisk(int fd)
+{
+ if(fsync(fd))
+   {
+    fprintf(stderr,"Cannot write file to disk [%s].\n",strerror(errno));
+    exit(EXIT_FAILURE);
+   }
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Make sure that the changes to the names of the files in a directory (files
+  created or renamed) have reached the disk.
+
+  int SyncDirectoryToDisk Returns 0 if OK or exits in case of an error.
+
+  const char *dirname The name of the directory.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int SyncDirectoryToDisk(const char *dirname)
+{
+ int fd;
+
+ fd=open(dirname,O_RDONLY);
+
+ if(fd<0)
+   {
+    fprintf(stderr,"Cannot open directory '%s' [%s].\n",dirname,strerror(errno));
+    exit(EXIT_FAILURE);
+   }
+
+ /* Some filesystems do not support this for directories */
+
+ if(fsync(fd) && errno!=EINVAL)
+   {
+    fprintf(stderr,"Cannot write directory '%s' to disk [%s].\n",dirname,strerror(errno));
+    exit(EXIT_FAILURE);
+   }
+
+ close(fd);
+
+ return(0);
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Close a file on disk.
 
@@ -367,6 +760,122 @@ int CloseFile(int fd)
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Start reading or writing a buffered file in the background using a second
+  buffer (reading ahead into it or writing it out while the first buffer is
+  being used).  The file must only be read or written sequentially until
+  SyncFileBuffered() is called.
+
+  int fd The file descriptor (opened for buffered reading or writing).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void AsyncFileBuffered(int fd)
+{
+ struct filebuffer *filebuffer;
+
+ assert(fd!=-1 && fd<nfilebuffers && filebuffers[fd]);
+
+ filebuffer=filebuffers[fd];
+
+ if(filebuffer->async)
+    return;
+
+ pthread_once(&asyncthread_once,StartAsyncThread);
+
+ if(!filebuffer->reading)
+    FlushFileBuffer(fd);
+
+ filebuffer->spare=(char*)malloc(FILEBUFFER_SIZE);
+
+ assert(filebuffer->spare); /* Check malloc() worked */
+
+ filebuffer->position=lseek(fd,0,SEEK_CUR);
+ filebuffer->iolength=0;
+ filebuffer->ioresult=0;
+
+ filebuffer->async=1;
+
+ /* Start reading ahead */
+
+ if(filebuffer->reading)
+    QueueAsync(filebuffer);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Stop reading or writing a buffered file in the background (waiting for any
+  outstanding write to finish) so that it can be used normally again.
+
+  int fd The file descriptor.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void SyncFileBuffered(int fd)
+{
+ struct filebuffer *filebuffer;
+
+ assert(fd!=-1 && fd<nfilebuffers && filebuffers[fd]);
+
+ filebuffer=filebuffers[fd];
+
+ if(!filebuffer->async)
+    return;
+
+ /* Write out the rest of the data or discard the data that has been read ahead */
+
+ if(!filebuffer->reading)
+    FlushFileBuffer(fd);
+
+ WaitAsync(filebuffer);
+
+ if(!filebuffer->reading)
+    filebuffer->position+=filebuffer->iolength;
+
+ filebuffer->async=0;
+
+ free(filebuffer->spare);
+ filebuffer->spare=NULL;
+
+ /* Put the file position where it would have been without the background reads and writes */
+
+ lseek(fd,filebuffer->position,SEEK_SET);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Close a file on disk that was opened for buffered reading or writing (any data still buffered is written first).
+
+  int CloseFileBuffered returns -1 (for similarity to the *OpenFile* functions).
+
+  int fd The file descriptor to close.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int CloseFileBuffered(int fd)
+{
+ assert(fd!=-1);
+
+ if(fd<nfilebuffers && filebuffers[fd])
+   {
+    if(filebuffers[fd]->async)
+       SyncFileBuffered(fd);
+
+    if(!filebuffers[fd]->reading)
+       FlushFileBuffer(fd);
+
+    pthread_mutex_lock(&filebuffers_mutex);
+
+    free(filebuffers[fd]->buffer);
+    free(filebuffers[fd]);
+    filebuffers[fd]=NULL;
+
+    pthread_mutex_unlock(&filebuffers_mutex);
+   }
+
+ close(fd);
+
+ return(-1);
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Delete a file from disk.
 
@@ -381,3 +890,357 @@ int DeleteFile(char *filename)
 
  return(0);
 }
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Copy a file on disk (replacing any existing file with the new name), the copy
+  has reached the disk when this returns.
+
+  int CopyFile Returns 0 if OK or exits in case of an error.
+
+  const char *from The name of the file to copy.
+
+  const char *to The name of the new file.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int CopyFile(const char *from,const char *to)
+{
+ off_t size=SizeFile(from);
+ int fdfrom,fdto;
+ size_t length=1024*1024;
+ char *buffer;
+
+ buffer=(char*)malloc(length);
+
+ assert(buffer); /* Check malloc() worked */
+
+ fdfrom=ReOpenFile(from);
+ fdto=OpenFileNew(to);
+
+ while(size>0)
+   {
+    if(size<length)
+       length=size;
+
+    if(ReadFile(fdfrom,buffer,length) || WriteFile(fdto,buffer,length))
+      {
+       fprintf(stderr,"Cannot copy file '%s' to '%s' [%s].\n",from,to,strerror(errno));
+       exit(EXIT_FAILURE);
+      }
+
+    size-=length;
+   }
+
+ SyncFileToDisk(fdto);
+
+ CloseFile(fdfrom);
+ CloseFile(fdto);
+
+ free(buffer);
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Write an array that may not be allocated to a file descriptor (preceded by
+  its length so that it can be read back by ReadFileArray()).
+
+  int WriteFileArray Returns 0 if OK or something else in case of an error.
+
+  int fd The file descriptor to write to.
+
+  const void *array The array to write (or NULL).
+
+  size_t length The length of the array in bytes.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int WriteFileArray(int fd,const void *array,size_t length)
+{
+ uint64_t header[2];
+
+ header[0]=!!array;
+ header[1]=array?length:0;
+
+ if(WriteFile(fd,header,sizeof(header)))
+    return(-1);
+
+ if(array && length)
+    return(WriteFile(fd,array,length));
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Read an array that was written by WriteFileArray() from a file descriptor.
+
+  int ReadFileArray Returns 0 if OK or something else in case of an error.
+
+  int fd The file descriptor to read from.
+
+  void **array Returns the newly allocated array (or NULL if it was not allocated when written).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int ReadFileArray(int fd,void **array)
+{
+ uint64_t header[2];
+
+ *array=NULL;
+
+ if(ReadFile(fd,header,sizeof(header)))
+    return(-1);
+
+ if(!header[0])
+    return(0);
+
+ *array=malloc(header[1]?header[1]:1);
+
+ assert(*array); /* Check malloc() worked */
+
+ if(header[1])
+    return(ReadFile(fd,*array,header[1]));
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Allocate the buffer for a file descriptor that has just been opened.
+
+  int fd The file descriptor.
+
+  int reading Set to true if the file is to be read or false if it is to be written.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void CreateFileBuffer(int fd,int reading)
+{
+ struct filebuffer *filebuffer;
+
+ filebuffer=(struct filebuffer*)malloc(sizeof(struct filebuffer));
+
+ assert(filebuffer); /* Check malloc() worked */
+
+ filebuffer->buffer=(char*)malloc(FILEBUFFER_SIZE);
+
+ assert(filebuffer->buffer); /* Check malloc() worked */
+
+ filebuffer->pointer=0;
+ filebuffer->length=0;
+ filebuffer->reading=reading;
+
+ filebuffer->fd=fd;
+
+ filebuffer->async=0;
+ filebuffer->spare=NULL;
+ filebuffer->iopending=0;
+
+ pthread_mutex_lock(&filebuffers_mutex);
+
+ if(fd>=nfilebuffers)
+   {
+    struct filebuffer **newfilebuffers;
+    int newnfilebuffers=nfilebuffers?nfilebuffers:16;
+
+    while(newnfilebuffers<=fd)
+       newnfilebuffers*=2;
+
+    /* The old list is not freed since another thread may be looking up its own (unchanging) entry in it. */
+
+    newfilebuffers=(struct filebuffer**)calloc(newnfilebuffers,sizeof(struct filebuffer*));
+
+    assert(newfilebuffers); /* Check calloc() worked */
+
+    if(nfilebuffers)
+       memcpy(newfilebuffers,filebuffers,nfilebuffers*sizeof(struct filebuffer*));
+
+    filebuffers=newfilebuffers;
+    nfilebuffers=newnfilebuffers;
+   }
+
+ filebuffers[fd]=filebuffer;
+
+ pthread_mutex_unlock(&filebuffers_mutex);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Write out the data that is held in the buffer for a file descriptor.
+
+  int FlushFileBuffer Returns 0 if OK or something else in case of an error.
+
+  int fd The file descriptor.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int FlushFileBuffer(int fd)
+{
+ struct filebuffer *filebuffer=filebuffers[fd];
+
+ if(filebuffer->pointer==0)
+    return(0);
+
+ if(filebuffer->async)
+   {
+    char *temp;
+
+    /* Wait for the previous write, swap buffers and write this one in the background */
+
+    WaitAsync(filebuffer);
+
+    if(filebuffer->ioresult!=filebuffer->iolength)
+       return(-1);
+
+    filebuffer->position+=filebuffer->iolength;
+
+    temp=filebuffer->buffer;
+    filebuffer->buffer=filebuffer->spare;
+    filebuffer->spare=temp;
+
+    filebuffer->iolength=filebuffer->pointer;
+
+    QueueAsync(filebuffer);
+   }
+ else
+    if(WriteFile(fd,filebuffer->buffer,filebuffer->pointer))
+       return(-1);
+
+ filebuffer->pointer=0;
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Start the thread that performs the background reads and writes.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void StartAsyncThread(void)
+{
+ pthread_t thread;
+
+ if(pthread_create(&thread,NULL,AsyncThread,NULL))
+   {
+    fprintf(stderr,"Cannot create thread for background file access.\n");
+    exit(EXIT_FAILURE);
+   }
+
+ pthread_detach(thread);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  The thread that performs the background reads and writes (one at a time in the order that they were queued).
+
+  void *AsyncThread Never returns.
+
+  void *arg Not used.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void *AsyncThread(void *arg)
+{
+ while(1)
+   {
+    struct filebuffer *filebuffer;
+    ssize_t n;
+
+    pthread_mutex_lock(&asyncqueue_mutex);
+
+    while(!asyncqueue_head)
+       pthread_cond_wait(&asyncqueue_cond,&asyncqueue_mutex);
+
+    filebuffer=asyncqueue_head;
+
+    asyncqueue_head=filebuffer->next;
+    if(!asyncqueue_head)
+       asyncqueue_tail=NULL;
+
+    pthread_mutex_unlock(&asyncqueue_mutex);
+
+    /* Read into or write from the second buffer (only this thread uses the file position while the file is in the queue) */
+
+    if(filebuffer->reading)
+      {
+       if(lseek(filebuffer->fd,filebuffer->position,SEEK_SET)!=filebuffer->position)
+          n=-1;
+       else
+          n=read(filebuffer->fd,filebuffer->spare,FILEBUFFER_SIZE);
+
+       if(n>0)
+#ifdef __GNUC__
+          __sync_fetch_and_add(&file_bytes_read,n);
+#else
+          file_bytes_read+=n;
+#endif
+      }
+    else
+      {
+       if(lseek(filebuffer->fd,filebuffer->position,SEEK_SET)!=filebuffer->position)
+          n=-1;
+       else
+          n=write(filebuffer->fd,filebuffer->spare,filebuffer->iolength);
+
+       if(n>0)
+#ifdef __GNUC__
+          __sync_fetch_and_add(&file_bytes_written,n);
+#else
+          file_bytes_written+=n;
+#endif
+      }
+
+    /* Mark it as finished */
+
+    pthread_mutex_lock(&asyncqueue_mutex);
+
+    filebuffer->ioresult=n;
+    filebuffer->iopending=0;
+
+    pthread_cond_broadcast(&asyncdone_cond);
+
+    pthread_mutex_unlock(&asyncqueue_mutex);
+   }
+
+ return(NULL);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Queue a background read into or write from the second buffer of a file.
+
+  struct filebuffer *filebuffer The file buffer.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void QueueAsync(struct filebuffer *filebuffer)
+{
+ pthread_mutex_lock(&asyncqueue_mutex);
+
+ filebuffer->iopending=1;
+ filebuffer->next=NULL;
+
+ if(asyncqueue_tail)
+    asyncqueue_tail->next=filebuffer;
+ else
+    asyncqueue_head=filebuffer;
+
+ asyncqueue_tail=filebuffer;
+
+ pthread_cond_signal(&asyncqueue_cond);
+
+ pthread_mutex_unlock(&asyncqueue_mutex);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Wait for the background read or write of a file to finish (if there is one).
+
+  struct filebuffer *filebuffer The file buffer.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void WaitAsync(struct filebuffer *filebuffer)
+{
+ pthread_mutex_lock(&asyncqueue_mutex);
+
+ while(filebuffer->iopending)
+    pthread_cond_wait(&asyncdone_cond,&asyncqueue_mutex);
+
+ pthread_mutex_unlock(&asyncqueue_mutex);
+}
@@ -24,10 +24,21 @@
 #define FILES_H    /*+ To stop multiple inclusions. +*/
 
 #include <assert.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <sys/types.h>
 
 
+/*+ The size of the buffer used for each file opened using the *FileBuffered* functions. +*/
+#define FILEBUFFER_SIZE (64*1024)
+
+
+/* Variables in files.c */
+
+extern uint64_t file_bytes_read;
+extern uint64_t file_bytes_written;
+
+
 /* Functions in files.c */
 
 char *FileName(const char *dirname,const char *prefix, const char *name);
@@ -41,18 +52,40 @@ int OpenFileAppend(const char *filename);
 int ReOpenFile(const char *filename);
 int ReOpenFileWriteable(const char *filename);
 
+int OpenFileBufferedNew(const char *filename);
+int OpenFileBufferedAppend(const char *filename);
+int ReOpenFileBuffered(const char *filename);
+
 static int WriteFile(int fd,const void *address,size_t length);
 static int ReadFile(int fd,void *address,size_t length);
 
+int WriteFileBuffered(int fd,const void *address,size_t length);
+int ReadFileBuffered(int fd,void *address,size_t length);
+
 off_t SizeFile(const char *filename);
 int ExistsFile(const char *filename);
 
 static int SeekFile(int fd,off_t position);
 
+int SeekFileBuffered(int fd,off_t position);
+int SkipFileBuffered(int fd,off_t skip);
+
+void AsyncFileBuffered(int fd);
+void SyncFileBuffered(int fd);
+
+int SyncFileToDisk(int fd);
+int SyncDirectoryToDisk(const char *dirname);
+
 int CloseFile(int fd);
+int CloseFileBuffered(int fd);
 
 int DeleteFile(char *filename);
 
+int CopyFile(const char *from,const char *to);
+
+int WriteFileArray(int fd,const void *array,size_t length);
+int ReadFileArray(int fd,void **array);
+
 
 /* Inline the frequently called functions */
 
@@ -77,6 +110,12 @@ static inline int WriteFile(int fd,const void *address,size_t length)
  if(write(fd,address,length)!=length)
     return(-1);
 
+#ifdef __GNUC__
+ __sync_fetch_and_add(&file_bytes_written,length); /* may be called from more than one thread */
+#else
+ file_bytes_written+=length;
+#endif
+
  return(0);
 }
 
@@ -102,6 +141,12 @@ static inline int ReadFile(int fd,void *address,size_t length)
  if(read(fd,address,length)!=length)
     return(-1);
 
+#ifdef __GNUC__
+ __sync_fetch_and_add(&file_bytes_read,length); /* may be called from more than one thread */
+#else
+ file_bytes_read+=length;
+#endif
+
  return(0);
 }
 
@@ -35,6 +35,8 @@ Results *FindNormalRoute(Nodes *nodes,Segments *segments,Ways *ways,Relations *r
 
 Results *FindMiddleRoute(Nodes *supernodes,Segments *supersegments,Ways *superways,Relations *relations,Profile *profile,Results *begin,Results *end);
 
+int FindAlternativeRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,Results *begin,Results *end,Results *middle,Results **alternatives,int nalternatives);
+
 Results *FindStartRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,index_t start_node,index_t prev_segment,index_t finish_node,int *nsuper);
 
 Results *FindFinishRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,index_t finish_node);
@@ -43,10 +45,14 @@ Results *CombineRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *rel
 
 void FixForwardRoute(Results *results,Result *finish_result);
 
+void FindRouteScores(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,index_t *waypoints,int nwaypoints,score_t *scores);
+
+void OptimiseWaypointOrder(score_t *scores,int nwaypoints,int fixed_finish,int *order);
+
 
 /* Functions in output.c */
 
-void PrintRoute(Results **results,int nresults,Nodes *nodes,Segments *segments,Ways *ways,Profile *profile);
+void PrintRoute(Results **results,int nresults,Nodes *nodes,Segments *segments,Ways *ways,Profile *profile,int alternative);
 
 
 #endif /* FUNCTIONS_H */
@@ -30,7 +30,13 @@
 
 /* Functions in osmparser.c */
 
-int ParseOSM(FILE *file,NodesX *OSMNodes,SegmentsX *OSMSegments,WaysX *OSMWays,RelationsX *OSMRelations);
+int ParseOSM(FILE *file,NodesX *OSMNodes,SegmentsX *OSMSegments,WaysX *OSMWays,RelationsX *OSMRelations,AreaX *area);
+
+int ParseOSMPBF(FILE *file,NodesX *OSMNodes,SegmentsX *OSMSegments,WaysX *OSMWays,RelationsX *OSMRelations,AreaX *area);
+
+int ParseOSMChanges(FILE *file,NodesX *OSMNodes,SegmentsX *OSMSegments,WaysX *OSMWays,RelationsX *OSMRelations);
+
+void AddBoundaryNodes(NodesX *OSMNodes);
 
 
 #endif /* FUNCTIONSX_H */
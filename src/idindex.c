@@ -0,0 +1,134 @@
+/***************************************
+ A direct-mapped index of OSM identifiers.
+
+ Part of the Routino routing software.
+ ******************/ /******************
+ This file Copyright 2008-2011 Andrew M. Bishop
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************/
+
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "types.h"
+
+#include "idindex.h"
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Create a direct-mapped index for a sorted list of identifiers.  The index has
+  one bit for each possible identifier between the first and the last one so it
+  is only created if it will use less memory than the list itself.
+
+  IdIndex *NewIdIndex Returns the index or NULL if the identifiers are too sparse.
+
+  const uint32_t *ids The list of identifiers (sorted, with no duplicates).
+
+  index_t number The number of identifiers in the list.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+IdIndex *NewIdIndex(const uint32_t *ids,index_t number)
+{
+ IdIndex *idindex;
+ index_t nblocks,i;
+
+ if(number==0)
+    return(NULL);
+
+ nblocks=(index_t)(((uint64_t)ids[number-1]-ids[0])/32+1);
+
+ if((uint64_t)nblocks*sizeof(IdIndexBlock)>(uint64_t)number*sizeof(uint32_t))
+    return(NULL);
+
+ idindex=(IdIndex*)malloc(sizeof(IdIndex));
+
+ assert(idindex); /* Check malloc() worked */
+
+ idindex->first=ids[0];
+ idindex->last=ids[number-1];
+
+ idindex->blocks=(IdIndexBlock*)calloc(nblocks,sizeof(IdIndexBlock));
+
+ assert(idindex->blocks); /* Check calloc() worked */
+
+ for(i=0;i<number;i++)
+   {
+    uint32_t offset=ids[i]-idindex->first;
+
+    idindex->blocks[offset/32].bits|=(uint32_t)1<<(offset%32);
+   }
+
+ RecountIdIndex(idindex);
+
+ return(idindex);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Free a direct-mapped index.
+
+  IdIndex *idindex The index to free.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void FreeIdIndex(IdIndex *idindex)
+{
+ free(idindex->blocks);
+
+ free(idindex);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Remove an identifier from the index (the positions of the others are not
+  changed until RecountIdIndex() is called).
+
+  IdIndex *idindex The index to modify.
+
+  uint32_t id The identifier to remove.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void RemoveIdIndex(IdIndex *idindex,uint32_t id)
+{
+ uint32_t offset=id-idindex->first;
+
+ idindex->blocks[offset/32].bits&=~((uint32_t)1<<(offset%32));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Recalculate the positions of the identifiers in the index.
+
+  IdIndex *idindex The index to modify.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void RecountIdIndex(IdIndex *idindex)
+{
+ index_t nblocks=(index_t)(((uint64_t)idindex->last-idindex->first)/32+1);
+ index_t count=0,i;
+
+ for(i=0;i<nblocks;i++)
+   {
+    uint32_t bits=idindex->blocks[i].bits;
+
+    idindex->blocks[i].count=count;
+
+    while(bits)
+      {
+       bits&=bits-1;
+       count++;
+      }
+   }
+}
@@ -0,0 +1,108 @@
+/***************************************
+ A header file for the direct-mapped index of OSM identifiers.
+
+ Part of the Routino routing software.
+ ******************/ /******************
+ This file Copyright 2008-2011 Andrew M. Bishop
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************/
+
+
+#ifndef IDINDEX_H
+#define IDINDEX_H    /*+ To stop multiple inclusions. +*/
+
+#include <stdint.h>
+
+#include "types.h"
+
+
+/* Data structures */
+
+
+/*+ A block of 32 consecutive identifiers. +*/
+typedef struct _IdIndexBlock
+{
+ uint32_t bits;                 /*+ A bit-mask with a bit set for each identifier that exists. +*/
+ index_t  count;                /*+ The number of identifiers that exist in the blocks before this one. +*/
+}
+ IdIndexBlock;
+
+
+/*+ A direct-mapped index from a sorted list of identifiers to their positions in the list. +*/
+typedef struct _IdIndex
+{
+ uint32_t      first;           /*+ The smallest identifier. +*/
+ uint32_t      last;            /*+ The largest identifier. +*/
+
+ IdIndexBlock *blocks;          /*+ The blocks of identifiers, starting with the smallest one. +*/
+}
+ IdIndex;
+
+
+/* Functions in idindex.c */
+
+IdIndex *NewIdIndex(const uint32_t *ids,index_t number);
+void FreeIdIndex(IdIndex *idindex);
+
+void RemoveIdIndex(IdIndex *idindex,uint32_t id);
+void RecountIdIndex(IdIndex *idindex);
+
+
+/* Macros and inline functions */
+
+static index_t LookupIdIndex(IdIndex *idindex,uint32_t id);
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the position of an identifier in the sorted list.
+
+  index_t LookupIdIndex Returns the position or ~0 if the identifier does not exist.
+
+  IdIndex *idindex The index to use.
+
+  uint32_t id The identifier to look for.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static inline index_t LookupIdIndex(IdIndex *idindex,uint32_t id)
+{
+ IdIndexBlock *block;
+ uint32_t offset,bits;
+
+ if(id<idindex->first || id>idindex->last)
+    return(~(index_t)0);
+
+ offset=id-idindex->first;
+
+ block=&idindex->blocks[offset/32];
+
+ if(!(block->bits&((uint32_t)1<<(offset%32))))
+    return(~(index_t)0);
+
+ /* Count the identifiers before this one in the same block */
+
+ bits=block->bits&(((uint32_t)1<<(offset%32))-1);
+
+#ifdef __GNUC__
+ return(block->count+__builtin_popcount(bits));
+#else
+ bits=bits-((bits>>1)&0x55555555);
+ bits=(bits&0x33333333)+((bits>>2)&0x33333333);
+
+ return(block->count+((((bits+(bits>>4))&0x0F0F0F0F)*0x01010101)>>24));
+#endif
+}
+
+
+#endif /* IDINDEX_H */
@@ -20,11 +20,13 @@
  ***************************************/
 
 
+#include <assert.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "logging.h"
 
@@ -48,6 +50,28 @@ static int printed_length=0;
 /*+ The file handle for the error log file. +*/
 static FILE *errorlogfile;
 
+/*+ A buffer to store the error log messages from one thread in. +*/
+typedef struct _errorlogbuffer
+{
+ char  *text;                   /*+ The messages. +*/
+ size_t length;                 /*+ The length of the messages. +*/
+ size_t size;                   /*+ The allocated size of the text. +*/
+}
+ errorlogbuffer;
+
+/*+ The key used to find the buffer for the current thread (if any). +*/
+static pthread_key_t errorlog_key;
+
+/*+ The variable used to make sure that the key is only created once. +*/
+static pthread_once_t errorlog_once=PTHREAD_ONCE_INIT;
+
+/*+ Set to true once any thread has stored messages in a buffer. +*/
+static int errorlog_buffered=0;
+
+/* Local functions */
+
+static void create_errorlog_key(void);
+
 
 /*++++++++++++++++++++++++++++++++++++++
   Print the first message in an overwriting sequence (to stdout).
@@ -307,14 +331,128 @@ void close_errorlog(void)
 
 void logerror(const char *format, ...)
 {
+ errorlogbuffer *buffer=NULL;
  va_list ap;
 
  if(!errorlogfile)
     return;
 
+ if(errorlog_buffered)
+    buffer=(errorlogbuffer*)pthread_getspecific(errorlog_key);
+
  va_start(ap,format);
 
- vfprintf(errorlogfile,format,ap);
+ if(buffer)
+   {
+    va_list ap2;
+    int length;
+
+    va_copy(ap2,ap);
+
+    length=vsnprintf(buffer->text+buffer->length,buffer->size-buffer->length,format,ap);
+
+    if((buffer->length+length)>=buffer->size)
+      {
+       buffer->size=buffer->length+length+1024;
+       buffer->text=(char*)realloc((void*)buffer->text,buffer->size);
+
+       assert(buffer->text); /* Check realloc() worked */
+
+       vsnprintf(buffer->text+buffer->length,buffer->size-buffer->length,format,ap2);
+      }
+
+    buffer->length+=length;
+
+    va_end(ap2);
+   }
+ else
+    vfprintf(errorlogfile,format,ap);
 
  va_end(ap);
 }
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Start storing the error log messages from the current thread in memory
+  (so that messages from several threads can be written out in order).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void start_errorlog_buffer(void)
+{
+ errorlogbuffer *buffer;
+
+ if(!errorlogfile)
+    return;
+
+ pthread_once(&errorlog_once,create_errorlog_key);
+
+ errorlog_buffered=1;
+
+ buffer=(errorlogbuffer*)calloc(1,sizeof(errorlogbuffer));
+
+ assert(buffer); /* Check calloc() worked */
+
+ pthread_setspecific(errorlog_key,buffer);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Return the error log messages that have been stored for the current thread and empty the buffer.
+
+  char *flush_errorlog_buffer Returns the stored messages (to be freed by the caller) or NULL if there are none.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+char *flush_errorlog_buffer(void)
+{
+ errorlogbuffer *buffer;
+ char *text;
+
+ if(!errorlog_buffered)
+    return(NULL);
+
+ buffer=(errorlogbuffer*)pthread_getspecific(errorlog_key);
+
+ if(!buffer || !buffer->length)
+    return(NULL);
+
+ text=buffer->text;
+
+ buffer->text=NULL;
+ buffer->length=buffer->size=0;
+
+ return(text);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Stop storing the error log messages from the current thread in memory (any
+  messages that have not been flushed are discarded).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void stop_errorlog_buffer(void)
+{
+ errorlogbuffer *buffer;
+
+ if(!errorlog_buffered)
+    return;
+
+ buffer=(errorlogbuffer*)pthread_getspecific(errorlog_key);
+
+ if(!buffer)
+    return;
+
+ pthread_setspecific(errorlog_key,NULL);
+
+ free(buffer->text);
+ free(buffer);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Create the key that is used to find the buffer for each thread.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void create_errorlog_key(void)
+{
+ pthread_key_create(&errorlog_key,NULL);
+}
@@ -61,6 +61,10 @@ void fprintf_last(FILE *file,const char *format, ...);
 void open_errorlog(const char *filename,int append);
 void close_errorlog(void);
 
+void start_errorlog_buffer(void);
+char *flush_errorlog_buffer(void);
+void stop_errorlog_buffer(void);
+
 #ifdef __GNUC__
 
 void logerror(const char *format, ...) __attribute__ ((format (printf, 1, 2)));
@@ -80,6 +80,9 @@ Nodes *LoadNodeList(const char *filename)
  for(i=0;i<sizeof(nodes->cached)/sizeof(nodes->cached[0]);i++)
     nodes->incache[i]=NO_NODE;
 
+ nodes->cachehits=0;
+ nodes->cachemisses=0;
+
 #endif
 
  return(nodes);
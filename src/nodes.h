@@ -83,6 +83,9 @@ struct _Nodes
  Node      cached[4];           /*+ Four cached nodes read from the file in slim mode. +*/
  index_t   incache[4];          /*+ The indexes of the cached nodes. +*/
 
+ uint32_t  cachehits;           /*+ The number of lookups found in the cache. +*/
+ uint32_t  cachemisses;         /*+ The number of lookups read from the file. +*/
+
 #endif
 };
 
@@ -149,12 +152,16 @@ static inline Node *LookupNode(Nodes *nodes,index_t index,int position)
 {
  if(nodes->incache[position-1]!=index)
    {
+    nodes->cachemisses++;
+
     SeekFile(nodes->fd,nodes->nodesoffset+(off_t)index*sizeof(Node));
 
     ReadFile(nodes->fd,&nodes->cached[position-1],sizeof(Node));
 
     nodes->incache[position-1]=index;
    }
+ else
+    nodes->cachehits++;
 
  return(&nodes->cached[position-1]);
 }
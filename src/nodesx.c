@@ -33,6 +33,7 @@
 #include "nodesx.h"
 #include "segmentsx.h"
 #include "waysx.h"
+#include "changesx.h"
 
 #include "types.h"
 
@@ -51,10 +52,10 @@ static NodesX *sortnodesx;
 
 /* Functions */
 
-static int sort_by_id(NodeX *a,NodeX *b);
+static void key_by_id(NodeX *nodex,uint32_t *key);
 static int deduplicate_and_index_by_id(NodeX *nodex,index_t index);
 
-static int sort_by_lat_long(NodeX *a,NodeX *b);
+static void key_by_lat_long(NodeX *nodex,uint32_t *key);
 static int index_by_lat_long(NodeX *nodex,index_t index);
 
 
@@ -85,14 +86,14 @@ NodesX *NewNodeList(int append)
    {
     off_t size;
 
-    nodesx->fd=OpenFileAppend(nodesx->filename);
+    nodesx->fd=OpenFileBufferedAppend(nodesx->filename);
 
     size=SizeFile(nodesx->filename);
 
     nodesx->number=size/sizeof(NodeX);
    }
  else
-    nodesx->fd=OpenFileNew(nodesx->filename);
+    nodesx->fd=OpenFileBufferedNew(nodesx->filename);
 
  return(nodesx);
 }
@@ -108,6 +109,9 @@ NodesX *NewNodeList(int append)
 
 void FreeNodeList(NodesX *nodesx,int keep)
 {
+ if(nodesx->fd!=-1)
+    nodesx->fd=CloseFileBuffered(nodesx->fd);
+
  if(!keep)
     DeleteFile(nodesx->filename);
 
@@ -116,16 +120,87 @@ void FreeNodeList(NodesX *nodesx,int keep)
  if(nodesx->idata)
     free(nodesx->idata);
 
+ if(nodesx->idindex)
+    FreeIdIndex(nodesx->idindex);
+
  if(nodesx->gdata)
     free(nodesx->gdata);
 
  if(nodesx->super)
     free(nodesx->super);
 
+ if(nodesx->changes)
+    FreeChangeList(nodesx->changes);
+
  free(nodesx);
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Save the state of the node list between two stages of processing so that the
+  processing can be resumed from here.
+
+  NodesX *nodesx The set of nodes to save.
+
+  int fd The file descriptor of the checkpoint file to write the state to.
+
+  const char *filename The name of the file to copy the node data to.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void CheckpointNodeList(NodesX *nodesx,int fd,const char *filename)
+{
+ assert(nodesx->fd==-1 && !nodesx->idindex); /* Only between processing stages after the ids are replaced. */
+
+ CopyFile(nodesx->filename,filename);
+
+ WriteFile(fd,&nodesx->number,sizeof(index_t));
+
+ WriteFile(fd,&nodesx->latbins,sizeof(index_t));
+ WriteFile(fd,&nodesx->lonbins,sizeof(index_t));
+ WriteFile(fd,&nodesx->latzero,sizeof(ll_bin_t));
+ WriteFile(fd,&nodesx->lonzero,sizeof(ll_bin_t));
+
+ WriteFileArray(fd,nodesx->idata,nodesx->number*sizeof(node_t));
+ WriteFileArray(fd,nodesx->gdata,nodesx->number*sizeof(index_t));
+ WriteFileArray(fd,nodesx->super,(1+nodesx->number/8)*sizeof(uint8_t));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Restore the state of the node list that was saved by CheckpointNodeList().
+
+  int ResumeNodeList Returns 0 if OK or something else in case of an error.
+
+  NodesX *nodesx The set of nodes to restore (newly allocated).
+
+  int fd The file descriptor of the checkpoint file to read the state from.
+
+  const char *filename The name of the file to copy the node data from.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int ResumeNodeList(NodesX *nodesx,int fd,const char *filename)
+{
+ if(nodesx->fd!=-1)
+    nodesx->fd=CloseFileBuffered(nodesx->fd);
+
+ CopyFile(filename,nodesx->filename);
+
+ if(ReadFile(fd,&nodesx->number,sizeof(index_t)))
+    return(1);
+
+ if(ReadFile(fd,&nodesx->latbins,sizeof(index_t)) || ReadFile(fd,&nodesx->lonbins,sizeof(index_t)) ||
+    ReadFile(fd,&nodesx->latzero,sizeof(ll_bin_t)) || ReadFile(fd,&nodesx->lonzero,sizeof(ll_bin_t)))
+    return(1);
+
+ if(ReadFileArray(fd,(void**)&nodesx->idata) ||
+    ReadFileArray(fd,(void**)&nodesx->gdata) ||
+    ReadFileArray(fd,(void**)&nodesx->super))
+    return(1);
+
+ return(0);
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Append a single node to an unsorted node list.
 
@@ -152,7 +227,7 @@ void AppendNode(NodesX *nodesx,node_t id,double latitude,double longitude,transp
  nodex.allow=allow;
  nodex.flags=flags;
 
- WriteFile(nodesx->fd,&nodex,sizeof(NodeX));
+ WriteFileBuffered(nodesx->fd,&nodex,sizeof(NodeX));
 
  nodesx->number++;
 
@@ -160,6 +235,127 @@ void AppendNode(NodesX *nodesx,node_t id,double latitude,double longitude,transp
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Save a copy of the parsed (unsorted) node list so that it can be updated later.
+
+  NodesX *nodesx The set of nodes to save.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void SaveParsedNodeList(NodesX *nodesx)
+{
+ char *filename=(char*)malloc(strlen(option_tmpdirname)+32);
+
+ sprintf(filename,"%s/nodesx.parsed.mem",option_tmpdirname);
+
+ nodesx->fd=CloseFileBuffered(nodesx->fd);
+
+ CopyFile(nodesx->filename,filename);
+
+ nodesx->fd=OpenFileBufferedAppend(nodesx->filename);
+
+ free(filename);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Replace the node list with the copy of the parsed node list saved earlier.
+
+  NodesX *nodesx The set of nodes to replace.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void LoadParsedNodeList(NodesX *nodesx)
+{
+ char *filename=(char*)malloc(strlen(option_tmpdirname)+32);
+
+ sprintf(filename,"%s/nodesx.parsed.mem",option_tmpdirname);
+
+ nodesx->fd=CloseFileBuffered(nodesx->fd);
+
+ CopyFile(filename,nodesx->filename);
+
+ nodesx->fd=OpenFileBufferedAppend(nodesx->filename);
+
+ nodesx->number=SizeFile(nodesx->filename)/sizeof(NodeX);
+
+ free(filename);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Remove the nodes that have been replaced or deleted by the change files,
+  keeping only the latest version of each changed node.
+
+  NodesX *nodesx The set of nodes to modify.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void ApplyNodeChanges(NodesX *nodesx)
+{
+ NodeX nodex;
+ index_t total=0,kept=0;
+ int fd;
+
+ if(!nodesx->changes)
+    return;
+
+ /* Print the start message */
+
+ printf_first("Applying Node Changes: Nodes=0");
+
+ /* Sort the changes */
+
+ SortChangeList(nodesx->changes);
+
+ /* Close the file (finished appending) */
+
+ nodesx->fd=CloseFileBuffered(nodesx->fd);
+
+ /* Re-open the file read-only and a new file writeable */
+
+ nodesx->fd=ReOpenFileBuffered(nodesx->filename);
+
+ DeleteFile(nodesx->filename);
+
+ fd=OpenFileBufferedNew(nodesx->filename);
+
+ /* Copy the nodes that have not been replaced */
+
+ while(!ReadFileBuffered(nodesx->fd,&nodex,sizeof(NodeX)))
+   {
+    ChangeX *changex=FindChange(nodesx->changes,nodex.id);
+
+    if(!changex || changex->index[0]==total)
+      {
+       WriteFileBuffered(fd,&nodex,sizeof(NodeX));
+
+       kept++;
+      }
+
+    total++;
+
+    if(!(total%10000))
+       printf_middle("Applying Node Changes: Nodes=%"Pindex_t" Kept=%"Pindex_t,total,kept);
+   }
+
+ nodesx->number=kept;
+
+ /* Close the files and re-open for appending */
+
+ nodesx->fd=CloseFileBuffered(nodesx->fd);
+ CloseFileBuffered(fd);
+
+ nodesx->fd=OpenFileBufferedAppend(nodesx->filename);
+
+ /* Free the changes */
+
+ FreeChangeList(nodesx->changes);
+ nodesx->changes=NULL;
+
+ /* Print the final message */
+
+ printf_last("Applied Node Changes: Nodes=%"Pindex_t" Kept=%"Pindex_t" Removed=%"Pindex_t,total,kept,total-kept);
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Sort the node list.
 
@@ -177,15 +373,15 @@ void SortNodeList(NodesX *nodesx)
 
  /* Close the file (finished appending) */
 
- nodesx->fd=CloseFile(nodesx->fd);
+ nodesx->fd=CloseFileBuffered(nodesx->fd);
 
  /* Re-open the file read-only and a new file writeable */
 
- nodesx->fd=ReOpenFile(nodesx->filename);
+ nodesx->fd=ReOpenFileBuffered(nodesx->filename);
 
  DeleteFile(nodesx->filename);
 
- fd=OpenFileNew(nodesx->filename);
+ fd=OpenFileBufferedNew(nodesx->filename);
 
  /* Allocate the array of indexes */
 
@@ -200,12 +396,22 @@ void SortNodeList(NodesX *nodesx)
 
  sortnodesx=nodesx;
 
- filesort_fixed(nodesx->fd,fd,sizeof(NodeX),(int (*)(const void*,const void*))sort_by_id,(int (*)(void*,index_t))deduplicate_and_index_by_id);
+ filesort_fixed_keyed(nodesx->fd,fd,sizeof(NodeX),1,(void (*)(const void*,uint32_t*))key_by_id,(int (*)(void*,index_t))deduplicate_and_index_by_id);
 
  /* Close the files */
 
- nodesx->fd=CloseFile(nodesx->fd);
- CloseFile(fd);
+ nodesx->fd=CloseFileBuffered(nodesx->fd);
+ CloseFileBuffered(fd);
+
+ /* Replace the list of indexes with a direct-mapped index if possible */
+
+ nodesx->idindex=NewIdIndex(nodesx->idata,nodesx->number);
+
+ if(nodesx->idindex)
+   {
+    free(nodesx->idata);
+    nodesx->idata=NULL;
+   }
 
  /* Print the final message */
 
@@ -214,26 +420,16 @@ void SortNodeList(NodesX *nodesx)
 
 
 /*++++++++++++++++++++++++++++++++++++++
-  Sort the nodes into id order.
+  Get the key to sort the nodes into id order.
 
-  int sort_by_id Returns the comparison of the id fields.
-
-  NodeX *a The first extended node.
+  NodeX *nodex The extended node.
 
-  NodeX *b The second extended node.
+  uint32_t *key Returns the key (the id).
   ++++++++++++++++++++++++++++++++++++++*/
 
-static int sort_by_id(NodeX *a,NodeX *b)
+static void key_by_id(NodeX *nodex,uint32_t *key)
 {
- node_t a_id=a->id;
- node_t b_id=b->id;
-
- if(a_id<b_id)
-    return(-1);
- else if(a_id>b_id)
-    return(1);
- else
-    return(0);
+ key[0]=nodex->id;
 }
 
 
@@ -288,22 +484,22 @@ void SortNodeListGeographically(NodesX *nodesx)
 
  /* Re-open the file read-only and a new file writeable */
 
- nodesx->fd=ReOpenFile(nodesx->filename);
+ nodesx->fd=ReOpenFileBuffered(nodesx->filename);
 
  DeleteFile(nodesx->filename);
 
- fd=OpenFileNew(nodesx->filename);
+ fd=OpenFileBufferedNew(nodesx->filename);
 
  /* Sort geographically */
 
  sortnodesx=nodesx;
 
- filesort_fixed(nodesx->fd,fd,sizeof(NodeX),(int (*)(const void*,const void*))sort_by_lat_long,(int (*)(void*,index_t))index_by_lat_long);
+ filesort_fixed_keyed(nodesx->fd,fd,sizeof(NodeX),2,(void (*)(const void*,uint32_t*))key_by_lat_long,(int (*)(void*,index_t))index_by_lat_long);
 
  /* Close the files */
 
- nodesx->fd=CloseFile(nodesx->fd);
- CloseFile(fd);
+ nodesx->fd=CloseFileBuffered(nodesx->fd);
+ CloseFileBuffered(fd);
 
  /* Print the final message */
 
@@ -312,52 +508,22 @@ void SortNodeListGeographically(NodesX *nodesx)
 
 
 /*++++++++++++++++++++++++++++++++++++++
-  Sort the nodes into latitude and longitude order (first by longitude bin
-  number, then by latitude bin number and then by exact longitude and then by
-  exact latitude).
-
-  int sort_by_lat_long Returns the comparison of the latitude and longitude fields.
+  Get the key to sort the nodes into latitude and longitude order (first by
+  longitude bin number, then by latitude bin number and then by exact longitude
+  and then by exact latitude).
 
-  NodeX *a The first extended node.
+  NodeX *nodex The extended node.
 
-  NodeX *b The second extended node.
+  uint32_t *key Returns the key (the bin numbers then the offsets within the bins).
   ++++++++++++++++++++++++++++++++++++++*/
 
-static int sort_by_lat_long(NodeX *a,NodeX *b)
+static void key_by_lat_long(NodeX *nodex,uint32_t *key)
 {
- ll_bin_t a_lon=latlong_to_bin(a->longitude);
- ll_bin_t b_lon=latlong_to_bin(b->longitude);
+ uint16_t lonbin=(uint16_t)latlong_to_bin(nodex->longitude)^0x8000;
+ uint16_t latbin=(uint16_t)latlong_to_bin(nodex->latitude )^0x8000;
 
- if(a_lon<b_lon)
-    return(-1);
- else if(a_lon>b_lon)
-    return(1);
- else
-   {
-    ll_bin_t a_lat=latlong_to_bin(a->latitude);
-    ll_bin_t b_lat=latlong_to_bin(b->latitude);
-
-    if(a_lat<b_lat)
-       return(-1);
-    else if(a_lat>b_lat)
-       return(1);
-    else
-      {
-       if(a->longitude<b->longitude)
-          return(-1);
-       else if(a->longitude>b->longitude)
-          return(1);
-       else
-         {
-          if(a->latitude<b->latitude)
-             return(-1);
-          else if(a->latitude>b->latitude)
-             return(1);
-         }
-
-       return(0);
-      }
-   }
+ key[0]=((uint32_t)lonbin<<16)|latbin;
+ key[1]=((uint32_t)latlong_to_off(nodex->longitude)<<16)|latlong_to_off(nodex->latitude);
 }
 
 
@@ -397,6 +563,9 @@ index_t IndexNodeX(NodesX *nodesx,node_t id)
  index_t end=nodesx->number-1;
  index_t mid;
 
+ if(nodesx->idindex)                  /* Direct-mapped lookup */
+    return(LookupIdIndex(nodesx->idindex,id));
+
  /* Binary search - search key exact match only is required.
   *
   *  # <- start  |  Check mid and move start or end if it doesn't match
@@ -469,25 +638,31 @@ void RemoveNonHighwayNodes(NodesX *nodesx,SegmentsX *segmentsx)
 
  /* Re-open the file read-only and a new file writeable */
 
- nodesx->fd=ReOpenFile(nodesx->filename);
+ nodesx->fd=ReOpenFileBuffered(nodesx->filename);
 
  DeleteFile(nodesx->filename);
 
- fd=OpenFileNew(nodesx->filename);
+ fd=OpenFileBufferedNew(nodesx->filename);
 
  /* Modify the on-disk image */
 
- while(!ReadFile(nodesx->fd,&nodex,sizeof(NodeX)))
+ while(!ReadFileBuffered(nodesx->fd,&nodex,sizeof(NodeX)))
    {
     if(!IsBitSet(segmentsx->usednode,total))
+      {
+       if(nodesx->idindex)
+          RemoveIdIndex(nodesx->idindex,nodex.id);
+
        nothighway++;
+      }
     else
       {
        nodex.id=highway;
 
-       WriteFile(fd,&nodex,sizeof(NodeX));
+       WriteFileBuffered(fd,&nodex,sizeof(NodeX));
 
-       nodesx->idata[highway]=nodesx->idata[total];
+       if(!nodesx->idindex)
+          nodesx->idata[highway]=nodesx->idata[total];
        highway++;
 
        if(nodex.latitude<lat_min)
@@ -508,10 +683,13 @@ void RemoveNonHighwayNodes(NodesX *nodesx,SegmentsX *segmentsx)
 
  nodesx->number=highway;
 
+ if(nodesx->idindex)
+    RecountIdIndex(nodesx->idindex);
+
  /* Close the files */
 
- nodesx->fd=CloseFile(nodesx->fd);
- CloseFile(fd);
+ nodesx->fd=CloseFileBuffered(nodesx->fd);
+ CloseFileBuffered(fd);
 
  /* Work out the number of bins */
 
@@ -564,11 +742,11 @@ void UpdateNodes(NodesX *nodesx,SegmentsX *segmentsx)
 
  /* Re-open the file read-only and a new file writeable */
 
- nodesx->fd=ReOpenFile(nodesx->filename);
+ nodesx->fd=ReOpenFileBuffered(nodesx->filename);
 
  DeleteFile(nodesx->filename);
 
- fd=OpenFileNew(nodesx->filename);
+ fd=OpenFileBufferedNew(nodesx->filename);
 
  /* Modify the on-disk image */
 
@@ -576,14 +754,14 @@ void UpdateNodes(NodesX *nodesx,SegmentsX *segmentsx)
    {
     NodeX nodex;
 
-    ReadFile(nodesx->fd,&nodex,sizeof(NodeX));
+    ReadFileBuffered(nodesx->fd,&nodex,sizeof(NodeX));
 
     if(IsBitSet(nodesx->super,nodex.id))
        nodex.flags|=NODE_SUPER;
 
     nodex.id=segmentsx->firstnode[nodesx->gdata[nodex.id]];
 
-    WriteFile(fd,&nodex,sizeof(NodeX));
+    WriteFileBuffered(fd,&nodex,sizeof(NodeX));
 
     if(!((i+1)%10000))
        printf_middle("Updating Super Nodes: Nodes=%"Pindex_t,i+1);
@@ -591,8 +769,8 @@ void UpdateNodes(NodesX *nodesx,SegmentsX *segmentsx)
 
  /* Close the files */
 
- nodesx->fd=CloseFile(nodesx->fd);
- CloseFile(fd);
+ nodesx->fd=CloseFileBuffered(nodesx->fd);
+ CloseFileBuffered(fd);
 
  /* Print the final message */
 
@@ -631,13 +809,13 @@ void SaveNodeList(NodesX *nodesx,const char *filename)
 
  /* Re-open the file */
 
- nodesx->fd=ReOpenFile(nodesx->filename);
+ nodesx->fd=ReOpenFileBuffered(nodesx->filename);
 
  /* Write out the nodes data */
 
- fd=OpenFileNew(filename);
+ fd=OpenFileBufferedNew(filename);
 
- SeekFile(fd,sizeof(NodesFile)+(nodesx->latbins*nodesx->lonbins+1)*sizeof(index_t));
+ SeekFileBuffered(fd,sizeof(NodesFile)+(nodesx->latbins*nodesx->lonbins+1)*sizeof(index_t));
 
  for(i=0;i<nodesx->number;i++)
    {
@@ -646,7 +824,7 @@ void SaveNodeList(NodesX *nodesx,const char *filename)
     ll_bin_t latbin,lonbin;
     ll_bin2_t llbin;
 
-    ReadFile(nodesx->fd,&nodex,sizeof(NodeX));
+    ReadFileBuffered(nodesx->fd,&nodex,sizeof(NodeX));
 
     /* Create the Node */
 
@@ -670,7 +848,7 @@ void SaveNodeList(NodesX *nodesx,const char *filename)
 
     /* Write the data */
 
-    WriteFile(fd,&node,sizeof(Node));
+    WriteFileBuffered(fd,&node,sizeof(Node));
 
     if(!((i+1)%10000))
        printf_middle("Writing Nodes: Nodes=%"Pindex_t,i+1);
@@ -678,7 +856,7 @@ void SaveNodeList(NodesX *nodesx,const char *filename)
 
  /* Close the file */
 
- nodesx->fd=CloseFile(nodesx->fd);
+ nodesx->fd=CloseFileBuffered(nodesx->fd);
 
  /* Finish off the offset indexing and write them out */
 
@@ -687,8 +865,8 @@ void SaveNodeList(NodesX *nodesx,const char *filename)
  for(;latlonbin<=maxlatlonbins;latlonbin++)
     offsets[latlonbin]=nodesx->number;
 
- SeekFile(fd,sizeof(NodesFile));
- WriteFile(fd,offsets,(nodesx->latbins*nodesx->lonbins+1)*sizeof(index_t));
+ SeekFileBuffered(fd,sizeof(NodesFile));
+ WriteFileBuffered(fd,offsets,(nodesx->latbins*nodesx->lonbins+1)*sizeof(index_t));
 
  free(offsets);
 
@@ -703,10 +881,10 @@ void SaveNodeList(NodesX *nodesx,const char *filename)
  nodesfile.latzero=nodesx->latzero;
  nodesfile.lonzero=nodesx->lonzero;
 
- SeekFile(fd,0);
- WriteFile(fd,&nodesfile,sizeof(NodesFile));
+ SeekFileBuffered(fd,0);
+ WriteFileBuffered(fd,&nodesfile,sizeof(NodesFile));
 
- CloseFile(fd);
+ CloseFileBuffered(fd);
 
  /* Print the final message */
 
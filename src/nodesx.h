@@ -31,6 +31,7 @@
 #include "typesx.h"
 
 #include "files.h"
+#include "idindex.h"
 
 
 /* Data structures */
@@ -57,6 +58,8 @@ struct _NodesX
 
  index_t   number;              /*+ The number of extended nodes still being considered. +*/
 
+ ChangesX *changes;             /*+ The nodes that have been changed by the change files. +*/
+
 #if !SLIM
 
  NodeX    *data;                /*+ The extended node data (when mapped into memory). +*/
@@ -68,6 +71,7 @@ struct _NodesX
 #endif
 
  node_t   *idata;               /*+ The extended node IDs (sorted by ID). +*/
+ IdIndex  *idindex;             /*+ The direct-mapped index of the extended node IDs (replaces idata if not too sparse). +*/
 
  index_t  *gdata;               /*+ The final node indexes (sorted geographically). +*/
 
@@ -88,10 +92,18 @@ void FreeNodeList(NodesX *nodesx,int keep);
 
 void SaveNodeList(NodesX *nodesx,const char *filename);
 
+void SaveParsedNodeList(NodesX *nodesx);
+void LoadParsedNodeList(NodesX *nodesx);
+
+void CheckpointNodeList(NodesX *nodesx,int fd,const char *filename);
+int ResumeNodeList(NodesX *nodesx,int fd,const char *filename);
+
 index_t IndexNodeX(NodesX *nodesx,node_t id);
 
 void AppendNode(NodesX *nodesx,node_t id,double latitude,double longitude,transports_t allow,uint16_t flags);
 
+void ApplyNodeChanges(NodesX *nodesx);
+
 void SortNodeList(NodesX *nodesx);
 
 void SortNodeListGeographically(NodesX *nodesx);
@@ -21,6 +21,7 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 
 #include "types.h"
@@ -33,6 +34,31 @@
 #include "functions.h"
 #include "fakes.h"
 #include "results.h"
+#include "overlay.h"
+
+
+/*+ The maximum amount by which an alternative route can be worse than the optimum route (as a fraction of the optimum). +*/
+#define ALTERNATIVE_STRETCH 0.25
+
+/*+ The maximum amount of an alternative route that can be shared with the optimum route or another alternative (as a fraction of the optimum). +*/
+#define ALTERNATIVE_SHARING 0.80
+
+/*+ The minimum part of an alternative route around the via point that must be locally optimal (as a fraction of the optimum). +*/
+#define ALTERNATIVE_PLATEAU 0.25
+
+/*+ The maximum number of passes to improve the order of the waypoints. +*/
+#define MAX_ORDER_PASSES 1000
+
+
+/*+ A candidate via point for an alternative route. +*/
+typedef struct _Candidate
+{
+ Result  *forward;              /*+ The result from the forward search (from the start to the via point). +*/
+ Result  *backward;             /*+ The result from the backward search (from the via point to the finish). +*/
+
+ score_t  score;                /*+ The total score of the route through the via point. +*/
+}
+ Candidate;
 
 
 /* Global variables */
@@ -43,11 +69,26 @@ extern int option_quiet;
 /*+ The option to calculate the quickest route insted of the shortest. +*/
 extern int option_quickest;
 
+/*+ The number of alternative routes to calculate. +*/
+extern int option_alternatives;
+
 
 /* Local functions */
 
 static index_t FindSuperSegment(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,index_t endnode,index_t endsegment);
 
+static Results *FindBackwardRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,index_t start_node,Results *end,score_t limit_score);
+static score_t PlateauScore(Results *middle,Results *backward,Result *forward1,Result *backward1);
+static Results *CopyRoute(Results *middle,Result *forward1,Results *backward,Result *backward1,index_t finish_node);
+static score_t SharedScore(Results *route1,Results *route2);
+static int sort_by_score(const void *a,const void *b);
+
+static Results *FindSuperRouteScores(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,Results *begin,Results **ends,int nends);
+static score_t JoinScore(Results *begin,Results *middle,Results *end);
+
+static void CalculateOverlayScores(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile);
+static inline score_t SegmentScore(Segments *segments,Segment *segment,index_t index,index_t node1,Way *way,Profile *profile,score_t segment_pref);
+
 
 /*++++++++++++++++++++++++++++++++++++++
   Find the optimum route between two nodes not passing through a super-node.
@@ -214,10 +255,11 @@ Results *FindNormalRoute(Nodes *nodes,Segments *segments,Ways *ways,Relations *r
              goto endloop;
          }
 
-       if(option_quickest==0)
-          segment_score=(score_t)DISTANCE(segment->distance)/segment_pref;
-       else
-          segment_score=(score_t)Duration(segment,way,profile)/segment_pref;
+       segment_score=SegmentScore(segments,segment,seg2r,node1,way,profile,segment_pref);
+
+       /* must not be closed by the overlay */
+       if(segment_score==INF_SCORE)
+          goto endloop;
 
        cumulative_score=result1->score+segment_score;
 
@@ -328,10 +370,14 @@ Results *FindMiddleRoute(Nodes *nodes,Segments *segments,Ways *ways,Relations *r
  Results *results;
  Queue   *queue;
  Result  *finish_result;
- score_t finish_score;
+ score_t finish_score,limit_factor;
  double  finish_lat,finish_lon;
  Result  *result1,*result2,*result3,*result4;
 
+ /* Calculate the scores of the super-segments affected by the overlay (the first time only) */
+
+ CalculateOverlayScores(nodes,segments,ways,relations,profile);
+
  if(!option_quiet)
     printf_first("Routing: Super-Nodes checked = 0");
 
@@ -340,6 +386,13 @@ Results *FindMiddleRoute(Nodes *nodes,Segments *segments,Ways *ways,Relations *r
  finish_score=INF_DISTANCE;
  finish_result=NULL;
 
+ /* When searching for alternative routes keep all results that could be part of one */
+
+ if(option_alternatives)
+    limit_factor=1+ALTERNATIVE_STRETCH;
+ else
+    limit_factor=1;
+
  if(IsFakeNode(end->finish_node))
     GetFakeLatLong(end->finish_node,&finish_lat,&finish_lon);
  else
@@ -424,7 +477,11 @@ Results *FindMiddleRoute(Nodes *nodes,Segments *segments,Ways *ways,Relations *r
     index_t turnrelation=NO_RELATION;
 
     /* score must be better than current best score */
-    if(result1->score>finish_score)
+    if(result1->score>finish_score*limit_factor)
+       continue;
+
+    /* estimated score to the finish must allow an alternative route */
+    if(limit_factor>1 && result1->sortby>finish_score*limit_factor)
        continue;
 
     node1=result1->node;
@@ -503,15 +560,16 @@ Results *FindMiddleRoute(Nodes *nodes,Segments *segments,Ways *ways,Relations *r
        if(!(node->allow&profile->allow))
           goto endloop;
 
-       if(option_quickest==0)
-          segment_score=(score_t)DISTANCE(segment->distance)/segment_pref;
-       else
-          segment_score=(score_t)Duration(segment,way,profile)/segment_pref;
+       segment_score=SegmentScore(segments,segment,seg2,node1,way,profile,segment_pref);
+
+       /* must not be closed by the overlay */
+       if(segment_score==INF_SCORE)
+          goto endloop;
 
        cumulative_score=result1->score+segment_score;
 
        /* score must be better than current best score */
-       if(cumulative_score>finish_score)
+       if(cumulative_score>finish_score*limit_factor)
           goto endloop;
 
        result2=FindResult(results,node2,seg2);
@@ -560,7 +618,7 @@ Results *FindMiddleRoute(Nodes *nodes,Segments *segments,Ways *ways,Relations *r
                 finish_result=result2;
                }
             }
-          else if(result2->score<finish_score)
+          else if(result2->score<finish_score*limit_factor)
             {
              double lat,lon;
              distance_t direct;
@@ -619,9 +677,12 @@ Results *FindMiddleRoute(Nodes *nodes,Segments *segments,Ways *ways,Relations *r
 
 
 /*++++++++++++++++++++++++++++++++++++++
-  Find the super-segment that represents the route that contains a particular segment.
+  Find alternative routes between the same points as the optimum super-node route. The results of the
+  forward search are combined with a backward search from the finish and routes through via points are
+  selected if they are not too much worse than the optimum, are locally optimal around the via point and
+  do not share too much with the optimum route or each other.
 
-  index_t FindSuperSegment Returns the index of the super-segment.
+  int FindAlternativeRoutes Returns the number of alternative routes that were found.
 
   Nodes *nodes The set of nodes to use.
 
@@ -633,59 +694,116 @@ Results *FindMiddleRoute(Nodes *nodes,Segments *segments,Ways *ways,Relations *r
 
   Profile *profile The profile containing the transport type, speeds and allowed highways.
 
-  index_t endnode The super-node that the route ends at.
+  Results *begin The initial portion of the route.
 
-  index_t endsegment The segment that the route ends with.
+  Results *end The final portion of the route.
+
+  Results *middle The optimum super-node route (from FindMiddleRoute() with alternatives selected).
+
+  Results **alternatives Returns the alternative super-node routes.
+
+  int nalternatives The maximum number of alternative routes to find.
   ++++++++++++++++++++++++++++++++++++++*/
 
-static index_t FindSuperSegment(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,index_t endnode,index_t endsegment)
+int FindAlternativeRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,Results *begin,Results *end,Results *middle,Results **alternatives,int nalternatives)
 {
- Segment *segment;
+ Results *backward,*optimum;
+ Result  *finish_result,*result1,*result2;
+ Candidate *candidates=NULL;
+ int     ncandidates=0,nfound=0,i,j;
+ score_t optimum_score,limit_score;
 
- if(IsFakeSegment(endsegment))
-    endsegment=IndexRealSegment(endsegment);
+ /* Find the optimum route */
 
- segment=LookupSegment(segments,endsegment,2);
+ finish_result=FindResult(middle,middle->finish_node,middle->last_segment);
 
- if(IsSuperSegment(segment))
-    return(endsegment);
+ optimum_score=finish_result->score;
+ limit_score=optimum_score*(1+ALTERNATIVE_STRETCH);
 
- /* Loop across all segments */
+ optimum=CopyRoute(middle,finish_result,NULL,NULL,end->finish_node);
 
- segment=FirstSegment(segments,nodes,endnode,3); /* endnode cannot be a fake node (must be a super-node) */
+ /* Search backwards from the finish */
 
- while(segment)
-   {
-    if(IsSuperSegment(segment))
-      {
-       Results *results;
-       index_t startnode;
+ backward=FindBackwardRoutes(nodes,segments,ways,relations,profile,begin->start_node,end,limit_score);
 
-       startnode=OtherNode(segment,endnode);
+ /* Find the via points that are reached by both searches */
 
-       results=FindNormalRoute(nodes,segments,ways,relations,profile,startnode,NO_SEGMENT,endnode);
+ result2=FirstResult(backward);
 
-       if(results && results->last_segment==endsegment)
+ while(result2)
+   {
+    result1=FindResult(middle,result2->node,result2->segment);
+
+    if(result1 && !result1->next && result1!=finish_result && (result1->score+result2->score)<=limit_score)
+       if(PlateauScore(middle,backward,result1,result2)>=optimum_score*ALTERNATIVE_PLATEAU)
          {
-          FreeResultsList(results);
-          return(IndexSegment(segments,segment));
+          if(!(ncandidates%256))
+            {
+             candidates=(Candidate*)realloc((void*)candidates,(ncandidates+256)*sizeof(Candidate));
+
+             assert(candidates); /* Check realloc() worked */
+            }
+
+          candidates[ncandidates].forward=result1;
+          candidates[ncandidates].backward=result2;
+          candidates[ncandidates].score=result1->score+result2->score;
+
+          ncandidates++;
          }
 
-       if(results)
-          FreeResultsList(results);
-      }
+    result2=NextResult(backward,result2);
+   }
 
-    segment=NextSegment(segments,segment,endnode); /* endnode cannot be a fake node (must be a super-node) */
+ /* Choose the best via points that give routes that are sufficiently different */
+
+ if(ncandidates)
+    qsort(candidates,ncandidates,sizeof(Candidate),sort_by_score);
+
+ for(i=0;i<ncandidates && nfound<nalternatives;i++)
+   {
+    Results *route;
+
+    /* must not be a via point on an alternative route that has already been found */
+    for(j=0;j<nfound;j++)
+       if(FindResult(alternatives[j],candidates[i].forward->node,candidates[i].forward->segment))
+          break;
+
+    if(j<nfound)
+       continue;
+
+    route=CopyRoute(middle,candidates[i].forward,backward,candidates[i].backward,end->finish_node);
+
+    if(!route)
+       continue;
+
+    /* must not share too much with the optimum route or the other alternatives */
+    if(SharedScore(route,optimum)>optimum_score*ALTERNATIVE_SHARING)
+       j=-1;
+    else
+       for(j=0;j<nfound;j++)
+          if(SharedScore(route,alternatives[j])>optimum_score*ALTERNATIVE_SHARING)
+             break;
+
+    if(j==nfound)
+       alternatives[nfound++]=route;
+    else
+       FreeResultsList(route);
    }
 
- return(endsegment);
+ if(candidates)
+    free(candidates);
+
+ FreeResultsList(backward);
+ FreeResultsList(optimum);
+
+ return(nfound);
 }
 
 
 /*++++++++++++++++++++++++++++++++++++++
-  Find all routes from a specified node to any super-node.
+  Find the routes from the super-nodes to the finish by searching backwards along the super-segments.
 
-  Results *FindStartRoutes Returns a set of results.
+  Results *FindBackwardRoutes Returns a set of results (the next pointers lead towards the finish).
 
   Nodes *nodes The set of nodes to use.
 
@@ -697,213 +815,387 @@ static index_t FindSuperSegment(Nodes *nodes,Segments *segments,Ways *ways,Relat
 
   Profile *profile The profile containing the transport type, speeds and allowed highways.
 
-  index_t start_node The start node.
-
-  index_t prev_segment The previous segment before the start node.
+  index_t start_node The start node (used as the target for the search).
 
-  index_t finish_node The finish node.
+  Results *end The final portion of the route.
 
-  int *nsuper Returns the number of super-nodes seen.
+  score_t limit_score The maximum score that any route can have.
   ++++++++++++++++++++++++++++++++++++++*/
 
-Results *FindStartRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,index_t start_node,index_t prev_segment,index_t finish_node,int *nsuper)
+static Results *FindBackwardRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,index_t start_node,Results *end,score_t limit_score)
 {
  Results *results;
  Queue   *queue;
- Result  *result1,*result2;
- int     found_finish=0;
+ double  start_lat,start_lon;
+ Result  *result1,*result2,*result3;
 
- /* Create the results and insert the start node */
+ /* Calculate the scores of the super-segments affected by the overlay (the first time only) */
 
- results=NewResultsList(64);
+ CalculateOverlayScores(nodes,segments,ways,relations,profile);
 
- results->start_node=start_node;
- results->prev_segment=prev_segment;
+ if(IsFakeNode(start_node))
+    GetFakeLatLong(start_node,&start_lat,&start_lon);
+ else
+    GetLatLong(nodes,start_node,&start_lat,&start_lon);
 
- result1=InsertResult(results,results->start_node,results->prev_segment);
+ /* Create the list of results and insert the super-nodes at the end of the route into the queue */
 
- /* Insert the first node into the queue */
+ results=NewResultsList(65536);
 
  queue=NewQueueList();
 
- InsertInQueue(queue,result1);
+ result3=FirstResult(end);
+
+ while(result3)
+   {
+    if(!IsFakeNode(result3->node) && !IsFakeSegment(result3->segment) &&
+       IsSuperNode(LookupNode(nodes,result3->node,1)) && IsSuperSegment(LookupSegment(segments,result3->segment,1)))
+      {
+       result2=InsertResult(results,result3->node,result3->segment);
+
+       result2->score=result3->score;
+       result2->sortby=result3->score;
+
+       InsertInQueue(queue,result2);
+      }
+
+    result3=NextResult(end,result3);
+   }
 
  /* Loop across all nodes in the queue */
 
  while((result1=PopFromQueue(queue)))
    {
-    index_t node1,seg1,seg1r;
     Segment *segment;
+    Way *way;
+    Node *node;
+    index_t node0,node1,seg1;
+    score_t segment_pref,segment_score,cumulative_score,direct_score;
+    double lat,lon;
+    distance_t direct;
     index_t turnrelation=NO_RELATION;
+    int i;
+
+    /* estimated score from the start must be better than the limit */
+    if(result1->sortby>limit_score)
+       continue;
 
     node1=result1->node;
     seg1=result1->segment;
 
-    if(IsFakeSegment(seg1))
-       seg1r=IndexRealSegment(seg1);
-    else
-       seg1r=seg1;
+    segment=LookupSegment(segments,seg1,2);
 
-    /* lookup if a turn restriction applies */
-    if(profile->turns && !IsFakeNode(node1) && IsTurnRestrictedNode(LookupNode(nodes,node1,1)))
-       turnrelation=FindFirstTurnRelation2(relations,node1,seg1r);
+    node0=OtherNode(segment,node1);
 
-    /* Loop across all segments */
+    /* must obey one-way restrictions (unless profile allows) */
+    if(profile->oneway && IsOnewayTo(segment,node0))
+       continue;
 
-    if(IsFakeNode(node1))
-       segment=FirstFakeSegment(node1);
-    else
-       segment=FirstSegment(segments,nodes,node1,1);
+    way=LookupWay(ways,segment->way,1);
 
-    while(segment)
-      {
-       Way *way;
-       index_t node2,seg2,seg2r;
-       score_t segment_pref,segment_score,cumulative_score;
-       int i;
+    /* transport must be allowed on the highway */
+    if(!(way->allow&profile->allow))
+       continue;
 
-       node2=OtherNode(segment,node1); /* need this here because we use node2 at the end of the loop */
+    /* must obey weight restriction (if exists) */
+    if(way->weight && way->weight<profile->weight)
+       continue;
 
-       /* must be a normal segment */
-       if(!IsNormalSegment(segment))
-          goto endloop;
+    /* must obey height/width/length restriction (if exists) */
+    if((way->height && way->height<profile->height) ||
+       (way->width  && way->width <profile->width ) ||
+       (way->length && way->length<profile->length))
+       continue;
 
-       /* must obey one-way restrictions (unless profile allows) */
-       if(profile->oneway && IsOnewayTo(segment,node1))
-          goto endloop;
+    segment_pref=profile->highway[HIGHWAY(way->type)];
 
-       if(IsFakeNode(node1) || IsFakeNode(node2))
-         {
-          seg2 =IndexFakeSegment(segment);
-          seg2r=IndexRealSegment(seg2);
-         }
-       else
+    for(i=1;i<Property_Count;i++)
+       if(ways->file.props & PROPERTIES(i))
          {
-          seg2 =IndexSegment(segments,segment);
-          seg2r=seg2;
+          if(way->props & PROPERTIES(i))
+             segment_pref*=profile->props_yes[i];
+          else
+             segment_pref*=profile->props_no[i];
          }
 
-       /* must not perform U-turn (unless profile allows) */
-       if(profile->turns && (seg1==seg2 || seg1==seg2r || seg1r==seg2 || (seg1r==seg2r && IsFakeUTurn(seg1,seg2))))
-          goto endloop;
+    /* profile preferences must allow this highway */
+    if(segment_pref==0)
+       continue;
 
-       /* must obey turn relations */
-       if(turnrelation!=NO_RELATION && !IsTurnAllowed(relations,turnrelation,node1,seg1r,seg2r,profile->allow))
-          goto endloop;
+    node=LookupNode(nodes,node1,1); /* node1 cannot be a fake node (must be a super-node) */
 
-       way=LookupWay(ways,segment->way,1);
+    /* mode of transport must be allowed through node1 */
+    if(!(node->allow&profile->allow))
+       continue;
 
-       /* mode of transport must be allowed on the highway */
-       if(!(way->allow&profile->allow))
-          goto endloop;
+    segment_score=SegmentScore(segments,segment,seg1,node0,way,profile,segment_pref);
 
-       /* must obey weight restriction (if exists) */
-       if(way->weight && way->weight<profile->weight)
-          goto endloop;
+    /* must not be closed by the overlay */
+    if(segment_score==INF_SCORE)
+       continue;
 
-       /* must obey height/width/length restriction (if exists) */
-       if((way->height && way->height<profile->height) ||
-          (way->width  && way->width <profile->width ) ||
-          (way->length && way->length<profile->length))
-          goto endloop;
+    cumulative_score=result1->score+segment_score;
 
-       segment_pref=profile->highway[HIGHWAY(way->type)];
+    /* score must be better than the limit */
+    if(cumulative_score>limit_score)
+       continue;
 
-       for(i=1;i<Property_Count;i++)
-          if(ways->file.props & PROPERTIES(i))
-            {
-             if(way->props & PROPERTIES(i))
-                segment_pref*=profile->props_yes[i];
-             else
-                segment_pref*=profile->props_no[i];
-            }
+    GetLatLong(nodes,node0,&lat,&lon); /* node0 cannot be a fake node (must be a super-node) */
 
-       /* profile preferences must allow this highway */
-       if(segment_pref==0)
+    direct=Distance(lat,lon,start_lat,start_lon);
+
+    if(option_quickest==0)
+       direct_score=(score_t)direct/profile->max_pref;
+    else
+       direct_score=(score_t)distance_speed_to_duration(direct,profile->max_speed)/profile->max_pref;
+
+    /* lookup if a turn restriction applies */
+    if(profile->turns && IsTurnRestrictedNode(LookupNode(nodes,node0,1)))
+       turnrelation=FindFirstTurnRelation1(relations,node0); /* working backwards => turn relation sort order doesn't help */
+
+    /* Loop across all segments */
+
+    segment=FirstSegment(segments,nodes,node0,1); /* node0 cannot be a fake node (must be a super-node) */
+
+    while(segment)
+      {
+       index_t seg0;
+
+       /* must be a super segment */
+       if(!IsSuperSegment(segment))
           goto endloop;
 
-       /* mode of transport must be allowed through node2 */
-       if(!IsFakeNode(node2))
+       seg0=IndexSegment(segments,segment);
+
+       /* must not perform U-turn */
+       if(seg0==seg1) /* No fake segments, applies to all profiles */
+          goto endloop;
+
+       /* must obey turn relations */
+       if(turnrelation!=NO_RELATION)
          {
-          Node *node=LookupNode(nodes,node2,2);
+          index_t turnrelation2=FindFirstTurnRelation2(relations,node0,seg0);
 
-          if(!(node->allow&profile->allow))
+          if(turnrelation2!=NO_RELATION && !IsTurnAllowed(relations,turnrelation2,node0,seg0,seg1,profile->allow))
              goto endloop;
          }
 
-       if(option_quickest==0)
-          segment_score=(score_t)DISTANCE(segment->distance)/segment_pref;
-       else
-          segment_score=(score_t)Duration(segment,way,profile)/segment_pref;
-
-       cumulative_score=result1->score+segment_score;
-
-       result2=FindResult(results,node2,seg2);
+       result2=FindResult(results,node0,seg0);
 
-       if(!result2) /* New end node/segment combination */
+       if(!result2) /* New start node/segment pair */
          {
-          result2=InsertResult(results,node2,seg2);
-          result2->prev=result1;
+          result2=InsertResult(results,node0,seg0);
+          result2->next=result1; /* working backwards */
           result2->score=cumulative_score;
+          result2->sortby=cumulative_score+direct_score;
 
-          if(!IsFakeNode(node2) && IsSuperNode(LookupNode(nodes,node2,2)))
-             (*nsuper)++;
-
-          if(!IsFakeNode(node2) && !IsSuperNode(LookupNode(nodes,node2,2)))
-            {
-             result2->sortby=result2->score;
-             InsertInQueue(queue,result2);
-            }
-
-          if(node2==finish_node)
-             found_finish=1;
+          InsertInQueue(queue,result2);
          }
-       else if(cumulative_score<result2->score) /* New end node/segment combination is better */
+       else if(cumulative_score<result2->score) /* New start node/segment pair is better */
          {
-          result2->prev=result1;
+          result2->next=result1; /* working backwards */
           result2->score=cumulative_score;
+          result2->sortby=cumulative_score+direct_score;
 
-          if(!IsFakeNode(node2) && !IsSuperNode(LookupNode(nodes,node2,2)))
-            {
-             result2->sortby=result2->score;
-             InsertInQueue(queue,result2);
-            }
+          InsertInQueue(queue,result2);
          }
 
       endloop:
 
-       if(IsFakeNode(node1))
-          segment=NextFakeSegment(segment,node1);
-       else if(IsFakeNode(node2))
-          segment=NULL; /* cannot call NextSegment() with a fake segment */
-       else
-         {
-          segment=NextSegment(segments,segment,node1);
-
-          if(!segment && IsFakeNode(finish_node))
-             segment=ExtraFakeSegment(node1,finish_node);
-         }
+       segment=NextSegment(segments,segment,node0); /* node0 cannot be a fake node (must be a super-node) */
       }
    }
 
  FreeQueueList(queue);
 
- /* Check it worked */
+ return(results);
+}
 
- if(results->number==1 || (*nsuper==0 && found_finish==0))
+
+/*++++++++++++++++++++++++++++++++++++++
+  Calculate the score of the part of a route around a via point where the forward and backward searches agree.
+
+  score_t PlateauScore Returns the score of the locally optimal part of the route.
+
+  Results *middle The results of the forward search.
+
+  Results *backward The results of the backward search.
+
+  Result *forward1 The result for the via point from the forward search.
+
+  Result *backward1 The result for the via point from the backward search.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static score_t PlateauScore(Results *middle,Results *backward,Result *forward1,Result *backward1)
+{
+ Result *forward2=forward1,*backward2=backward1;
+ Result *result;
+
+ /* Follow the route towards the start while the backward search took the same path */
+
+ while(forward1->prev && (result=FindResult(backward,forward1->prev->node,forward1->prev->segment)) && result->next==backward1)
    {
-    FreeResultsList(results);
-    return(NULL);
+    forward1=forward1->prev;
+    backward1=result;
    }
 
- return(results);
+ /* Follow the route towards the finish while the forward search took the same path */
+
+ while(backward2->next && (result=FindResult(middle,backward2->next->node,backward2->next->segment)) && result->prev==forward2)
+   {
+    backward2=backward2->next;
+    forward2=result;
+   }
+
+ return(forward2->score-forward1->score);
 }
 
 
 /*++++++++++++++++++++++++++++++++++++++
-  Find all routes from any super-node to a specific node (by working backwards from the specific node to all super-nodes).
+  Create a super-node route that follows the forward search to a via point and the backward search from it.
 
-  Results *FindFinishRoutes Returns a set of results.
+  Results *CopyRoute Returns the route or NULL if it contains a loop.
+
+  Results *middle The results of the forward search.
+
+  Result *forward1 The result for the via point from the forward search.
+
+  Results *backward The results of the backward search (or NULL to only copy the forward part).
+
+  Result *backward1 The result for the via point from the backward search (or NULL).
+
+  index_t finish_node The finish node.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static Results *CopyRoute(Results *middle,Result *forward1,Results *backward,Result *backward1,index_t finish_node)
+{
+ Results *route;
+ Result  *result1,*result2,*result3=NULL,*via=NULL;
+ score_t score=forward1->score;
+
+ route=NewResultsList(64);
+
+ route->start_node=middle->start_node;
+ route->prev_segment=middle->prev_segment;
+
+ /* Copy the forward part of the route (working backwards from the via point) */
+
+ result1=forward1;
+
+ do
+   {
+    result2=InsertResult(route,result1->node,result1->segment);
+
+    result2->score=result1->score;
+
+    if(result3)
+       result3->prev=result2;
+    else
+       via=result2;
+
+    result3=result2;
+
+    result1=result1->prev;
+   }
+ while(result1);
+
+ /* Copy the backward part of the route */
+
+ if(backward1)
+   {
+    score+=backward1->score;
+
+    result1=backward1->next;
+
+    while(result1)
+      {
+       /* must not visit the same node twice */
+       if(FindResult1(route,result1->node))
+         {
+          FreeResultsList(route);
+          return(NULL);
+         }
+
+       result2=InsertResult(route,result1->node,result1->segment);
+
+       result2->prev=via;
+       result2->score=score-result1->score;
+
+       via=result2;
+
+       result1=result1->next;
+      }
+   }
+
+ /* Finish off the end part of the route */
+
+ if(via->node!=finish_node)
+   {
+    result2=InsertResult(route,finish_node,NO_SEGMENT);
+
+    result2->prev=via;
+    result2->score=score;
+
+    via=result2;
+   }
+
+ FixForwardRoute(route,via);
+
+ return(route);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Calculate the score of the parts of one route that are also used by another route.
+
+  score_t SharedScore Returns the shared score.
+
+  Results *route1 The route to check.
+
+  Results *route2 The route to compare against.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static score_t SharedScore(Results *route1,Results *route2)
+{
+ Result *result=FindResult(route1,route1->start_node,route1->prev_segment);
+ score_t shared=0;
+
+ while((result=result->next))
+    if(FindResult(route2,result->node,result->segment))
+       shared+=result->score-result->prev->score;
+
+ return(shared);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Sort the candidate via points into order of increasing score.
+
+  int sort_by_score Returns the comparison of the score fields.
+
+  const void *a The first candidate.
+
+  const void *b The second candidate.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int sort_by_score(const void *a,const void *b)
+{
+ score_t a_score=((const Candidate*)a)->score;
+ score_t b_score=((const Candidate*)b)->score;
+
+ if(a_score<b_score)
+    return(-1);
+ else if(a_score>b_score)
+    return(1);
+ else
+    return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the super-segment that represents the route that contains a particular segment.
+
+  index_t FindSuperSegment Returns the index of the super-segment.
 
   Nodes *nodes The set of nodes to use.
 
@@ -915,22 +1207,94 @@ Results *FindStartRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *r
 
   Profile *profile The profile containing the transport type, speeds and allowed highways.
 
-  index_t finish_node The finishing node.
+  index_t endnode The super-node that the route ends at.
+
+  index_t endsegment The segment that the route ends with.
   ++++++++++++++++++++++++++++++++++++++*/
 
-Results *FindFinishRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,index_t finish_node)
+static index_t FindSuperSegment(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,index_t endnode,index_t endsegment)
 {
- Results *results,*results2;
+ Segment *segment;
+
+ if(IsFakeSegment(endsegment))
+    endsegment=IndexRealSegment(endsegment);
+
+ segment=LookupSegment(segments,endsegment,2);
+
+ if(IsSuperSegment(segment))
+    return(endsegment);
+
+ /* Loop across all segments */
+
+ segment=FirstSegment(segments,nodes,endnode,3); /* endnode cannot be a fake node (must be a super-node) */
+
+ while(segment)
+   {
+    if(IsSuperSegment(segment))
+      {
+       Results *results;
+       index_t startnode;
+
+       startnode=OtherNode(segment,endnode);
+
+       results=FindNormalRoute(nodes,segments,ways,relations,profile,startnode,NO_SEGMENT,endnode);
+
+       if(results && results->last_segment==endsegment)
+         {
+          FreeResultsList(results);
+          return(IndexSegment(segments,segment));
+         }
+
+       if(results)
+          FreeResultsList(results);
+      }
+
+    segment=NextSegment(segments,segment,endnode); /* endnode cannot be a fake node (must be a super-node) */
+   }
+
+ return(endsegment);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find all routes from a specified node to any super-node.
+
+  Results *FindStartRoutes Returns a set of results.
+
+  Nodes *nodes The set of nodes to use.
+
+  Segments *segments The set of segments to use.
+
+  Ways *ways The set of ways to use.
+
+  Relations *relations The set of relations to use.
+
+  Profile *profile The profile containing the transport type, speeds and allowed highways.
+
+  index_t start_node The start node.
+
+  index_t prev_segment The previous segment before the start node.
+
+  index_t finish_node The finish node.
+
+  int *nsuper Returns the number of super-nodes seen.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+Results *FindStartRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,index_t start_node,index_t prev_segment,index_t finish_node,int *nsuper)
+{
+ Results *results;
  Queue   *queue;
- Result  *result1,*result2,*result3;
+ Result  *result1,*result2;
+ int     found_finish=0;
 
- /* Create the results and insert the finish node */
+ /* Create the results and insert the start node */
 
  results=NewResultsList(64);
 
- results->finish_node=finish_node;
+ results->start_node=start_node;
+ results->prev_segment=prev_segment;
 
- result1=InsertResult(results,finish_node,NO_SEGMENT);
+ result1=InsertResult(results,results->start_node,results->prev_segment);
 
  /* Insert the first node into the queue */
 
@@ -956,7 +1320,7 @@ Results *FindFinishRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *
 
     /* lookup if a turn restriction applies */
     if(profile->turns && !IsFakeNode(node1) && IsTurnRestrictedNode(LookupNode(nodes,node1,1)))
-       turnrelation=FindFirstTurnRelation1(relations,node1); /* working backwards => turn relation sort order doesn't help */
+       turnrelation=FindFirstTurnRelation2(relations,node1,seg1r);
 
     /* Loop across all segments */
 
@@ -972,16 +1336,16 @@ Results *FindFinishRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *
        score_t segment_pref,segment_score,cumulative_score;
        int i;
 
+       node2=OtherNode(segment,node1); /* need this here because we use node2 at the end of the loop */
+
        /* must be a normal segment */
-       if((IsFakeNode(node1) || !IsSuperNode(LookupNode(nodes,node1,1))) && !IsNormalSegment(segment))
+       if(!IsNormalSegment(segment))
           goto endloop;
 
        /* must obey one-way restrictions (unless profile allows) */
-       if(profile->oneway && IsOnewayFrom(segment,node1)) /* Disallow oneway from node2 *to* node1 */
+       if(profile->oneway && IsOnewayTo(segment,node1))
           goto endloop;
 
-       node2=OtherNode(segment,node1);
-
        if(IsFakeNode(node1) || IsFakeNode(node2))
          {
           seg2 =IndexFakeSegment(segment);
@@ -998,13 +1362,8 @@ Results *FindFinishRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *
           goto endloop;
 
        /* must obey turn relations */
-       if(turnrelation!=NO_RELATION)
-         {
-          index_t turnrelation2=FindFirstTurnRelation2(relations,node1,seg2r); /* node2 -> node1 -> result1->next->node */
-
-          if(turnrelation2!=NO_RELATION && !IsTurnAllowed(relations,turnrelation2,node1,seg2r,seg1r,profile->allow))
-             goto endloop;
-         }
+       if(turnrelation!=NO_RELATION && !IsTurnAllowed(relations,turnrelation,node1,seg1r,seg2r,profile->allow))
+          goto endloop;
 
        way=LookupWay(ways,segment->way,1);
 
@@ -1046,33 +1405,40 @@ Results *FindFinishRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *
              goto endloop;
          }
 
-       if(option_quickest==0)
-          segment_score=(score_t)DISTANCE(segment->distance)/segment_pref;
-       else
-          segment_score=(score_t)Duration(segment,way,profile)/segment_pref;
+       segment_score=SegmentScore(segments,segment,seg2r,node1,way,profile,segment_pref);
+
+       /* must not be closed by the overlay */
+       if(segment_score==INF_SCORE)
+          goto endloop;
 
        cumulative_score=result1->score+segment_score;
 
        result2=FindResult(results,node2,seg2);
 
-       if(!result2) /* New end node */
+       if(!result2) /* New end node/segment combination */
          {
           result2=InsertResult(results,node2,seg2);
-          result2->next=result1;   /* working backwards */
+          result2->prev=result1;
           result2->score=cumulative_score;
 
-          if(IsFakeNode(node1) || (!IsFakeNode(node1) && !IsSuperNode(LookupNode(nodes,node1,1)))) /* Overshoot by one segment */
+          if(!IsFakeNode(node2) && IsSuperNode(LookupNode(nodes,node2,2)))
+             (*nsuper)++;
+
+          if(!IsFakeNode(node2) && !IsSuperNode(LookupNode(nodes,node2,2)))
             {
              result2->sortby=result2->score;
              InsertInQueue(queue,result2);
             }
+
+          if(node2==finish_node)
+             found_finish=1;
          }
-       else if(cumulative_score<result2->score) /* New end node is better */
+       else if(cumulative_score<result2->score) /* New end node/segment combination is better */
          {
-          result2->next=result1; /* working backwards */
+          result2->prev=result1;
           result2->score=cumulative_score;
 
-          if(IsFakeNode(node1) || (!IsFakeNode(node1) && !IsSuperNode(LookupNode(nodes,node1,1)))) /* Overshoot by one segment */
+          if(!IsFakeNode(node2) && !IsSuperNode(LookupNode(nodes,node2,2)))
             {
              result2->sortby=result2->score;
              InsertInQueue(queue,result2);
@@ -1083,8 +1449,15 @@ Results *FindFinishRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *
 
        if(IsFakeNode(node1))
           segment=NextFakeSegment(segment,node1);
+       else if(IsFakeNode(node2))
+          segment=NULL; /* cannot call NextSegment() with a fake segment */
        else
+         {
           segment=NextSegment(segments,segment,node1);
+
+          if(!segment && IsFakeNode(finish_node))
+             segment=ExtraFakeSegment(node1,finish_node);
+         }
       }
    }
 
@@ -1092,30 +1465,237 @@ Results *FindFinishRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *
 
  /* Check it worked */
 
- if(results->number==1)
+ if(results->number==1 || (*nsuper==0 && found_finish==0))
    {
     FreeResultsList(results);
     return(NULL);
    }
 
- /* Create a results structure with the node at the end of the segment opposite the start */
+ return(results);
+}
 
- results2=NewResultsList(64);
 
- results2->finish_node=results->finish_node;
+/*++++++++++++++++++++++++++++++++++++++
+  Find all routes from any super-node to a specific node (by working backwards from the specific node to all super-nodes).
 
- result3=FirstResult(results);
+  Results *FindFinishRoutes Returns a set of results.
 
- while(result3)
-   {
-    if(result3->next)
-      {
-       result2=InsertResult(results2,result3->next->node,result3->segment);
+  Nodes *nodes The set of nodes to use.
 
-       result2->score=result3->next->score;
-      }
+  Segments *segments The set of segments to use.
 
-    result3=NextResult(results,result3);
+  Ways *ways The set of ways to use.
+
+  Relations *relations The set of relations to use.
+
+  Profile *profile The profile containing the transport type, speeds and allowed highways.
+
+  index_t finish_node The finishing node.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+Results *FindFinishRoutes(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,index_t finish_node)
+{
+ Results *results,*results2;
+ Queue   *queue;
+ Result  *result1,*result2,*result3;
+
+ /* Calculate the scores of the super-segments affected by the overlay (the first time only) */
+
+ CalculateOverlayScores(nodes,segments,ways,relations,profile);
+
+ /* Create the results and insert the finish node */
+
+ results=NewResultsList(64);
+
+ results->finish_node=finish_node;
+
+ result1=InsertResult(results,finish_node,NO_SEGMENT);
+
+ /* Insert the first node into the queue */
+
+ queue=NewQueueList();
+
+ InsertInQueue(queue,result1);
+
+ /* Loop across all nodes in the queue */
+
+ while((result1=PopFromQueue(queue)))
+   {
+    index_t node1,seg1,seg1r;
+    Segment *segment;
+    index_t turnrelation=NO_RELATION;
+
+    node1=result1->node;
+    seg1=result1->segment;
+
+    if(IsFakeSegment(seg1))
+       seg1r=IndexRealSegment(seg1);
+    else
+       seg1r=seg1;
+
+    /* lookup if a turn restriction applies */
+    if(profile->turns && !IsFakeNode(node1) && IsTurnRestrictedNode(LookupNode(nodes,node1,1)))
+       turnrelation=FindFirstTurnRelation1(relations,node1); /* working backwards => turn relation sort order doesn't help */
+
+    /* Loop across all segments */
+
+    if(IsFakeNode(node1))
+       segment=FirstFakeSegment(node1);
+    else
+       segment=FirstSegment(segments,nodes,node1,1);
+
+    while(segment)
+      {
+       Way *way;
+       index_t node2,seg2,seg2r;
+       score_t segment_pref,segment_score,cumulative_score;
+       int i;
+
+       /* must be a normal segment */
+       if((IsFakeNode(node1) || !IsSuperNode(LookupNode(nodes,node1,1))) && !IsNormalSegment(segment))
+          goto endloop;
+
+       /* must obey one-way restrictions (unless profile allows) */
+       if(profile->oneway && IsOnewayFrom(segment,node1)) /* Disallow oneway from node2 *to* node1 */
+          goto endloop;
+
+       node2=OtherNode(segment,node1);
+
+       if(IsFakeNode(node1) || IsFakeNode(node2))
+         {
+          seg2 =IndexFakeSegment(segment);
+          seg2r=IndexRealSegment(seg2);
+         }
+       else
+         {
+          seg2 =IndexSegment(segments,segment);
+          seg2r=seg2;
+         }
+
+       /* must not perform U-turn (unless profile allows) */
+       if(profile->turns && (seg1==seg2 || seg1==seg2r || seg1r==seg2 || (seg1r==seg2r && IsFakeUTurn(seg1,seg2))))
+          goto endloop;
+
+       /* must obey turn relations */
+       if(turnrelation!=NO_RELATION)
+         {
+          index_t turnrelation2=FindFirstTurnRelation2(relations,node1,seg2r); /* node2 -> node1 -> result1->next->node */
+
+          if(turnrelation2!=NO_RELATION && !IsTurnAllowed(relations,turnrelation2,node1,seg2r,seg1r,profile->allow))
+             goto endloop;
+         }
+
+       way=LookupWay(ways,segment->way,1);
+
+       /* mode of transport must be allowed on the highway */
+       if(!(way->allow&profile->allow))
+          goto endloop;
+
+       /* must obey weight restriction (if exists) */
+       if(way->weight && way->weight<profile->weight)
+          goto endloop;
+
+       /* must obey height/width/length restriction (if exists) */
+       if((way->height && way->height<profile->height) ||
+          (way->width  && way->width <profile->width ) ||
+          (way->length && way->length<profile->length))
+          goto endloop;
+
+       segment_pref=profile->highway[HIGHWAY(way->type)];
+
+       for(i=1;i<Property_Count;i++)
+          if(ways->file.props & PROPERTIES(i))
+            {
+             if(way->props & PROPERTIES(i))
+                segment_pref*=profile->props_yes[i];
+             else
+                segment_pref*=profile->props_no[i];
+            }
+
+       /* profile preferences must allow this highway */
+       if(segment_pref==0)
+          goto endloop;
+
+       /* mode of transport must be allowed through node2 */
+       if(!IsFakeNode(node2))
+         {
+          Node *node=LookupNode(nodes,node2,2);
+
+          if(!(node->allow&profile->allow))
+             goto endloop;
+         }
+
+       segment_score=SegmentScore(segments,segment,seg2r,node2,way,profile,segment_pref);
+
+       /* must not be closed by the overlay */
+       if(segment_score==INF_SCORE)
+          goto endloop;
+
+       cumulative_score=result1->score+segment_score;
+
+       result2=FindResult(results,node2,seg2);
+
+       if(!result2) /* New end node */
+         {
+          result2=InsertResult(results,node2,seg2);
+          result2->next=result1;   /* working backwards */
+          result2->score=cumulative_score;
+
+          if(IsFakeNode(node1) || (!IsFakeNode(node1) && !IsSuperNode(LookupNode(nodes,node1,1)))) /* Overshoot by one segment */
+            {
+             result2->sortby=result2->score;
+             InsertInQueue(queue,result2);
+            }
+         }
+       else if(cumulative_score<result2->score) /* New end node is better */
+         {
+          result2->next=result1; /* working backwards */
+          result2->score=cumulative_score;
+
+          if(IsFakeNode(node1) || (!IsFakeNode(node1) && !IsSuperNode(LookupNode(nodes,node1,1)))) /* Overshoot by one segment */
+            {
+             result2->sortby=result2->score;
+             InsertInQueue(queue,result2);
+            }
+         }
+
+      endloop:
+
+       if(IsFakeNode(node1))
+          segment=NextFakeSegment(segment,node1);
+       else
+          segment=NextSegment(segments,segment,node1);
+      }
+   }
+
+ FreeQueueList(queue);
+
+ /* Check it worked */
+
+ if(results->number==1)
+   {
+    FreeResultsList(results);
+    return(NULL);
+   }
+
+ /* Create a results structure with the node at the end of the segment opposite the start */
+
+ results2=NewResultsList(64);
+
+ results2->finish_node=results->finish_node;
+
+ result3=FirstResult(results);
+
+ while(result3)
+   {
+    if(result3->next)
+      {
+       result2=InsertResult(results2,result3->next->node,result3->segment);
+
+       result2->score=result3->next->score;
+      }
+
+    result3=NextResult(results,result3);
    }
 
  /* Fix up the result->next pointers */
@@ -1324,3 +1904,604 @@ void FixForwardRoute(Results *results,Result *finish_result)
  results->finish_node=finish_result->node;
  results->last_segment=finish_result->segment;
 }
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Calculate the score of the optimum route from each one of a set of nodes to each other one.
+
+  Nodes *nodes The set of nodes to use.
+
+  Segments *segments The set of segments to use.
+
+  Ways *ways The set of ways to use.
+
+  Relations *relations The set of relations to use.
+
+  Profile *profile The profile containing the transport type, speeds and allowed highways.
+
+  index_t *waypoints The set of nodes to find the routes between.
+
+  int nwaypoints The number of nodes.
+
+  score_t *scores Returns the scores (nwaypoints x nwaypoints, INF_SCORE if there is no route).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void FindRouteScores(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,index_t *waypoints,int nwaypoints,score_t *scores)
+{
+ Results **ends;
+ int i,j;
+
+ if(!option_quiet)
+    printf_first("Routing: Waypoints checked = 0/%d",nwaypoints);
+
+ /* Calculate the end of the route for each of the waypoints */
+
+ ends=(Results**)malloc(nwaypoints*sizeof(Results*));
+
+ assert(ends); /* Check malloc() worked */
+
+ for(j=0;j<nwaypoints;j++)
+    ends[j]=FindFinishRoutes(nodes,segments,ways,relations,profile,waypoints[j]);
+
+ /* Calculate the routes from each of the waypoints */
+
+ for(i=0;i<nwaypoints;i++)
+   {
+    Results *begin,*middle=NULL;
+    int nsuper=0;
+
+    begin=FindStartRoutes(nodes,segments,ways,relations,profile,waypoints[i],NO_SEGMENT,NO_NODE,&nsuper);
+
+    if(begin && nsuper)
+       middle=FindSuperRouteScores(nodes,segments,ways,relations,profile,begin,ends,nwaypoints);
+
+    for(j=0;j<nwaypoints;j++)
+      {
+       if(waypoints[i]==waypoints[j])
+          scores[i*nwaypoints+j]=0;
+       else if(!begin || !ends[j])
+          scores[i*nwaypoints+j]=INF_SCORE;
+       else
+          scores[i*nwaypoints+j]=JoinScore(begin,middle,ends[j]);
+      }
+
+    if(middle)
+       FreeResultsList(middle);
+
+    if(begin)
+       FreeResultsList(begin);
+
+    if(!option_quiet)
+       printf_middle("Routing: Waypoints checked = %d/%d",i+1,nwaypoints);
+   }
+
+ for(j=0;j<nwaypoints;j++)
+    if(ends[j])
+       FreeResultsList(ends[j]);
+
+ free(ends);
+
+ if(!option_quiet)
+    printf_last("Routing: Waypoints checked = %d/%d",nwaypoints,nwaypoints);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the scores of the routes from the start to all super-nodes until the ends of all of the
+  routes to a set of finish points have been reached with the best possible score.
+
+  Results *FindSuperRouteScores Returns a set of results (only the scores are useful, not the routes).
+
+  Nodes *nodes The set of nodes to use.
+
+  Segments *segments The set of segments to use.
+
+  Ways *ways The set of ways to use.
+
+  Relations *relations The set of relations to use.
+
+  Profile *profile The profile containing the transport type, speeds and allowed highways.
+
+  Results *begin The initial portion of the routes.
+
+  Results **ends The final portions of the routes (some may be NULL - ignore them).
+
+  int nends The number of final portions of the routes.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static Results *FindSuperRouteScores(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,Results *begin,Results **ends,int nends)
+{
+ Results *results;
+ Queue   *queue;
+ Result  *result1,*result2,*result3;
+ int     npopped=0;
+
+ /* Calculate the scores of the super-segments affected by the overlay (the first time only) */
+
+ CalculateOverlayScores(nodes,segments,ways,relations,profile);
+
+ /* Create the list of results and insert the first node into the queue */
+
+ results=NewResultsList(65536);
+
+ results->start_node=begin->start_node;
+ results->prev_segment=begin->prev_segment;
+
+ result1=InsertResult(results,results->start_node,results->prev_segment);
+
+ queue=NewQueueList();
+
+ /* Insert the finish points of the beginning part of the path into the queue,
+    translating the segments into super-segments. */
+
+ result3=FirstResult(begin);
+
+ while(result3)
+   {
+    if((results->start_node!=result3->node || results->prev_segment!=result3->segment) &&
+       !IsFakeNode(result3->node) && IsSuperNode(LookupNode(nodes,result3->node,1)))
+      {
+       index_t superseg=FindSuperSegment(nodes,segments,ways,relations,profile,result3->node,result3->segment);
+
+       result2=FindResult(results,result3->node,superseg);
+
+       if(!result2)
+         {
+          result2=InsertResult(results,result3->node,superseg);
+          result2->prev=result1;
+
+          result2->score=result3->score;
+          result2->sortby=result3->score;
+
+          InsertInQueue(queue,result2);
+         }
+       else if(result3->score<result2->score)
+         {
+          result2->score=result3->score;
+          result2->sortby=result3->score;
+
+          InsertInQueue(queue,result2);
+         }
+      }
+
+    result3=NextResult(begin,result3);
+   }
+
+ if(begin->number==1)
+    InsertInQueue(queue,result1);
+
+ /* Loop across all nodes in the queue */
+
+ while((result1=PopFromQueue(queue)))
+   {
+    index_t node1,seg1;
+    Segment *segment;
+    index_t turnrelation=NO_RELATION;
+
+    /* stop when no route to any finish point can be improved */
+    if(!(++npopped%1024))
+      {
+       int i;
+
+       for(i=0;i<nends;i++)
+          if(ends[i] && JoinScore(begin,results,ends[i])>result1->score)
+             break;
+
+       if(i==nends)
+          break;
+      }
+
+    node1=result1->node;
+    seg1=result1->segment;
+
+    /* lookup if a turn restriction applies */
+    if(profile->turns && IsTurnRestrictedNode(LookupNode(nodes,node1,1))) /* node1 cannot be a fake node (must be a super-node) */
+       turnrelation=FindFirstTurnRelation2(relations,node1,seg1);
+
+    /* Loop across all segments */
+
+    segment=FirstSegment(segments,nodes,node1,1); /* node1 cannot be a fake node (must be a super-node) */
+
+    while(segment)
+      {
+       Way *way;
+       Node *node;
+       index_t node2,seg2;
+       score_t segment_pref,segment_score,cumulative_score;
+       int i;
+
+       /* must be a super segment */
+       if(!IsSuperSegment(segment))
+          goto endloop;
+
+       /* must obey one-way restrictions (unless profile allows) */
+       if(profile->oneway && IsOnewayTo(segment,node1))
+          goto endloop;
+
+       node2=OtherNode(segment,node1);
+
+       seg2=IndexSegment(segments,segment); /* node2 cannot be a fake node (must be a super-node) */
+
+       /* must not perform U-turn */
+       if(seg1==seg2) /* No fake segments, applies to all profiles */
+          goto endloop;
+
+       /* must obey turn relations */
+       if(turnrelation!=NO_RELATION && !IsTurnAllowed(relations,turnrelation,node1,seg1,seg2,profile->allow))
+          goto endloop;
+
+       way=LookupWay(ways,segment->way,1);
+
+       /* transport must be allowed on the highway */
+       if(!(way->allow&profile->allow))
+          goto endloop;
+
+       /* must obey weight restriction (if exists) */
+       if(way->weight && way->weight<profile->weight)
+          goto endloop;
+
+       /* must obey height/width/length restriction (if exists) */
+       if((way->height && way->height<profile->height) ||
+          (way->width  && way->width <profile->width ) ||
+          (way->length && way->length<profile->length))
+          goto endloop;
+
+       segment_pref=profile->highway[HIGHWAY(way->type)];
+
+       for(i=1;i<Property_Count;i++)
+          if(ways->file.props & PROPERTIES(i))
+            {
+             if(way->props & PROPERTIES(i))
+                segment_pref*=profile->props_yes[i];
+             else
+                segment_pref*=profile->props_no[i];
+            }
+
+       /* profile preferences must allow this highway */
+       if(segment_pref==0)
+          goto endloop;
+
+       node=LookupNode(nodes,node2,2); /* node2 cannot be a fake node (must be a super-node) */
+
+       /* mode of transport must be allowed through node2 */
+       if(!(node->allow&profile->allow))
+          goto endloop;
+
+       segment_score=SegmentScore(segments,segment,seg2,node1,way,profile,segment_pref);
+
+       /* must not be closed by the overlay */
+       if(segment_score==INF_SCORE)
+          goto endloop;
+
+       cumulative_score=result1->score+segment_score;
+
+       result2=FindResult(results,node2,seg2);
+
+       if(!result2) /* New end node/segment pair */
+         {
+          result2=InsertResult(results,node2,seg2);
+          result2->prev=result1;
+          result2->score=cumulative_score;
+          result2->sortby=cumulative_score;
+
+          InsertInQueue(queue,result2);
+         }
+       else if(cumulative_score<result2->score) /* New end node/segment pair is better */
+         {
+          result2->prev=result1;
+          result2->score=cumulative_score;
+          result2->sortby=cumulative_score;
+
+          InsertInQueue(queue,result2);
+         }
+
+      endloop:
+
+       segment=NextSegment(segments,segment,node1); /* node1 cannot be a fake node (must be a super-node) */
+      }
+   }
+
+ FreeQueueList(queue);
+
+ return(results);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the best score for a route made by joining the start and middle of a route to the end of a route.
+
+  score_t JoinScore Returns the score of the best route (or INF_SCORE if there is none).
+
+  Results *begin The initial portion of the route.
+
+  Results *middle The super-node portion of the route (may be NULL).
+
+  Results *end The final portion of the route.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static score_t JoinScore(Results *begin,Results *middle,Results *end)
+{
+ Result *result1,*result2;
+ score_t score=INF_SCORE;
+
+ result2=FirstResult(end);
+
+ while(result2)
+   {
+    if((result1=FindResult(begin,result2->node,result2->segment)) && (result1->score+result2->score)<score)
+       score=result1->score+result2->score;
+
+    if(middle && (result1=FindResult(middle,result2->node,result2->segment)) && (result1->score+result2->score)<score)
+       score=result1->score+result2->score;
+
+    result2=NextResult(end,result2);
+   }
+
+ return(score);
+}
+
+
+/*+ The score of the route between the waypoints at two positions in the current order. +*/
+#define SCORE(aa,bb) scores[order[aa]*nwaypoints+order[bb]]
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Choose the order in which to visit a set of waypoints to give the best total score (the first waypoint
+  is always kept first and optionally the last one is kept last). The order is found using the nearest
+  neighbour and then improved by reversing parts of it (2-opt) and moving short chains of waypoints (Or-opt).
+
+  score_t *scores The scores of the routes between the waypoints (nwaypoints x nwaypoints).
+
+  int nwaypoints The number of waypoints.
+
+  int fixed_finish Set to true if the last waypoint must be kept last.
+
+  int *order Returns the order in which to visit the waypoints.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void OptimiseWaypointOrder(score_t *scores,int nwaypoints,int fixed_finish,int *order)
+{
+ int *temp;
+ int i,j,k,last,improved,npasses=0;
+
+ /* Initial order from nearest neighbours */
+
+ for(i=0;i<nwaypoints;i++)
+    order[i]=i;
+
+ last=nwaypoints-1;
+
+ if(fixed_finish)
+    last--;
+
+ for(i=1;i<=last;i++)
+   {
+    int best=i;
+
+    for(j=i+1;j<=last;j++)
+       if(SCORE(i-1,j)<SCORE(i-1,best))
+          best=j;
+
+    k=order[i];
+    order[i]=order[best];
+    order[best]=k;
+   }
+
+ temp=(int*)malloc(nwaypoints*sizeof(int));
+
+ assert(temp); /* Check malloc() worked */
+
+ /* Improve the order until no more improvements can be found */
+
+ do
+   {
+    improved=0;
+
+    /* Reverse parts of the route (2-opt), the scores in each direction can be different */
+
+    for(i=1;i<last;i++)
+      {
+       score_t forward=0,reverse=0;
+
+       for(j=i+1;j<=last;j++)
+         {
+          score_t before,after;
+
+          forward+=SCORE(j-1,j);
+          reverse+=SCORE(j,j-1);
+
+          before=SCORE(i-1,i)+forward;
+          after =SCORE(i-1,j)+reverse;
+
+          if(j<nwaypoints-1)
+            {
+             before+=SCORE(j,j+1);
+             after +=SCORE(i,j+1);
+            }
+
+          if(after<before*0.9999)
+            {
+             for(k=0;k<=(j-i)/2;k++)
+               {
+                int swap=order[i+k];
+                order[i+k]=order[j-k];
+                order[j-k]=swap;
+               }
+
+             improved=1;
+             break;
+            }
+         }
+      }
+
+    /* Move chains of one, two or three waypoints to another place in the route (Or-opt) */
+
+    for(k=1;k<=3;k++)
+       for(i=1;i+k-1<=last;i++)
+         {
+          int e=i+k-1;             /* The last waypoint in the chain */
+          score_t removed;
+
+          removed=SCORE(i-1,i);
+
+          if(e<nwaypoints-1)
+             removed+=SCORE(e,e+1)-SCORE(i-1,e+1);
+
+          for(j=0;j<=last;j++)
+            {
+             score_t inserted;
+             int m,n=0,p;
+
+             if(j>=i-1 && j<=e)
+                continue;
+
+             inserted=SCORE(j,i);
+
+             if(j<nwaypoints-1)
+                inserted+=SCORE(e,j+1)-SCORE(j,j+1);
+
+             if(inserted>=removed*0.9999)
+                continue;
+
+             /* Move the chain to follow waypoint j */
+
+             for(m=0;m<nwaypoints;m++)
+               {
+                if(m>=i && m<=e)
+                   continue;
+
+                temp[n++]=order[m];
+
+                if(m==j)
+                   for(p=i;p<=e;p++)
+                      temp[n++]=order[p];
+               }
+
+             for(m=0;m<nwaypoints;m++)
+                order[m]=temp[m];
+
+             improved=1;
+             break;
+            }
+         }
+   }
+ while(improved && ++npasses<MAX_ORDER_PASSES);
+
+ free(temp);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Calculate the scores of the super-segments that are affected by the overlay.
+
+  Nodes *nodes The set of nodes to use.
+
+  Segments *segments The set of segments to use.
+
+  Ways *ways The set of ways to use.
+
+  Relations *relations The set of relations to use.
+
+  Profile *profile The profile containing the transport type, speeds and allowed highways.
+
+  The super-segments were created from the unmodified segments so the score of each affected
+  one is replaced by the score of the best route between its two super-nodes (in each direction).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void CalculateOverlayScores(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile)
+{
+ Overlay *overlay=segments->overlay;
+ index_t i;
+
+ if(!overlay || overlay->superscores || overlay->file.snumber==0)
+    return;
+
+ overlay->superscores=(score_t*)malloc(2*overlay->file.snumber*sizeof(score_t));
+
+ assert(overlay->superscores); /* Check malloc() worked */
+
+ for(i=0;i<overlay->file.snumber;i++)
+   {
+    Segment *segment=LookupSegment(segments,overlay->supersegments[i],1);
+    index_t node1=segment->node1,node2=segment->node2;
+    int j;
+
+    for(j=0;j<2;j++)
+      {
+       Results *results=NULL;
+
+       if(node1!=node2)
+          results=FindNormalRoute(nodes,segments,ways,relations,profile,j?node2:node1,NO_SEGMENT,j?node1:node2);
+
+       if(results)
+         {
+          overlay->superscores[2*i+j]=FindResult(results,results->finish_node,results->last_segment)->score;
+
+          FreeResultsList(results);
+         }
+       else
+          overlay->superscores[2*i+j]=INF_SCORE;
+      }
+   }
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Calculate the score for travelling along a segment, taking into account the overlay (if there is one).
+
+  score_t SegmentScore Returns the score or INF_SCORE if the segment is closed by the overlay.
+
+  Segments *segments The set of segments to use.
+
+  Segment *segment The segment (may be a fake segment).
+
+  index_t index The index of the segment (the real segment if it is a fake one).
+
+  index_t node1 The node that the segment is travelled from.
+
+  Way *way The way that the segment belongs to.
+
+  Profile *profile The profile containing the transport type, speeds and allowed highways.
+
+  score_t segment_pref The preference for the segment calculated from the profile.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static inline score_t SegmentScore(Segments *segments,Segment *segment,index_t index,index_t node1,Way *way,Profile *profile,score_t segment_pref)
+{
+ Overlay *overlay=segments->overlay;
+
+ if(overlay)
+   {
+    if(IsNormalSegment(segment))
+      {
+       SegmentOverride *override=FindSegmentOverride(overlay,index);
+
+       if(override)
+         {
+          if(IsClosedOverride(overlay,override))
+             return(INF_SCORE);
+
+          if(option_quickest==0)
+             return((score_t)DISTANCE(segment->distance)/segment_pref);
+          else
+             return((score_t)OverrideDuration(overlay,override,segment,way,profile)/segment_pref);
+         }
+      }
+    else /* a super-segment that is not also a normal segment */
+      {
+       index_t position=FindOverlaySuperSegment(overlay,index);
+
+       if(position!=NO_SEGMENT)
+         {
+          assert(overlay->superscores); /* Bugs elsewhere can lead to using them before they are calculated. */
+
+          return(overlay->superscores[2*position+(segment->node1==node1?0:1)]);
+         }
+      }
+   }
+
+ if(option_quickest==0)
+    return((score_t)DISTANCE(segment->distance)/segment_pref);
+ else
+    return((score_t)Duration(segment,way,profile)/segment_pref);
+}
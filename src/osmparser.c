@@ -1,5 +1,5 @@
 /***************************************
- OSM XML file parser (either JOSM or planet)
+ OSM XML and PBF file parser (either JOSM or planet)
 
  Part of the Routino routing software.
  ******************/ /******************
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include "typesx.h"
 #include "functionsx.h"
@@ -33,10 +34,15 @@
 #include "segmentsx.h"
 #include "waysx.h"
 #include "relationsx.h"
+#include "changesx.h"
+#include "areax.h"
 
 #include "xmlparse.h"
+#include "pbfparse.h"
+#include "osmxmlparse.h"
 #include "tagging.h"
 
+#include "files.h"
 #include "logging.h"
 
 
@@ -49,6 +55,100 @@
 #define ISFALSE(xx) (!strcmp(xx,"false") || !strcmp(xx,"no") || !strcmp(xx,"0"))
 
 
+/* Constants */
+
+/*+ The types of item that are stored after parsing and tagging. +*/
+#define ITEM_NODE     1
+#define ITEM_WAY      2
+#define ITEM_RELATION 3
+
+/*+ The roles of relation members that are used. +*/
+#define ROLE_OTHER 0
+#define ROLE_VIA   1
+#define ROLE_FROM  2
+#define ROLE_TO    3
+
+
+/* Local types */
+
+/*+ A node, way or relation that has been parsed and had the tagging rules applied. +*/
+typedef struct _parseditem
+{
+ int      type;                 /*+ The type of item. +*/
+ int      change;               /*+ The type of change (when parsing a change file). +*/
+ int64_t  id;                   /*+ The id of the item. +*/
+ double   latitude;             /*+ The latitude of a node. +*/
+ double   longitude;            /*+ The longitude of a node. +*/
+ int      nrefs;                /*+ The number of way nodes or relation members. +*/
+ TagList *tags;                 /*+ The tags after applying the tagging rules. +*/
+ char    *errors;               /*+ The error log messages from applying the tagging rules (or NULL). +*/
+}
+ parseditem;
+
+/*+ A block of the file that is parsed by one thread and the items that were found in it. +*/
+typedef struct _parsedblock
+{
+ pbfblock    *pbf;              /*+ The block of a PBF file. +*/
+ osmxmlchunk *xml;              /*+ The chunk of an XML file. +*/
+
+ int          retval;           /*+ The result of parsing the block. +*/
+ unsigned long long position;   /*+ The position in the file at the end of the block. +*/
+
+ parseditem  *items;            /*+ The items found in the block. +*/
+ int          nitems;           /*+ The number of items. +*/
+ int          items_size;       /*+ The allocated number of items. +*/
+
+ int64_t     *refs;             /*+ The way nodes and relation members of all of the items. +*/
+ int         *types;            /*+ The relation member types. +*/
+ char        *roles;            /*+ The relation member roles. +*/
+ int          nrefs;            /*+ The number of way nodes and relation members. +*/
+ int          refs_size;        /*+ The allocated number of way nodes and relation members. +*/
+
+ TagList     *input;            /*+ The tags of the item being stored (re-used for each item). +*/
+}
+ parsedblock;
+
+/*+ A list of node ids that is searched after sorting it. +*/
+typedef struct _nodeidlist
+{
+ node_t   *ids;                 /*+ The ids (in the order added until sorted). +*/
+ index_t   number;              /*+ The number of ids. +*/
+ index_t   size;                /*+ The allocated number of ids. +*/
+ int       sorted;              /*+ Set to true when the ids are sorted with no duplicates. +*/
+}
+ nodeidlist;
+
+/*+ A list of way ids that is searched after sorting it. +*/
+typedef struct _wayidlist
+{
+ way_t    *ids;                 /*+ The ids (in the order added until sorted). +*/
+ index_t   number;              /*+ The number of ids. +*/
+ index_t   size;                /*+ The allocated number of ids. +*/
+ int       sorted;              /*+ Set to true when the ids are sorted with no duplicates. +*/
+}
+ wayidlist;
+
+/*+ A node that is outside of the clipping area (stored until it is known if it is needed). +*/
+typedef struct _outsidenode
+{
+ node_t       id;               /*+ The id of the node. +*/
+ transports_t allow;            /*+ The types of transport that are allowed through the node. +*/
+ uint16_t     flags;            /*+ The node flags. +*/
+ double       latitude;         /*+ The latitude of the node (radians). +*/
+ double       longitude;        /*+ The longitude of the node (radians). +*/
+}
+ outsidenode;
+
+
+/* Global variables */
+
+/*+ The number of threads to use for parsing. +*/
+extern int option_parse_threads;
+
+/*+ The name of the temporary directory. +*/
+extern char *option_tmpdirname;
+
+
 /* Local variables */
 
 static index_t nnodes=0;
@@ -70,6 +170,46 @@ static way_t       relation_from=NO_WAY_ID;
 static way_t       relation_to=NO_WAY_ID;
 static node_t      relation_via=NO_NODE_ID;
 
+static int parsing_changes=0;
+
+/*+ The area that the data is clipped to (or NULL). +*/
+static AreaX *clip_area=NULL;
+
+/*+ The file that the nodes outside of the area are stored in until the ways have been parsed. +*/
+static int   clip_fd=-1;
+static char *clip_filename=NULL;
+
+/*+ The nodes inside the area, the ways that are kept and the nodes outside of the area that are used by them. +*/
+static nodeidlist clip_nodes,clip_needed;
+static wayidlist  clip_ways;
+
+static const char *position_name;
+static unsigned long long (*position_function)(void);
+
+/*+ The block that is used to store each item when parsing in a single thread. +*/
+static parsedblock serial_block;
+
+/*+ The position in the file at the end of the last block that was processed when parsing in several threads. +*/
+static unsigned long long parallel_position=0;
+
+/*+ The blocks that are being parsed in several threads (used as a ring). +*/
+static parsedblock *parallel_blocks=NULL;
+static int          parallel_nblocks=0;
+
+/*+ The number of blocks that have been read, started parsing and finished parsing. +*/
+static unsigned long long parallel_nread=0,parallel_nstarted=0,parallel_nparsed=0;
+
+/*+ Set to true for each block when it has been parsed. +*/
+static int *parallel_parsed=NULL;
+
+/*+ Set to true when the threads are to stop. +*/
+static int parallel_finished=0;
+
+/*+ The mutex and condition variables for the blocks being parsed in several threads. +*/
+static pthread_mutex_t parallel_mutex=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  parallel_read_cond=PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  parallel_parsed_cond=PTHREAD_COND_INITIALIZER;
+
 static NodesX     *nodes;
 static SegmentsX  *segments;
 static WaysX      *ways;
@@ -82,6 +222,25 @@ static void process_node_tags(TagList *tags,node_t id,double latitude,double lon
 static void process_way_tags(TagList *tags,way_t id);
 static void process_relation_tags(TagList *tags,relation_t id);
 
+static parseditem *store_item(parsedblock *block,int type,int64_t id,int ntags,char **keys,char **values);
+static void process_items(parsedblock *block);
+
+static int parse_parallel(FILE *file,osmxmlfile *xmlfile);
+static void *parse_thread(void *arg);
+static unsigned long long parallel_position_function(void);
+
+static void start_clipping(AreaX *area);
+static int clip_way(way_t id);
+static int clip_relation(void);
+
+static void append_node_id(nodeidlist *list,node_t id);
+static int find_node_id(nodeidlist *list,node_t id);
+static int sort_by_node_id(const node_t *a,const node_t *b);
+
+static void append_way_id(wayidlist *list,way_t id);
+static int find_way_id(wayidlist *list,way_t id);
+static int sort_by_way_id(const way_t *a,const way_t *b);
+
 static double parse_speed(way_t id,const char *k,const char *v);
 static double parse_weight(way_t id,const char *k,const char *v);
 static double parse_length(way_t id,const char *k,const char *v);
@@ -101,6 +260,13 @@ static int tagType_function(const char *_tag_,int _type_,const char *k,const cha
 //static int boundsType_function(const char *_tag_,int _type_);
 
 
+/* The item processing function prototypes (for PBF files and the fast XML parser) */
+
+static int item_node_function(void *data,int64_t id,double latitude,double longitude,int ntags,char **keys,char **values);
+static int item_way_function(void *data,int64_t id,int nrefs,int64_t *refs,int ntags,char **keys,char **values);
+static int item_relation_function(void *data,int64_t id,int nmembers,int *types,int64_t *refs,char **roles,int ntags,char **keys,char **values);
+
+
 /* The XML tag definitions */
 
 /*+ The boundsType type tag. +*/
@@ -178,6 +344,12 @@ static xmltag xmlDeclaration_tag=
 static xmltag *xml_toplevel_tags[]={&xmlDeclaration_tag,&osmType_tag,NULL};
 
 
+/* The item definitions */
+
+/*+ The functions to call for the items in a PBF file or from the fast XML parser. +*/
+static pbfcallbacks item_callbacks={item_node_function,item_way_function,item_relation_function};
+
+
 /* The XML tag processing functions */
 
 
@@ -567,10 +739,13 @@ static int relationType_function(const char *_tag_,int _type_,const char *id)
   WaysX *OSMWays The data structure of ways to fill in.
 
   RelationsX *OSMRelations The data structure of relations to fill in.
+
+  AreaX *area The area to clip the data to (or NULL for all of the data).
   ++++++++++++++++++++++++++++++++++++++*/
 
-int ParseOSM(FILE *file,NodesX *OSMNodes,SegmentsX *OSMSegments,WaysX *OSMWays,RelationsX *OSMRelations)
+int ParseOSM(FILE *file,NodesX *OSMNodes,SegmentsX *OSMSegments,WaysX *OSMWays,RelationsX *OSMRelations,AreaX *area)
 {
+ osmxmlfile *xmlfile=NULL;
  int retval;
 
  /* Copy the function parameters and initialise the variables. */
@@ -580,6 +755,9 @@ int ParseOSM(FILE *file,NodesX *OSMNodes,SegmentsX *OSMSegments,WaysX *OSMWays,R
  ways=OSMWays;
  relations=OSMRelations;
 
+ if(area)
+    start_clipping(area);
+
  way_nodes=(node_t*)malloc(256*sizeof(node_t));
 
  relation_nodes    =(node_t    *)malloc(256*sizeof(node_t));
@@ -592,9 +770,37 @@ int ParseOSM(FILE *file,NodesX *OSMNodes,SegmentsX *OSMSegments,WaysX *OSMWays,R
 
  printf_first("Reading: Lines=0 Nodes=0 Ways=0 Relations=0");
 
- retval=ParseXML(file,xml_toplevel_tags,XMLPARSE_UNKNOWN_ATTR_IGNORE);
+ /* Use the fast parser on a memory mapped file if possible (in several threads if
+    requested), otherwise the generic XML parser */
+
+ position_name="Lines";
+
+ if(option_parse_threads>1)
+    xmlfile=OpenOSMXMLFile(file);
+
+ if(xmlfile)
+   {
+    position_function=parallel_position_function;
+
+    retval=parse_parallel(NULL,xmlfile);
+
+    CloseOSMXMLFile(xmlfile);
+   }
+ else
+   {
+    position_function=ParseOSMXML_LineNumber;
+
+    retval=ParseOSMXML(file,&item_callbacks);
+   }
+
+ if(retval<0)
+   {
+    retval=ParseXML(file,xml_toplevel_tags,XMLPARSE_UNKNOWN_ATTR_IGNORE);
+
+    position_function=ParseXML_LineNumber;
+   }
 
- printf_last("Read: Lines=%llu Nodes=%"Pindex_t" Ways=%"Pindex_t" Relations=%"Pindex_t,ParseXML_LineNumber(),nnodes,nways,nrelations);
+ printf_last("Read: Lines=%llu Nodes=%"Pindex_t" Ways=%"Pindex_t" Relations=%"Pindex_t,position_function(),nnodes,nways,nrelations);
 
  free(way_nodes);
 
@@ -607,189 +813,1051 @@ int ParseOSM(FILE *file,NodesX *OSMNodes,SegmentsX *OSMSegments,WaysX *OSMWays,R
 
 
 /*++++++++++++++++++++++++++++++++++++++
-  Process the tags associated with a node.
+  Parse an OSM PBF file (from planet download).
 
-  TagList *tags The list of node tags.
+  int ParseOSMPBF Returns 0 if OK or something else in case of an error.
 
-  node_t id The id of the node.
+  FILE *file The file to read from.
 
-  double latitude The latitude of the node.
+  NodesX *OSMNodes The data structure of nodes to fill in.
 
-  double longitude The longitude of the node.
-  ++++++++++++++++++++++++++++++++++++++*/
+  SegmentsX *OSMSegments The data structure of segments to fill in.
 
-static void process_node_tags(TagList *tags,node_t id,double latitude,double longitude)
-{
- transports_t allow=Transports_ALL;
- uint16_t flags=0;
- int i;
+  WaysX *OSMWays The data structure of ways to fill in.
 
- /* Parse the tags */
+  RelationsX *OSMRelations The data structure of relations to fill in.
 
- for(i=0;i<tags->ntags;i++)
-   {
-    char *k=tags->k[i];
-    char *v=tags->v[i];
+  AreaX *area The area to clip the data to (or NULL for all of the data).
+  ++++++++++++++++++++++++++++++++++++++*/
 
-    switch(*k)
-      {
-      case 'b':
-       if(!strcmp(k,"bicycle"))
-         {
-          if(ISFALSE(v))
-             allow&=~Transports_Bicycle;
-          else if(!ISTRUE(v))
-             logerror("Node %"Pnode_t" has an unrecognised tag value 'bicycle' = '%s' (after tagging rules); using 'yes'.\n",id,v);
-         }
+int ParseOSMPBF(FILE *file,NodesX *OSMNodes,SegmentsX *OSMSegments,WaysX *OSMWays,RelationsX *OSMRelations,AreaX *area)
+{
+ int retval;
 
-       break;
+ /* Copy the function parameters and initialise the variables. */
 
-      case 'f':
-       if(!strcmp(k,"foot"))
-         {
-          if(ISFALSE(v))
-             allow&=~Transports_Foot;
-          else if(!ISTRUE(v))
-             logerror("Node %"Pnode_t" has an unrecognised tag value 'foot' = '%s' (after tagging rules); using 'yes'.\n",id,v);
-         }
+ nodes=OSMNodes;
+ segments=OSMSegments;
+ ways=OSMWays;
+ relations=OSMRelations;
 
-       break;
+ if(area)
+    start_clipping(area);
 
-      case 'g':
-       if(!strcmp(k,"goods"))
-         {
-          if(ISFALSE(v))
-             allow&=~Transports_Goods;
-          else if(!ISTRUE(v))
-             logerror("Node %"Pnode_t" has an unrecognised tag value 'goods' = '%s' (after tagging rules); using 'yes'.\n",id,v);
-         }
+ way_nodes=(node_t*)malloc(256*sizeof(node_t));
 
-       break;
+ relation_nodes    =(node_t    *)malloc(256*sizeof(node_t));
+ relation_ways     =(way_t     *)malloc(256*sizeof(way_t));
+ relation_relations=(relation_t*)malloc(256*sizeof(relation_t));
 
-      case 'h':
-       if(!strcmp(k,"highway"))
-          if(!strcmp(v,"mini_roundabout"))
-             flags|=NODE_MINIRNDBT;
+ /* Parse the file */
 
-       if(!strcmp(k,"horse"))
-         {
-          if(ISFALSE(v))
-             allow&=~Transports_Horse;
-          else if(!ISTRUE(v))
-             logerror("Node %"Pnode_t" has an unrecognised tag value 'horse' = '%s' (after tagging rules); using 'yes'.\n",id,v);
-         }
+ nnodes=0,nways=0,nrelations=0;
 
-       if(!strcmp(k,"hgv"))
-         {
-          if(ISFALSE(v))
-             allow&=~Transports_HGV;
-          else if(!ISTRUE(v))
-             logerror("Node %"Pnode_t" has an unrecognised tag value 'hgv' = '%s' (after tagging rules); using 'yes'.\n",id,v);
-         }
+ printf_first("Reading: Blocks=0 Nodes=0 Ways=0 Relations=0");
 
-       break;
+ position_name="Blocks";
 
-      case 'm':
-       if(!strcmp(k,"moped"))
-         {
-          if(ISFALSE(v))
-             allow&=~Transports_Moped;
-          else if(!ISTRUE(v))
-             logerror("Node %"Pnode_t" has an unrecognised tag value 'moped' = '%s' (after tagging rules); using 'yes'.\n",id,v);
-         }
+ if(option_parse_threads>1)
+   {
+    position_function=parallel_position_function;
 
-       if(!strcmp(k,"motorbike"))
-         {
-          if(ISFALSE(v))
-             allow&=~Transports_Motorbike;
-          else if(!ISTRUE(v))
-             logerror("Node %"Pnode_t" has an unrecognised tag value 'motorbike' = '%s' (after tagging rules); using 'yes'.\n",id,v);
-         }
+    retval=parse_parallel(file,NULL);
+   }
+ else
+   {
+    position_function=ParsePBF_BlockNumber;
 
-       if(!strcmp(k,"motorcar"))
-         {
-          if(ISFALSE(v))
-             allow&=~Transports_Motorcar;
-          else if(!ISTRUE(v))
-             logerror("Node %"Pnode_t" has an unrecognised tag value 'motorcar' = '%s' (after tagging rules); using 'yes'.\n",id,v);
-         }
+    retval=ParsePBF(file,&item_callbacks);
+   }
 
-       break;
+ printf_last("Read: Blocks=%llu Nodes=%"Pindex_t" Ways=%"Pindex_t" Relations=%"Pindex_t,position_function(),nnodes,nways,nrelations);
 
-      case 'p':
-       if(!strcmp(k,"psv"))
-         {
-          if(ISFALSE(v))
-             allow&=~Transports_PSV;
-          else if(!ISTRUE(v))
-             logerror("Node %"Pnode_t" has an unrecognised tag value 'psv' = '%s' (after tagging rules); using 'yes'.\n",id,v);
-         }
+ free(way_nodes);
 
-       break;
+ free(relation_nodes);
+ free(relation_ways);
+ free(relation_relations);
 
-      case 'w':
-       if(!strcmp(k,"wheelchair"))
-         {
-          if(ISFALSE(v))
-             allow&=~Transports_Wheelchair;
-          else if(!ISTRUE(v))
-             logerror("Node %"Pnode_t" has an unrecognised tag value 'wheelchair' = '%s' (after tagging rules); using 'yes'.\n",id,v);
-         }
+ return(retval);
+}
 
-       break;
 
-      default:
-       logerror("Node %"Pnode_t" has an unrecognised tag '%s' = '%s' (after tagging rules); ignoring it.\n",id,k,v);
-      }
-   }
+/*++++++++++++++++++++++++++++++++++++++
+  Parse an OSM XML change file (from planet replication diffs).  The new
+  versions of the created and modified items are appended to the data and all
+  of the changed items are recorded so that the old versions can be removed.
 
- /* Create the node */
+  int ParseOSMChanges Returns 0 if OK or something else in case of an error.
 
- AppendNode(nodes,id,degrees_to_radians(latitude),degrees_to_radians(longitude),allow,flags);
-}
+  FILE *file The file to read from.
 
+  NodesX *OSMNodes The data structure of nodes to fill in.
 
-/*++++++++++++++++++++++++++++++++++++++
-  Process the tags associated with a way.
+  SegmentsX *OSMSegments The data structure of segments to fill in.
 
-  TagList *tags The list of way tags.
+  WaysX *OSMWays The data structure of ways to fill in.
 
-  way_t id The id of the way.
+  RelationsX *OSMRelations The data structure of relations to fill in.
   ++++++++++++++++++++++++++++++++++++++*/
 
-static void process_way_tags(TagList *tags,way_t id)
+int ParseOSMChanges(FILE *file,NodesX *OSMNodes,SegmentsX *OSMSegments,WaysX *OSMWays,RelationsX *OSMRelations)
 {
- Way   way={0};
- int   oneway=0;
- char *name=NULL,*ref=NULL,*refname=NULL;
- int i;
+ int retval;
 
- /* Parse the tags - just look for highway */
+ /* Copy the function parameters and initialise the variables. */
 
- for(i=0;i<tags->ntags;i++)
-   {
-    char *k=tags->k[i];
-    char *v=tags->v[i];
+ nodes=OSMNodes;
+ segments=OSMSegments;
+ ways=OSMWays;
+ relations=OSMRelations;
 
-    if(!strcmp(k,"highway"))
-      {
-       way.type=HighwayType(v);
+ if(!nodes->changes)
+    nodes->changes=NewChangeList();
+ if(!ways->changes)
+    ways->changes=NewChangeList();
+ if(!relations->changes)
+    relations->changes=NewChangeList();
 
-       if(way.type==Way_Count)
-          logerror("Way %"Pway_t" has an unrecognised highway type '%s' (after tagging rules); ignoring it.\n",id,v);
-      }
-   }
+ way_nodes=(node_t*)malloc(256*sizeof(node_t));
 
- /* Don't continue if this is not a highway (bypass error logging) */
+ relation_nodes    =(node_t    *)malloc(256*sizeof(node_t));
+ relation_ways     =(way_t     *)malloc(256*sizeof(way_t));
+ relation_relations=(relation_t*)malloc(256*sizeof(relation_t));
 
- if(way.type==0 || way.type==Way_Count)
-    return;
+ /* Parse the file */
 
- /* Parse the tags - look for the others */
+ nnodes=0,nways=0,nrelations=0;
 
- for(i=0;i<tags->ntags;i++)
-   {
-    char *k=tags->k[i];
+ printf_first("Reading: Lines=0 Nodes=0 Ways=0 Relations=0");
+
+ /* Only the fast parser on a memory mapped file knows about the changes (and
+    only in a single thread since a chunk does not know which change it is in) */
+
+ position_name="Lines";
+ position_function=ParseOSMXML_LineNumber;
+
+ parsing_changes=1;
+
+ retval=ParseOSMXML(file,&item_callbacks);
+
+ parsing_changes=0;
+
+ if(retval<0)
+   {
+    fprintf(stderr,"Cannot memory map the change file (it must be an uncompressed file and not a pipe).\n");
+    retval=1;
+   }
+
+ printf_last("Read: Lines=%llu Nodes=%"Pindex_t" Ways=%"Pindex_t" Relations=%"Pindex_t,position_function(),nnodes,nways,nrelations);
+
+ free(way_nodes);
+
+ free(relation_nodes);
+ free(relation_ways);
+ free(relation_relations);
+
+ return(retval);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Add the nodes outside of the clipping area that are used by the ways that cross
+  the edge of it (once all of the files have been parsed) and free the lists used
+  for clipping.
+
+  NodesX *OSMNodes The data structure of nodes to add them to.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void AddBoundaryNodes(NodesX *OSMNodes)
+{
+ outsidenode node;
+ index_t total=0,added=0;
+
+ if(!clip_area)
+    return;
+
+ /* Print the start message */
+
+ printf_first("Adding Boundary Nodes: Nodes=0 Added=0");
+
+ /* Re-open the file of nodes outside of the area */
+
+ clip_fd=CloseFileBuffered(clip_fd);
+
+ clip_fd=ReOpenFileBuffered(clip_filename);
+
+ /* Add the nodes that are used by the ways that are kept */
+
+ while(!ReadFileBuffered(clip_fd,&node,sizeof(outsidenode)))
+   {
+    if(find_node_id(&clip_needed,node.id))
+      {
+       AppendNode(OSMNodes,node.id,node.latitude,node.longitude,node.allow,node.flags);
+
+       added++;
+      }
+
+    total++;
+
+    if(!(total%10000))
+       printf_middle("Adding Boundary Nodes: Nodes=%"Pindex_t" Added=%"Pindex_t,total,added);
+   }
+
+ /* Close and delete the file */
+
+ clip_fd=CloseFileBuffered(clip_fd);
+
+ DeleteFile(clip_filename);
+
+ free(clip_filename);
+ clip_filename=NULL;
+
+ /* Free the lists */
+
+ if(clip_nodes.ids)
+    free(clip_nodes.ids);
+ if(clip_ways.ids)
+    free(clip_ways.ids);
+ if(clip_needed.ids)
+    free(clip_needed.ids);
+
+ clip_nodes.ids=clip_ways.ids=clip_needed.ids=NULL;
+
+ clip_area=NULL;
+
+ /* Print the final message */
+
+ printf_last("Added Boundary Nodes: Nodes=%"Pindex_t" Added=%"Pindex_t" Removed=%"Pindex_t,total,added,total-added);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse a PBF file or a memory mapped XML file in several threads.  The main
+  thread reads the blocks (or splits the XML file into chunks), the other threads
+  parse them and apply the tagging rules and then the main thread processes the
+  items from each block in the same order as they are in the file.
+
+  int parse_parallel Returns 0 if OK or something else in case of an error.
+
+  FILE *file The PBF file to read from (or NULL).
+
+  osmxmlfile *xmlfile The mapped XML file to read from (or NULL).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int parse_parallel(FILE *file,osmxmlfile *xmlfile)
+{
+ pthread_t *threads;
+ int nthreads=option_parse_threads,nstarted=0;
+ int i,retval=0,eof=0;
+
+ parallel_nblocks=2*nthreads;
+
+ parallel_blocks=(parsedblock*)calloc(parallel_nblocks,sizeof(parsedblock));
+ parallel_parsed=(int*)calloc(parallel_nblocks,sizeof(int));
+
+ assert(parallel_blocks && parallel_parsed); /* Check calloc() worked */
+
+ for(i=0;i<parallel_nblocks;i++)
+   {
+    if(file)
+       parallel_blocks[i].pbf=NewPBFBlock();
+    else
+       parallel_blocks[i].xml=NewOSMXMLChunk();
+   }
+
+ parallel_nread=parallel_nstarted=parallel_nparsed=0;
+ parallel_finished=0;
+ parallel_position=0;
+
+ /* Start the threads */
+
+ threads=(pthread_t*)malloc(nthreads*sizeof(pthread_t));
+
+ assert(threads); /* Check malloc() worked */
+
+ for(i=0;i<nthreads;i++)
+    if(!pthread_create(&threads[nstarted],NULL,parse_thread,NULL))
+       nstarted++;
+
+ if(nstarted==0)
+   {
+    fprintf(stderr,"Error: Cannot create any threads to parse the file.\n");
+    exit(EXIT_FAILURE);
+   }
+
+ /* Read the blocks and process them in order once they have been parsed */
+
+ while(!retval)
+   {
+    parsedblock *block;
+
+    /* Fill all of the empty blocks */
+
+    while(!eof && (int)(parallel_nread-parallel_nparsed)<parallel_nblocks)
+      {
+       int result;
+
+       block=&parallel_blocks[parallel_nread%parallel_nblocks];
+
+       if(file)
+          result=ReadPBFBlock(file,block->pbf);
+       else
+          result=ReadOSMXMLChunk(xmlfile,block->xml);
+
+       if(result)
+         {
+          if(result>0)
+             retval=result;
+
+          eof=1;
+          break;
+         }
+
+       pthread_mutex_lock(&parallel_mutex);
+
+       parallel_nread++;
+
+       pthread_cond_signal(&parallel_read_cond);
+
+       pthread_mutex_unlock(&parallel_mutex);
+      }
+
+    if(retval || parallel_nparsed==parallel_nread)
+       break;
+
+    /* Wait for the oldest block to be parsed and process the items in it */
+
+    block=&parallel_blocks[parallel_nparsed%parallel_nblocks];
+
+    pthread_mutex_lock(&parallel_mutex);
+
+    while(!parallel_parsed[parallel_nparsed%parallel_nblocks])
+       pthread_cond_wait(&parallel_parsed_cond,&parallel_mutex);
+
+    parallel_parsed[parallel_nparsed%parallel_nblocks]=0;
+
+    pthread_mutex_unlock(&parallel_mutex);
+
+    parallel_position=block->position;
+
+    process_items(block);
+
+    retval=block->retval;
+
+    parallel_nparsed++;
+   }
+
+ /* Stop the threads */
+
+ pthread_mutex_lock(&parallel_mutex);
+
+ parallel_finished=1;
+
+ pthread_cond_broadcast(&parallel_read_cond);
+
+ pthread_mutex_unlock(&parallel_mutex);
+
+ for(i=0;i<nstarted;i++)
+    pthread_join(threads[i],NULL);
+
+ free(threads);
+
+ /* Tidy up (any items left in the blocks after an error are discarded) */
+
+ for(i=0;i<parallel_nblocks;i++)
+   {
+    parsedblock *block=&parallel_blocks[i];
+    int j;
+
+    for(j=0;j<block->nitems;j++)
+      {
+       DeleteTagList(block->items[j].tags);
+
+       if(block->items[j].errors)
+          free(block->items[j].errors);
+      }
+
+    if(block->pbf)
+       FreePBFBlock(block->pbf);
+    if(block->xml)
+       FreeOSMXMLChunk(block->xml);
+
+    free(block->items);
+    free(block->refs);
+    free(block->types);
+    free(block->roles);
+
+    if(block->input)
+       DeleteTagList(block->input);
+   }
+
+ free(parallel_blocks);
+ free(parallel_parsed);
+
+ return(retval);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  The function that is run in each thread to parse the blocks.
+
+  void *parse_thread Returns NULL.
+
+  void *arg Not used.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void *parse_thread(void *arg)
+{
+ start_errorlog_buffer();
+
+ pthread_mutex_lock(&parallel_mutex);
+
+ while(1)
+   {
+    parsedblock *block;
+
+    while(!parallel_finished && parallel_nstarted==parallel_nread)
+       pthread_cond_wait(&parallel_read_cond,&parallel_mutex);
+
+    if(parallel_finished)
+       break;
+
+    block=&parallel_blocks[parallel_nstarted%parallel_nblocks];
+
+    parallel_nstarted++;
+
+    pthread_mutex_unlock(&parallel_mutex);
+
+    if(block->pbf)
+      {
+       block->retval=ParsePBFBlock(block->pbf,&item_callbacks,block);
+       block->position=PBFBlockNumber(block->pbf);
+      }
+    else
+      {
+       block->retval=ParseOSMXMLChunk(block->xml,&item_callbacks,block);
+       block->position=OSMXMLChunkLineNumber(block->xml);
+      }
+
+    pthread_mutex_lock(&parallel_mutex);
+
+    parallel_parsed[block-parallel_blocks]=1;
+
+    pthread_cond_signal(&parallel_parsed_cond);
+   }
+
+ pthread_mutex_unlock(&parallel_mutex);
+
+ stop_errorlog_buffer();
+
+ return(NULL);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Return the position in the file when parsing in several threads.
+
+  unsigned long long parallel_position_function Returns the position at the end of the last block that was processed.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static unsigned long long parallel_position_function(void)
+{
+ return(parallel_position);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  The function that is called for each node in a PBF file or from the fast XML parser.
+
+  int item_node_function Returns 0 if no error occured or something else otherwise.
+
+  void *data The block to store the node in (or NULL to process it immediately).
+
+  int64_t id The id of the node.
+
+  double latitude The latitude of the node.
+
+  double longitude The longitude of the node.
+
+  int ntags The number of tags.
+
+  char **keys The tag keys.
+
+  char **values The tag values.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int item_node_function(void *data,int64_t id,double latitude,double longitude,int ntags,char **keys,char **values)
+{
+ parsedblock *block=data?(parsedblock*)data:&serial_block;
+ parseditem *item=store_item(block,ITEM_NODE,id,ntags,keys,values);
+
+ item->latitude=latitude;
+ item->longitude=longitude;
+
+ if(!data)
+    process_items(block);
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  The function that is called for each way in a PBF file or from the fast XML parser.
+
+  int item_way_function Returns 0 if no error occured or something else otherwise.
+
+  void *data The block to store the way in (or NULL to process it immediately).
+
+  int64_t id The id of the way.
+
+  int nrefs The number of nodes in the way.
+
+  int64_t *refs The ids of the nodes in the way.
+
+  int ntags The number of tags.
+
+  char **keys The tag keys.
+
+  char **values The tag values.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int item_way_function(void *data,int64_t id,int nrefs,int64_t *refs,int ntags,char **keys,char **values)
+{
+ parsedblock *block=data?(parsedblock*)data:&serial_block;
+ parseditem *item=store_item(block,ITEM_WAY,id,ntags,keys,values);
+
+ if((block->nrefs+nrefs)>block->refs_size)
+   {
+    block->refs_size=block->nrefs+nrefs+256;
+
+    block->refs =(int64_t*)realloc((void*)block->refs ,block->refs_size*sizeof(int64_t));
+    block->types=(int*    )realloc((void*)block->types,block->refs_size*sizeof(int));
+    block->roles=(char*   )realloc((void*)block->roles,block->refs_size*sizeof(char));
+
+    assert(block->refs && block->types && block->roles); /* Check realloc() worked */
+   }
+
+ memcpy(block->refs+block->nrefs,refs,nrefs*sizeof(int64_t));
+
+ block->nrefs+=nrefs;
+ item->nrefs=nrefs;
+
+ if(!data)
+    process_items(block);
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  The function that is called for each relation in a PBF file or from the fast XML parser.
+
+  int item_relation_function Returns 0 if no error occured or something else otherwise.
+
+  void *data The block to store the relation in (or NULL to process it immediately).
+
+  int64_t id The id of the relation.
+
+  int nmembers The number of members of the relation.
+
+  int *types The types of the members (PBFPARSE_MEMBER_NODE, PBFPARSE_MEMBER_WAY or PBFPARSE_MEMBER_RELATION).
+
+  int64_t *refs The ids of the members.
+
+  char **roles The roles of the members.
+
+  int ntags The number of tags.
+
+  char **keys The tag keys.
+
+  char **values The tag values.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int item_relation_function(void *data,int64_t id,int nmembers,int *types,int64_t *refs,char **roles,int ntags,char **keys,char **values)
+{
+ parsedblock *block=data?(parsedblock*)data:&serial_block;
+ parseditem *item=store_item(block,ITEM_RELATION,id,ntags,keys,values);
+ int i;
+
+ if((block->nrefs+nmembers)>block->refs_size)
+   {
+    block->refs_size=block->nrefs+nmembers+256;
+
+    block->refs =(int64_t*)realloc((void*)block->refs ,block->refs_size*sizeof(int64_t));
+    block->types=(int*    )realloc((void*)block->types,block->refs_size*sizeof(int));
+    block->roles=(char*   )realloc((void*)block->roles,block->refs_size*sizeof(char));
+
+    assert(block->refs && block->types && block->roles); /* Check realloc() worked */
+   }
+
+ /* Only the roles that are used are kept */
+
+ for(i=0;i<nmembers;i++)
+   {
+    int role=ROLE_OTHER;
+
+    if(types[i]==PBFPARSE_MEMBER_NODE && !strcmp(roles[i],"via"))
+       role=ROLE_VIA;
+    else if(types[i]==PBFPARSE_MEMBER_WAY && !strcmp(roles[i],"from"))
+       role=ROLE_FROM;
+    else if(types[i]==PBFPARSE_MEMBER_WAY && !strcmp(roles[i],"to"))
+       role=ROLE_TO;
+
+    block->refs [block->nrefs+i]=refs[i];
+    block->types[block->nrefs+i]=types[i];
+    block->roles[block->nrefs+i]=role;
+   }
+
+ block->nrefs+=nmembers;
+ item->nrefs=nmembers;
+
+ if(!data)
+    process_items(block);
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Store an item in a block and apply the tagging rules to it (this part of the
+  processing can be run in any thread).
+
+  parseditem *store_item Returns the stored item.
+
+  parsedblock *block The block to store the item in.
+
+  int type The type of the item.
+
+  int64_t id The id of the item.
+
+  int ntags The number of tags.
+
+  char **keys The tag keys.
+
+  char **values The tag values.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static parseditem *store_item(parsedblock *block,int type,int64_t id,int ntags,char **keys,char **values)
+{
+ parseditem *item;
+ int i;
+
+ if(block->nitems==block->items_size)
+   {
+    block->items_size+=1024;
+    block->items=(parseditem*)realloc((void*)block->items,block->items_size*sizeof(parseditem));
+
+    assert(block->items); /* Check realloc() worked */
+   }
+
+ item=&block->items[block->nitems++];
+
+ item->type=type;
+ item->id=id;
+ item->nrefs=0;
+
+ if(parsing_changes)
+    item->change=ParseOSMXML_ChangeType();
+ else
+    item->change=OSMXMLPARSE_CHANGE_NONE;
+
+ if(item->change==OSMXMLPARSE_CHANGE_DELETE)
+   {
+    item->tags=NULL;
+    item->errors=NULL;
+
+    return(item);
+   }
+
+ if(!block->input)
+    block->input=NewTagList();
+ else
+    ResetTagList(block->input);
+
+ for(i=0;i<ntags;i++)
+    AppendTag(block->input,keys[i],values[i]);
+
+ if(type==ITEM_NODE)
+    item->tags=ApplyTaggingRules(&NodeRules,block->input,(node_t)id);
+ else if(type==ITEM_WAY)
+    item->tags=ApplyTaggingRules(&WayRules,block->input,(way_t)id);
+ else /* if(type==ITEM_RELATION) */
+    item->tags=ApplyTaggingRules(&RelationRules,block->input,(relation_t)id);
+
+ /* Any error messages are only kept if this thread is storing them */
+
+ item->errors=flush_errorlog_buffer();
+
+ return(item);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Process the items that have been stored in a block in the order that they
+  were parsed and empty the block (this part of the processing must be run in
+  the main thread).
+
+  parsedblock *block The block of items.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void process_items(parsedblock *block)
+{
+ int64_t *refs=block->refs;
+ int *types=block->types;
+ char *roles=block->roles;
+ int i,j;
+
+ for(i=0;i<block->nitems;i++)
+   {
+    parseditem *item=&block->items[i];
+
+    if(item->errors)
+      {
+       logerror("%s",item->errors);
+       free(item->errors);
+      }
+
+    if(item->type==ITEM_NODE)
+      {
+       node_t node_id;
+
+       nnodes++;
+
+       if(!(nnodes%10000))
+          printf_middle("Reading: %s=%llu Nodes=%"Pindex_t" Ways=%"Pindex_t" Relations=%"Pindex_t,position_name,position_function(),nnodes,nways,nrelations);
+
+       node_id=(node_t)item->id;
+       assert((int64_t)node_id==item->id);   /* check node id can be stored in node_t data type. */
+
+       if(item->change!=OSMXMLPARSE_CHANGE_NONE)
+          AppendChange(nodes->changes,node_id,nodes->number,0);
+
+       if(item->change!=OSMXMLPARSE_CHANGE_DELETE)
+          process_node_tags(item->tags,node_id,item->latitude,item->longitude);
+      }
+    else if(item->type==ITEM_WAY)
+      {
+       way_t way_id;
+
+       nways++;
+
+       if(!(nways%1000))
+          printf_middle("Reading: %s=%llu Nodes=%"Pindex_t" Ways=%"Pindex_t" Relations=%"Pindex_t,position_name,position_function(),nnodes,nways,nrelations);
+
+       way_id=(way_t)item->id;
+       assert((int64_t)way_id==item->id);    /* check way id can be stored in way_t data type. */
+
+       /* Copy the node ids (the list grows in multiples of 256 as it does for XML) */
+
+       way_nodes=(node_t*)realloc((void*)way_nodes,(item->nrefs/256+1)*256*sizeof(node_t));
+
+       assert(way_nodes); /* Check realloc() worked */
+
+       for(way_nnodes=0;way_nnodes<item->nrefs;way_nnodes++)
+         {
+          way_nodes[way_nnodes]=(node_t)refs[way_nnodes];
+          assert((int64_t)way_nodes[way_nnodes]==refs[way_nnodes]); /* check node id can be stored in node_t data type. */
+         }
+
+       if(item->change!=OSMXMLPARSE_CHANGE_NONE)
+          AppendChange(ways->changes,way_id,ways->number,segments->number);
+
+       if(item->change!=OSMXMLPARSE_CHANGE_DELETE)
+          process_way_tags(item->tags,way_id);
+      }
+    else /* if(item->type==ITEM_RELATION) */
+      {
+       relation_t relation_id;
+
+       nrelations++;
+
+       if(!(nrelations%1000))
+          printf_middle("Reading: %s=%llu Nodes=%"Pindex_t" Ways=%"Pindex_t" Relations=%"Pindex_t,position_name,position_function(),nnodes,nways,nrelations);
+
+       relation_id=(relation_t)item->id;
+       assert((int64_t)relation_id==item->id); /* check relation id can be stored in relation_t data type. */
+
+       relation_nnodes=relation_nways=relation_nrelations=0;
+
+       relation_from=NO_WAY_ID;
+       relation_to=NO_WAY_ID;
+       relation_via=NO_NODE_ID;
+
+       /* Handle the members in the same way as the XML member tags */
+
+       for(j=0;j<item->nrefs;j++)
+         {
+          if(types[j]==PBFPARSE_MEMBER_NODE)
+            {
+             node_t node_id=(node_t)refs[j];
+
+             assert((int64_t)node_id==refs[j]);   /* check node id can be stored in node_t data type. */
+
+             if(relation_nnodes && (relation_nnodes%256)==0)
+                relation_nodes=(node_t*)realloc((void*)relation_nodes,(relation_nnodes+256)*sizeof(node_t));
+
+             relation_nodes[relation_nnodes++]=node_id;
+
+             if(roles[j]==ROLE_VIA)
+                relation_via=node_id;
+            }
+          else if(types[j]==PBFPARSE_MEMBER_WAY)
+            {
+             way_t way_id=(way_t)refs[j];
+
+             assert((int64_t)way_id==refs[j]);    /* check way id can be stored in way_t data type. */
+
+             if(relation_nways && (relation_nways%256)==0)
+                relation_ways=(way_t*)realloc((void*)relation_ways,(relation_nways+256)*sizeof(way_t));
+
+             relation_ways[relation_nways++]=way_id;
+
+             if(roles[j]==ROLE_FROM)
+                relation_from=way_id;
+             if(roles[j]==ROLE_TO)
+                relation_to=way_id;
+            }
+          else if(types[j]==PBFPARSE_MEMBER_RELATION)
+            {
+             relation_t member_id=(relation_t)refs[j];
+
+             assert((int64_t)member_id==refs[j]); /* check relation id can be stored in relation_t data type. */
+
+             if(relation_nrelations && (relation_nrelations%256)==0)
+                relation_relations=(relation_t*)realloc((void*)relation_relations,(relation_nrelations+256)*sizeof(relation_t));
+
+             relation_relations[relation_nrelations++]=member_id;
+            }
+         }
+
+       if(item->change!=OSMXMLPARSE_CHANGE_NONE)
+          AppendChange(relations->changes,relation_id,relations->rnumber,relations->trnumber);
+
+       if(item->change!=OSMXMLPARSE_CHANGE_DELETE)
+          process_relation_tags(item->tags,relation_id);
+      }
+
+    if(item->tags)
+       DeleteTagList(item->tags);
+
+    refs+=item->nrefs;
+    types+=item->nrefs;
+    roles+=item->nrefs;
+   }
+
+ block->nitems=0;
+ block->nrefs=0;
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Process the tags associated with a node.
+
+  TagList *tags The list of node tags.
+
+  node_t id The id of the node.
+
+  double latitude The latitude of the node.
+
+  double longitude The longitude of the node.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void process_node_tags(TagList *tags,node_t id,double latitude,double longitude)
+{
+ transports_t allow=Transports_ALL;
+ uint16_t flags=0;
+ int i;
+
+ /* Parse the tags */
+
+ for(i=0;i<tags->ntags;i++)
+   {
+    char *k=tags->k[i];
+    char *v=tags->v[i];
+
+    switch(*k)
+      {
+      case 'b':
+       if(!strcmp(k,"bicycle"))
+         {
+          if(ISFALSE(v))
+             allow&=~Transports_Bicycle;
+          else if(!ISTRUE(v))
+             logerror("Node %"Pnode_t" has an unrecognised tag value 'bicycle' = '%s' (after tagging rules); using 'yes'.\n",id,v);
+         }
+
+       break;
+
+      case 'f':
+       if(!strcmp(k,"foot"))
+         {
+          if(ISFALSE(v))
+             allow&=~Transports_Foot;
+          else if(!ISTRUE(v))
+             logerror("Node %"Pnode_t" has an unrecognised tag value 'foot' = '%s' (after tagging rules); using 'yes'.\n",id,v);
+         }
+
+       break;
+
+      case 'g':
+       if(!strcmp(k,"goods"))
+         {
+          if(ISFALSE(v))
+             allow&=~Transports_Goods;
+          else if(!ISTRUE(v))
+             logerror("Node %"Pnode_t" has an unrecognised tag value 'goods' = '%s' (after tagging rules); using 'yes'.\n",id,v);
+         }
+
+       break;
+
+      case 'h':
+       if(!strcmp(k,"highway"))
+          if(!strcmp(v,"mini_roundabout"))
+             flags|=NODE_MINIRNDBT;
+
+       if(!strcmp(k,"horse"))
+         {
+          if(ISFALSE(v))
+             allow&=~Transports_Horse;
+          else if(!ISTRUE(v))
+             logerror("Node %"Pnode_t" has an unrecognised tag value 'horse' = '%s' (after tagging rules); using 'yes'.\n",id,v);
+         }
+
+       if(!strcmp(k,"hgv"))
+         {
+          if(ISFALSE(v))
+             allow&=~Transports_HGV;
+          else if(!ISTRUE(v))
+             logerror("Node %"Pnode_t" has an unrecognised tag value 'hgv' = '%s' (after tagging rules); using 'yes'.\n",id,v);
+         }
+
+       break;
+
+      case 'm':
+       if(!strcmp(k,"moped"))
+         {
+          if(ISFALSE(v))
+             allow&=~Transports_Moped;
+          else if(!ISTRUE(v))
+             logerror("Node %"Pnode_t" has an unrecognised tag value 'moped' = '%s' (after tagging rules); using 'yes'.\n",id,v);
+         }
+
+       if(!strcmp(k,"motorbike"))
+         {
+          if(ISFALSE(v))
+             allow&=~Transports_Motorbike;
+          else if(!ISTRUE(v))
+             logerror("Node %"Pnode_t" has an unrecognised tag value 'motorbike' = '%s' (after tagging rules); using 'yes'.\n",id,v);
+         }
+
+       if(!strcmp(k,"motorcar"))
+         {
+          if(ISFALSE(v))
+             allow&=~Transports_Motorcar;
+          else if(!ISTRUE(v))
+             logerror("Node %"Pnode_t" has an unrecognised tag value 'motorcar' = '%s' (after tagging rules); using 'yes'.\n",id,v);
+         }
+
+       break;
+
+      case 'p':
+       if(!strcmp(k,"psv"))
+         {
+          if(ISFALSE(v))
+             allow&=~Transports_PSV;
+          else if(!ISTRUE(v))
+             logerror("Node %"Pnode_t" has an unrecognised tag value 'psv' = '%s' (after tagging rules); using 'yes'.\n",id,v);
+         }
+
+       break;
+
+      case 'w':
+       if(!strcmp(k,"wheelchair"))
+         {
+          if(ISFALSE(v))
+             allow&=~Transports_Wheelchair;
+          else if(!ISTRUE(v))
+             logerror("Node %"Pnode_t" has an unrecognised tag value 'wheelchair' = '%s' (after tagging rules); using 'yes'.\n",id,v);
+         }
+
+       break;
+
+      default:
+       logerror("Node %"Pnode_t" has an unrecognised tag '%s' = '%s' (after tagging rules); ignoring it.\n",id,k,v);
+      }
+   }
+
+ /* Create the node (or store it until it is known if it is needed if outside of the area) */
+
+ if(clip_area && !InsideArea(clip_area,degrees_to_radians(latitude),degrees_to_radians(longitude)))
+   {
+    outsidenode node;
+
+    node.id=id;
+    node.allow=allow;
+    node.flags=flags;
+    node.latitude =degrees_to_radians(latitude);
+    node.longitude=degrees_to_radians(longitude);
+
+    WriteFileBuffered(clip_fd,&node,sizeof(outsidenode));
+
+    return;
+   }
+
+ AppendNode(nodes,id,degrees_to_radians(latitude),degrees_to_radians(longitude),allow,flags);
+
+ if(clip_area)
+    append_node_id(&clip_nodes,id);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Process the tags associated with a way.
+
+  TagList *tags The list of way tags.
+
+  way_t id The id of the way.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void process_way_tags(TagList *tags,way_t id)
+{
+ Way   way={0};
+ int   oneway=0;
+ char *name=NULL,*ref=NULL,*refname=NULL;
+ int i;
+
+ /* Parse the tags - just look for highway */
+
+ for(i=0;i<tags->ntags;i++)
+   {
+    char *k=tags->k[i];
+    char *v=tags->v[i];
+
+    if(!strcmp(k,"highway"))
+      {
+       way.type=HighwayType(v);
+
+       if(way.type==Way_Count)
+          logerror("Way %"Pway_t" has an unrecognised highway type '%s' (after tagging rules); ignoring it.\n",id,v);
+      }
+   }
+
+ /* Don't continue if this is not a highway (bypass error logging) */
+
+ if(way.type==0 || way.type==Way_Count)
+    return;
+
+ /* Don't continue if none of the nodes are inside of the area */
+
+ if(clip_area && !clip_way(id))
+    return;
+
+ /* Parse the tags - look for the others */
+
+ for(i=0;i<tags->ntags;i++)
+   {
+    char *k=tags->k[i];
     char *v=tags->v[i];
 
     switch(*k)
@@ -1057,6 +2125,11 @@ static void process_relation_tags(TagList *tags,relation_t id)
  TurnRestriction restriction=TurnRestrict_None;
  int i;
 
+ /* Don't continue if none of the members are inside of the area */
+
+ if(clip_area && !clip_relation())
+    return;
+
  /* Parse the tags */
 
  for(i=0;i<tags->ntags;i++)
@@ -1156,6 +2229,297 @@ static void process_relation_tags(TagList *tags,relation_t id)
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Start clipping the data to an area (the first time that it is called, the
+  lists are kept for the following files).
+
+  AreaX *area The area to clip the data to.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void start_clipping(AreaX *area)
+{
+ if(clip_area)
+    return;
+
+ clip_area=area;
+
+ clip_filename=(char*)malloc(strlen(option_tmpdirname)+32);
+
+ sprintf(clip_filename,"%s/osmparser.%p.tmp",option_tmpdirname,(void*)area);
+
+ clip_fd=OpenFileBufferedNew(clip_filename);
+
+ memset(&clip_nodes ,0,sizeof(nodeidlist));
+ memset(&clip_ways  ,0,sizeof(wayidlist));
+ memset(&clip_needed,0,sizeof(nodeidlist));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Check if a way is to be kept because at least one of its nodes is inside of the
+  area and if so record it and the nodes that are outside of the area.
+
+  int clip_way Returns true if the way is to be kept.
+
+  way_t id The id of the way (the nodes are in way_nodes).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int clip_way(way_t id)
+{
+ int i,inside=0;
+
+ for(i=0;i<way_nnodes;i++)
+    if(find_node_id(&clip_nodes,way_nodes[i]))
+      {
+       inside=1;
+       break;
+      }
+
+ if(!inside)
+    return(0);
+
+ append_way_id(&clip_ways,id);
+
+ for(i=0;i<way_nnodes;i++)
+    if(!find_node_id(&clip_nodes,way_nodes[i]))
+       append_node_id(&clip_needed,way_nodes[i]);
+
+ return(1);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Check if a relation is to be kept because it has a member node inside of the
+  area, a member way that is kept or a member relation (that might be kept).
+
+  int clip_relation Returns true if the relation is to be kept.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int clip_relation(void)
+{
+ int i;
+
+ if(relation_nrelations)
+    return(1);
+
+ for(i=0;i<relation_nways;i++)
+    if(find_way_id(&clip_ways,relation_ways[i]))
+       return(1);
+
+ for(i=0;i<relation_nnodes;i++)
+    if(find_node_id(&clip_nodes,relation_nodes[i]))
+       return(1);
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Append a node id to a list (the list grows in multiples of 256 entries).
+
+  nodeidlist *list The list of ids.
+
+  node_t id The id to append.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void append_node_id(nodeidlist *list,node_t id)
+{
+ if(list->number==list->size)
+   {
+    list->size+=256;
+
+    list->ids=(node_t*)realloc((void*)list->ids,list->size*sizeof(node_t));
+
+    assert(list->ids); /* Check realloc() worked */
+   }
+
+ if(list->number>0 && id<=list->ids[list->number-1])
+    list->sorted=0;
+ else if(list->number==0)
+    list->sorted=1;
+
+ list->ids[list->number++]=id;
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find a node id in a list (sorting the list and removing the duplicates first if
+  ids have been added out of order).
+
+  int find_node_id Returns true if the id is in the list.
+
+  nodeidlist *list The list of ids.
+
+  node_t id The id to find.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int find_node_id(nodeidlist *list,node_t id)
+{
+ index_t start=0,end,mid;
+
+ if(list->number==0)
+    return(0);
+
+ if(!list->sorted)
+   {
+    index_t i,j;
+
+    qsort(list->ids,list->number,sizeof(node_t),(int (*)(const void*,const void*))sort_by_node_id);
+
+    for(i=1,j=0;i<list->number;i++)
+       if(list->ids[i]!=list->ids[j])
+          list->ids[++j]=list->ids[i];
+
+    list->number=j+1;
+
+    list->sorted=1;
+   }
+
+ /* Binary search */
+
+ end=list->number-1;
+
+ if(id<list->ids[start] || id>list->ids[end])
+    return(0);
+
+ while((end-start)>1)
+   {
+    mid=start+(end-start)/2;
+
+    if(list->ids[mid]<id)
+       start=mid;
+    else
+       end=mid;
+   }
+
+ return(list->ids[start]==id || list->ids[end]==id);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Sort the node ids into ascending order.
+
+  int sort_by_node_id Returns the comparison of the ids.
+
+  const node_t *a The first id.
+
+  const node_t *b The second id.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int sort_by_node_id(const node_t *a,const node_t *b)
+{
+ if(*a<*b)
+    return(-1);
+ else if(*a>*b)
+    return(1);
+ else
+    return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Append a way id to a list (the list grows in multiples of 256 entries).
+
+  wayidlist *list The list of ids.
+
+  way_t id The id to append.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void append_way_id(wayidlist *list,way_t id)
+{
+ if(list->number==list->size)
+   {
+    list->size+=256;
+
+    list->ids=(way_t*)realloc((void*)list->ids,list->size*sizeof(way_t));
+
+    assert(list->ids); /* Check realloc() worked */
+   }
+
+ if(list->number>0 && id<=list->ids[list->number-1])
+    list->sorted=0;
+ else if(list->number==0)
+    list->sorted=1;
+
+ list->ids[list->number++]=id;
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find a way id in a list (sorting the list and removing the duplicates first if
+  ids have been added out of order).
+
+  int find_way_id Returns true if the id is in the list.
+
+  wayidlist *list The list of ids.
+
+  way_t id The id to find.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int find_way_id(wayidlist *list,way_t id)
+{
+ index_t start=0,end,mid;
+
+ if(list->number==0)
+    return(0);
+
+ if(!list->sorted)
+   {
+    index_t i,j;
+
+    qsort(list->ids,list->number,sizeof(way_t),(int (*)(const void*,const void*))sort_by_way_id);
+
+    for(i=1,j=0;i<list->number;i++)
+       if(list->ids[i]!=list->ids[j])
+          list->ids[++j]=list->ids[i];
+
+    list->number=j+1;
+
+    list->sorted=1;
+   }
+
+ /* Binary search */
+
+ end=list->number-1;
+
+ if(id<list->ids[start] || id>list->ids[end])
+    return(0);
+
+ while((end-start)>1)
+   {
+    mid=start+(end-start)/2;
+
+    if(list->ids[mid]<id)
+       start=mid;
+    else
+       end=mid;
+   }
+
+ return(list->ids[start]==id || list->ids[end]==id);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Sort the way ids into ascending order.
+
+  int sort_by_way_id Returns the comparison of the ids.
+
+  const way_t *a The first id.
+
+  const way_t *b The second id.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int sort_by_way_id(const way_t *a,const way_t *b)
+{
+ if(*a<*b)
+    return(-1);
+ else if(*a>*b)
+    return(1);
+ else
+    return(0);
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Convert a string containing a speed into a double precision.
 
@@ -0,0 +1,1142 @@
+/***************************************
+ A fast OSM XML file parser that works directly on a memory mapped file.
+
+ Part of the Routino routing software.
+ ******************/ /******************
+ This file Copyright 2008-2011 Andrew M. Bishop
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************/
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "osmxmlparse.h"
+#include "xmlparse.h"
+
+
+/* The elements that are recognised */
+
+#define ELEMENT_OTHER    0
+#define ELEMENT_NODE     1
+#define ELEMENT_WAY      2
+#define ELEMENT_RELATION 3
+#define ELEMENT_TAG      4
+#define ELEMENT_ND       5
+#define ELEMENT_MEMBER   6
+#define ELEMENT_CREATE   7
+#define ELEMENT_MODIFY   8
+#define ELEMENT_DELETE   9
+
+/*+ The maximum number of attributes that are used from any element. +*/
+#define MAX_ATTRIBUTES 3
+
+
+/*+ A string in the mapped file (not terminated and possibly containing entity references). +*/
+typedef struct _stringview
+{
+ const char *start;             /*+ The start of the string. +*/
+ size_t      length;            /*+ The length of the string. +*/
+ int         encoded;           /*+ Set to true if the string contains an entity or character reference. +*/
+}
+ stringview;
+
+
+/* Local variables */
+
+/*+ The names of the elements that are recognised. +*/
+static const char *element_names[]={NULL,"node","way","relation","tag","nd","member","create","modify","delete"};
+
+/*+ The names of the attributes that are used from each element. +*/
+static const char *attribute_names[][MAX_ATTRIBUTES]={{NULL},
+                                                      {"id","lat","lon"},
+                                                      {"id"},
+                                                      {"id"},
+                                                      {"k","v"},
+                                                      {"ref"},
+                                                      {"type","ref","role"},
+                                                      {NULL},
+                                                      {NULL},
+                                                      {NULL}};
+
+/*+ The number of bytes of the file that are put in each chunk (approximately). +*/
+#define CHUNK_SIZE (1024*1024)
+
+
+/*+ A memory mapped file that is split into chunks. +*/
+struct _osmxmlfile
+{
+ const char        *data;       /*+ The mapped file. +*/
+ size_t             size;       /*+ The size of the file. +*/
+
+ const char        *position;   /*+ The start of the next chunk. +*/
+ unsigned long long lineno;     /*+ The line number at the start of the next chunk. +*/
+};
+
+
+/*+ A chunk of a file and the state used while parsing it. +*/
+struct _osmxmlchunk
+{
+ const char        *start;      /*+ The start of the chunk. +*/
+ const char        *end;        /*+ The end of the chunk. +*/
+
+ unsigned long long firstline;  /*+ The line number at the start of the chunk. +*/
+ unsigned long long lineno;     /*+ The current line number. +*/
+
+ int     change;                /*+ The type of change (create, modify or delete) in a change file. +*/
+
+ int     item;                  /*+ The item (node, way or relation) that is being parsed. +*/
+ int64_t item_id;               /*+ The id of the item. +*/
+ double  item_latitude;         /*+ The latitude of the node. +*/
+ double  item_longitude;        /*+ The longitude of the node. +*/
+
+ char  *strings;                /*+ The strings (tags and roles) for the current item. +*/
+ size_t strings_used;           /*+ The used size of the strings. +*/
+ size_t strings_size;           /*+ The allocated size of the strings. +*/
+
+ size_t *key_offsets;           /*+ The tag keys of the current item (as offsets into the strings). +*/
+ size_t *value_offsets;         /*+ The tag values of the current item (as offsets into the strings). +*/
+ char  **keys;                  /*+ The tag keys of the current item. +*/
+ char  **values;                /*+ The tag values of the current item. +*/
+ int     ntags;                 /*+ The number of tags of the current item. +*/
+ int     tags_size;             /*+ The allocated size of the tags. +*/
+
+ int64_t *refs;                 /*+ The way nodes or relation members of the current item. +*/
+ int     *types;                /*+ The relation member types of the current item. +*/
+ size_t  *role_offsets;         /*+ The relation member roles of the current item (as offsets into the strings). +*/
+ char   **roles;                /*+ The relation member roles of the current item. +*/
+ int      nrefs;                /*+ The number of way nodes or relation members. +*/
+ int      refs_size;            /*+ The allocated size of the way nodes or relation members. +*/
+};
+
+
+/*+ The chunk that is being parsed by ParseOSMXML(). +*/
+static osmxmlchunk *current_chunk=NULL;
+
+/*+ The last line number in the file parsed by ParseOSMXML(). +*/
+static unsigned long long last_lineno=0;
+
+
+/* Local functions */
+
+static int parse_chunk(osmxmlchunk *chunk,pbfcallbacks *callbacks,void *data);
+static int start_element(osmxmlchunk *chunk,int element,stringview *attributes,int *found,int empty,pbfcallbacks *callbacks,void *data);
+static int finish_item(osmxmlchunk *chunk,pbfcallbacks *callbacks,void *data);
+
+static const char *find_split(const char *start,const char *p,const char *end);
+
+static int element_type(const char *name,size_t length);
+static int attribute_index(int element,const char *name,size_t length);
+
+static int copy_string(osmxmlchunk *chunk,const stringview *view,size_t *offset);
+static int parse_integer(const stringview *view,int64_t *value);
+static int parse_floating(const stringview *view,double *value);
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse an OSM XML file by mapping it into memory, calling the callback
+  functions for each item.  Only regular files can be mapped and the generic XML
+  parser must be used for anything else.
+
+  int ParseOSMXML Returns 0 if OK, -1 if the file cannot be mapped (and has not been read) or something else in case of an error.
+
+  FILE *file The file to read from.
+
+  pbfcallbacks *callbacks The functions to call for the nodes, ways and relations (with a NULL data pointer).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int ParseOSMXML(FILE *file,pbfcallbacks *callbacks)
+{
+ osmxmlfile *xmlfile=OpenOSMXMLFile(file);
+ int retval;
+
+ if(!xmlfile)
+    return(-1);
+
+ /* Parse the whole file as a single chunk */
+
+ current_chunk=NewOSMXMLChunk();
+
+ current_chunk->start=xmlfile->data;
+ current_chunk->end=xmlfile->data+xmlfile->size;
+ current_chunk->firstline=1;
+
+ retval=ParseOSMXMLChunk(current_chunk,callbacks,NULL);
+
+ last_lineno=current_chunk->lineno;
+
+ /* Tidy up */
+
+ FreeOSMXMLChunk(current_chunk);
+ current_chunk=NULL;
+
+ CloseOSMXMLFile(xmlfile);
+
+ return(retval);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Return the current line number in the file being parsed by ParseOSMXML().
+
+  unsigned long long ParseOSMXML_LineNumber Returns the line number.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+unsigned long long ParseOSMXML_LineNumber(void)
+{
+ if(!current_chunk)
+    return(last_lineno);
+
+ return(current_chunk->lineno);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Return the type of change that the item being passed to the callback function
+  belongs to when parsing an OSM change file with ParseOSMXML().
+
+  int ParseOSMXML_ChangeType Returns one of the OSMXMLPARSE_CHANGE_* values.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int ParseOSMXML_ChangeType(void)
+{
+ if(!current_chunk)
+    return(OSMXMLPARSE_CHANGE_NONE);
+
+ return(current_chunk->change);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Map an OSM XML file into memory so that it can be split into chunks.
+
+  osmxmlfile *OpenOSMXMLFile Returns the mapped file or NULL if the file cannot be mapped (and has not been read).
+
+  FILE *file The file to map.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+osmxmlfile *OpenOSMXMLFile(FILE *file)
+{
+ osmxmlfile *xmlfile;
+ struct stat buf;
+ int fd=fileno(file);
+ void *data;
+
+ if(fstat(fd,&buf) || !S_ISREG(buf.st_mode) || buf.st_size==0 || lseek(fd,0,SEEK_CUR)!=0)
+    return(NULL);
+
+ data=mmap(NULL,buf.st_size,PROT_READ,MAP_SHARED,fd,0);
+
+ if(data==MAP_FAILED)
+    return(NULL);
+
+ xmlfile=(osmxmlfile*)malloc(sizeof(osmxmlfile));
+
+ assert(xmlfile); /* Check malloc() worked */
+
+ xmlfile->data=(const char*)data;
+ xmlfile->size=buf.st_size;
+
+ xmlfile->position=xmlfile->data;
+ xmlfile->lineno=1;
+
+ return(xmlfile);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Unmap an OSM XML file (after all of the chunks have been parsed).
+
+  osmxmlfile *xmlfile The mapped file.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void CloseOSMXMLFile(osmxmlfile *xmlfile)
+{
+ munmap((void*)xmlfile->data,xmlfile->size);
+
+ free(xmlfile);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Create a new chunk to parse part of a file.
+
+  osmxmlchunk *NewOSMXMLChunk Returns the new chunk.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+osmxmlchunk *NewOSMXMLChunk(void)
+{
+ osmxmlchunk *chunk=(osmxmlchunk*)calloc(1,sizeof(osmxmlchunk));
+
+ assert(chunk); /* Check calloc() worked */
+
+ return(chunk);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Free a chunk and its buffers.
+
+  osmxmlchunk *chunk The chunk to free.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void FreeOSMXMLChunk(osmxmlchunk *chunk)
+{
+ free(chunk->strings);
+
+ free(chunk->key_offsets);
+ free(chunk->value_offsets);
+ free(chunk->keys);
+ free(chunk->values);
+
+ free(chunk->refs);
+ free(chunk->types);
+ free(chunk->role_offsets);
+ free(chunk->roles);
+
+ free(chunk);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Select the next chunk of the file.  The chunks are split just before the
+  start of a node, way or relation so that they can be parsed independently.
+
+  int ReadOSMXMLChunk Returns 0 if OK or -1 at the end of the file.
+
+  osmxmlfile *xmlfile The mapped file.
+
+  osmxmlchunk *chunk The chunk to fill in.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int ReadOSMXMLChunk(osmxmlfile *xmlfile,osmxmlchunk *chunk)
+{
+ const char *end=xmlfile->data+xmlfile->size;
+ const char *p;
+
+ if(xmlfile->position==end)
+    return(-1);
+
+ chunk->start=xmlfile->position;
+ chunk->firstline=xmlfile->lineno;
+
+ if((size_t)(end-chunk->start)>CHUNK_SIZE)
+    chunk->end=find_split(chunk->start,chunk->start+CHUNK_SIZE,end);
+ else
+    chunk->end=end;
+
+ /* Count the lines so that the next chunk knows where it starts */
+
+ for(p=chunk->start;(p=memchr(p,'\n',chunk->end-p));p++)
+    xmlfile->lineno++;
+
+ xmlfile->position=chunk->end;
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse a chunk of the file calling the callback functions for each item.
+
+  int ParseOSMXMLChunk Returns 0 if OK or something else in case of an error.
+
+  osmxmlchunk *chunk The chunk to parse.
+
+  pbfcallbacks *callbacks The functions to call for the nodes, ways and relations.
+
+  void *data The data pointer to pass to the callback functions.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int ParseOSMXMLChunk(osmxmlchunk *chunk,pbfcallbacks *callbacks,void *data)
+{
+ chunk->lineno=chunk->firstline;
+ chunk->item=ELEMENT_OTHER;
+ chunk->change=OSMXMLPARSE_CHANGE_NONE;
+
+ return(parse_chunk(chunk,callbacks,data));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Return the current line number in a chunk (the last line once it has been parsed).
+
+  unsigned long long OSMXMLChunkLineNumber Returns the line number.
+
+  osmxmlchunk *chunk The chunk.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+unsigned long long OSMXMLChunkLineNumber(osmxmlchunk *chunk)
+{
+ return(chunk->lineno);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find a place to split the file, just before a node, way or relation start tag.
+  The chunk is scanned from its start (which is outside of any markup) so that
+  a split is never made inside a comment, CDATA section, processing instruction
+  or attribute value; if there is no such place the rest of the file is used.
+
+  const char *find_split Returns the position of the split (or the end of the file).
+
+  const char *start The start of the chunk.
+
+  const char *p The position to start searching from.
+
+  const char *end The end of the file.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static const char *find_split(const char *start,const char *p,const char *end)
+{
+ const char *q=start;
+
+ while((q=memchr(q,'<',end-q)))
+   {
+    const char *close=NULL;
+
+    /* A node, way or relation start tag after the search position */
+
+    if(q>=p)
+      {
+       size_t length=0;
+
+       if((end-q)>5 && !strncmp(q+1,"node",4))
+          length=4;
+       else if((end-q)>4 && !strncmp(q+1,"way",3))
+          length=3;
+       else if((end-q)>9 && !strncmp(q+1,"relation",8))
+          length=8;
+
+       if(length && (q[length+1]==' ' || q[length+1]=='\t' || q[length+1]=='\r' || q[length+1]=='\n'))
+          return(q);
+      }
+
+    /* Skip comments, CDATA sections and processing instructions */
+
+    if((end-q)>=4 && !strncmp(q,"<!--",4))
+       close="-->";
+    else if((end-q)>=9 && !strncmp(q,"<![CDATA[",9))
+       close="]]>";
+    else if((end-q)>=2 && !strncmp(q,"<?",2))
+       close="?>";
+
+    if(close)
+      {
+       size_t closelen=strlen(close);
+
+       q+=2;
+
+       while((q=memchr(q,close[0],end-q)) && ((size_t)(end-q)<closelen || strncmp(q,close,closelen)))
+          q++;
+
+       if(!q)
+          return(end);
+
+       q+=closelen;
+       continue;
+      }
+
+    /* Skip other tags (the attribute values can contain '<' and '>') */
+
+    for(q++;q<end && *q!='>';q++)
+       if(*q=='"' || *q=='\'')
+         {
+          q=memchr(q+1,*q,end-q-1);
+
+          if(!q)
+             return(end);
+         }
+
+    if(q==end)
+       return(end);
+   }
+
+ return(end);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse the contents of a chunk of the file.
+
+  int parse_chunk Returns 0 if OK or something else in case of an error.
+
+  osmxmlchunk *chunk The chunk to parse.
+
+  pbfcallbacks *callbacks The functions to call for the nodes, ways and relations.
+
+  void *data The data pointer to pass to the callback functions.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int parse_chunk(osmxmlchunk *chunk,pbfcallbacks *callbacks,void *data)
+{
+ const char *p=chunk->start,*end=chunk->end;
+
+ while(1)
+   {
+    const char *name;
+    stringview attributes[MAX_ATTRIBUTES];
+    int found[MAX_ATTRIBUTES]={0};
+    int element,empty=0;
+
+    /* Skip the text to the next tag */
+
+    while(p<end && *p!='<')
+      {
+       if(*p=='\n')
+          chunk->lineno++;
+       p++;
+      }
+
+    if(p==end)
+       break;
+
+    p++;
+
+    if(p==end)
+       goto unexpected_eof;
+
+    /* Skip declarations, processing instructions and comments */
+
+    if(*p=='?' || *p=='!')
+      {
+       const char *close=((end-p)>=3 && !strncmp(p,"!--",3))?"-->":">";
+       size_t closelen=strlen(close);
+
+       while(p<end && ((size_t)(end-p)<closelen || strncmp(p,close,closelen)))
+         {
+          if(*p=='\n')
+             chunk->lineno++;
+          p++;
+         }
+
+       if(p==end)
+          goto unexpected_eof;
+
+       p+=closelen;
+       continue;
+      }
+
+    /* An end tag */
+
+    if(*p=='/')
+      {
+       name=++p;
+
+       while(p<end && *p!='>' && *p!=' ' && *p!='\t' && *p!='\r' && *p!='\n')
+          p++;
+
+       element=element_type(name,p-name);
+
+       while(p<end && *p!='>')
+         {
+          if(*p=='\n')
+             chunk->lineno++;
+          p++;
+         }
+
+       if(p==end)
+          goto unexpected_eof;
+
+       p++;
+
+       if(element!=ELEMENT_OTHER && element==chunk->item)
+         {
+          if(finish_item(chunk,callbacks,data))
+             return(1);
+         }
+       else if(element>=ELEMENT_CREATE)
+          chunk->change=OSMXMLPARSE_CHANGE_NONE;
+
+       continue;
+      }
+
+    /* A start tag */
+
+    name=p;
+
+    while(p<end && *p!='>' && *p!='/' && *p!=' ' && *p!='\t' && *p!='\r' && *p!='\n')
+       p++;
+
+    element=element_type(name,p-name);
+
+    while(1)
+      {
+       const char *attribute;
+       size_t length;
+       char quote;
+       int index;
+
+       while(p<end && (*p==' ' || *p=='\t' || *p=='\r' || *p=='\n'))
+         {
+          if(*p=='\n')
+             chunk->lineno++;
+          p++;
+         }
+
+       if(p==end)
+          goto unexpected_eof;
+
+       if(*p=='>')
+         {
+          p++;
+          break;
+         }
+
+       if(*p=='/')
+         {
+          if((p+1)==end || p[1]!='>')
+             goto invalid_tag;
+
+          p+=2;
+          empty=1;
+          break;
+         }
+
+       /* An attribute name and value */
+
+       attribute=p;
+
+       while(p<end && *p!='=' && *p!='>' && *p!='/' && *p!=' ' && *p!='\t' && *p!='\r' && *p!='\n')
+          p++;
+
+       length=p-attribute;
+
+       while(p<end && (*p==' ' || *p=='\t' || *p=='\r' || *p=='\n'))
+         {
+          if(*p=='\n')
+             chunk->lineno++;
+          p++;
+         }
+
+       if(p==end || *p!='=')
+          goto invalid_tag;
+
+       p++;
+
+       while(p<end && (*p==' ' || *p=='\t' || *p=='\r' || *p=='\n'))
+         {
+          if(*p=='\n')
+             chunk->lineno++;
+          p++;
+         }
+
+       if(p==end || (*p!='"' && *p!='\''))
+          goto invalid_tag;
+
+       quote=*p++;
+
+       index=attribute_index(element,attribute,length);
+
+       if(index>=0)
+         {
+          attributes[index].start=p;
+          attributes[index].encoded=0;
+          found[index]=1;
+         }
+
+       while(p<end && *p!=quote)
+         {
+          if(*p=='&')
+            {
+             if(index>=0)
+                attributes[index].encoded=1;
+            }
+          else if(*p=='<')
+             goto invalid_tag;
+          else if(*p=='\n')
+             chunk->lineno++;
+          p++;
+         }
+
+       if(p==end)
+          goto unexpected_eof;
+
+       if(index>=0)
+          attributes[index].length=p-attributes[index].start;
+
+       p++;
+      }
+
+    if(element!=ELEMENT_OTHER)
+       if(start_element(chunk,element,attributes,found,empty,callbacks,data))
+          return(1);
+   }
+
+ if(chunk->item!=ELEMENT_OTHER)
+    goto unexpected_eof;
+
+ return(0);
+
+ unexpected_eof:
+
+ fprintf(stderr,"XML Parser: Error on line %llu: unexpected end of file seen.\n",chunk->lineno);
+ return(1);
+
+ invalid_tag:
+
+ fprintf(stderr,"XML Parser: Error on line %llu: invalid tag or attribute seen.\n",chunk->lineno);
+ return(1);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Handle the start of one of the recognised elements.
+
+  int start_element Returns 0 if OK or something else in case of an error.
+
+  osmxmlchunk *chunk The chunk being parsed.
+
+  int element The type of element.
+
+  stringview *attributes The values of the attributes of the element.
+
+  int *found Set to true for each of the attributes that was found.
+
+  int empty Set to true if the element is empty (has no end tag).
+
+  pbfcallbacks *callbacks The functions to call for the nodes, ways and relations.
+
+  void *data The data pointer to pass to the callback functions.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int start_element(osmxmlchunk *chunk,int element,stringview *attributes,int *found,int empty,pbfcallbacks *callbacks,void *data)
+{
+ int i;
+
+ /* Check that all of the required attributes are present */
+
+ for(i=0;i<MAX_ATTRIBUTES && attribute_names[element][i];i++)
+    if(!found[i] && !(element==ELEMENT_MEMBER && i==2) &&  /* role is optional */
+       !(element==ELEMENT_NODE && i>0 && chunk->change==OSMXMLPARSE_CHANGE_DELETE)) /* position is optional for a deleted node */
+      {
+       fprintf(stderr,"XML Parser: Error on line %llu: '%s' attribute must be specified in <%s> tag.\n",chunk->lineno,attribute_names[element][i],element_names[element]);
+       return(1);
+      }
+
+ switch(element)
+   {
+   case ELEMENT_NODE:
+   case ELEMENT_WAY:
+   case ELEMENT_RELATION:
+    if(chunk->item!=ELEMENT_OTHER)
+      {
+       fprintf(stderr,"XML Parser: Error on line %llu: unexpected <%s> tag seen.\n",chunk->lineno,element_names[element]);
+       return(1);
+      }
+
+    chunk->item=element;
+
+    chunk->ntags=chunk->nrefs=0;
+    chunk->strings_used=0;
+
+    if(parse_integer(&attributes[0],&chunk->item_id))
+      {
+       fprintf(stderr,"XML Parser: Error on line %llu: 'id' attribute must be a integer in <%s> tag.\n",chunk->lineno,element_names[element]);
+       return(1);
+      }
+
+    if(element==ELEMENT_NODE && (!found[1] || !found[2]))
+       chunk->item_latitude=chunk->item_longitude=0;
+    else if(element==ELEMENT_NODE)
+      {
+       if(parse_floating(&attributes[1],&chunk->item_latitude))
+         {
+          fprintf(stderr,"XML Parser: Error on line %llu: 'lat' attribute must be a number in <node> tag.\n",chunk->lineno);
+          return(1);
+         }
+
+       if(parse_floating(&attributes[2],&chunk->item_longitude))
+         {
+          fprintf(stderr,"XML Parser: Error on line %llu: 'lon' attribute must be a number in <node> tag.\n",chunk->lineno);
+          return(1);
+         }
+      }
+
+    if(empty)
+       return(finish_item(chunk,callbacks,data));
+
+    break;
+
+   case ELEMENT_TAG:
+    if(chunk->item==ELEMENT_OTHER)
+       break;
+
+    if(chunk->ntags==chunk->tags_size)
+      {
+       chunk->tags_size+=16;
+
+       chunk->key_offsets  =(size_t*)realloc((void*)chunk->key_offsets  ,chunk->tags_size*sizeof(size_t));
+       chunk->value_offsets=(size_t*)realloc((void*)chunk->value_offsets,chunk->tags_size*sizeof(size_t));
+       chunk->keys  =(char**)realloc((void*)chunk->keys  ,chunk->tags_size*sizeof(char*));
+       chunk->values=(char**)realloc((void*)chunk->values,chunk->tags_size*sizeof(char*));
+
+       assert(chunk->key_offsets && chunk->value_offsets && chunk->keys && chunk->values); /* Check realloc() worked */
+      }
+
+    if(copy_string(chunk,&attributes[0],&chunk->key_offsets[chunk->ntags]) || copy_string(chunk,&attributes[1],&chunk->value_offsets[chunk->ntags]))
+       return(1);
+
+    chunk->ntags++;
+
+    break;
+
+   case ELEMENT_ND:
+   case ELEMENT_MEMBER:
+    if(chunk->item!=(element==ELEMENT_ND?ELEMENT_WAY:ELEMENT_RELATION))
+       break;
+
+    if(chunk->nrefs==chunk->refs_size)
+      {
+       chunk->refs_size+=256;
+
+       chunk->refs        =(int64_t*)realloc((void*)chunk->refs        ,chunk->refs_size*sizeof(int64_t));
+       chunk->types       =(int*    )realloc((void*)chunk->types       ,chunk->refs_size*sizeof(int));
+       chunk->role_offsets=(size_t* )realloc((void*)chunk->role_offsets,chunk->refs_size*sizeof(size_t));
+       chunk->roles       =(char**  )realloc((void*)chunk->roles       ,chunk->refs_size*sizeof(char*));
+
+       assert(chunk->refs && chunk->types && chunk->role_offsets && chunk->roles); /* Check realloc() worked */
+      }
+
+    if(parse_integer(&attributes[element==ELEMENT_ND?0:1],&chunk->refs[chunk->nrefs]))
+      {
+       fprintf(stderr,"XML Parser: Error on line %llu: 'ref' attribute must be a integer in <%s> tag.\n",chunk->lineno,element_names[element]);
+       return(1);
+      }
+
+    if(element==ELEMENT_MEMBER)
+      {
+       if(attributes[0].length==4 && !strncmp(attributes[0].start,"node",4))
+          chunk->types[chunk->nrefs]=PBFPARSE_MEMBER_NODE;
+       else if(attributes[0].length==3 && !strncmp(attributes[0].start,"way",3))
+          chunk->types[chunk->nrefs]=PBFPARSE_MEMBER_WAY;
+       else if(attributes[0].length==8 && !strncmp(attributes[0].start,"relation",8))
+          chunk->types[chunk->nrefs]=PBFPARSE_MEMBER_RELATION;
+       else
+          chunk->types[chunk->nrefs]=-1;
+
+       if(!found[2])
+         {
+          attributes[2].start="";
+          attributes[2].length=0;
+          attributes[2].encoded=0;
+         }
+
+       if(copy_string(chunk,&attributes[2],&chunk->role_offsets[chunk->nrefs]))
+          return(1);
+      }
+
+    chunk->nrefs++;
+
+    break;
+
+   case ELEMENT_CREATE:
+   case ELEMENT_MODIFY:
+   case ELEMENT_DELETE:
+    if(empty)
+       break;
+
+    if(element==ELEMENT_CREATE)
+       chunk->change=OSMXMLPARSE_CHANGE_CREATE;
+    else if(element==ELEMENT_MODIFY)
+       chunk->change=OSMXMLPARSE_CHANGE_MODIFY;
+    else
+       chunk->change=OSMXMLPARSE_CHANGE_DELETE;
+
+    break;
+   }
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Pass the item that has just finished to the callback function.
+
+  int finish_item Returns 0 if OK or something else in case of an error.
+
+  osmxmlchunk *chunk The chunk being parsed.
+
+  pbfcallbacks *callbacks The functions to call for the nodes, ways and relations.
+
+  void *data The data pointer to pass to the callback functions.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int finish_item(osmxmlchunk *chunk,pbfcallbacks *callbacks,void *data)
+{
+ int i,element=chunk->item;
+
+ chunk->item=ELEMENT_OTHER;
+
+ /* The strings are only fixed in place now that they have all been copied */
+
+ for(i=0;i<chunk->ntags;i++)
+   {
+    chunk->keys[i]  =chunk->strings+chunk->key_offsets[i];
+    chunk->values[i]=chunk->strings+chunk->value_offsets[i];
+   }
+
+ if(element==ELEMENT_NODE)
+    return(callbacks->node(data,chunk->item_id,chunk->item_latitude,chunk->item_longitude,chunk->ntags,chunk->keys,chunk->values));
+
+ if(element==ELEMENT_WAY)
+    return(callbacks->way(data,chunk->item_id,chunk->nrefs,chunk->refs,chunk->ntags,chunk->keys,chunk->values));
+
+ for(i=0;i<chunk->nrefs;i++)
+    chunk->roles[i]=chunk->strings+chunk->role_offsets[i];
+
+ return(callbacks->relation(data,chunk->item_id,chunk->nrefs,chunk->types,chunk->refs,chunk->roles,chunk->ntags,chunk->keys,chunk->values));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the type of an element from its name.
+
+  int element_type Returns the type of element or ELEMENT_OTHER if not recognised.
+
+  const char *name The name of the element.
+
+  size_t length The length of the name.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int element_type(const char *name,size_t length)
+{
+ int i;
+
+ for(i=ELEMENT_NODE;i<=ELEMENT_DELETE;i++)
+    if(length==strlen(element_names[i]) && !strncmp(name,element_names[i],length))
+       return(i);
+
+ return(ELEMENT_OTHER);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the index of an attribute of an element from its name.
+
+  int attribute_index Returns the index of the attribute or -1 if it is not used.
+
+  int element The type of element.
+
+  const char *name The name of the attribute.
+
+  size_t length The length of the name.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int attribute_index(int element,const char *name,size_t length)
+{
+ int i;
+
+ for(i=0;i<MAX_ATTRIBUTES && attribute_names[element][i];i++)
+    if(length==strlen(attribute_names[element][i]) && !strncmp(name,attribute_names[element][i],length))
+       return(i);
+
+ return(-1);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Copy a string from the file into the strings for the current item, decoding any references.
+
+  int copy_string Returns 0 if OK or something else in case of an error.
+
+  osmxmlchunk *chunk The chunk being parsed.
+
+  const stringview *view The string in the file.
+
+  size_t *offset Returns the offset of the copied string.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int copy_string(osmxmlchunk *chunk,const stringview *view,size_t *offset)
+{
+ const char *p=view->start,*end=view->start+view->length;
+
+ /* A decoded string is never longer than the encoded one */
+
+ if((chunk->strings_used+view->length+1)>chunk->strings_size)
+   {
+    chunk->strings_size=chunk->strings_used+view->length+1+1024;
+    chunk->strings=(char*)realloc((void*)chunk->strings,chunk->strings_size);
+
+    assert(chunk->strings); /* Check realloc() worked */
+   }
+
+ *offset=chunk->strings_used;
+
+ if(!view->encoded)
+   {
+    memcpy(chunk->strings+chunk->strings_used,p,view->length);
+    chunk->strings_used+=view->length;
+   }
+ else
+    while(p<end)
+      {
+       if(*p=='&')
+         {
+          char ref[16],decoded[5];
+          const char *semicolon=memchr(p,';',end-p),*str;
+
+          if(!semicolon || (semicolon-p+1)>=(int)sizeof(ref))
+            {
+             fprintf(stderr,"XML Parser: Error on line %llu: invalid entity or character reference seen.\n",chunk->lineno);
+             return(1);
+            }
+
+          memcpy(ref,p,semicolon-p+1);
+          ref[semicolon-p+1]=0;
+
+          if(ref[1]=='#')
+             str=ParseXML_Decode_Char_Ref_r(ref,decoded);
+          else
+             str=ParseXML_Decode_Entity_Ref(ref);
+
+          if(!str)
+            {
+             fprintf(stderr,"XML Parser: Error on line %llu: invalid entity reference '%s' seen.\n",chunk->lineno,ref);
+             return(1);
+            }
+
+          while(*str)
+             chunk->strings[chunk->strings_used++]=*str++;
+
+          p=semicolon+1;
+         }
+       else
+          chunk->strings[chunk->strings_used++]=*p++;
+      }
+
+ chunk->strings[chunk->strings_used++]=0;
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse an integer directly from the file.
+
+  int parse_integer Returns 0 if OK or something else if it is not an integer.
+
+  const stringview *view The string in the file.
+
+  int64_t *value Returns the value.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int parse_integer(const stringview *view,int64_t *value)
+{
+ const char *p=view->start,*end=view->start+view->length;
+ int negative=0;
+
+ if(p<end && (*p=='-' || *p=='+'))
+    negative=(*p++=='-');
+
+ if(p==end)
+    return(1);
+
+ *value=0;
+
+ for(;p<end;p++)
+   {
+    if(*p<'0' || *p>'9')
+       return(1);
+
+    *value=*value*10+(*p-'0');
+   }
+
+ if(negative)
+    *value=-*value;
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse a floating point number directly from the file.  Numbers that have no
+  more than 15 significant digits, 22 decimal places and no exponent are
+  converted with a single rounding (the same result as atof()), anything else is
+  converted using strtod().
+
+  int parse_floating Returns 0 if OK or something else if it is not a number.
+
+  const stringview *view The string in the file.
+
+  double *value Returns the value.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int parse_floating(const stringview *view,double *value)
+{
+ /*+ The powers of ten that can be represented exactly. +*/
+ static const double powers[]={1E0,1E1,1E2,1E3,1E4,1E5,1E6,1E7,1E8,1E9,1E10,1E11,1E12,1E13,1E14,1E15,
+                               1E16,1E17,1E18,1E19,1E20,1E21,1E22};
+ const char *p=view->start,*end=view->start+view->length;
+ int negative=0,digits=0,decimals=-1;
+ int64_t mantissa=0;
+
+ if(p<end && (*p=='-' || *p=='+'))
+    negative=(*p++=='-');
+
+ for(;p<end;p++)
+   {
+    if(*p>='0' && *p<='9')
+      {
+       mantissa=mantissa*10+(*p-'0');
+
+       if(mantissa)
+          digits++;
+       if(decimals>=0)
+          decimals++;
+      }
+    else if(*p=='.' && decimals<0)
+       decimals=0;
+    else
+       break;
+   }
+
+ if(p==end && digits<=15 && decimals<=22 && (p-view->start)>(negative || *view->start=='+'))
+   {
+    *value=(double)mantissa;
+
+    if(decimals>0)
+       *value/=powers[decimals];
+
+    if(negative)
+       *value=-*value;
+
+    return(0);
+   }
+ else
+   {
+    char number[64];
+
+    if(view->length>=sizeof(number))
+       return(1);
+
+    memcpy(number,view->start,view->length);
+    number[view->length]=0;
+
+    if(!*number || !ParseXML_IsFloating(number))
+       return(1);
+
+    *value=strtod(number,NULL);
+
+    return(0);
+   }
+}
@@ -0,0 +1,67 @@
+/***************************************
+ A header file for the fast OSM XML file parser.
+
+ Part of the Routino routing software.
+ ******************/ /******************
+ This file Copyright 2008-2011 Andrew M. Bishop
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************/
+
+
+#ifndef OSMXMLPARSE_H
+#define OSMXMLPARSE_H    /*+ To stop multiple inclusions. +*/
+
+#include <stdio.h>
+
+#include "pbfparse.h"
+
+
+/*+ The types of change that an item in an OSM change file can belong to. +*/
+#define OSMXMLPARSE_CHANGE_NONE   0
+#define OSMXMLPARSE_CHANGE_CREATE 1
+#define OSMXMLPARSE_CHANGE_MODIFY 2
+#define OSMXMLPARSE_CHANGE_DELETE 3
+
+
+/*+ A memory mapped file that is split into chunks (the contents are private). +*/
+typedef struct _osmxmlfile osmxmlfile;
+
+/*+ A chunk of a file and the state used while parsing it (the contents are private). +*/
+typedef struct _osmxmlchunk osmxmlchunk;
+
+
+/* Fast OSM XML parser functions (the items are passed to the same callbacks as for PBF files) */
+
+int ParseOSMXML(FILE *file,pbfcallbacks *callbacks);
+
+unsigned long long ParseOSMXML_LineNumber(void);
+
+int ParseOSMXML_ChangeType(void);
+
+/* Fast OSM XML parser functions for splitting the file into chunks and parsing them separately (in different threads) */
+
+osmxmlfile *OpenOSMXMLFile(FILE *file);
+void CloseOSMXMLFile(osmxmlfile *xmlfile);
+
+osmxmlchunk *NewOSMXMLChunk(void);
+void FreeOSMXMLChunk(osmxmlchunk *chunk);
+
+int ReadOSMXMLChunk(osmxmlfile *xmlfile,osmxmlchunk *chunk);
+int ParseOSMXMLChunk(osmxmlchunk *chunk,pbfcallbacks *callbacks,void *data);
+
+unsigned long long OSMXMLChunkLineNumber(osmxmlchunk *chunk);
+
+
+#endif /* OSMXMLPARSE_H */
@@ -20,6 +20,7 @@
  ***************************************/
 
 
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -34,6 +35,7 @@
 #include "nodes.h"
 #include "segments.h"
 #include "ways.h"
+#include "overlay.h"
 
 #include "files.h"
 #include "functions.h"
@@ -51,6 +53,66 @@ extern int option_quickest;
 /*+ The options to select the format of the output. +*/
 extern int option_html,option_gpx_track,option_gpx_route,option_text,option_stdout,option_text_all;
 
+/* Local types */
+
+/*+ A flag to indicate that the route point is the first one of a route leg. +*/
+#define ROUTE_LEG_START  1
+
+/*+ A flag to indicate that the route point is the start node of a route leg (no segment leads to it). +*/
+#define ROUTE_START_NODE 2
+
+/*+ A flag to indicate that the route point is a super-node. +*/
+#define ROUTE_SUPER_NODE 4
+
+/*+ The information about one point of the route, calculated once and used by all of the output formats. +*/
+typedef struct _RoutePoint
+{
+ index_t    node;               /*+ The node (real or fake) at this point. +*/
+ index_t    way;                /*+ The way used to reach this point (NO_WAY at the start of a leg). +*/
+
+ double     lat;                /*+ The latitude of the point (radians). +*/
+ double     lon;                /*+ The longitude of the point (radians). +*/
+
+ distance_t seg_distance;       /*+ The distance of the segment leading to this point. +*/
+ duration_t seg_duration;       /*+ The duration of the segment leading to this point. +*/
+
+ distance_t junc_distance;      /*+ The distance since the previous important junction. +*/
+ duration_t junc_duration;      /*+ The duration since the previous important junction. +*/
+
+ distance_t cum_distance;       /*+ The total distance from the start of the route. +*/
+ duration_t cum_duration;       /*+ The total duration from the start of the route. +*/
+
+ int16_t    bearing;            /*+ The bearing of the segment leading to this point. +*/
+ int16_t    bearing_next;       /*+ The bearing of the segment leaving this point. +*/
+ int16_t    turn;               /*+ The angle turned at this point. +*/
+
+ highway_t  highway;            /*+ The highway type of the way used to reach this point. +*/
+
+ uint8_t    important;          /*+ The importance of the junction (10 = waypoint, 5 = U-turn, 0 = unimportant). +*/
+ uint8_t    flags;              /*+ The ROUTE_* flags for this point. +*/
+}
+ RoutePoint;
+
+/*+ The number of route points to allocate at a time. +*/
+#define ROUTE_POINT_INCREMENT 256
+
+/*+ Convert a turn angle into an index into the list of turn descriptions. +*/
+#define TurnClass(xx)    (((202+(xx))/45)%8)
+
+/*+ Convert a bearing into an index into the list of heading descriptions. +*/
+#define HeadingClass(xx) ((4+(22+(xx))/45)%8)
+
+
+/* Local functions */
+
+static RoutePoint *AnnotateRoute(Results **results,int nresults,Nodes *nodes,Segments *segments,Ways *ways,Profile *profile,int *npoints);
+
+static double turn_angle(RoutePoint *point1,RoutePoint *pointm,RoutePoint *point2);
+static double bearing_angle(RoutePoint *point1,RoutePoint *point2);
+
+static FILE *open_file(const char *name,const char *suffix);
+
+
 /* Local variables */
 
 /*+ Heuristics for determining if a junction is important. +*/
@@ -86,77 +148,42 @@ static char junction_other_way[Way_Count][Way_Count]=
   Ways *ways The set of ways to use.
 
   Profile *profile The profile containing the transport type, speeds and allowed highways.
+
+  int alternative The number of the alternative route (or 0 for the optimum route).
   ++++++++++++++++++++++++++++++++++++++*/
 
-void PrintRoute(Results **results,int nresults,Nodes *nodes,Segments *segments,Ways *ways,Profile *profile)
+void PrintRoute(Results **results,int nresults,Nodes *nodes,Segments *segments,Ways *ways,Profile *profile,int alternative)
 {
  FILE *htmlfile=NULL,*gpxtrackfile=NULL,*gpxroutefile=NULL,*textfile=NULL,*textallfile=NULL;
+ char name[32];
 
- int point=1;
- distance_t cum_distance=0;
- duration_t cum_duration=0;
- double finish_lat,finish_lon;
+ RoutePoint *points;
+ int npoints,i;
  int segment_count=0,route_count=0;
  int point_count=0;
 
  /* Open the files */
 
  if(option_quickest==0)
-   {
-    /* Print the result for the shortest route */
-
-    if(option_html)
-       htmlfile    =fopen("shortest.html","w");
-    if(option_gpx_track)
-       gpxtrackfile=fopen("shortest-track.gpx","w");
-    if(option_gpx_route)
-       gpxroutefile=fopen("shortest-route.gpx","w");
-    if(option_text)
-       textfile    =fopen("shortest.txt","w");
-    if(option_stdout)
-       textfile    = stdout;
-    if(option_text_all)
-       textallfile =fopen("shortest-all.txt","w");
-
-    if(option_html && !htmlfile)
-       fprintf(stderr,"Warning: Cannot open file 'shortest.html' for writing [%s].\n",strerror(errno));
-    if(option_gpx_track && !gpxtrackfile)
-       fprintf(stderr,"Warning: Cannot open file 'shortest-track.gpx' for writing [%s].\n",strerror(errno));
-    if(option_gpx_route && !gpxroutefile)
-       fprintf(stderr,"Warning: Cannot open file 'shortest-route.gpx' for writing [%s].\n",strerror(errno));
-    if(option_text && !textfile)
-       fprintf(stderr,"Warning: Cannot open file 'shortest.txt' for writing [%s].\n",strerror(errno));
-    if(option_text_all && !textallfile)
-       fprintf(stderr,"Warning: Cannot open file 'shortest-all.txt' for writing [%s].\n",strerror(errno));
-   }
+    strcpy(name,"shortest");     /* Print the result for the shortest route */
  else
-   {
-    /* Print the result for the quickest route */
-
-    if(option_html)
-       htmlfile    =fopen("quickest.html","w");
-    if(option_gpx_track)
-       gpxtrackfile=fopen("quickest-track.gpx","w");
-    if(option_gpx_route)
-       gpxroutefile=fopen("quickest-route.gpx","w");
-    if(option_text)
-       textfile    =fopen("quickest.txt","w");
-    if(option_stdout)
-       textfile    = stdout;
-    if(option_text_all)
-       textallfile =fopen("quickest-all.txt","w");
-
-    if(option_html && !htmlfile)
-       fprintf(stderr,"Warning: Cannot open file 'quickest.html' for writing [%s].\n",strerror(errno));
-    if(option_gpx_track && !gpxtrackfile)
-       fprintf(stderr,"Warning: Cannot open file 'quickest-track.gpx' for writing [%s].\n",strerror(errno));
-    if(option_gpx_route && !gpxroutefile)
-       fprintf(stderr,"Warning: Cannot open file 'quickest-route.gpx' for writing [%s].\n",strerror(errno));
-    if(option_text && !textfile)
-       fprintf(stderr,"Warning: Cannot open file 'quickest.txt' for writing [%s].\n",strerror(errno));
-    if(option_text_all && !textallfile)
-       fprintf(stderr,"Warning: Cannot open file 'quickest-all.txt' for writing [%s].\n",strerror(errno));
-   }
+    strcpy(name,"quickest");     /* Print the result for the quickest route */
+
+ if(alternative)
+    sprintf(name+strlen(name),"-alt%d",alternative);
+
+ if(option_html)
+    htmlfile    =open_file(name,".html");
+ if(option_gpx_track)
+    gpxtrackfile=open_file(name,"-track.gpx");
+ if(option_gpx_route)
+    gpxroutefile=open_file(name,"-route.gpx");
+ if(option_text)
+    textfile    =open_file(name,".txt");
+ if(option_stdout && !alternative)
+    textfile    = stdout;
+ if(option_text_all)
+    textallfile =open_file(name,"-all.txt");
 
  /* Print the head of the files */
 
@@ -292,7 +319,313 @@ void PrintRoute(Results **results,int nresults,Nodes *nodes,Segments *segments,W
                         /* "%10.6f\t%11.6f\t%8d%c\t%s\t%5.3f\t%5.2f\t%5.2f\t%5.1f\t%3d\t%4d\t%s\n" */
    }
 
- /* Loop through the segments of the route and print it */
+ /* Calculate the route geometry once and loop through the points of the route and print it */
+
+ points=AnnotateRoute(results,nresults,nodes,segments,ways,profile,&npoints);
+
+ for(i=0;i<npoints;i++)
+   {
+    RoutePoint *routepoint=&points[i];
+    double latitude=routepoint->lat,longitude=routepoint->lon;
+    int important=routepoint->important;
+    int nextpoint=(i<(npoints-1));
+
+    if(gpxtrackfile && routepoint->flags&ROUTE_LEG_START)
+       fprintf(gpxtrackfile,"<trkseg>\n");
+
+    if(gpxtrackfile)
+       fprintf(gpxtrackfile,"<trkpt lat=\"%.6f\" lon=\"%.6f\"/>\n",
+               radians_to_degrees(latitude),radians_to_degrees(longitude));
+
+    if(!(routepoint->flags&ROUTE_START_NODE))
+      {
+       /* Cache the values to be printed rather than calculating them repeatedly for each output format */
+
+       char *waynameraw=NULL,*waynamexml=NULL;
+       const char *wayname=NULL;
+
+       if(important>1 || textallfile)
+         {
+          Way *resultway=LookupWay(ways,routepoint->way,1);
+
+          waynameraw=WayName(ways,resultway);
+
+          if(!*waynameraw)
+            {
+             wayname=HighwayName(routepoint->highway);
+             waynameraw=translate_highway[routepoint->highway];
+            }
+          else
+             wayname=waynameraw;
+         }
+
+       /* Print out the important points (junctions / waypoints) */
+
+       if(important>1)
+         {
+          /* Print the intermediate finish points (because they have correct junction distances) */
+
+          if(htmlfile)
+            {
+             char *type;
+
+             if(important==10)
+                type=translate_html_waypoint;
+             else
+                type=translate_html_junction;
+
+             if(!waynamexml)
+                waynamexml=ParseXML_Encode_Safe_XML(waynameraw);
+
+             fprintf(htmlfile,"<tr class='s'><td class='l'>%s:<td class='r'>",translate_html_segment[0]);
+             fprintf(htmlfile,translate_html_segment[1],
+                               waynamexml,
+                               distance_to_km(routepoint->junc_distance),duration_to_minutes(routepoint->junc_duration));
+             fprintf(htmlfile," [<span class='j'>");
+             fprintf(htmlfile,translate_html_total[1],
+                               distance_to_km(routepoint->cum_distance),duration_to_minutes(routepoint->cum_duration));
+             fprintf(htmlfile,"</span>]\n");
+
+             fprintf(htmlfile,"<tr class='c'><td class='l'>%d:<td class='r'>%.6f %.6f\n",
+                              ++point_count,
+                              radians_to_degrees(latitude),radians_to_degrees(longitude));
+
+             if(nextpoint)
+               {
+                fprintf(htmlfile,"<tr class='n'><td class='l'>%s:<td class='r'>",translate_html_node[0]);
+                fprintf(htmlfile,translate_html_node[1],
+                                 type,
+                                 translate_turn[TurnClass(routepoint->turn)],
+                                 translate_heading[HeadingClass(routepoint->bearing_next)]);
+                fprintf(htmlfile,"\n");
+               }
+             else
+               {
+                fprintf(htmlfile,"<tr class='n'><td class='l'>%s:<td class='r'>",translate_html_stop[0]);
+                fprintf(htmlfile,translate_html_stop[1],
+                                 translate_html_waypoint);
+                fprintf(htmlfile,"\n");
+                fprintf(htmlfile,"<tr class='t'><td class='l'>%s:<td class='r'><span class='j'>",translate_html_total[0]);
+                fprintf(htmlfile,translate_html_total[1],
+                                 distance_to_km(routepoint->cum_distance),duration_to_minutes(routepoint->cum_duration));
+                fprintf(htmlfile,"</span>\n");
+               }
+            }
+
+          if(gpxroutefile)
+            {
+             if(!waynamexml)
+                waynamexml=ParseXML_Encode_Safe_XML(waynameraw);
+
+             fprintf(gpxroutefile,"<desc>");
+             fprintf(gpxroutefile,translate_gpx_step,
+                                  translate_heading[HeadingClass(routepoint->bearing)],
+                                  waynamexml,
+                                  distance_to_km(routepoint->junc_distance),duration_to_minutes(routepoint->junc_duration));
+             fprintf(gpxroutefile,"</desc></rtept>\n");
+
+             if(!nextpoint)
+               {
+                fprintf(gpxroutefile,"<rtept lat=\"%.6f\" lon=\"%.6f\"><name>%s</name>\n",
+                                     radians_to_degrees(latitude),radians_to_degrees(longitude),
+                                     translate_gpx_finish);
+                fprintf(gpxroutefile,"<desc>");
+                fprintf(gpxroutefile,translate_gpx_final,
+                                     distance_to_km(routepoint->cum_distance),duration_to_minutes(routepoint->cum_duration));
+                fprintf(gpxroutefile,"</desc></rtept>\n");
+               }
+             else if(important==10)
+                fprintf(gpxroutefile,"<rtept lat=\"%.6f\" lon=\"%.6f\"><name>%s%d</name>\n",
+                                     radians_to_degrees(latitude),radians_to_degrees(longitude),
+                                     translate_gpx_inter,++segment_count);
+             else
+                fprintf(gpxroutefile,"<rtept lat=\"%.6f\" lon=\"%.6f\"><name>%s%03d</name>\n",
+                                     radians_to_degrees(latitude),radians_to_degrees(longitude),
+                                     translate_gpx_trip,++route_count);
+            }
+
+          if(textfile)
+            {
+             char *type;
+
+             if(important==10)
+                type="Waypt";
+             else
+                type="Junct";
+
+             if(nextpoint)
+                fprintf(textfile,"%10.6f\t%11.6f\t%6.3f km\t%4.1f min\t%5.1f km\t%4.0f min\t%s\t %+d\t %+d\t%s\n",
+                                 radians_to_degrees(latitude),radians_to_degrees(longitude),
+                                 distance_to_km(routepoint->junc_distance),duration_to_minutes(routepoint->junc_duration),
+                                 distance_to_km(routepoint->cum_distance),duration_to_minutes(routepoint->cum_duration),
+                                 type,
+                                 (22+routepoint->turn)/45,
+                                 ((22+routepoint->bearing_next)/45+4)%8-4,
+                                 wayname);
+             else
+                fprintf(textfile,"%10.6f\t%11.6f\t%6.3f km\t%4.1f min\t%5.1f km\t%4.0f min\t%s\t\t\t%s\n",
+                                 radians_to_degrees(latitude),radians_to_degrees(longitude),
+                                 distance_to_km(routepoint->junc_distance),duration_to_minutes(routepoint->junc_duration),
+                                 distance_to_km(routepoint->cum_distance),duration_to_minutes(routepoint->cum_duration),
+                                 type,
+                                 wayname);
+            }
+         }
+
+       /* Print out all of the results */
+
+       if(textallfile)
+         {
+          char *type;
+
+          if(important==10)
+             type="Waypt";
+          else if(important==2)
+             type="Change";
+          else if(important>=1)
+             type="Junct";
+          else
+             type="Inter";
+
+          fprintf(textallfile,"%10.6f\t%11.6f\t%8d%c\t%s\t%5.3f\t%5.2f\t%5.2f\t%5.1f\t%3d\t%4d\t%s\n",
+                              radians_to_degrees(latitude),radians_to_degrees(longitude),
+                              IsFakeNode(routepoint->node)?(NODE_FAKE-routepoint->node):routepoint->node,
+                              (routepoint->flags&ROUTE_SUPER_NODE)?'*':' ',type,
+                              distance_to_km(routepoint->seg_distance),duration_to_minutes(routepoint->seg_duration),
+                              distance_to_km(routepoint->cum_distance),duration_to_minutes(routepoint->cum_duration),
+                              profile->speed[routepoint->highway],
+                              routepoint->bearing,
+                              wayname);
+         }
+
+       if(waynamexml && waynamexml!=waynameraw)
+          free(waynamexml);
+      }
+    else if(!routepoint->cum_distance)
+      {
+       char *bearing_next_str=translate_heading[HeadingClass(routepoint->bearing_next)];
+
+       /* Print out the very first start point */
+
+       if(htmlfile)
+         {
+          fprintf(htmlfile,"<tr class='c'><td class='l'>%d:<td class='r'>%.6f %.6f\n",
+                           ++point_count,
+                           radians_to_degrees(latitude),radians_to_degrees(longitude));
+          fprintf(htmlfile,"<tr class='n'><td class='l'>%s:<td class='r'>",translate_html_start[0]);
+          fprintf(htmlfile,translate_html_start[1],
+                           translate_html_waypoint,
+                           bearing_next_str);
+          fprintf(htmlfile,"\n");
+         }
+
+       if(gpxroutefile)
+          fprintf(gpxroutefile,"<rtept lat=\"%.6f\" lon=\"%.6f\"><name>%s</name>\n",
+                               radians_to_degrees(latitude),radians_to_degrees(longitude),
+                               translate_gpx_start);
+
+       if(textfile)
+          fprintf(textfile,"%10.6f\t%11.6f\t%6.3f km\t%4.1f min\t%5.1f km\t%4.0f min\t%s\t\t +%d\t\n",
+                           radians_to_degrees(latitude),radians_to_degrees(longitude),
+                           0.0,0.0,0.0,0.0,
+                           "Waypt",
+                           (22+routepoint->bearing_next)/45);
+
+       if(textallfile)
+          fprintf(textallfile,"%10.6f\t%11.6f\t%8d%c\t%s\t%5.3f\t%5.2f\t%5.2f\t%5.1f\t\t\t\n",
+                              radians_to_degrees(latitude),radians_to_degrees(longitude),
+                              IsFakeNode(routepoint->node)?(NODE_FAKE-routepoint->node):routepoint->node,
+                              (routepoint->flags&ROUTE_SUPER_NODE)?'*':' ',"Waypt",
+                              0.0,0.0,0.0,0.0);
+      }
+
+    if(gpxtrackfile && (!nextpoint || points[i+1].flags&ROUTE_LEG_START))
+       fprintf(gpxtrackfile,"</trkseg>\n");
+   }
+
+ free(points);
+
+ /* Print the tail of the files */
+
+ if(htmlfile)
+   {
+    fprintf(htmlfile,"</table>\n");
+
+    if((translate_copyright_creator[0] && translate_copyright_creator[1]) ||
+       (translate_copyright_source[0]  && translate_copyright_source[1]) ||
+       (translate_copyright_license[0] && translate_copyright_license[1]))
+      {
+       fprintf(htmlfile,"<p>\n");
+       fprintf(htmlfile,"<table class='c'>\n");
+       if(translate_copyright_creator[0] && translate_copyright_creator[1])
+          fprintf(htmlfile,"<tr><td class='l'>%s:<td class='r'>%s\n",translate_copyright_creator[0],translate_copyright_creator[1]);
+       if(translate_copyright_source[0] && translate_copyright_source[1])
+          fprintf(htmlfile,"<tr><td class='l'>%s:<td class='r'>%s\n",translate_copyright_source[0],translate_copyright_source[1]);
+       if(translate_copyright_license[0] && translate_copyright_license[1])
+          fprintf(htmlfile,"<tr><td class='l'>%s:<td class='r'>%s\n",translate_copyright_license[0],translate_copyright_license[1]);
+       fprintf(htmlfile,"</table>\n");
+      }
+
+    fprintf(htmlfile,"</BODY>\n");
+    fprintf(htmlfile,"</HTML>\n");
+   }
+
+ if(gpxtrackfile)
+   {
+    fprintf(gpxtrackfile,"</trk>\n");
+    fprintf(gpxtrackfile,"</gpx>\n");
+   }
+
+ if(gpxroutefile)
+   {
+    fprintf(gpxroutefile,"</rte>\n");
+    fprintf(gpxroutefile,"</gpx>\n");
+   }
+
+ /* Close the files */
+
+ if(htmlfile)
+    fclose(htmlfile);
+ if(gpxtrackfile)
+    fclose(gpxtrackfile);
+ if(gpxroutefile)
+    fclose(gpxroutefile);
+ if(textfile)
+    fclose(textfile);
+ if(textallfile)
+    fclose(textallfile);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Calculate the geometry, distances, durations, bearings and turns for each point of the route.
+
+  RoutePoint *AnnotateRoute Returns an array of route points (to be freed by the caller).
+
+  Results **results The set of results to use (some may be NULL - ignore them).
+
+  int nresults The number of results in the list.
+
+  Nodes *nodes The set of nodes to use.
+
+  Segments *segments The set of segments to use.
+
+  Ways *ways The set of ways to use.
+
+  Profile *profile The profile containing the transport type, speeds and allowed highways.
+
+  int *npoints Returns the number of points in the array.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static RoutePoint *AnnotateRoute(Results **results,int nresults,Nodes *nodes,Segments *segments,Ways *ways,Profile *profile,int *npoints)
+{
+ RoutePoint *points=NULL;
+ int nallocated=0,n=0,i;
+ int point=1;
+ distance_t cum_distance=0;
+ duration_t cum_duration=0;
+
+ /* Loop through the segments of the route and store the distances and junction types */
 
  while(!results[point])
     point++;
@@ -300,43 +633,43 @@ void PrintRoute(Results **results,int nresults,Nodes *nodes,Segments *segments,W
  while(point<=nresults)
    {
     int nextpoint=point;
-    double start_lat,start_lon;
     distance_t junc_distance=0;
     duration_t junc_duration=0;
     Result *result;
-
-    if(gpxtrackfile)
-       fprintf(gpxtrackfile,"<trkseg>\n");
-
-    if(IsFakeNode(results[point]->start_node))
-       GetFakeLatLong(results[point]->start_node,&start_lat,&start_lon);
-    else
-       GetLatLong(nodes,results[point]->start_node,&start_lat,&start_lon);
-
-    if(IsFakeNode(results[point]->finish_node))
-       GetFakeLatLong(results[point]->finish_node,&finish_lat,&finish_lon);
-    else
-       GetLatLong(nodes,results[point]->finish_node,&finish_lat,&finish_lon);
+    int legstart=1;
 
     result=FindResult(results[point],results[point]->start_node,results[point]->prev_segment);
 
     do
       {
-       double latitude,longitude;
+       RoutePoint *routepoint;
        Result *nextresult;
        index_t nextrealsegment;
-       Segment *nextresultsegment;
 
-       if(result->node==results[point]->start_node)
-         {latitude=start_lat; longitude=start_lon;}
-       else if(result->node==results[point]->finish_node)
-         {latitude=finish_lat; longitude=finish_lon;}
+       if(n==nallocated)
+         {
+          nallocated+=ROUTE_POINT_INCREMENT;
+          points=(RoutePoint*)realloc((void*)points,nallocated*sizeof(RoutePoint));
+
+          assert(points); /* Check realloc() worked */
+         }
+
+       routepoint=&points[n];
+
+       routepoint->node=result->node;
+       routepoint->flags=legstart?ROUTE_LEG_START:0;
+
+       if(IsFakeNode(result->node))
+          GetFakeLatLong(result->node,&routepoint->lat,&routepoint->lon);
        else
-          GetLatLong(nodes,result->node,&latitude,&longitude);
+         {
+          GetLatLong(nodes,result->node,&routepoint->lat,&routepoint->lon);
 
-       if(gpxtrackfile)
-          fprintf(gpxtrackfile,"<trkpt lat=\"%.6f\" lon=\"%.6f\"/>\n",
-                  radians_to_degrees(latitude),radians_to_degrees(longitude));
+          if(IsSuperNode(LookupNode(nodes,result->node,1)))
+             routepoint->flags|=ROUTE_SUPER_NODE;
+         }
+
+       routepoint->bearing=routepoint->bearing_next=routepoint->turn=0;
 
        nextresult=result->next;
 
@@ -352,38 +685,21 @@ void PrintRoute(Results **results,int nresults,Nodes *nodes,Segments *segments,W
        if(nextresult)
          {
           if(IsFakeSegment(nextresult->segment))
-            {
-             nextresultsegment=LookupFakeSegment(nextresult->segment);
              nextrealsegment=IndexRealSegment(nextresult->segment);
-            }
           else
-            {
-             nextresultsegment=LookupSegment(segments,nextresult->segment,1);
              nextrealsegment=nextresult->segment;
-            }
          }
        else
-         {
-          nextresultsegment=NULL;
           nextrealsegment=NO_SEGMENT;
-         }
 
        if(result->node!=results[point]->start_node)
          {
-          distance_t seg_distance=0;
-          duration_t seg_duration=0;
           index_t realsegment;
           Segment *resultsegment;
           Way *resultway;
+          SegmentOverride *override;
           int important=0;
 
-          /* Cache the values to be printed rather than calculating them repeatedly for each output format */
-
-          char *waynameraw=NULL,*waynamexml=NULL;
-          const char *wayname=NULL;
-          int bearing_int=0,bearing_next_int=0,turn_int=0;
-          char *bearing_str=NULL,*bearing_next_str=NULL,*turn_str=NULL;
-
           /* Get the properties of this segment */
 
           if(IsFakeSegment(result->segment))
@@ -398,12 +714,20 @@ void PrintRoute(Results **results,int nresults,Nodes *nodes,Segments *segments,W
             }
           resultway=LookupWay(ways,resultsegment->way,1);
 
-          seg_distance+=DISTANCE(resultsegment->distance);
-          seg_duration+=Duration(resultsegment,resultway,profile);
-          junc_distance+=seg_distance;
-          junc_duration+=seg_duration;
-          cum_distance+=seg_distance;
-          cum_duration+=seg_duration;
+          routepoint->way=resultsegment->way;
+          routepoint->highway=HIGHWAY(resultway->type);
+
+          routepoint->seg_distance=DISTANCE(resultsegment->distance);
+
+          if(segments->overlay && (override=FindSegmentOverride(segments->overlay,realsegment)))
+             routepoint->seg_duration=OverrideDuration(segments->overlay,override,resultsegment,resultway,profile);
+          else
+             routepoint->seg_duration=Duration(resultsegment,resultway,profile);
+
+          junc_distance+=routepoint->seg_distance;
+          junc_duration+=routepoint->seg_duration;
+          cum_distance+=routepoint->seg_distance;
+          cum_duration+=routepoint->seg_duration;
 
           /* Decide if this is an important junction */
 
@@ -448,313 +772,151 @@ void PrintRoute(Results **results,int nresults,Nodes *nodes,Segments *segments,W
              while(segment);
             }
 
-          /* Print out the important points (junctions / waypoints) */
+          routepoint->important=important;
+
+          /* The junction distance is reset after each important point */
+
+          routepoint->junc_distance=junc_distance;
+          routepoint->junc_duration=junc_duration;
 
           if(important>1)
             {
-             /* Print the intermediate finish points (because they have correct junction distances) */
+             junc_distance=0;
+             junc_duration=0;
+            }
+         }
+       else
+         {
+          routepoint->flags|=ROUTE_START_NODE;
 
-             if(htmlfile)
-               {
-                char *type;
+          routepoint->way=NO_WAY;
+          routepoint->highway=0;
+          routepoint->important=0;
 
-                if(important==10)
-                   type=translate_html_waypoint;
-                else
-                   type=translate_html_junction;
+          routepoint->seg_distance=routepoint->junc_distance=0;
+          routepoint->seg_duration=routepoint->junc_duration=0;
+         }
 
-                if(!waynameraw)
-                  {
-                   waynameraw=WayName(ways,resultway);
-                   if(!*waynameraw)
-                      waynameraw=translate_highway[HIGHWAY(resultway->type)];
-                  }
+       routepoint->cum_distance=cum_distance;
+       routepoint->cum_duration=cum_duration;
 
-                if(!waynamexml)
-                   waynamexml=ParseXML_Encode_Safe_XML(waynameraw);
+       n++;
 
-                fprintf(htmlfile,"<tr class='s'><td class='l'>%s:<td class='r'>",translate_html_segment[0]);
-                fprintf(htmlfile,translate_html_segment[1],
-                                  waynamexml,
-                                  distance_to_km(junc_distance),duration_to_minutes(junc_duration));
-                fprintf(htmlfile," [<span class='j'>");
-                fprintf(htmlfile,translate_html_total[1],
-                                  distance_to_km(cum_distance),duration_to_minutes(cum_duration));
-                fprintf(htmlfile,"</span>]\n");
+       legstart=0;
 
-                fprintf(htmlfile,"<tr class='c'><td class='l'>%d:<td class='r'>%.6f %.6f\n",
-                                 ++point_count,
-                                 radians_to_degrees(latitude),radians_to_degrees(longitude));
+       result=nextresult;
+      }
+    while(point==nextpoint);
 
-                if(nextresult)
-                  {
-                   if(!turn_str)
-                     {
-                      turn_int=(int)TurnAngle(nodes,resultsegment,nextresultsegment,result->node);
-                      turn_str=translate_turn[((202+turn_int)/45)%8];
-                     }
+    point=nextpoint;
+   }
 
-                   if(!bearing_next_str)
-                     {
-                      bearing_next_int=(int)BearingAngle(nodes,nextresultsegment,nextresult->node);
-                      bearing_next_str=translate_heading[(4+(22+bearing_next_int)/45)%8];
-                     }
+ /* Calculate the bearings and turns from the stored coordinates, the start of each leg
+    after the first is the same node as the end of the previous leg so it is skipped. */
 
-                   fprintf(htmlfile,"<tr class='n'><td class='l'>%s:<td class='r'>",translate_html_node[0]);
-                   fprintf(htmlfile,translate_html_node[1],
-                                    type,
-                                    turn_str,
-                                    bearing_next_str);
-                   fprintf(htmlfile,"\n");
-                  }
-                else
-                  {
-                   fprintf(htmlfile,"<tr class='n'><td class='l'>%s:<td class='r'>",translate_html_stop[0]);
-                   fprintf(htmlfile,translate_html_stop[1],
-                                    translate_html_waypoint);
-                   fprintf(htmlfile,"\n");
-                   fprintf(htmlfile,"<tr class='t'><td class='l'>%s:<td class='r'><span class='j'>",translate_html_total[0]);
-                   fprintf(htmlfile,translate_html_total[1],
-                                    distance_to_km(cum_distance),duration_to_minutes(cum_duration));
-                   fprintf(htmlfile,"</span>\n");
-                  }
-               }
+ for(i=0;i<n;i++)
+   {
+    int next=i+1;
 
-             if(gpxroutefile)
-               {
-                if(!waynameraw)
-                  {
-                   waynameraw=WayName(ways,resultway);
-                   if(!*waynameraw)
-                      waynameraw=translate_highway[HIGHWAY(resultway->type)];
-                  }
-
-                if(!waynamexml)
-                   waynamexml=ParseXML_Encode_Safe_XML(waynameraw);
-
-                if(!bearing_str)
-                  {
-                   bearing_int=(int)BearingAngle(nodes,resultsegment,result->node);
-                   bearing_str=translate_heading[(4+(22+bearing_int)/45)%8];
-                  }
+    if(next<n && points[next].flags&ROUTE_LEG_START)
+       next++;
 
-                fprintf(gpxroutefile,"<desc>");
-                fprintf(gpxroutefile,translate_gpx_step,
-                                     bearing_str,
-                                     waynamexml,
-                                     distance_to_km(junc_distance),duration_to_minutes(junc_duration));
-                fprintf(gpxroutefile,"</desc></rtept>\n");
+    if(!(points[i].flags&ROUTE_START_NODE))
+       points[i].bearing=(int)bearing_angle(&points[i],&points[i-1]);
 
-                if(!nextresult)
-                  {
-                   fprintf(gpxroutefile,"<rtept lat=\"%.6f\" lon=\"%.6f\"><name>%s</name>\n",
-                                        radians_to_degrees(finish_lat),radians_to_degrees(finish_lon),
-                                        translate_gpx_finish);
-                   fprintf(gpxroutefile,"<desc>");
-                   fprintf(gpxroutefile,translate_gpx_final,
-                                        distance_to_km(cum_distance),duration_to_minutes(cum_duration));
-                   fprintf(gpxroutefile,"</desc></rtept>\n");
-                  }
-                else if(important==10)
-                   fprintf(gpxroutefile,"<rtept lat=\"%.6f\" lon=\"%.6f\"><name>%s%d</name>\n",
-                                        radians_to_degrees(latitude),radians_to_degrees(longitude),
-                                        translate_gpx_inter,++segment_count);
-                else
-                   fprintf(gpxroutefile,"<rtept lat=\"%.6f\" lon=\"%.6f\"><name>%s%03d</name>\n",
-                                        radians_to_degrees(latitude),radians_to_degrees(longitude),
-                                        translate_gpx_trip,++route_count);
-               }
+    if(next<n)
+      {
+       points[i].bearing_next=(int)bearing_angle(&points[next],&points[i]);
 
-             if(textfile)
-               {
-                char *type;
-
-                if(important==10)
-                   type="Waypt";
-                else
-                   type="Junct";
-
-                if(!wayname)
-                  {
-                   wayname=WayName(ways,resultway);
-                   if(!*wayname)
-                      wayname=HighwayName(HIGHWAY(resultway->type));
-                  }
-
-                if(nextresult)
-                  {
-                   if(!turn_str)
-                     {
-                      turn_int=(int)TurnAngle(nodes,resultsegment,nextresultsegment,result->node);
-                      turn_str=translate_turn[((202+turn_int)/45)%8];
-                     }
+       if(!(points[i].flags&ROUTE_START_NODE))
+          points[i].turn=(int)turn_angle(&points[i-1],&points[i],&points[next]);
+      }
+   }
 
-                   if(!bearing_next_str)
-                     {
-                      bearing_next_int=(int)BearingAngle(nodes,nextresultsegment,nextresult->node);
-                      bearing_next_str=translate_heading[(4+(22+bearing_next_int)/45)%8];
-                     }
+ *npoints=n;
 
-                   fprintf(textfile,"%10.6f\t%11.6f\t%6.3f km\t%4.1f min\t%5.1f km\t%4.0f min\t%s\t %+d\t %+d\t%s\n",
-                                    radians_to_degrees(latitude),radians_to_degrees(longitude),
-                                    distance_to_km(junc_distance),duration_to_minutes(junc_duration),
-                                    distance_to_km(cum_distance),duration_to_minutes(cum_duration),
-                                    type,
-                                    (22+turn_int)/45,
-                                    ((22+bearing_next_int)/45+4)%8-4,
-                                    wayname);
-                  }
-                else
-                   fprintf(textfile,"%10.6f\t%11.6f\t%6.3f km\t%4.1f min\t%5.1f km\t%4.0f min\t%s\t\t\t%s\n",
-                                    radians_to_degrees(latitude),radians_to_degrees(longitude),
-                                    distance_to_km(junc_distance),duration_to_minutes(junc_duration),
-                                    distance_to_km(cum_distance),duration_to_minutes(cum_duration),
-                                    type,
-                                    wayname);
-               }
+ return(points);
+}
 
-             junc_distance=0;
-             junc_duration=0;
-            }
 
-          /* Print out all of the results */
+/*++++++++++++++++++++++++++++++++++++++
+  Calculate the angle to turn at a route point, equivalent to TurnAngle() but using the stored coordinates.
 
-          if(textallfile)
-            {
-             char *type;
+  double turn_angle Returns a value in the range -180 to +180 indicating the angle to turn.
 
-             if(important==10)
-                type="Waypt";
-             else if(important==2)
-                type="Change";
-             else if(important>=1)
-                type="Junct";
-             else
-                type="Inter";
+  RoutePoint *point1 The point before the junction.
 
-             if(!wayname)
-               {
-                wayname=WayName(ways,resultway);
-                if(!*wayname)
-                   wayname=HighwayName(HIGHWAY(resultway->type));
-               }
+  RoutePoint *pointm The point at the junction.
 
-             if(!bearing_str)
-               {
-                bearing_int=(int)BearingAngle(nodes,resultsegment,result->node);
-                bearing_str=translate_heading[(4+(22+bearing_int)/45)%8];
-               }
+  RoutePoint *point2 The point after the junction.
+  ++++++++++++++++++++++++++++++++++++++*/
 
-             fprintf(textallfile,"%10.6f\t%11.6f\t%8d%c\t%s\t%5.3f\t%5.2f\t%5.2f\t%5.1f\t%3d\t%4d\t%s\n",
-                                 radians_to_degrees(latitude),radians_to_degrees(longitude),
-                                 IsFakeNode(result->node)?(NODE_FAKE-result->node):result->node,
-                                 (!IsFakeNode(result->node) && IsSuperNode(LookupNode(nodes,result->node,1)))?'*':' ',type,
-                                 distance_to_km(seg_distance),duration_to_minutes(seg_duration),
-                                 distance_to_km(cum_distance),duration_to_minutes(cum_duration),
-                                 profile->speed[HIGHWAY(resultway->type)],
-                                 bearing_int,
-                                 wayname);
-            }
+static double turn_angle(RoutePoint *point1,RoutePoint *pointm,RoutePoint *point2)
+{
+ double angle1,angle2,angle;
 
-          if(waynamexml && waynamexml!=waynameraw)
-             free(waynamexml);
-         }
-       else if(!cum_distance)
-         {
-          int   bearing_next_int=(int)BearingAngle(nodes,nextresultsegment,nextresult->node);
-          char *bearing_next_str=translate_heading[(4+(22+bearing_next_int)/45)%8];
+ angle1=atan2((pointm->lon-point1->lon)*cos(pointm->lat),(pointm->lat-point1->lat));
+ angle2=atan2((point2->lon-pointm->lon)*cos(pointm->lat),(point2->lat-pointm->lat));
 
-          /* Print out the very first start point */
+ angle=angle2-angle1;
 
-          if(htmlfile)
-            {
-             fprintf(htmlfile,"<tr class='c'><td class='l'>%d:<td class='r'>%.6f %.6f\n",
-                              ++point_count,
-                              radians_to_degrees(latitude),radians_to_degrees(longitude));
-             fprintf(htmlfile,"<tr class='n'><td class='l'>%s:<td class='r'>",translate_html_start[0]);
-             fprintf(htmlfile,translate_html_start[1],
-                              translate_html_waypoint,
-                              bearing_next_str);
-             fprintf(htmlfile,"\n");
-            }
+ angle=radians_to_degrees(angle);
 
-          if(gpxroutefile)
-             fprintf(gpxroutefile,"<rtept lat=\"%.6f\" lon=\"%.6f\"><name>%s</name>\n",
-                                  radians_to_degrees(latitude),radians_to_degrees(longitude),
-                                  translate_gpx_start);
+ if(angle<-180) angle+=360;
+ if(angle> 180) angle-=360;
 
-          if(textfile)
-             fprintf(textfile,"%10.6f\t%11.6f\t%6.3f km\t%4.1f min\t%5.1f km\t%4.0f min\t%s\t\t +%d\t\n",
-                              radians_to_degrees(latitude),radians_to_degrees(longitude),
-                              0.0,0.0,0.0,0.0,
-                              "Waypt",
-                              (22+bearing_next_int)/45);
+ return(angle);
+}
 
-          if(textallfile)
-             fprintf(textallfile,"%10.6f\t%11.6f\t%8d%c\t%s\t%5.3f\t%5.2f\t%5.2f\t%5.1f\t\t\t\n",
-                                 radians_to_degrees(latitude),radians_to_degrees(longitude),
-                                 IsFakeNode(result->node)?(NODE_FAKE-result->node):result->node,
-                                 (!IsFakeNode(result->node) && IsSuperNode(LookupNode(nodes,result->node,1)))?'*':' ',"Waypt",
-                                 0.0,0.0,0.0,0.0);
-         }
 
-       result=nextresult;
-      }
-    while(point==nextpoint);
+/*++++++++++++++++++++++++++++++++++++++
+  Calculate the bearing of a route segment, equivalent to BearingAngle() but using the stored coordinates.
 
-    if(gpxtrackfile)
-       fprintf(gpxtrackfile,"</trkseg>\n");
+  double bearing_angle Returns a value in the range 0 to 359 indicating the bearing.
 
-    point=nextpoint;
-   }
+  RoutePoint *point1 The point at the end of the segment.
 
- /* Print the tail of the files */
+  RoutePoint *point2 The point at the other end of the segment.
+  ++++++++++++++++++++++++++++++++++++++*/
 
- if(htmlfile)
-   {
-    fprintf(htmlfile,"</table>\n");
+static double bearing_angle(RoutePoint *point1,RoutePoint *point2)
+{
+ double angle;
 
-    if((translate_copyright_creator[0] && translate_copyright_creator[1]) ||
-       (translate_copyright_source[0]  && translate_copyright_source[1]) ||
-       (translate_copyright_license[0] && translate_copyright_license[1]))
-      {
-       fprintf(htmlfile,"<p>\n");
-       fprintf(htmlfile,"<table class='c'>\n");
-       if(translate_copyright_creator[0] && translate_copyright_creator[1])
-          fprintf(htmlfile,"<tr><td class='l'>%s:<td class='r'>%s\n",translate_copyright_creator[0],translate_copyright_creator[1]);
-       if(translate_copyright_source[0] && translate_copyright_source[1])
-          fprintf(htmlfile,"<tr><td class='l'>%s:<td class='r'>%s\n",translate_copyright_source[0],translate_copyright_source[1]);
-       if(translate_copyright_license[0] && translate_copyright_license[1])
-          fprintf(htmlfile,"<tr><td class='l'>%s:<td class='r'>%s\n",translate_copyright_license[0],translate_copyright_license[1]);
-       fprintf(htmlfile,"</table>\n");
-      }
+ angle=atan2((point2->lat-point1->lat),(point2->lon-point1->lon)*cos(point1->lat));
 
-    fprintf(htmlfile,"</BODY>\n");
-    fprintf(htmlfile,"</HTML>\n");
-   }
+ angle=radians_to_degrees(angle);
 
- if(gpxtrackfile)
-   {
-    fprintf(gpxtrackfile,"</trk>\n");
-    fprintf(gpxtrackfile,"</gpx>\n");
-   }
+ angle=270-angle;
 
- if(gpxroutefile)
-   {
-    fprintf(gpxroutefile,"</rte>\n");
-    fprintf(gpxroutefile,"</gpx>\n");
-   }
+ if(angle<  0) angle+=360;
+ if(angle>360) angle-=360;
 
- /* Close the files */
+ return(angle);
+}
 
- if(htmlfile)
-    fclose(htmlfile);
- if(gpxtrackfile)
-    fclose(gpxtrackfile);
- if(gpxroutefile)
-    fclose(gpxroutefile);
- if(textfile)
-    fclose(textfile);
- if(textallfile)
-    fclose(textallfile);
+
+/*++++++++++++++++++++++++++++++++++++++
+  Open one of the output files for writing, printing a warning if it cannot be opened.
+
+  FILE *open_file Returns the opened file or NULL in case of error.
+
+  const char *name The name of the route (the start of the filename).
+
+  const char *suffix The type of output file (the end of the filename).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static FILE *open_file(const char *name,const char *suffix)
+{
+ char filename[64];
+ FILE *file;
+
+ sprintf(filename,"%s%s",name,suffix);
+
+ file=fopen(filename,"w");
+
+ if(!file)
+    fprintf(stderr,"Warning: Cannot open file '%s' for writing [%s].\n",filename,strerror(errno));
+
+ return(file);
 }
@@ -0,0 +1,268 @@
+/***************************************
+ Runtime segment overlay functions.
+
+ Part of the Routino routing software.
+ ******************/ /******************
+ This file Copyright 2008-2011 Andrew M. Bishop
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************/
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "types.h"
+#include "segments.h"
+#include "ways.h"
+#include "overlay.h"
+
+#include "files.h"
+#include "profiles.h"
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Load in an overlay from a file.
+
+  Overlay *LoadOverlay Returns the overlay that has just been loaded.
+
+  const char *filename The name of the file to load.
+
+  index_t nnodes The number of nodes in the database.
+
+  index_t nsegments The number of segments in the database.
+
+  index_t nways The number of ways in the database.
+
+  The file is always memory mapped (even in slim mode) since it is small and a
+  new version can replace it on disk without affecting a router that is using it.
+  The overlay is refused (NULL is returned) if it was made for a different
+  database or contains a segment index that is not in this database.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+Overlay *LoadOverlay(const char *filename,index_t nnodes,index_t nsegments,index_t nways)
+{
+ Overlay *overlay;
+ off_t size;
+ const char *error=NULL;
+ index_t i;
+
+ size=SizeFile(filename);
+
+ if(size<(off_t)sizeof(OverlayFile))
+   {
+    fprintf(stderr,"Error: The overlay file '%s' is not valid (too short).\n",filename);
+    return(NULL);
+   }
+
+ overlay=(Overlay*)malloc(sizeof(Overlay));
+
+ assert(overlay); /* Check malloc() worked */
+
+ overlay->data=MapFile(filename);
+
+ /* Copy the OverlayFile structure from the loaded data */
+
+ overlay->file=*((OverlayFile*)overlay->data);
+
+ /* Set the pointers in the Overlay structure. */
+
+ overlay->overrides=(SegmentOverride*)(overlay->data+sizeof(OverlayFile));
+ overlay->supersegments=(index_t*)(overlay->data+sizeof(OverlayFile)+overlay->file.number*sizeof(SegmentOverride));
+
+ /* Check that the overlay was made for this database and that the segment indexes are sorted and in range. */
+
+ if(overlay->file.magic!=OVERLAY_MAGIC || overlay->file.version!=OVERLAY_VERSION)
+    error="is not an overlay file or is from an incompatible version";
+ else if(size!=(off_t)(sizeof(OverlayFile)+overlay->file.number*sizeof(SegmentOverride)+overlay->file.snumber*sizeof(index_t)))
+    error="has the wrong size";
+ else if(overlay->file.nnodes!=nnodes || overlay->file.nsegments!=nsegments || overlay->file.nways!=nways)
+    error="was made for a different database (run overlaymaker again)";
+ else
+   {
+    for(i=0;i<overlay->file.number;i++)
+       if(overlay->overrides[i].segment>=nsegments || (i>0 && overlay->overrides[i].segment<=overlay->overrides[i-1].segment))
+          error="contains an invalid segment override";
+
+    for(i=0;i<overlay->file.snumber;i++)
+       if(overlay->supersegments[i]>=nsegments || (i>0 && overlay->supersegments[i]<=overlay->supersegments[i-1]))
+          error="contains an invalid super-segment";
+   }
+
+ if(error)
+   {
+    fprintf(stderr,"Error: The overlay file '%s' %s.\n",filename,error);
+
+    overlay->data=UnmapFile(filename);
+
+    free(overlay);
+
+    return(NULL);
+   }
+
+ overlay->superscores=NULL;
+
+ overlay->hour=0;
+
+ return(overlay);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the override for a segment (if there is one).
+
+  SegmentOverride *FindSegmentOverride Returns a pointer to the override or NULL if the segment is not overridden.
+
+  Overlay *overlay The overlay to search.
+
+  index_t segment The index of the segment.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+SegmentOverride *FindSegmentOverride(Overlay *overlay,index_t segment)
+{
+ int start=0;
+ int end=overlay->file.number-1;
+ int mid;
+
+ /* Binary search - search key exact match only is required.
+  *
+  *  # <- start  |  Check mid and move start or end if it doesn't match
+  *  #           |
+  *  #           |  Since an exact match is wanted we can set end=mid-1
+  *  # <- mid    |  or start=mid+1 because we know that mid doesn't match.
+  *  #           |
+  *  #           |  Eventually either end=start or end=start+1 and one of
+  *  # <- end    |  start or end is the wanted one.
+  */
+
+ if(end<start)                                       /* There are no overrides */
+    return(NULL);
+ else if(segment<overlay->overrides[start].segment)  /* Check key is not before start */
+    return(NULL);
+ else if(segment>overlay->overrides[end].segment)    /* Check key is not after end */
+    return(NULL);
+ else
+   {
+    do
+      {
+       mid=(start+end)/2;                            /* Choose mid point */
+
+       if(overlay->overrides[mid].segment<segment)   /* Mid point is too low */
+          start=mid+1;
+       else if(overlay->overrides[mid].segment>segment) /* Mid point is too high */
+          end=mid-1;
+       else                                          /* Mid point is correct */
+          return(&overlay->overrides[mid]);
+      }
+    while((end-start)>1);
+
+    if(overlay->overrides[start].segment==segment)   /* Start is correct */
+       return(&overlay->overrides[start]);
+
+    if(overlay->overrides[end].segment==segment)     /* End is correct */
+       return(&overlay->overrides[end]);
+   }
+
+ return(NULL);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the position of a super-segment in the list of super-segments affected by the overlay.
+
+  index_t FindOverlaySuperSegment Returns the position in the list or NO_SEGMENT if the super-segment is not affected.
+
+  Overlay *overlay The overlay to search.
+
+  index_t segment The index of the super-segment.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+index_t FindOverlaySuperSegment(Overlay *overlay,index_t segment)
+{
+ int start=0;
+ int end=overlay->file.snumber-1;
+ int mid;
+
+ /* Binary search - search key exact match only is required (see FindSegmentOverride) */
+
+ if(end<start)                                       /* There are no super-segments */
+    return(NO_SEGMENT);
+ else if(segment<overlay->supersegments[start])      /* Check key is not before start */
+    return(NO_SEGMENT);
+ else if(segment>overlay->supersegments[end])        /* Check key is not after end */
+    return(NO_SEGMENT);
+ else
+   {
+    do
+      {
+       mid=(start+end)/2;                            /* Choose mid point */
+
+       if(overlay->supersegments[mid]<segment)       /* Mid point is too low */
+          start=mid+1;
+       else if(overlay->supersegments[mid]>segment)  /* Mid point is too high */
+          end=mid-1;
+       else                                          /* Mid point is correct */
+          return(mid);
+      }
+    while((end-start)>1);
+
+    if(overlay->supersegments[start]==segment)       /* Start is correct */
+       return(start);
+
+    if(overlay->supersegments[end]==segment)         /* End is correct */
+       return(end);
+   }
+
+ return(NO_SEGMENT);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Calculate the duration of travel on a segment that is overridden.
+
+  duration_t OverrideDuration Returns the duration of travel (the segment must not be closed).
+
+  Overlay *overlay The overlay containing the override.
+
+  SegmentOverride *override The override for the segment.
+
+  Segment *segment The segment.
+
+  Way *way The way that the segment belongs to.
+
+  Profile *profile The profile of the transport being used.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+duration_t OverrideDuration(Overlay *overlay,SegmentOverride *override,Segment *segment,Way *way,Profile *profile)
+{
+ duration_t duration;
+ uint8_t factor=override->factor[overlay->hour];
+
+ if(override->speed)
+   {
+    Way overway=*way;
+
+    overway.speed=override->speed;
+
+    duration=Duration(segment,&overway,profile);
+   }
+ else
+    duration=Duration(segment,way,profile);
+
+ if(factor!=100)
+    duration=(duration_t)((double)duration*100.0/(double)factor);
+
+ return(duration);
+}
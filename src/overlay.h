@@ -0,0 +1,110 @@
+/***************************************
+ A header file for the runtime segment overlay.
+
+ Part of the Routino routing software.
+ ******************/ /******************
+ This file Copyright 2008-2011 Andrew M. Bishop
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************/
+
+
+#ifndef OVERLAY_H
+#define OVERLAY_H    /*+ To stop multiple inclusions. +*/
+
+#include <stdint.h>
+
+#include "types.h"
+
+#include "profiles.h"
+
+
+/* Constants */
+
+/*+ The number of separate time periods in a day that can have their own speed factor. +*/
+#define OVERLAY_HOURS 24
+
+/*+ The magic number at the start of an overlay file ("RTOV" when read as characters). +*/
+#define OVERLAY_MAGIC   0x564f5452
+
+/*+ The version of the overlay file format. +*/
+#define OVERLAY_VERSION 1
+
+
+/* Data structures */
+
+
+/*+ A structure containing the override for a single segment. +*/
+typedef struct _SegmentOverride
+{
+ index_t  segment;              /*+ The index of the segment that is overridden. +*/
+
+ speed_t  speed;                /*+ The replacement speed of the segment (or 0 to keep the way speed). +*/
+
+ uint8_t  factor[OVERLAY_HOURS]; /*+ The speed as a percentage of normal for each hour of the day (0 for closed). +*/
+}
+ SegmentOverride;
+
+
+/*+ A structure containing the header from the file. +*/
+typedef struct _OverlayFile
+{
+ uint32_t magic;                /*+ The magic number (OVERLAY_MAGIC). +*/
+ uint32_t version;              /*+ The file format version (OVERLAY_VERSION). +*/
+
+ index_t  nnodes;               /*+ The number of nodes in the database that the overlay was made for. +*/
+ index_t  nsegments;            /*+ The number of segments in the database that the overlay was made for. +*/
+ index_t  nways;                /*+ The number of ways in the database that the overlay was made for. +*/
+
+ index_t  number;               /*+ The number of segment overrides. +*/
+ index_t  snumber;              /*+ The number of super-segments affected by the overrides. +*/
+}
+ OverlayFile;
+
+
+/*+ A structure containing a set of segment overrides (and pointers to mmap file). +*/
+struct _Overlay
+{
+ OverlayFile      file;         /*+ The header data from the file. +*/
+
+ void            *data;         /*+ The memory mapped data. +*/
+
+ SegmentOverride *overrides;    /*+ An array of segment overrides sorted by segment index. +*/
+
+ index_t         *supersegments; /*+ An array of the affected super-segments sorted by index. +*/
+
+ score_t         *superscores;  /*+ The recalculated scores of the affected super-segments in each direction (or NULL if not yet calculated). +*/
+
+ int              hour;         /*+ The hour of the day to use when applying the overrides. +*/
+};
+
+
+/* Functions in overlay.c */
+
+Overlay *LoadOverlay(const char *filename,index_t nnodes,index_t nsegments,index_t nways);
+
+SegmentOverride *FindSegmentOverride(Overlay *overlay,index_t segment);
+
+index_t FindOverlaySuperSegment(Overlay *overlay,index_t segment);
+
+duration_t OverrideDuration(Overlay *overlay,SegmentOverride *override,Segment *segment,Way *way,Profile *profile);
+
+
+/* Macros */
+
+/*+ Return true if the segment override closes the segment at the current hour. +*/
+#define IsClosedOverride(xxx,yyy)  (!(yyy)->factor[(xxx)->hour])
+
+
+#endif /* OVERLAY_H */
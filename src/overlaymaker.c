@@ -0,0 +1,689 @@
+/***************************************
+ Segment overlay file maker.
+
+ Part of the Routino routing software.
+ ******************/ /******************
+ This file Copyright 2008-2011 Andrew M. Bishop
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************/
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "types.h"
+#include "nodes.h"
+#include "segments.h"
+#include "ways.h"
+#include "overlay.h"
+
+#include "files.h"
+
+
+/* Data structures */
+
+/*+ A single override entry from the input file (for a segment or all of the segments of a way). +*/
+typedef struct _OverrideEntry
+{
+ int      isway;                /*+ Set if the index is a way index rather than a segment index. +*/
+ index_t  index;                /*+ The index of the segment or way. +*/
+
+ speed_t  speed;                /*+ The replacement speed (or 0 if not set). +*/
+ uint8_t  factor[OVERLAY_HOURS]; /*+ The speed factor for each hour (if set). +*/
+ uint32_t hours;                /*+ A bitmask of the hours for which the factor is set. +*/
+}
+ OverrideEntry;
+
+/*+ A segment that has an override entry applied to it. +*/
+typedef struct _OverridePair
+{
+ index_t  segment;              /*+ The segment index. +*/
+ int      entry;                /*+ The entry (in input file order). +*/
+}
+ OverridePair;
+
+
+/* Local functions */
+
+static int ParseLine(char *line,OverrideEntry *entry);
+
+static index_t *ReachedSuperNodes(Nodes *nodes,Segments *segments,index_t node,index_t *labels,index_t ***supers,index_t **nsupers,index_t *nlabels);
+
+static int sort_by_segment(const void *a,const void *b);
+static int sort_by_index(const void *a,const void *b);
+
+static void print_usage(int detail,const char *argerr,const char *err);
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  The main program for the overlay maker.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int main(int argc,char** argv)
+{
+ Nodes         *OSMNodes;
+ Segments      *OSMSegments;
+ Ways          *OSMWays;
+ char          *dirname=NULL,*prefix=NULL,*filename=NULL,*overlayfile=NULL;
+ char          *tmpname;
+ FILE          *file;
+ char           line[1024];
+ int            lineno=0;
+ OverrideEntry *entries=NULL;
+ int            nentries=0;
+ OverridePair  *pairs=NULL;
+ index_t        npairs=0;
+ SegmentOverride *overrides;
+ index_t        noverrides=0;
+ index_t       *supersegments=NULL;
+ index_t        nsupersegments=0;
+ index_t       *labels,**supers=NULL,*nsupers=NULL,nlabels=0;
+ index_t        i,j;
+ OverlayFile    header;
+ int           *firstentry,*nextentry;
+ int            fd,arg,k;
+
+ /* Parse the command line arguments */
+
+ for(arg=1;arg<argc;arg++)
+   {
+    if(!strcmp(argv[arg],"--help"))
+       print_usage(1,NULL,NULL);
+    else if(!strncmp(argv[arg],"--dir=",6))
+       dirname=&argv[arg][6];
+    else if(!strncmp(argv[arg],"--prefix=",9))
+       prefix=&argv[arg][9];
+    else if(!strncmp(argv[arg],"--overlay=",10))
+       overlayfile=&argv[arg][10];
+    else if(argv[arg][0]=='-' && argv[arg][1]=='-')
+       print_usage(0,argv[arg],NULL);
+    else if(filename)
+       print_usage(0,argv[arg],NULL);
+    else
+       filename=argv[arg];
+   }
+
+ if(!filename)
+    print_usage(0,NULL,"The name of the file containing the overrides must be given.");
+
+ if(!overlayfile)
+    overlayfile=FileName(dirname,prefix,"overlay.mem");
+
+ /* Load in the data - Note: No error checking because Load*List() will call exit() in case of an error. */
+
+ OSMNodes=LoadNodeList(FileName(dirname,prefix,"nodes.mem"));
+
+ OSMSegments=LoadSegmentList(FileName(dirname,prefix,"segments.mem"));
+
+ OSMWays=LoadWayList(FileName(dirname,prefix,"ways.mem"));
+
+ /* Read in the override entries */
+
+ if(!(file=fopen(filename,"r")))
+   {
+    fprintf(stderr,"Error: Cannot open the file '%s' for reading.\n",filename);
+    return(1);
+   }
+
+ while(fgets(line,sizeof(line),file))
+   {
+    OverrideEntry entry;
+    int result;
+
+    lineno++;
+
+    if((result=ParseLine(line,&entry))<0)
+      {
+       fprintf(stderr,"Error: Cannot parse line %d of the file '%s'.\n",lineno,filename);
+       return(1);
+      }
+
+    if(result==0)
+       continue;
+
+    if(( entry.isway && entry.index>=OSMWays->file.number) ||
+       (!entry.isway && (entry.index>=OSMSegments->file.number || !IsNormalSegment(LookupSegment(OSMSegments,entry.index,1)))))
+      {
+       fprintf(stderr,"Error: Line %d of the file '%s' refers to a %s that does not exist.\n",lineno,filename,entry.isway?"way":"segment");
+       return(1);
+      }
+
+    if((nentries%256)==0)
+      {
+       entries=(OverrideEntry*)realloc((void*)entries,(nentries+256)*sizeof(OverrideEntry));
+
+       assert(entries); /* Check realloc() worked */
+      }
+
+    entries[nentries++]=entry;
+   }
+
+ fclose(file);
+
+ /* Find the segments that each entry applies to */
+
+ for(k=0;k<nentries;k++)
+    if(!entries[k].isway)
+      {
+       if((npairs%1024)==0)
+         {
+          pairs=(OverridePair*)realloc((void*)pairs,(npairs+1024)*sizeof(OverridePair));
+
+          assert(pairs); /* Check realloc() worked */
+         }
+
+       pairs[npairs].segment=entries[k].index;
+       pairs[npairs].entry=k;
+       npairs++;
+      }
+
+ /* Make a list of the entries for each way (in the order that they appear in the file) */
+
+ firstentry=(int*)malloc(OSMWays->file.number*sizeof(int));
+ nextentry=(int*)malloc((nentries+1)*sizeof(int));
+
+ assert(firstentry && nextentry); /* Check malloc() worked */
+
+ for(i=0;i<OSMWays->file.number;i++)
+    firstentry[i]=-1;
+
+ for(k=nentries;k>0;k--)
+    if(entries[k-1].isway)
+      {
+       nextentry[k-1]=firstentry[entries[k-1].index];
+       firstentry[entries[k-1].index]=k-1;
+      }
+
+ for(i=0;i<OSMSegments->file.number;i++)
+   {
+    Segment *segment=LookupSegment(OSMSegments,i,1);
+
+    if(!IsNormalSegment(segment))
+       continue;
+
+    for(k=firstentry[segment->way];k!=-1;k=nextentry[k])
+      {
+       if((npairs%1024)==0)
+         {
+          pairs=(OverridePair*)realloc((void*)pairs,(npairs+1024)*sizeof(OverridePair));
+
+          assert(pairs); /* Check realloc() worked */
+         }
+
+       pairs[npairs].segment=i;
+       pairs[npairs].entry=k;
+       npairs++;
+      }
+   }
+
+ /* Merge the entries for each segment (later entries in the file take priority) */
+
+ qsort(pairs,npairs,sizeof(OverridePair),sort_by_segment);
+
+ /* Zeroed so that the padding written to the file is not uninitialised memory */
+
+ overrides=(SegmentOverride*)calloc(npairs+1,sizeof(SegmentOverride));
+
+ assert(overrides); /* Check calloc() worked */
+
+ for(i=0;i<npairs;i++)
+   {
+    OverrideEntry *entry=&entries[pairs[i].entry];
+
+    if(i==0 || pairs[i].segment!=pairs[i-1].segment)
+      {
+       overrides[noverrides].segment=pairs[i].segment;
+       overrides[noverrides].speed=0;
+
+       for(j=0;j<OVERLAY_HOURS;j++)
+          overrides[noverrides].factor[j]=100;
+
+       noverrides++;
+      }
+
+    if(entry->speed)
+       overrides[noverrides-1].speed=entry->speed;
+
+    for(j=0;j<OVERLAY_HOURS;j++)
+       if(entry->hours&(1<<j))
+          overrides[noverrides-1].factor[j]=entry->factor[j];
+   }
+
+ /* Find the super-segments that might be affected, these are the ones between
+    any two super-nodes that can be reached from the overridden segment without
+    passing through another super-node. */
+
+ labels=(index_t*)malloc(OSMNodes->file.number*sizeof(index_t));
+
+ assert(labels); /* Check malloc() worked */
+
+ for(i=0;i<OSMNodes->file.number;i++)
+    labels[i]=NO_NODE;
+
+ for(i=0;i<noverrides;i++)
+   {
+    Segment *segment=LookupSegment(OSMSegments,overrides[i].segment,1);
+    index_t node1=segment->node1,node2=segment->node2;
+    index_t *reached1,*reached2;
+    index_t *reached;
+    index_t nreached=0;
+
+    reached1=ReachedSuperNodes(OSMNodes,OSMSegments,node1,labels,&supers,&nsupers,&nlabels);
+    reached2=ReachedSuperNodes(OSMNodes,OSMSegments,node2,labels,&supers,&nsupers,&nlabels);
+
+    reached=(index_t*)malloc((reached1[0]+reached2[0]+2)*sizeof(index_t));
+
+    assert(reached); /* Check malloc() worked */
+
+    for(j=1;j<=reached1[0];j++)
+       reached[nreached++]=reached1[j];
+
+    for(j=1;j<=reached2[0];j++)
+       reached[nreached++]=reached2[j];
+
+    free(reached1);
+    free(reached2);
+
+    qsort(reached,nreached,sizeof(index_t),sort_by_index);
+
+    for(j=0;j<nreached;j++)
+      {
+       Segment *supersegment;
+
+       if(j>0 && reached[j]==reached[j-1])
+          continue;
+
+       supersegment=FirstSegment(OSMSegments,OSMNodes,reached[j],1);
+
+       while(supersegment)
+         {
+          index_t othernode=OtherNode(supersegment,reached[j]);
+
+          if(IsSuperSegment(supersegment) && !IsNormalSegment(supersegment) &&
+             bsearch(&othernode,reached,nreached,sizeof(index_t),sort_by_index))
+            {
+             if((nsupersegments%1024)==0)
+               {
+                supersegments=(index_t*)realloc((void*)supersegments,(nsupersegments+1024)*sizeof(index_t));
+
+                assert(supersegments); /* Check realloc() worked */
+               }
+
+             supersegments[nsupersegments++]=IndexSegment(OSMSegments,supersegment);
+            }
+
+          supersegment=NextSegment(OSMSegments,supersegment,reached[j]);
+         }
+      }
+
+    free(reached);
+   }
+
+ qsort(supersegments,nsupersegments,sizeof(index_t),sort_by_index);
+
+ for(i=0,j=0;i<nsupersegments;i++)
+    if(i==0 || supersegments[i]!=supersegments[i-1])
+       supersegments[j++]=supersegments[i];
+
+ nsupersegments=j;
+
+ /* Write out the overlay to a temporary file and then replace the old one (so that a
+    router that is already running keeps using the old version of the file). */
+
+ tmpname=(char*)malloc(strlen(overlayfile)+5);
+
+ sprintf(tmpname,"%s.tmp",overlayfile);
+
+ fd=OpenFileNew(tmpname);
+
+ header.magic  =OVERLAY_MAGIC;
+ header.version=OVERLAY_VERSION;
+
+ header.nnodes   =OSMNodes->file.number;
+ header.nsegments=OSMSegments->file.number;
+ header.nways    =OSMWays->file.number;
+
+ header.number=noverrides;
+ header.snumber=nsupersegments;
+
+ WriteFile(fd,&header,sizeof(OverlayFile));
+
+ WriteFile(fd,overrides,noverrides*sizeof(SegmentOverride));
+
+ WriteFile(fd,supersegments,nsupersegments*sizeof(index_t));
+
+ CloseFile(fd);
+
+ if(rename(tmpname,overlayfile))
+   {
+    fprintf(stderr,"Error: Cannot rename the file '%s' to '%s'.\n",tmpname,overlayfile);
+    return(1);
+   }
+
+ printf("Wrote '%s' with %d segment overrides and %d affected super-segments.\n",overlayfile,noverrides,nsupersegments);
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse a line from the input file.
+
+  int ParseLine Returns 1 if the line contains an entry, 0 if it is empty or a comment or -1 in case of an error.
+
+  char *line The line of text.
+
+  OverrideEntry *entry Returns the parsed entry.
+
+  The format of each line is: (segment|way) <index> [closed] [speed=<km/h>] [<hour1>-<hour2>=<percent>] ...
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int ParseLine(char *line,OverrideEntry *entry)
+{
+ char *hash=strchr(line,'#');
+ char *word;
+ int j;
+
+ if(hash)
+    *hash=0;
+
+ if(!(word=strtok(line," \t\r\n")))
+    return(0);
+
+ if(!strcmp(word,"segment"))
+    entry->isway=0;
+ else if(!strcmp(word,"way"))
+    entry->isway=1;
+ else
+    return(-1);
+
+ if(!(word=strtok(NULL," \t\r\n")) || !isdigit(word[0]))
+    return(-1);
+
+ entry->index=atoi(word);
+ entry->speed=0;
+ entry->hours=0;
+
+ while((word=strtok(NULL," \t\r\n")))
+   {
+    int hour1,hour2,percent,speed;
+
+    if(!strcmp(word,"closed"))
+      {
+       for(j=0;j<OVERLAY_HOURS;j++)
+          entry->factor[j]=0;
+
+       entry->hours=(1<<OVERLAY_HOURS)-1;
+      }
+    else if(sscanf(word,"speed=%d",&speed)==1)
+      {
+       if(speed<=0 || speed>255)
+          return(-1);
+
+       entry->speed=kph_to_speed(speed);
+      }
+    else if(sscanf(word,"%d-%d=%d",&hour1,&hour2,&percent)==3)
+      {
+       if(hour1<0 || hour1>=OVERLAY_HOURS || hour2<0 || hour2>OVERLAY_HOURS || percent<0 || percent>255)
+          return(-1);
+
+       /* The range can wrap around midnight and a range of zero length is the whole day */
+
+       j=hour1;
+
+       do
+         {
+          entry->factor[j]=percent;
+          entry->hours|=1<<j;
+
+          j=(j+1)%OVERLAY_HOURS;
+         }
+       while(j!=hour2%OVERLAY_HOURS);
+      }
+    else
+       return(-1);
+   }
+
+ return(1);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the super-nodes that can be reached from a node without passing through another super-node.
+
+  index_t *ReachedSuperNodes Returns an allocated array with the number of super-nodes followed by the super-nodes.
+
+  Nodes *nodes The set of nodes to use.
+
+  Segments *segments The set of segments to use.
+
+  index_t node The node to start from.
+
+  index_t *labels The label of the region for each node (NO_NODE if not yet labelled).
+
+  index_t ***supers The super-nodes reached from each labelled region.
+
+  index_t **nsupers The number of super-nodes reached from each labelled region.
+
+  index_t *nlabels The number of labelled regions.
+
+  Each region of normal nodes is only searched once however many overridden segments it contains.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static index_t *ReachedSuperNodes(Nodes *nodes,Segments *segments,index_t node,index_t *labels,index_t ***supers,index_t **nsupers,index_t *nlabels)
+{
+ index_t *reached;
+ index_t label,i;
+
+ /* A super-node is only reachable from itself */
+
+ if(IsSuperNode(LookupNode(nodes,node,1)))
+   {
+    reached=(index_t*)malloc(2*sizeof(index_t));
+
+    assert(reached); /* Check malloc() worked */
+
+    reached[0]=1;
+    reached[1]=node;
+
+    return(reached);
+   }
+
+ /* Search the region containing the node if it has not already been searched */
+
+ if(labels[node]==NO_NODE)
+   {
+    index_t *stack=NULL;
+    index_t nstack=0;
+
+    label=(*nlabels)++;
+
+    *supers=(index_t**)realloc((void*)*supers,*nlabels*sizeof(index_t*));
+    *nsupers=(index_t*)realloc((void*)*nsupers,*nlabels*sizeof(index_t));
+
+    assert(*supers && *nsupers); /* Check realloc() worked */
+
+    (*supers)[label]=NULL;
+    (*nsupers)[label]=0;
+
+    labels[node]=label;
+
+    stack=(index_t*)malloc(1024*sizeof(index_t));
+
+    assert(stack); /* Check malloc() worked */
+
+    stack[nstack++]=node;
+
+    while(nstack>0)
+      {
+       index_t node1=stack[--nstack];
+       Segment *segment=FirstSegment(segments,nodes,node1,1);
+
+       while(segment)
+         {
+          index_t node2=OtherNode(segment,node1);
+
+          if(IsNormalSegment(segment))
+            {
+             if(IsSuperNode(LookupNode(nodes,node2,1)))
+               {
+                if(((*nsupers)[label]%64)==0)
+                  {
+                   (*supers)[label]=(index_t*)realloc((void*)(*supers)[label],((*nsupers)[label]+64)*sizeof(index_t));
+
+                   assert((*supers)[label]); /* Check realloc() worked */
+                  }
+
+                (*supers)[label][(*nsupers)[label]++]=node2;
+               }
+             else if(labels[node2]==NO_NODE)
+               {
+                labels[node2]=label;
+
+                if((nstack%1024)==0)
+                  {
+                   stack=(index_t*)realloc((void*)stack,(nstack+1024)*sizeof(index_t));
+
+                   assert(stack); /* Check realloc() worked */
+                  }
+
+                stack[nstack++]=node2;
+               }
+            }
+
+          segment=NextSegment(segments,segment,node1);
+         }
+      }
+
+    free(stack);
+   }
+
+ label=labels[node];
+
+ reached=(index_t*)malloc(((*nsupers)[label]+1)*sizeof(index_t));
+
+ assert(reached); /* Check malloc() worked */
+
+ reached[0]=(*nsupers)[label];
+
+ for(i=0;i<(*nsupers)[label];i++)
+    reached[i+1]=(*supers)[label][i];
+
+ return(reached);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Sort the segment/entry pairs into segment order and then entry order.
+
+  int sort_by_segment Returns the comparison of the segment and entry fields.
+
+  const void *a The first pair.
+
+  const void *b The second pair.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int sort_by_segment(const void *a,const void *b)
+{
+ const OverridePair *pa=(const OverridePair*)a;
+ const OverridePair *pb=(const OverridePair*)b;
+
+ if(pa->segment<pb->segment)
+    return(-1);
+ else if(pa->segment>pb->segment)
+    return(1);
+ else
+    return(pa->entry-pb->entry);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Sort indexes into order.
+
+  int sort_by_index Returns the comparison of the indexes.
+
+  const void *a The first index.
+
+  const void *b The second index.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int sort_by_index(const void *a,const void *b)
+{
+ index_t ia=*(const index_t*)a;
+ index_t ib=*(const index_t*)b;
+
+ if(ia<ib)
+    return(-1);
+ else if(ia>ib)
+    return(1);
+ else
+    return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Print out the usage information.
+
+  int detail The level of detail to use - 0 = low, 1 = high.
+
+  const char *argerr The argument that gave the error (if there is one).
+
+  const char *err Other error message (if there is one).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void print_usage(int detail,const char *argerr,const char *err)
+{
+ fprintf(stderr,
+         "Usage: overlaymaker [--help]\n"
+         "                    [--dir=<dirname>] [--prefix=<name>]\n"
+         "                    [--overlay=<filename>]\n"
+         "                    <filename>\n");
+
+ if(argerr)
+    fprintf(stderr,
+            "\n"
+            "Error with command line parameter: %s\n",argerr);
+
+ if(err)
+    fprintf(stderr,
+            "\n"
+            "Error: %s\n",err);
+
+ if(detail)
+    fprintf(stderr,
+            "\n"
+            "--help                  Prints this information.\n"
+            "\n"
+            "--dir=<dirname>         The directory containing the routing database.\n"
+            "--prefix=<name>         The filename prefix for the routing database.\n"
+            "--overlay=<filename>    The name of the overlay file to write\n"
+            "                        (defaults to 'overlay.mem' with '--dir' and\n"
+            "                         '--prefix' options).\n"
+            "\n"
+            "<filename>              The file containing the segment overrides, one per\n"
+            "                        line (blank lines and text after '#' are ignored):\n"
+            "\n"
+            "  (segment|way) <index> [closed] [speed=<speed>] [<hour1>-<hour2>=<percent>] ...\n"
+            "\n"
+            "                        'closed' stops all routing over the segment(s),\n"
+            "                        'speed' sets the speed limit (km/h) and each hour\n"
+            "                        range (<hour1> inclusive, <hour2> exclusive) sets the\n"
+            "                        speed as a percentage of normal (0 for closed).\n");
+
+ exit(!detail);
+}
@@ -0,0 +1,1101 @@
+/***************************************
+ An OSM PBF (protocol buffer binary format) file parser.
+
+ Part of the Routino routing software.
+ ******************/ /******************
+ This file Copyright 2008-2011 Andrew M. Bishop
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************/
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <zlib.h>
+
+#include "pbfparse.h"
+
+
+/* Limits */
+
+/*+ The maximum size of a block header (from the file format specification). +*/
+#define PBF_MAX_HEADER_SIZE (64*1024)
+
+/*+ The maximum size of a block (from the file format specification). +*/
+#define PBF_MAX_BLOB_SIZE   (32*1024*1024)
+
+
+/*+ A block read from the file and the buffers used to decode it. +*/
+struct _pbfblock
+{
+ unsigned long long number;     /*+ The number of the block in the file. +*/
+ char               type[16];   /*+ The type of the block. +*/
+
+ unsigned char *buffer;         /*+ The data read from the file. +*/
+ size_t         length;         /*+ The length of the data read from the file. +*/
+ size_t         buffer_size;    /*+ The allocated size of the buffer. +*/
+
+ unsigned char *zbuffer;        /*+ The uncompressed data. +*/
+ size_t         zbuffer_size;   /*+ The allocated size of the uncompressed data buffer. +*/
+
+ char         **strings;        /*+ The string table of the block. +*/
+ char          *string_data;    /*+ The terminated copies of the strings. +*/
+ size_t         nstrings;       /*+ The number of strings. +*/
+ size_t         strings_size;   /*+ The allocated size of the string table. +*/
+ size_t         string_data_size; /*+ The allocated size of the string data. +*/
+
+ char         **tag_keys;       /*+ The tag keys of the current item. +*/
+ char         **tag_values;     /*+ The tag values of the current item. +*/
+ int            ntags;          /*+ The number of tags of the current item. +*/
+ int            tags_size;      /*+ The allocated size of the tags. +*/
+
+ int64_t       *refs;           /*+ The way nodes or relation members of the current item. +*/
+ int           *types;          /*+ The relation member types of the current item. +*/
+ char         **roles;          /*+ The relation member roles of the current item. +*/
+ int            refs_size;      /*+ The allocated size of the way nodes or relation members. +*/
+
+ int            error;          /*+ Set to true if the data being decoded is invalid. +*/
+};
+
+
+/* Local variables */
+
+/*+ The number of blocks that have been read. +*/
+static unsigned long long nblocks=0;
+
+
+/* Local functions */
+
+static int uncompress_blob(pbfblock *block,const unsigned char **data,size_t *length);
+
+static int parse_header_block(pbfblock *block,const unsigned char *data,size_t length);
+static int parse_primitive_block(pbfblock *block,const unsigned char *data,size_t length,pbfcallbacks *callbacks,void *userdata);
+static void parse_string_table(pbfblock *block,const unsigned char *data,size_t length);
+static int parse_primitive_group(pbfblock *block,const unsigned char *data,size_t length,pbfcallbacks *callbacks,void *userdata,int32_t granularity,int64_t lat_offset,int64_t lon_offset);
+
+static int parse_node(pbfblock *block,const unsigned char *data,size_t length,pbfcallbacks *callbacks,void *userdata,int32_t granularity,int64_t lat_offset,int64_t lon_offset);
+static int parse_dense_nodes(pbfblock *block,const unsigned char *data,size_t length,pbfcallbacks *callbacks,void *userdata,int32_t granularity,int64_t lat_offset,int64_t lon_offset);
+static int parse_way(pbfblock *block,const unsigned char *data,size_t length,pbfcallbacks *callbacks,void *userdata);
+static int parse_relation(pbfblock *block,const unsigned char *data,size_t length,pbfcallbacks *callbacks,void *userdata);
+
+static void add_tag(pbfblock *block,uint64_t key,uint64_t value);
+static void add_tags(pbfblock *block,const unsigned char *keys,size_t keyslength,const unsigned char *values,size_t valueslength);
+static void grow_refs(pbfblock *block,int n);
+
+static int next_field(int *error,const unsigned char **p,const unsigned char *end,int *field,uint64_t *value,const unsigned char **data,size_t *length);
+static inline uint64_t read_varint(int *error,const unsigned char **p,const unsigned char *end);
+static inline int64_t read_zigzag(int *error,const unsigned char **p,const unsigned char *end);
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse an OSM PBF file calling the callback functions for each item.
+
+  int ParsePBF Returns 0 if OK or something else in case of an error.
+
+  FILE *file The file to read from.
+
+  pbfcallbacks *callbacks The functions to call for the nodes, ways and relations (with a NULL data pointer).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int ParsePBF(FILE *file,pbfcallbacks *callbacks)
+{
+ pbfblock *block=NewPBFBlock();
+ int retval;
+
+ nblocks=0;
+
+ while(!(retval=ReadPBFBlock(file,block)))
+    if((retval=ParsePBFBlock(block,callbacks,NULL)))
+       break;
+
+ FreePBFBlock(block);
+
+ if(retval<0)                   /* End of file */
+    retval=0;
+
+ return(retval);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Return the number of the last block that has been read.
+
+  unsigned long long ParsePBF_BlockNumber Returns the block number.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+unsigned long long ParsePBF_BlockNumber(void)
+{
+ return(nblocks);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Create a new block to read data into.
+
+  pbfblock *NewPBFBlock Returns the new block.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+pbfblock *NewPBFBlock(void)
+{
+ pbfblock *block=(pbfblock*)calloc(1,sizeof(pbfblock));
+
+ assert(block); /* Check calloc() worked */
+
+ return(block);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Free a block and its buffers.
+
+  pbfblock *block The block to free.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void FreePBFBlock(pbfblock *block)
+{
+ free(block->buffer);
+ free(block->zbuffer);
+
+ free(block->strings);
+ free(block->string_data);
+
+ free(block->tag_keys);
+ free(block->tag_values);
+
+ free(block->refs);
+ free(block->types);
+ free(block->roles);
+
+ free(block);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Return the number of a block in the file.
+
+  unsigned long long PBFBlockNumber Returns the block number.
+
+  pbfblock *block The block.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+unsigned long long PBFBlockNumber(pbfblock *block)
+{
+ return(block->number);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Read the next block from the file (without decoding it).
+
+  int ReadPBFBlock Returns 0 if OK, -1 at the end of the file or something else in case of an error.
+
+  FILE *file The file to read from.
+
+  pbfblock *block The block to read the data into.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int ReadPBFBlock(FILE *file,pbfblock *block)
+{
+ unsigned char lengthbytes[4];
+ const unsigned char *p,*end,*fielddata;
+ size_t n,headersize,datasize=0,fieldlength;
+ uint64_t value;
+ int field,error=0;
+
+ /* Read the length of the header (big-endian) */
+
+ n=fread(lengthbytes,1,4,file);
+
+ if(n==0 && feof(file))
+    return(-1);
+
+ if(n!=4)
+   {
+    fprintf(stderr,"PBF Parser: Error reading the file after block %llu (truncated file).\n",nblocks);
+    return(1);
+   }
+
+ headersize=((size_t)lengthbytes[0]<<24)|((size_t)lengthbytes[1]<<16)|((size_t)lengthbytes[2]<<8)|(size_t)lengthbytes[3];
+
+ if(headersize>PBF_MAX_HEADER_SIZE)
+   {
+    fprintf(stderr,"PBF Parser: Error reading the file after block %llu (header is too large).\n",nblocks);
+    return(1);
+   }
+
+ if(block->buffer_size<PBF_MAX_HEADER_SIZE)
+   {
+    block->buffer_size=PBF_MAX_HEADER_SIZE;
+    block->buffer=(unsigned char*)realloc((void*)block->buffer,block->buffer_size);
+
+    assert(block->buffer); /* Check realloc() worked */
+   }
+
+ if(fread(block->buffer,1,headersize,file)!=headersize)
+   {
+    fprintf(stderr,"PBF Parser: Error reading the file after block %llu (truncated file).\n",nblocks);
+    return(1);
+   }
+
+ /* Decode the header */
+
+ *block->type=0;
+
+ p=block->buffer;
+ end=block->buffer+headersize;
+
+ while(next_field(&error,&p,end,&field,&value,&fielddata,&fieldlength))
+   {
+    if(field==1 && fielddata)             /* type */
+      {
+       if(fieldlength>15)
+          fieldlength=15;
+
+       memcpy(block->type,fielddata,fieldlength);
+       block->type[fieldlength]=0;
+      }
+    else if(field==3 && !fielddata)       /* datasize */
+       datasize=value;
+   }
+
+ if(error || datasize>PBF_MAX_BLOB_SIZE)
+   {
+    fprintf(stderr,"PBF Parser: Error reading the file after block %llu (invalid header).\n",nblocks);
+    return(1);
+   }
+
+ /* Read the blob */
+
+ if(block->buffer_size<datasize)
+   {
+    block->buffer_size=datasize;
+    block->buffer=(unsigned char*)realloc((void*)block->buffer,block->buffer_size);
+
+    assert(block->buffer); /* Check realloc() worked */
+   }
+
+ if(fread(block->buffer,1,datasize,file)!=datasize)
+   {
+    fprintf(stderr,"PBF Parser: Error reading the file after block %llu (truncated file).\n",nblocks);
+    return(1);
+   }
+
+ block->length=datasize;
+ block->number=++nblocks;
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Decode a block that has been read from the file calling the callback functions for each item.
+
+  int ParsePBFBlock Returns 0 if OK or something else in case of an error.
+
+  pbfblock *block The block to decode.
+
+  pbfcallbacks *callbacks The functions to call for the nodes, ways and relations.
+
+  void *data The data pointer to pass to the callback functions.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int ParsePBFBlock(pbfblock *block,pbfcallbacks *callbacks,void *data)
+{
+ const unsigned char *blockdata;
+ size_t length;
+ int retval=0;
+
+ block->error=0;
+
+ if(uncompress_blob(block,&blockdata,&length))
+    return(1);
+
+ if(!strcmp(block->type,"OSMHeader"))
+    retval=parse_header_block(block,blockdata,length);
+ else if(!strcmp(block->type,"OSMData"))
+    retval=parse_primitive_block(block,blockdata,length,callbacks,data);
+
+ if(!retval && block->error)
+   {
+    fprintf(stderr,"PBF Parser: Error in block %llu: invalid data.\n",block->number);
+    retval=1;
+   }
+
+ return(retval);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Uncompress the data in a block.
+
+  int uncompress_blob Returns 0 if OK or something else in case of an error.
+
+  pbfblock *block The block to uncompress.
+
+  const unsigned char **data Returns a pointer to the uncompressed data.
+
+  size_t *length Returns the length of the uncompressed data.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int uncompress_blob(pbfblock *block,const unsigned char **data,size_t *length)
+{
+ const unsigned char *p,*end,*fielddata;
+ const unsigned char *zdata=NULL;
+ size_t fieldlength,zlength=0;
+ uint64_t value,rawsize=0;
+ int field;
+
+ *data=NULL;
+ *length=0;
+
+ p=block->buffer;
+ end=block->buffer+block->length;
+
+ while(next_field(&block->error,&p,end,&field,&value,&fielddata,&fieldlength))
+   {
+    if(field==1 && fielddata)             /* raw */
+      {
+       *data=fielddata;
+       *length=fieldlength;
+      }
+    else if(field==2 && !fielddata)       /* raw_size */
+       rawsize=value;
+    else if(field==3 && fielddata)        /* zlib_data */
+      {
+       zdata=fielddata;
+       zlength=fieldlength;
+      }
+    else if(field>=4 && field<=7)         /* lzma_data, OBSOLETE_bzip2_data, lz4_data, zstd_data */
+      {
+       fprintf(stderr,"PBF Parser: Error in block %llu: unsupported compression method.\n",block->number);
+       return(1);
+      }
+   }
+
+ if(block->error)
+   {
+    fprintf(stderr,"PBF Parser: Error in block %llu: invalid block.\n",block->number);
+    return(1);
+   }
+
+ if(zdata)
+   {
+    uLongf destlength=rawsize;
+
+    if(rawsize>PBF_MAX_BLOB_SIZE)
+      {
+       fprintf(stderr,"PBF Parser: Error in block %llu: uncompressed data is too large.\n",block->number);
+       return(1);
+      }
+
+    if(block->zbuffer_size<rawsize)
+      {
+       block->zbuffer_size=rawsize;
+       block->zbuffer=(unsigned char*)realloc((void*)block->zbuffer,block->zbuffer_size);
+
+       assert(block->zbuffer); /* Check realloc() worked */
+      }
+
+    if(uncompress(block->zbuffer,&destlength,zdata,zlength)!=Z_OK || destlength!=rawsize)
+      {
+       fprintf(stderr,"PBF Parser: Error in block %llu: cannot uncompress the data.\n",block->number);
+       return(1);
+      }
+
+    *data=block->zbuffer;
+    *length=destlength;
+   }
+ else if(!*data)
+    *data=block->buffer;
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse a header block and check that the file can be read.
+
+  int parse_header_block Returns 0 if OK or something else in case of an error.
+
+  pbfblock *block The block being decoded.
+
+  const unsigned char *data The uncompressed data.
+
+  size_t length The length of the data.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int parse_header_block(pbfblock *block,const unsigned char *data,size_t length)
+{
+ const unsigned char *p=data,*end=data+length,*fielddata;
+ size_t fieldlength;
+ uint64_t value;
+ int field;
+
+ while(next_field(&block->error,&p,end,&field,&value,&fielddata,&fieldlength))
+    if(field==4 && fielddata)             /* required_features */
+      {
+       if((fieldlength==14 && !memcmp(fielddata,"OsmSchema-V0.6",14)) ||
+          (fieldlength==10 && !memcmp(fielddata,"DenseNodes",10)))
+          continue;
+
+       fprintf(stderr,"PBF Parser: Error in block %llu: unsupported required feature '%.*s'.\n",block->number,(int)fieldlength,fielddata);
+       return(1);
+      }
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse a primitive block containing nodes, ways and relations.
+
+  int parse_primitive_block Returns 0 if OK or something else in case of an error.
+
+  pbfblock *block The block being decoded.
+
+  const unsigned char *data The uncompressed data.
+
+  size_t length The length of the data.
+
+  pbfcallbacks *callbacks The functions to call for the nodes, ways and relations.
+
+  void *userdata The data pointer to pass to the callback functions.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int parse_primitive_block(pbfblock *block,const unsigned char *data,size_t length,pbfcallbacks *callbacks,void *userdata)
+{
+ const unsigned char *p,*end=data+length,*fielddata;
+ size_t fieldlength;
+ uint64_t value;
+ int field;
+ int32_t granularity=100;
+ int64_t lat_offset=0,lon_offset=0;
+
+ /* The string table and coordinate scaling must be found before the groups are decoded */
+
+ block->nstrings=0;
+
+ p=data;
+
+ while(next_field(&block->error,&p,end,&field,&value,&fielddata,&fieldlength))
+   {
+    if(field==1 && fielddata)             /* stringtable */
+       parse_string_table(block,fielddata,fieldlength);
+    else if(field==17 && !fielddata)      /* granularity */
+       granularity=(int32_t)value;
+    else if(field==19 && !fielddata)      /* lat_offset */
+       lat_offset=(int64_t)value;
+    else if(field==20 && !fielddata)      /* lon_offset */
+       lon_offset=(int64_t)value;
+   }
+
+ /* Decode the groups */
+
+ p=data;
+
+ while(next_field(&block->error,&p,end,&field,&value,&fielddata,&fieldlength))
+    if(field==2 && fielddata)             /* primitivegroup */
+       if(parse_primitive_group(block,fielddata,fieldlength,callbacks,userdata,granularity,lat_offset,lon_offset))
+          return(1);
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse the string table of a block (the strings are copied so that they can be terminated).
+
+  pbfblock *block The block being decoded.
+
+  const unsigned char *data The string table data.
+
+  size_t length The length of the data.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void parse_string_table(pbfblock *block,const unsigned char *data,size_t length)
+{
+ const unsigned char *p=data,*end=data+length,*fielddata;
+ size_t fieldlength,offset=0;
+ uint64_t value;
+ int field;
+
+ /* Each string takes at least two bytes in the table (key and length) which sets the maximum sizes */
+
+ if(block->strings_size<(length/2+1))
+   {
+    block->strings_size=length/2+1;
+    block->strings=(char**)realloc((void*)block->strings,block->strings_size*sizeof(char*));
+
+    assert(block->strings); /* Check realloc() worked */
+   }
+
+ if(block->string_data_size<length)
+   {
+    block->string_data_size=length;
+    block->string_data=(char*)realloc((void*)block->string_data,block->string_data_size);
+
+    assert(block->string_data); /* Check realloc() worked */
+   }
+
+ while(next_field(&block->error,&p,end,&field,&value,&fielddata,&fieldlength))
+    if(field==1 && fielddata)             /* s */
+      {
+       block->strings[block->nstrings++]=block->string_data+offset;
+
+       memcpy(block->string_data+offset,fielddata,fieldlength);
+       block->string_data[offset+fieldlength]=0;
+
+       offset+=fieldlength+1;
+      }
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse a primitive group containing one type of item.
+
+  int parse_primitive_group Returns 0 if OK or something else in case of an error.
+
+  pbfblock *block The block being decoded.
+
+  const unsigned char *data The group data.
+
+  size_t length The length of the data.
+
+  pbfcallbacks *callbacks The functions to call for the nodes, ways and relations.
+
+  void *userdata The data pointer to pass to the callback functions.
+
+  int32_t granularity The granularity of the coordinates (nanodegrees).
+
+  int64_t lat_offset The offset of the latitudes (nanodegrees).
+
+  int64_t lon_offset The offset of the longitudes (nanodegrees).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int parse_primitive_group(pbfblock *block,const unsigned char *data,size_t length,pbfcallbacks *callbacks,void *userdata,int32_t granularity,int64_t lat_offset,int64_t lon_offset)
+{
+ const unsigned char *p=data,*end=data+length,*fielddata;
+ size_t fieldlength;
+ uint64_t value;
+ int field;
+ int retval=0;
+
+ while(!retval && next_field(&block->error,&p,end,&field,&value,&fielddata,&fieldlength))
+   {
+    if(!fielddata)
+       continue;
+
+    if(field==1)                          /* nodes */
+       retval=parse_node(block,fielddata,fieldlength,callbacks,userdata,granularity,lat_offset,lon_offset);
+    else if(field==2)                     /* dense */
+       retval=parse_dense_nodes(block,fielddata,fieldlength,callbacks,userdata,granularity,lat_offset,lon_offset);
+    else if(field==3)                     /* ways */
+       retval=parse_way(block,fielddata,fieldlength,callbacks,userdata);
+    else if(field==4)                     /* relations */
+       retval=parse_relation(block,fielddata,fieldlength,callbacks,userdata);
+   }
+
+ return(retval);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse a single node.
+
+  int parse_node Returns 0 if OK or something else in case of an error.
+
+  pbfblock *block The block being decoded.
+
+  const unsigned char *data The node data.
+
+  size_t length The length of the data.
+
+  pbfcallbacks *callbacks The functions to call for the nodes, ways and relations.
+
+  void *userdata The data pointer to pass to the callback functions.
+
+  int32_t granularity The granularity of the coordinates (nanodegrees).
+
+  int64_t lat_offset The offset of the latitudes (nanodegrees).
+
+  int64_t lon_offset The offset of the longitudes (nanodegrees).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int parse_node(pbfblock *block,const unsigned char *data,size_t length,pbfcallbacks *callbacks,void *userdata,int32_t granularity,int64_t lat_offset,int64_t lon_offset)
+{
+ const unsigned char *p=data,*end=data+length,*fielddata;
+ const unsigned char *keys=NULL,*values=NULL;
+ size_t fieldlength,keyslength=0,valueslength=0;
+ uint64_t value;
+ int field;
+ int64_t id=0,lat=0,lon=0;
+
+ while(next_field(&block->error,&p,end,&field,&value,&fielddata,&fieldlength))
+   {
+    if(field==1 && !fielddata)            /* id */
+       id=(int64_t)(value>>1)^-(int64_t)(value&1);
+    else if(field==2 && fielddata)        /* keys */
+       keys=fielddata,keyslength=fieldlength;
+    else if(field==3 && fielddata)        /* vals */
+       values=fielddata,valueslength=fieldlength;
+    else if(field==8 && !fielddata)       /* lat */
+       lat=(int64_t)(value>>1)^-(int64_t)(value&1);
+    else if(field==9 && !fielddata)       /* lon */
+       lon=(int64_t)(value>>1)^-(int64_t)(value&1);
+   }
+
+ add_tags(block,keys,keyslength,values,valueslength);
+
+ if(block->error || !callbacks->node)
+    return(0);
+
+ return(callbacks->node(userdata,id,(double)(lat_offset+granularity*lat)/1.0E9,(double)(lon_offset+granularity*lon)/1.0E9,
+                        block->ntags,block->tag_keys,block->tag_values));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse a set of densely packed nodes.
+
+  int parse_dense_nodes Returns 0 if OK or something else in case of an error.
+
+  pbfblock *block The block being decoded.
+
+  const unsigned char *data The dense node data.
+
+  size_t length The length of the data.
+
+  pbfcallbacks *callbacks The functions to call for the nodes, ways and relations.
+
+  void *userdata The data pointer to pass to the callback functions.
+
+  int32_t granularity The granularity of the coordinates (nanodegrees).
+
+  int64_t lat_offset The offset of the latitudes (nanodegrees).
+
+  int64_t lon_offset The offset of the longitudes (nanodegrees).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int parse_dense_nodes(pbfblock *block,const unsigned char *data,size_t length,pbfcallbacks *callbacks,void *userdata,int32_t granularity,int64_t lat_offset,int64_t lon_offset)
+{
+ const unsigned char *p=data,*end=data+length,*fielddata;
+ const unsigned char *ids=NULL,*lats=NULL,*lons=NULL,*keysvals=NULL;
+ const unsigned char *idsend=NULL,*latsend=NULL,*lonsend=NULL,*keysvalsend=NULL;
+ size_t fieldlength;
+ uint64_t value;
+ int field;
+ int64_t id=0,lat=0,lon=0;
+
+ while(next_field(&block->error,&p,end,&field,&value,&fielddata,&fieldlength))
+   {
+    if(!fielddata)
+       continue;
+
+    if(field==1)                          /* id (delta coded) */
+       ids=fielddata,idsend=fielddata+fieldlength;
+    else if(field==8)                     /* lat (delta coded) */
+       lats=fielddata,latsend=fielddata+fieldlength;
+    else if(field==9)                     /* lon (delta coded) */
+       lons=fielddata,lonsend=fielddata+fieldlength;
+    else if(field==10)                    /* keys_vals */
+       keysvals=fielddata,keysvalsend=fielddata+fieldlength;
+   }
+
+ while(ids<idsend && !block->error)
+   {
+    id +=read_zigzag(&block->error,&ids ,idsend);
+    lat+=read_zigzag(&block->error,&lats,latsend);
+    lon+=read_zigzag(&block->error,&lons,lonsend);
+
+    /* The tags of each node are a list of key and value string indexes ending with a zero */
+
+    block->ntags=0;
+
+    while(keysvals<keysvalsend)
+      {
+       uint64_t key=read_varint(&block->error,&keysvals,keysvalsend);
+
+       if(key==0)
+          break;
+
+       add_tag(block,key,read_varint(&block->error,&keysvals,keysvalsend));
+      }
+
+    if(block->error || !callbacks->node)
+       continue;
+
+    if(callbacks->node(userdata,id,(double)(lat_offset+granularity*lat)/1.0E9,(double)(lon_offset+granularity*lon)/1.0E9,
+                       block->ntags,block->tag_keys,block->tag_values))
+       return(1);
+   }
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse a single way.
+
+  int parse_way Returns 0 if OK or something else in case of an error.
+
+  pbfblock *block The block being decoded.
+
+  const unsigned char *data The way data.
+
+  size_t length The length of the data.
+
+  pbfcallbacks *callbacks The functions to call for the nodes, ways and relations.
+
+  void *userdata The data pointer to pass to the callback functions.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int parse_way(pbfblock *block,const unsigned char *data,size_t length,pbfcallbacks *callbacks,void *userdata)
+{
+ const unsigned char *p=data,*end=data+length,*fielddata;
+ const unsigned char *keys=NULL,*values=NULL,*noderefs=NULL;
+ size_t fieldlength,keyslength=0,valueslength=0,noderefslength=0;
+ uint64_t value;
+ int field;
+ int64_t id=0,ref=0;
+ int nrefs=0;
+
+ while(next_field(&block->error,&p,end,&field,&value,&fielddata,&fieldlength))
+   {
+    if(field==1 && !fielddata)            /* id */
+       id=(int64_t)value;
+    else if(field==2 && fielddata)        /* keys */
+       keys=fielddata,keyslength=fieldlength;
+    else if(field==3 && fielddata)        /* vals */
+       values=fielddata,valueslength=fieldlength;
+    else if(field==8 && fielddata)        /* refs (delta coded) */
+       noderefs=fielddata,noderefslength=fieldlength;
+   }
+
+ add_tags(block,keys,keyslength,values,valueslength);
+
+ if(noderefs)
+   {
+    const unsigned char *noderefsend=noderefs+noderefslength;
+
+    while(noderefs<noderefsend)
+      {
+       ref+=read_zigzag(&block->error,&noderefs,noderefsend);
+
+       grow_refs(block,nrefs+1);
+
+       block->refs[nrefs++]=ref;
+      }
+   }
+
+ if(block->error || !callbacks->way)
+    return(0);
+
+ return(callbacks->way(userdata,id,nrefs,block->refs,block->ntags,block->tag_keys,block->tag_values));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Parse a single relation.
+
+  int parse_relation Returns 0 if OK or something else in case of an error.
+
+  pbfblock *block The block being decoded.
+
+  const unsigned char *data The relation data.
+
+  size_t length The length of the data.
+
+  pbfcallbacks *callbacks The functions to call for the nodes, ways and relations.
+
+  void *userdata The data pointer to pass to the callback functions.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int parse_relation(pbfblock *block,const unsigned char *data,size_t length,pbfcallbacks *callbacks,void *userdata)
+{
+ const unsigned char *p=data,*end=data+length,*fielddata;
+ const unsigned char *keys=NULL,*values=NULL;
+ const unsigned char *rolesids=NULL,*memids=NULL,*memtypes=NULL;
+ const unsigned char *rolesidsend=NULL,*memidsend=NULL,*memtypesend=NULL;
+ size_t fieldlength,keyslength=0,valueslength=0;
+ uint64_t value;
+ int field;
+ int64_t id=0,ref=0;
+ int nmembers=0;
+
+ while(next_field(&block->error,&p,end,&field,&value,&fielddata,&fieldlength))
+   {
+    if(field==1 && !fielddata)            /* id */
+       id=(int64_t)value;
+    else if(field==2 && fielddata)        /* keys */
+       keys=fielddata,keyslength=fieldlength;
+    else if(field==3 && fielddata)        /* vals */
+       values=fielddata,valueslength=fieldlength;
+    else if(field==8 && fielddata)        /* roles_sid */
+       rolesids=fielddata,rolesidsend=fielddata+fieldlength;
+    else if(field==9 && fielddata)        /* memids (delta coded) */
+       memids=fielddata,memidsend=fielddata+fieldlength;
+    else if(field==10 && fielddata)       /* types */
+       memtypes=fielddata,memtypesend=fielddata+fieldlength;
+   }
+
+ add_tags(block,keys,keyslength,values,valueslength);
+
+ while(memids<memidsend)
+   {
+    uint64_t role=read_varint(&block->error,&rolesids,rolesidsend);
+
+    grow_refs(block,nmembers+1);
+
+    ref+=read_zigzag(&block->error,&memids,memidsend);
+
+    block->refs[nmembers]=ref;
+    block->types[nmembers]=(int)read_varint(&block->error,&memtypes,memtypesend);
+
+    if(role<block->nstrings)
+       block->roles[nmembers]=block->strings[role];
+    else
+       block->error=1;
+
+    nmembers++;
+   }
+
+ if(block->error || !callbacks->relation)
+    return(0);
+
+ return(callbacks->relation(userdata,id,nmembers,block->types,block->refs,block->roles,block->ntags,block->tag_keys,block->tag_values));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Append a tag to the list of tags for the current item.
+
+  pbfblock *block The block being decoded.
+
+  uint64_t key The index of the key in the string table.
+
+  uint64_t value The index of the value in the string table.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void add_tag(pbfblock *block,uint64_t key,uint64_t value)
+{
+ if(key>=block->nstrings || value>=block->nstrings)
+   {
+    block->error=1;
+    return;
+   }
+
+ if(block->ntags==block->tags_size)
+   {
+    block->tags_size+=16;
+
+    block->tag_keys  =(char**)realloc((void*)block->tag_keys  ,block->tags_size*sizeof(char*));
+    block->tag_values=(char**)realloc((void*)block->tag_values,block->tags_size*sizeof(char*));
+
+    assert(block->tag_keys && block->tag_values); /* Check realloc() worked */
+   }
+
+ block->tag_keys  [block->ntags]=block->strings[key];
+ block->tag_values[block->ntags]=block->strings[value];
+
+ block->ntags++;
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Set the list of tags for the current item from separate lists of keys and values.
+
+  pbfblock *block The block being decoded.
+
+  const unsigned char *keys The packed list of key string indexes.
+
+  size_t keyslength The length of the list of keys.
+
+  const unsigned char *values The packed list of value string indexes.
+
+  size_t valueslength The length of the list of values.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void add_tags(pbfblock *block,const unsigned char *keys,size_t keyslength,const unsigned char *values,size_t valueslength)
+{
+ const unsigned char *keysend=keys+keyslength,*valuesend=values+valueslength;
+
+ block->ntags=0;
+
+ if(!keys)
+    return;
+
+ while(keys<keysend)
+   {
+    uint64_t key=read_varint(&block->error,&keys,keysend);
+
+    add_tag(block,key,read_varint(&block->error,&values,valuesend));
+   }
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Make sure that the lists of way nodes or relation members are large enough.
+
+  pbfblock *block The block being decoded.
+
+  int n The number of items that are needed.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void grow_refs(pbfblock *block,int n)
+{
+ if(n<=block->refs_size)
+    return;
+
+ block->refs_size+=256;
+
+ block->refs =(int64_t*)realloc((void*)block->refs ,block->refs_size*sizeof(int64_t));
+ block->types=(int*    )realloc((void*)block->types,block->refs_size*sizeof(int));
+ block->roles=(char**  )realloc((void*)block->roles,block->refs_size*sizeof(char*));
+
+ assert(block->refs && block->types && block->roles); /* Check realloc() worked */
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Decode the next field of a protocol buffer message.
+
+  int next_field Returns 1 if there was a field or 0 at the end of the message or in case of an error.
+
+  int *error Set to true in case of an error (and checked before starting).
+
+  const unsigned char **p The position in the message (updated).
+
+  const unsigned char *end The end of the message.
+
+  int *field Returns the field number.
+
+  uint64_t *value Returns the value of a variable length integer field.
+
+  const unsigned char **data Returns the data of a length delimited field (or NULL for other fields).
+
+  size_t *length Returns the length of a length delimited field.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int next_field(int *error,const unsigned char **p,const unsigned char *end,int *field,uint64_t *value,const unsigned char **data,size_t *length)
+{
+ uint64_t key;
+
+ if(*p>=end || *error)
+    return(0);
+
+ key=read_varint(error,p,end);
+
+ *field=(int)(key>>3);
+ *value=0;
+ *data=NULL;
+ *length=0;
+
+ switch(key&7)
+   {
+   case 0:                      /* varint */
+    *value=read_varint(error,p,end);
+    break;
+
+   case 1:                      /* 64-bit */
+    if((end-*p)<8)
+       *error=1;
+    else
+       *p+=8;
+    break;
+
+   case 2:                      /* length delimited */
+    *length=read_varint(error,p,end);
+
+    if(*length>(size_t)(end-*p))
+       *error=1;
+    else
+      {
+       *data=*p;
+       *p+=*length;
+      }
+    break;
+
+   case 5:                      /* 32-bit */
+    if((end-*p)<4)
+       *error=1;
+    else
+       *p+=4;
+    break;
+
+   default:
+    *error=1;
+   }
+
+ return(!*error);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Decode a variable length integer.
+
+  uint64_t read_varint Returns the value.
+
+  int *error Set to true in case of an error.
+
+  const unsigned char **p The position in the data (updated).
+
+  const unsigned char *end The end of the data.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static inline uint64_t read_varint(int *error,const unsigned char **p,const unsigned char *end)
+{
+ uint64_t value=0;
+ int shift=0;
+
+ while(*p<end && shift<64)
+   {
+    unsigned char byte=*(*p)++;
+
+    value|=(uint64_t)(byte&0x7f)<<shift;
+
+    if(!(byte&0x80))
+       return(value);
+
+    shift+=7;
+   }
+
+ *error=1;
+ *p=end;
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Decode a zig-zag encoded signed variable length integer.
+
+  int64_t read_zigzag Returns the value.
+
+  int *error Set to true in case of an error.
+
+  const unsigned char **p The position in the data (updated).
+
+  const unsigned char *end The end of the data.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static inline int64_t read_zigzag(int *error,const unsigned char **p,const unsigned char *end)
+{
+ uint64_t value=read_varint(error,p,end);
+
+ return((int64_t)(value>>1)^-(int64_t)(value&1));
+}
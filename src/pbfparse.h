@@ -0,0 +1,73 @@
+/***************************************
+ A header file for the OSM PBF (protocol buffer binary format) parser.
+
+ Part of the Routino routing software.
+ ******************/ /******************
+ This file Copyright 2008-2011 Andrew M. Bishop
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************/
+
+
+#ifndef PBFPARSE_H
+#define PBFPARSE_H    /*+ To stop multiple inclusions. +*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+
+/*+ The types of relation members. +*/
+#define PBFPARSE_MEMBER_NODE     0
+#define PBFPARSE_MEMBER_WAY      1
+#define PBFPARSE_MEMBER_RELATION 2
+
+
+/*+ A structure to hold the functions that are called for each item in the file
+    (the data pointer is passed through from the parsing function). +*/
+typedef struct _pbfcallbacks
+{
+ /*+ The function that is called for each node. +*/
+ int (*node)(void *data,int64_t id,double latitude,double longitude,int ntags,char **keys,char **values);
+
+ /*+ The function that is called for each way. +*/
+ int (*way)(void *data,int64_t id,int nrefs,int64_t *refs,int ntags,char **keys,char **values);
+
+ /*+ The function that is called for each relation. +*/
+ int (*relation)(void *data,int64_t id,int nmembers,int *types,int64_t *refs,char **roles,int ntags,char **keys,char **values);
+}
+ pbfcallbacks;
+
+
+/*+ A block read from the file and the buffers used to decode it (the contents are private). +*/
+typedef struct _pbfblock pbfblock;
+
+
+/* PBF parser functions */
+
+int ParsePBF(FILE *file,pbfcallbacks *callbacks);
+
+unsigned long long ParsePBF_BlockNumber(void);
+
+/* PBF parser functions for reading and decoding the blocks separately (in different threads) */
+
+pbfblock *NewPBFBlock(void);
+void FreePBFBlock(pbfblock *block);
+
+int ReadPBFBlock(FILE *file,pbfblock *block);
+int ParsePBFBlock(pbfblock *block,pbfcallbacks *callbacks,void *data);
+
+unsigned long long PBFBlockNumber(pbfblock *block);
+
+
+#endif /* PBFPARSE_H */
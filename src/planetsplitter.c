@@ -24,6 +24,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <dirent.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 
 #include "types.h"
 #include "ways.h"
@@ -34,14 +37,29 @@
 #include "waysx.h"
 #include "relationsx.h"
 #include "superx.h"
+#include "areax.h"
 
 #include "files.h"
 #include "logging.h"
 #include "functions.h"
 #include "functionsx.h"
+#include "sorting.h"
 #include "tagging.h"
 
 
+/* Constants */
+
+/*+ The stages of the processing after which a checkpoint can be saved. +*/
+#define CHECKPOINT_NONE      0
+#define CHECKPOINT_PROCESSED 1
+#define CHECKPOINT_SUPER     2
+#define CHECKPOINT_MERGED    3
+#define CHECKPOINT_CROSSREF  4
+
+/*+ The value at the start of a checkpoint file (changed if the format changes). +*/
+#define CHECKPOINT_MAGIC 0x52434B31
+
+
 /* Global variables */
 
 /*+ The name of the temporary directory. +*/
@@ -50,9 +68,63 @@ char *option_tmpdirname=NULL;
 /*+ The amount of RAM to use for filesorting. +*/
 size_t option_filesort_ramsize=0;
 
+/*+ The number of threads to use for filesorting. +*/
+int option_filesort_threads=1;
+
+/*+ The number of temporary files to merge at once when filesorting (or 0 to choose automatically). +*/
+int option_filesort_fanin=0;
+
+/*+ Set to true to compress the temporary files of fixed length items when filesorting. +*/
+int option_filesort_compress=0;
+
+/*+ The number of threads to use for parsing the input files. +*/
+int option_parse_threads=1;
+
+/*+ The number of threads to use for finding super-nodes and creating super-segments. +*/
+int option_super_threads=1;
+
+
+/* Local variables */
+
+/*+ The file to write the report of the time and memory used by each stage to (or NULL). +*/
+static FILE *report=NULL;
+
+/*+ The name of the stage that is being run (or NULL). +*/
+static const char *stage_name=NULL;
+
+/*+ The iteration of the super-data processing for the stage (or -1). +*/
+static int stage_iteration=-1;
+
+/*+ The time, CPU time and counters when the stage (and the program) started. +*/
+static struct timeval stage_time,start_time;
+static double         stage_cputime;
+static uint64_t       stage_bytes_read,stage_bytes_written;
+static index_t        stage_nsorts,stage_nruns,stage_npasses;
+
+/*+ The largest peak resident memory size of any stage (the peak is reset at the start of each stage). +*/
+static long max_peakrss=0;
+
+/*+ The set of checkpoint data files that will be written next (alternates so that the previous checkpoint is always complete). +*/
+static int checkpoint_slot=0;
+
 
 /* Local functions */
 
+static void StartStage(const char *name,int iteration);
+static void EndStage(void);
+static void EndReport(void);
+static void ReportStage(const char *name,int iteration,struct timeval *time,double cputime,uint64_t bytes_read,uint64_t bytes_written,index_t nsorts,index_t nruns,index_t npasses,long peakrss);
+
+static double CPUTime(void);
+static void ResetPeakRSS(void);
+static long PeakRSS(void);
+
+static void save_checkpoint(int stage,int iteration,int quit,NodesX *nodesx,SegmentsX *segmentsx,SegmentsX *supersegmentsx,WaysX *waysx,RelationsX *relationsx);
+static int load_checkpoint(int *stage,int *iteration,int *quit,NodesX *nodesx,SegmentsX *segmentsx,SegmentsX **supersegmentsx,WaysX *waysx,RelationsX *relationsx);
+static void delete_checkpoint(void);
+static void delete_stale_tmpfiles(void);
+static char *checkpoint_filename(int slot,const char *name);
+
 static void print_usage(int detail,const char *argerr,const char *err);
 
 
@@ -66,10 +138,14 @@ int main(int argc,char** argv)
  SegmentsX  *Segments,*SuperSegments=NULL,*MergedSegments=NULL;
  WaysX      *Ways;
  RelationsX *Relations;
+ AreaX      *Area=NULL;
  int         iteration=0,quit=0;
  int         max_iterations=5;
- char       *dirname=NULL,*prefix=NULL,*tagging=NULL,*errorlog=NULL;
+ char       *dirname=NULL,*prefix=NULL,*tagging=NULL,*errorlog=NULL,*reportfile=NULL;
+ char       *bbox=NULL,*polygon=NULL;
  int         option_parse_only=0,option_process_only=0;
+ int         option_keep=0,option_changes=0;
+ int         option_checkpoint=0,option_resume=0,resume_stage=CHECKPOINT_NONE;
  int         option_filenames=0;
  int         arg;
 
@@ -81,6 +157,16 @@ int main(int argc,char** argv)
        print_usage(1,NULL,NULL);
     else if(!strncmp(argv[arg],"--sort-ram-size=",16))
        option_filesort_ramsize=atoi(&argv[arg][16]);
+    else if(!strncmp(argv[arg],"--sort-threads=",15))
+       option_filesort_threads=atoi(&argv[arg][15]);
+    else if(!strncmp(argv[arg],"--sort-fan-in=",14))
+       option_filesort_fanin=atoi(&argv[arg][14]);
+    else if(!strcmp(argv[arg],"--sort-compress"))
+       option_filesort_compress=1;
+    else if(!strncmp(argv[arg],"--parse-threads=",16))
+       option_parse_threads=atoi(&argv[arg][16]);
+    else if(!strncmp(argv[arg],"--super-threads=",16))
+       option_super_threads=atoi(&argv[arg][16]);
     else if(!strncmp(argv[arg],"--dir=",6))
        dirname=&argv[arg][6];
     else if(!strncmp(argv[arg],"--tmpdir=",9))
@@ -91,6 +177,18 @@ int main(int argc,char** argv)
        option_parse_only=1;
     else if(!strcmp(argv[arg],"--process-only"))
        option_process_only=1;
+    else if(!strcmp(argv[arg],"--keep"))
+       option_keep=1;
+    else if(!strcmp(argv[arg],"--changes"))
+       option_changes=1;
+    else if(!strncmp(argv[arg],"--bbox=",7))
+       bbox=&argv[arg][7];
+    else if(!strncmp(argv[arg],"--polygon=",10))
+       polygon=&argv[arg][10];
+    else if(!strcmp(argv[arg],"--checkpoint"))
+       option_checkpoint=1;
+    else if(!strcmp(argv[arg],"--resume"))
+       option_resume=1;
     else if(!strcmp(argv[arg],"--loggable"))
        option_loggable=1;
     else if(!strcmp(argv[arg],"--errorlog"))
@@ -101,6 +199,8 @@ int main(int argc,char** argv)
        max_iterations=atoi(&argv[arg][17]);
     else if(!strncmp(argv[arg],"--tagging=",10))
        tagging=&argv[arg][10];
+    else if(!strncmp(argv[arg],"--report=",9))
+       reportfile=&argv[arg][9];
     else if(argv[arg][0]=='-' && argv[arg][1]=='-')
        print_usage(0,argv[arg],NULL);
     else
@@ -115,6 +215,27 @@ int main(int argc,char** argv)
  if(option_filenames && option_process_only)
     print_usage(0,NULL,"Cannot use '--process-only' and filenames at the same time.");
 
+ if((option_keep || option_changes) && (option_parse_only || option_process_only))
+    print_usage(0,NULL,"Cannot use '--keep' or '--changes' with '--parse-only' or '--process-only'.");
+
+ if(option_changes && !option_filenames)
+    print_usage(0,NULL,"The '--changes' option requires the names of the change files.");
+
+ if(option_resume && (option_filenames || option_parse_only || option_process_only || option_keep || option_changes))
+    print_usage(0,NULL,"Cannot use '--resume' with filenames or any of the other parsing options.");
+
+ if(option_checkpoint && option_parse_only)
+    print_usage(0,NULL,"Cannot use '--checkpoint' and '--parse-only' at the same time.");
+
+ if(bbox && polygon)
+    print_usage(0,NULL,"Cannot use '--bbox' and '--polygon' at the same time.");
+
+ if((bbox || polygon) && (option_process_only || option_changes || option_resume))
+    print_usage(0,NULL,"Cannot use '--bbox' or '--polygon' with '--process-only', '--changes' or '--resume'.");
+
+ if(option_resume)
+    option_checkpoint=1;
+
  if(!option_filesort_ramsize)
    {
 #if SLIM
@@ -155,12 +276,47 @@ int main(int argc,char** argv)
       }
    }
 
+ if(bbox)
+   {
+    Area=NewAreaBBox(bbox);
+
+    if(!Area)
+       print_usage(0,NULL,"The '--bbox' option must be 'left,bottom,right,top' in degrees.");
+   }
+ else if(polygon)
+   {
+    Area=NewAreaPolygon(polygon);
+
+    if(!Area)
+       return(1);
+   }
+
  if(ParseXMLTaggingRules(tagging))
    {
     fprintf(stderr,"Error: Cannot read the tagging rules in the file '%s'.\n",tagging);
     return(1);
    }
 
+ /* Create the report file */
+
+ if(reportfile)
+   {
+    report=fopen(reportfile,"w");
+
+    if(!report)
+      {
+       fprintf(stderr,"Cannot open file '%s' for writing [%s].\n",reportfile,strerror(errno));
+       exit(EXIT_FAILURE);
+      }
+
+    gettimeofday(&start_time,NULL);
+   }
+
+ /* Delete the temporary files left by the run that was interrupted (before any new ones are created) */
+
+ if(option_resume)
+    delete_stale_tmpfiles();
+
  /* Create new node, segment, way and relation variables */
 
  Nodes=NewNodeList(option_parse_only||option_process_only);
@@ -174,7 +330,38 @@ int main(int argc,char** argv)
  /* Create the error log file */
 
  if(errorlog)
-    open_errorlog(FileName(dirname,prefix,errorlog),option_parse_only||option_process_only);
+    open_errorlog(FileName(dirname,prefix,errorlog),option_parse_only||option_process_only||option_resume);
+
+ /* Load the state of the processing from the last checkpoint */
+
+ if(option_resume)
+   {
+    printf("\nResume From Checkpoint\n======================\n\n");
+    fflush(stdout);
+
+    StartStage("LoadCheckpoint",-1);
+
+    if(load_checkpoint(&resume_stage,&iteration,&quit,Nodes,Segments,&SuperSegments,Ways,Relations))
+      {
+       fprintf(stderr,"Error: Cannot resume, there is no complete checkpoint in the '%s' directory.\n",option_tmpdirname);
+       exit(EXIT_FAILURE);
+      }
+   }
+
+ /* Load the data that was kept from a previous run (before parsing the changes) */
+
+ if(option_changes)
+   {
+    printf("\nLoad Kept Data\n==============\n\n");
+    fflush(stdout);
+
+    StartStage("LoadParsedData",-1);
+
+    LoadParsedNodeList(Nodes);
+    LoadParsedSegmentList(Segments);
+    LoadParsedWayList(Ways);
+    LoadParsedRelationList(Relations);
+   }
 
  /* Parse the file */
 
@@ -198,23 +385,83 @@ int main(int argc,char** argv)
        printf("\nParse OSM Data [%s]\n==============\n\n",argv[arg]);
        fflush(stdout);
 
-       if(ParseOSM(file,Nodes,Segments,Ways,Relations))
-          exit(EXIT_FAILURE);
+       StartStage("ParseOSM",-1);
+
+       if(option_changes)
+         {
+          if(ParseOSMChanges(file,Nodes,Segments,Ways,Relations))
+             exit(EXIT_FAILURE);
+         }
+       else if(strlen(argv[arg])>4 && !strcmp(argv[arg]+strlen(argv[arg])-4,".pbf"))
+         {
+          if(ParseOSMPBF(file,Nodes,Segments,Ways,Relations,Area))
+             exit(EXIT_FAILURE);
+         }
+       else
+         {
+          if(ParseOSM(file,Nodes,Segments,Ways,Relations,Area))
+             exit(EXIT_FAILURE);
+         }
 
        fclose(file);
       }
    }
- else if(!option_process_only)
+ else if(!option_process_only && !option_resume)
    {
     printf("\nParse OSM Data\n==============\n\n");
     fflush(stdout);
 
-    if(ParseOSM(stdin,Nodes,Segments,Ways,Relations))
+    StartStage("ParseOSM",-1);
+
+    if(ParseOSM(stdin,Nodes,Segments,Ways,Relations,Area))
        exit(EXIT_FAILURE);
    }
 
+ /* Add the nodes outside of the clipping area that are used by the ways that are kept */
+
+ if(Area)
+   {
+    StartStage("ClipOSM",-1);
+
+    AddBoundaryNodes(Nodes);
+
+    FreeArea(Area);
+   }
+
+ /* Remove the old versions of the changed items (the segments must be first) */
+
+ if(option_changes)
+   {
+    printf("\nApply OSM Changes\n=================\n\n");
+    fflush(stdout);
+
+    StartStage("ApplyChanges",-1);
+
+    ApplySegmentChanges(Segments,Ways);
+
+    ApplyNodeChanges(Nodes);
+
+    ApplyWayChanges(Ways);
+
+    ApplyRelationChanges(Relations);
+   }
+
+ /* Keep a copy of the parsed data so that changes can be applied later */
+
+ if(option_keep || option_changes)
+   {
+    StartStage("SaveParsedData",-1);
+
+    SaveParsedNodeList(Nodes);
+    SaveParsedSegmentList(Segments);
+    SaveParsedWayList(Ways);
+    SaveParsedRelationList(Relations);
+   }
+
  if(option_parse_only)
    {
+    EndReport();
+
     FreeNodeList(Nodes,1);
     FreeSegmentList(Segments,1);
     FreeWayList(Ways,1);
@@ -225,163 +472,260 @@ int main(int argc,char** argv)
 
  DeleteXMLTaggingRules();
 
- /* Process the data */
+ /* Process the data (unless resuming from a later checkpoint) */
 
- printf("\nProcess OSM Data\n================\n\n");
- fflush(stdout);
+ if(resume_stage<CHECKPOINT_PROCESSED)
+   {
+    printf("\nProcess OSM Data\n================\n\n");
+    fflush(stdout);
 
- /* Sort the nodes, segments, ways and relations */
+    /* Sort the nodes, segments, ways and relations */
 
- SortNodeList(Nodes);
+    StartStage("SortNodeList",-1);
 
- SortSegmentList(Segments);
+    SortNodeList(Nodes);
 
- SortWayList(Ways);
+    StartStage("SortSegmentList",-1);
 
- SortRelationList(Relations);
+    SortSegmentList(Segments);
 
- /* Remove bad segments (must be after sorting the nodes and segments) */
+    StartStage("SortWayList",-1);
 
- RemoveBadSegments(Nodes,Segments);
+    SortWayList(Ways);
 
- /* Remove non-highway nodes (must be after removing the bad segments) */
+    StartStage("SortRelationList",-1);
 
- RemoveNonHighwayNodes(Nodes,Segments);
+    SortRelationList(Relations);
 
- /* Process the route relations and first part of turn relations (must be before compacting the ways) */
+    /* Remove bad segments (must be after sorting the nodes and segments) */
 
- ProcessRouteRelations(Relations,Ways);
+    StartStage("RemoveBadSegments",-1);
 
- ProcessTurnRelations1(Relations,Nodes,Ways);
+    RemoveBadSegments(Nodes,Segments);
 
- /* Compact the ways (must be before measuring the segments) */
+    /* Remove non-highway nodes (must be after removing the bad segments) */
 
- CompactWayList(Ways);
+    StartStage("RemoveNonHighwayNodes",-1);
 
- /* Measure the segments and replace node/way id with index (must be after removing non-highway nodes) */
+    RemoveNonHighwayNodes(Nodes,Segments);
 
- MeasureSegments(Segments,Nodes,Ways);
+    /* Process the route relations and first part of turn relations (must be before compacting the ways) */
 
- /* Index the segments */
+    StartStage("ProcessRouteRelations",-1);
 
- IndexSegments(Segments,Nodes);
+    ProcessRouteRelations(Relations,Ways);
 
- /* Convert the turn relations from ways into nodes */
+    StartStage("ProcessTurnRelations1",-1);
 
- ProcessTurnRelations2(Relations,Nodes,Segments,Ways);
+    ProcessTurnRelations1(Relations,Nodes,Ways);
 
+    /* Compact the ways (must be before measuring the segments) */
 
- /* Repeated iteration on Super-Nodes and Super-Segments */
+    StartStage("CompactWayList",-1);
 
- do
-   {
-    int nsuper;
+    CompactWayList(Ways);
 
-    printf("\nProcess Super-Data (iteration %d)\n================================%s\n\n",iteration,iteration>9?"=":"");
-    fflush(stdout);
+    /* Measure the segments and replace node/way id with index (must be after removing non-highway nodes) */
 
-    if(iteration==0)
-      {
-       /* Select the super-nodes */
+    StartStage("MeasureSegments",-1);
+
+    MeasureSegments(Segments,Nodes,Ways);
 
-       ChooseSuperNodes(Nodes,Segments,Ways);
+    /* Index the segments */
+
+    StartStage("IndexSegments",-1);
+
+    IndexSegments(Segments,Nodes);
+
+    /* Convert the turn relations from ways into nodes */
 
-       /* Select the super-segments */
+    StartStage("ProcessTurnRelations2",-1);
 
-       SuperSegments=CreateSuperSegments(Nodes,Segments,Ways);
+    ProcessTurnRelations2(Relations,Nodes,Segments,Ways);
 
-       nsuper=Segments->number;
+    if(option_checkpoint)
+      {
+       StartStage("SaveCheckpoint",-1);
+
+       save_checkpoint(CHECKPOINT_PROCESSED,iteration,quit,Nodes,Segments,NULL,Ways,Relations);
       }
-    else
+   }
+
+ /* Create the super-data and combine it with the normal data (unless resuming from a later checkpoint) */
+
+ if(resume_stage<CHECKPOINT_MERGED)
+   {
+    /* Repeated iteration on Super-Nodes and Super-Segments */
+
+    while(!quit)
       {
-       SegmentsX *SuperSegments2;
+       int nsuper;
+
+       printf("\nProcess Super-Data (iteration %d)\n================================%s\n\n",iteration,iteration>9?"=":"");
+       fflush(stdout);
+
+       if(iteration==0)
+         {
+          /* Select the super-nodes */
+
+          StartStage("ChooseSuperNodes",iteration);
+
+          ChooseSuperNodes(Nodes,Segments,Ways);
+
+          /* Select the super-segments */
+
+          StartStage("CreateSuperSegments",iteration);
+
+          SuperSegments=CreateSuperSegments(Nodes,Segments,Ways);
+
+          nsuper=Segments->number;
+         }
+       else
+         {
+          SegmentsX *SuperSegments2;
+
+          /* Select the super-nodes */
+
+          StartStage("ChooseSuperNodes",iteration);
 
-       /* Select the super-nodes */
+          ChooseSuperNodes(Nodes,SuperSegments,Ways);
 
-       ChooseSuperNodes(Nodes,SuperSegments,Ways);
+          /* Select the super-segments */
 
-       /* Select the super-segments */
+          StartStage("CreateSuperSegments",iteration);
 
-       SuperSegments2=CreateSuperSegments(Nodes,SuperSegments,Ways);
+          SuperSegments2=CreateSuperSegments(Nodes,SuperSegments,Ways);
 
-       nsuper=SuperSegments->number;
+          nsuper=SuperSegments->number;
 
-       FreeSegmentList(SuperSegments,0);
+          FreeSegmentList(SuperSegments,0);
 
-       SuperSegments=SuperSegments2;
+          SuperSegments=SuperSegments2;
+         }
+
+       /* Sort the super-segments */
+
+       StartStage("SortSegmentList",iteration);
+
+       SortSegmentList(SuperSegments);
+
+       /* Remove duplicated super-segments */
+
+       StartStage("DeduplicateSegments",iteration);
+
+       DeduplicateSegments(SuperSegments,Nodes,Ways);
+
+       /* Index the segments */
+
+       StartStage("IndexSegments",iteration);
+
+       IndexSegments(SuperSegments,Nodes);
+
+       /* Check for end condition */
+
+       if(SuperSegments->number==nsuper)
+          quit=1;
+
+       iteration++;
+
+       if(iteration>max_iterations)
+          quit=1;
+
+       /* Save a checkpoint after each iteration */
+
+       if(option_checkpoint)
+         {
+          StartStage("SaveCheckpoint",iteration-1);
+
+          save_checkpoint(CHECKPOINT_SUPER,iteration,quit,Nodes,Segments,SuperSegments,Ways,Relations);
+         }
       }
 
-    /* Sort the super-segments */
+    /* Combine the super-segments */
 
-    SortSegmentList(SuperSegments);
+    printf("\nCombine Segments and Super-Segments\n===================================\n\n");
+    fflush(stdout);
 
-    /* Remove duplicated super-segments */
+    /* Merge the super-segments */
 
-    DeduplicateSegments(SuperSegments,Nodes,Ways);
+    StartStage("MergeSuperSegments",-1);
 
-    /* Index the segments */
+    MergedSegments=MergeSuperSegments(Segments,SuperSegments);
 
-    IndexSegments(SuperSegments,Nodes);
+    FreeSegmentList(Segments,0);
 
-    /* Check for end condition */
+    FreeSegmentList(SuperSegments,0);
 
-    if(SuperSegments->number==nsuper)
-       quit=1;
+    Segments=MergedSegments;
 
-    iteration++;
+    /* Sort and re-index the segments */
 
-    if(iteration>max_iterations)
-       quit=1;
-   }
- while(!quit);
+    StartStage("SortSegmentList",-1);
 
- /* Combine the super-segments */
+    SortSegmentList(Segments);
 
- printf("\nCombine Segments and Super-Segments\n===================================\n\n");
- fflush(stdout);
+    StartStage("IndexSegments",-1);
 
- /* Merge the super-segments */
+    IndexSegments(Segments,Nodes);
 
- MergedSegments=MergeSuperSegments(Segments,SuperSegments);
+    if(option_checkpoint)
+      {
+       StartStage("SaveCheckpoint",-1);
 
- FreeSegmentList(Segments,0);
+       save_checkpoint(CHECKPOINT_MERGED,iteration,quit,Nodes,Segments,NULL,Ways,Relations);
+      }
+   }
 
- FreeSegmentList(SuperSegments,0);
+ /* Cross reference the nodes, segments and relations (unless resuming from a later checkpoint) */
 
- Segments=MergedSegments;
+ if(resume_stage<CHECKPOINT_CROSSREF)
+   {
+    printf("\nCross-Reference Nodes and Segments\n==================================\n\n");
+    fflush(stdout);
 
- /* Sort and re-index the segments */
+    /* Sort the nodes geographically and update the segment indexes accordingly */
 
- SortSegmentList(Segments);
+    StartStage("SortNodeListGeographically",-1);
 
- IndexSegments(Segments,Nodes);
+    SortNodeListGeographically(Nodes);
 
- /* Cross reference the nodes and segments */
+    StartStage("UpdateSegments",-1);
 
- printf("\nCross-Reference Nodes and Segments\n==================================\n\n");
- fflush(stdout);
+    UpdateSegments(Segments,Nodes,Ways);
+
+    /* Sort the segments geographically and re-index them */
+
+    StartStage("SortSegmentList",-1);
 
- /* Sort the nodes geographically and update the segment indexes accordingly */
+    SortSegmentList(Segments);
 
- SortNodeListGeographically(Nodes);
+    StartStage("IndexSegments",-1);
 
- UpdateSegments(Segments,Nodes,Ways);
+    IndexSegments(Segments,Nodes);
 
- /* Sort the segments geographically and re-index them */
+    /* Update the nodes */
 
- SortSegmentList(Segments);
+    StartStage("UpdateNodes",-1);
 
- IndexSegments(Segments,Nodes);
+    UpdateNodes(Nodes,Segments);
 
- /* Update the nodes */
+    /* Fix the turn relations after sorting nodes geographically */
 
- UpdateNodes(Nodes,Segments);
+    StartStage("UpdateTurnRelations",-1);
 
- /* Fix the turn relations after sorting nodes geographically */
+    UpdateTurnRelations(Relations,Nodes,Segments);
 
- UpdateTurnRelations(Relations,Nodes,Segments);
+    StartStage("SortTurnRelationList",-1);
 
- SortTurnRelationList(Relations);
+    SortTurnRelationList(Relations);
+
+    if(option_checkpoint)
+      {
+       StartStage("SaveCheckpoint",-1);
+
+       save_checkpoint(CHECKPOINT_CROSSREF,iteration,quit,Nodes,Segments,NULL,Ways,Relations);
+      }
+   }
 
  /* Output the results */
 
@@ -390,28 +734,43 @@ int main(int argc,char** argv)
 
  /* Write out the nodes */
 
+ StartStage("SaveNodeList",-1);
+
  SaveNodeList(Nodes,FileName(dirname,prefix,"nodes.mem"));
 
  FreeNodeList(Nodes,0);
 
  /* Write out the segments */
 
+ StartStage("SaveSegmentList",-1);
+
  SaveSegmentList(Segments,FileName(dirname,prefix,"segments.mem"));
 
  FreeSegmentList(Segments,0);
 
  /* Write out the ways */
 
+ StartStage("SaveWayList",-1);
+
  SaveWayList(Ways,FileName(dirname,prefix,"ways.mem"));
 
  FreeWayList(Ways,0);
 
  /* Write out the relations */
 
+ StartStage("SaveRelationList",-1);
+
  SaveRelationList(Relations,FileName(dirname,prefix,"relations.mem"));
 
  FreeRelationList(Relations,0);
 
+ /* The checkpoint is not needed once the database is complete */
+
+ if(option_checkpoint)
+    delete_checkpoint();
+
+ EndReport();
+
  /* Close the error log file */
 
  if(errorlog)
@@ -421,6 +780,490 @@ int main(int argc,char** argv)
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Save a checkpoint of the processing (the temporary files are copied and the
+  state that is only in memory is written to a checkpoint file).
+
+  int stage The stage of the processing that has just finished.
+
+  int iteration The iteration of the super-data processing.
+
+  int quit Set to true if the super-data processing has finished.
+
+  NodesX *nodesx The set of nodes.
+
+  SegmentsX *segmentsx The set of segments.
+
+  SegmentsX *supersegmentsx The set of super-segments (or NULL).
+
+  WaysX *waysx The set of ways.
+
+  RelationsX *relationsx The set of relations.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void save_checkpoint(int stage,int iteration,int quit,NodesX *nodesx,SegmentsX *segmentsx,SegmentsX *supersegmentsx,WaysX *waysx,RelationsX *relationsx)
+{
+ char *filename,*tmpfilename,*filenames[2];
+ uint32_t header[6];
+ int fd;
+
+ /* Print the start message */
+
+ printf_first("Saving Checkpoint");
+
+ /* Write the state to a temporary file (copying the data files) */
+
+ tmpfilename=FileName(option_tmpdirname,NULL,"checkpoint.tmp");
+
+ fd=OpenFileNew(tmpfilename);
+
+ header[0]=CHECKPOINT_MAGIC;
+ header[1]=stage;
+ header[2]=iteration;
+ header[3]=quit;
+ header[4]=checkpoint_slot;
+ header[5]=!!supersegmentsx;
+
+ WriteFile(fd,header,sizeof(header));
+
+ filenames[0]=checkpoint_filename(checkpoint_slot,"nodesx.mem");
+ CheckpointNodeList(nodesx,fd,filenames[0]);
+ free(filenames[0]);
+
+ filenames[0]=checkpoint_filename(checkpoint_slot,"segmentsx.mem");
+ CheckpointSegmentList(segmentsx,nodesx,fd,filenames[0]);
+ free(filenames[0]);
+
+ if(supersegmentsx)
+   {
+    filenames[0]=checkpoint_filename(checkpoint_slot,"supersegmentsx.mem");
+    CheckpointSegmentList(supersegmentsx,nodesx,fd,filenames[0]);
+    free(filenames[0]);
+   }
+
+ filenames[0]=checkpoint_filename(checkpoint_slot,"waysx.mem");
+ filenames[1]=checkpoint_filename(checkpoint_slot,"waynames.mem");
+ CheckpointWayList(waysx,fd,filenames[0],filenames[1]);
+ free(filenames[0]);
+ free(filenames[1]);
+
+ filenames[0]=checkpoint_filename(checkpoint_slot,"relationsx.route.mem");
+ filenames[1]=checkpoint_filename(checkpoint_slot,"relationsx.turn.mem");
+ CheckpointRelationList(relationsx,fd,filenames[0],filenames[1]);
+ free(filenames[0]);
+ free(filenames[1]);
+
+ /* The checkpoint and the copied data files must reach the disk before the checkpoint is used */
+
+ SyncFileToDisk(fd);
+
+ CloseFile(fd);
+
+ /* Replace the previous checkpoint (renaming is atomic so there is always a complete one) */
+
+ filename=FileName(option_tmpdirname,NULL,"checkpoint.mem");
+
+ if(rename(tmpfilename,filename))
+   {
+    fprintf(stderr,"Cannot rename file '%s' to '%s' [%s].\n",tmpfilename,filename,strerror(errno));
+    exit(EXIT_FAILURE);
+   }
+
+ SyncDirectoryToDisk(option_tmpdirname);
+
+ free(tmpfilename);
+ free(filename);
+
+ checkpoint_slot=!checkpoint_slot;
+
+ /* Print the final message */
+
+ printf_last("Saved Checkpoint: Stage=%d Iteration=%d",stage,iteration);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Load the last checkpoint of the processing that was saved by save_checkpoint().
+
+  int load_checkpoint Returns 0 if OK or something else if there is no valid checkpoint.
+
+  int *stage Returns the stage of the processing that had finished.
+
+  int *iteration Returns the iteration of the super-data processing.
+
+  int *quit Returns true if the super-data processing had finished.
+
+  NodesX *nodesx The set of nodes to restore.
+
+  SegmentsX *segmentsx The set of segments to restore.
+
+  SegmentsX **supersegmentsx Returns the set of super-segments (if there was one).
+
+  WaysX *waysx The set of ways to restore.
+
+  RelationsX *relationsx The set of relations to restore.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int load_checkpoint(int *stage,int *iteration,int *quit,NodesX *nodesx,SegmentsX *segmentsx,SegmentsX **supersegmentsx,WaysX *waysx,RelationsX *relationsx)
+{
+ char *filename,*filenames[2];
+ uint32_t header[6];
+ int fd,slot,retval=0;
+
+ filename=FileName(option_tmpdirname,NULL,"checkpoint.mem");
+
+ if(!ExistsFile(filename))
+   {
+    free(filename);
+    return(1);
+   }
+
+ /* Print the start message */
+
+ printf_first("Loading Checkpoint");
+
+ fd=ReOpenFile(filename);
+
+ free(filename);
+
+ if(ReadFile(fd,header,sizeof(header)) || header[0]!=CHECKPOINT_MAGIC)
+   {
+    CloseFile(fd);
+    return(1);
+   }
+
+ *stage=header[1];
+ *iteration=header[2];
+ *quit=header[3];
+ slot=header[4];
+
+ /* Read the state (copying the data files) */
+
+ filenames[0]=checkpoint_filename(slot,"nodesx.mem");
+ retval|=ResumeNodeList(nodesx,fd,filenames[0]);
+ free(filenames[0]);
+
+ filenames[0]=checkpoint_filename(slot,"segmentsx.mem");
+ retval|=ResumeSegmentList(segmentsx,fd,filenames[0]);
+ free(filenames[0]);
+
+ if(header[5])
+   {
+    *supersegmentsx=NewSegmentList(0);
+
+    filenames[0]=checkpoint_filename(slot,"supersegmentsx.mem");
+    retval|=ResumeSegmentList(*supersegmentsx,fd,filenames[0]);
+    free(filenames[0]);
+   }
+
+ filenames[0]=checkpoint_filename(slot,"waysx.mem");
+ filenames[1]=checkpoint_filename(slot,"waynames.mem");
+ retval|=ResumeWayList(waysx,fd,filenames[0],filenames[1]);
+ free(filenames[0]);
+ free(filenames[1]);
+
+ filenames[0]=checkpoint_filename(slot,"relationsx.route.mem");
+ filenames[1]=checkpoint_filename(slot,"relationsx.turn.mem");
+ retval|=ResumeRelationList(relationsx,fd,filenames[0],filenames[1]);
+ free(filenames[0]);
+ free(filenames[1]);
+
+ CloseFile(fd);
+
+ /* The next checkpoint must not overwrite the one just loaded */
+
+ checkpoint_slot=!slot;
+
+ /* Print the final message */
+
+ printf_last("Loaded Checkpoint: Stage=%d Iteration=%d",*stage,*iteration);
+
+ return(retval);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Delete the checkpoint file and the data files for both sets of checkpoints.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void delete_checkpoint(void)
+{
+ const char *names[]={"nodesx.mem","segmentsx.mem","supersegmentsx.mem","waysx.mem","waynames.mem","relationsx.route.mem","relationsx.turn.mem"};
+ char *filename;
+ int slot,i;
+
+ filename=FileName(option_tmpdirname,NULL,"checkpoint.mem");
+ DeleteFile(filename);
+ free(filename);
+
+ for(slot=0;slot<2;slot++)
+    for(i=0;i<(int)(sizeof(names)/sizeof(names[0]));i++)
+      {
+       filename=checkpoint_filename(slot,names[i]);
+       DeleteFile(filename);
+       free(filename);
+      }
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Delete the temporary files that were being used when the processing was
+  interrupted ('<name>.<address>.tmp' and 'filesort.<number>.tmp' but not the
+  '<name>.input.tmp' files kept for applying changes).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void delete_stale_tmpfiles(void)
+{
+ const char *prefixes[]={"nodesx.","segmentsx.","waysx.","waynames.","relationsx.route.","relationsx.turn.","osmparser.","filesort."};
+ DIR *dir;
+ struct dirent *entry;
+ char *filename;
+ int i;
+
+ dir=opendir(option_tmpdirname);
+
+ if(!dir)
+    return;
+
+ while((entry=readdir(dir)))
+    for(i=0;i<(int)(sizeof(prefixes)/sizeof(prefixes[0]));i++)
+      {
+       const char *middle=entry->d_name+strlen(prefixes[i]);
+       size_t length=strlen(entry->d_name);
+
+       if(strncmp(entry->d_name,prefixes[i],strlen(prefixes[i])))
+          continue;
+
+       if(length<=strlen(prefixes[i])+4 || strcmp(entry->d_name+length-4,".tmp"))
+          continue;
+
+       if(!strncmp(middle,"input.",6) || strchr(middle,'.')!=entry->d_name+length-4)
+          continue;
+
+       filename=FileName(option_tmpdirname,NULL,entry->d_name);
+       DeleteFile(filename);
+       free(filename);
+      }
+
+ closedir(dir);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Return the name of one of the data files of a checkpoint.
+
+  char *checkpoint_filename Returns a pointer to memory allocated to the filename.
+
+  int slot The set of checkpoint data files.
+
+  const char *name The name of the data file.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static char *checkpoint_filename(int slot,const char *name)
+{
+ char prefix[16];
+
+ sprintf(prefix,"checkpoint%d",slot);
+
+ return(FileName(option_tmpdirname,prefix,name));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Start recording the time and memory used by a stage of the processing (finishing the previous stage).
+
+  const char *name The name of the stage.
+
+  int iteration The iteration of the super-data processing (or -1).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void StartStage(const char *name,int iteration)
+{
+ if(!report)
+    return;
+
+ EndStage();
+
+ stage_name=name;
+ stage_iteration=iteration;
+
+ ResetPeakRSS();
+
+ stage_bytes_read=file_bytes_read;
+ stage_bytes_written=file_bytes_written;
+
+ stage_nsorts=filesort_nsorts;
+ stage_nruns=filesort_nruns;
+ stage_npasses=filesort_npasses;
+
+ stage_cputime=CPUTime();
+
+ gettimeofday(&stage_time,NULL);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Finish recording the current stage of the processing and write it to the report.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void EndStage(void)
+{
+ long peakrss;
+
+ if(!report || !stage_name)
+    return;
+
+ peakrss=PeakRSS();
+
+ if(peakrss>max_peakrss)
+    max_peakrss=peakrss;
+
+ ReportStage(stage_name,stage_iteration,&stage_time,CPUTime()-stage_cputime,
+             file_bytes_read-stage_bytes_read,file_bytes_written-stage_bytes_written,
+             filesort_nsorts-stage_nsorts,filesort_nruns-stage_nruns,filesort_npasses-stage_npasses,
+             peakrss);
+
+ stage_name=NULL;
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Finish the last stage of the processing, write the totals for the whole program and close the report.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void EndReport(void)
+{
+ if(!report)
+    return;
+
+ EndStage();
+
+ ReportStage("total",-1,&start_time,CPUTime(),
+             file_bytes_read,file_bytes_written,
+             filesort_nsorts,filesort_nruns,filesort_npasses,
+             max_peakrss);
+
+ fclose(report);
+
+ report=NULL;
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Write one line of the report in JSON format.
+
+  const char *name The name of the stage.
+
+  int iteration The iteration of the super-data processing (or -1).
+
+  struct timeval *time The time that the stage started.
+
+  double cputime The CPU time used by the stage.
+
+  uint64_t bytes_read The number of bytes read from files.
+
+  uint64_t bytes_written The number of bytes written to files.
+
+  index_t nsorts The number of files that were sorted.
+
+  index_t nruns The number of temporary files written while sorting.
+
+  index_t npasses The number of extra merge passes needed while sorting.
+
+  long peakrss The peak resident memory size (kB).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void ReportStage(const char *name,int iteration,struct timeval *time,double cputime,uint64_t bytes_read,uint64_t bytes_written,index_t nsorts,index_t nruns,index_t npasses,long peakrss)
+{
+ struct timeval now;
+ double walltime;
+
+ gettimeofday(&now,NULL);
+
+ walltime=(double)(now.tv_sec-time->tv_sec)+(double)(now.tv_usec-time->tv_usec)/1000000.0;
+
+ fprintf(report,"{\"stage\": \"%s\", ",name);
+
+ if(iteration>=0)
+    fprintf(report,"\"iteration\": %d, ",iteration);
+
+ fprintf(report,"\"wall\": %.3f, \"cpu\": %.3f, \"bytes_read\": %llu, \"bytes_written\": %llu, \"sorts\": %"Pindex_t", \"sort_runs\": %"Pindex_t", \"sort_passes\": %"Pindex_t", \"peak_rss_kb\": %ld}\n",
+         walltime,cputime,(unsigned long long)bytes_read,(unsigned long long)bytes_written,nsorts,nruns,npasses,peakrss);
+
+ fflush(report);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Return the CPU time (user and system) used by the program so far.
+
+  double CPUTime Returns the time in seconds.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static double CPUTime(void)
+{
+ struct rusage usage;
+
+ getrusage(RUSAGE_SELF,&usage);
+
+ return((double)(usage.ru_utime.tv_sec+usage.ru_stime.tv_sec)+(double)(usage.ru_utime.tv_usec+usage.ru_stime.tv_usec)/1000000.0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Reset the peak resident memory size so that the peak for each stage is found
+  (only possible on Linux, elsewhere the peak for the program so far is used).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void ResetPeakRSS(void)
+{
+ FILE *file=fopen("/proc/self/clear_refs","w");
+
+ if(file)
+   {
+    fputs("5",file);
+    fclose(file);
+   }
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Return the peak resident memory size since it was last reset.
+
+  long PeakRSS Returns the peak size in kB.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static long PeakRSS(void)
+{
+ struct rusage usage;
+ FILE *file=fopen("/proc/self/status","r");
+ long peakrss=-1;
+
+ if(file)
+   {
+    char line[256];
+
+    while(fgets(line,sizeof(line),file))
+       if(!strncmp(line,"VmHWM:",6))
+         {
+          peakrss=atol(line+6);
+          break;
+         }
+
+    fclose(file);
+   }
+
+ if(peakrss<0)
+   {
+    getrusage(RUSAGE_SELF,&usage);
+
+    peakrss=usage.ru_maxrss;
+   }
+
+ return(peakrss);
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Print out the usage information.
 
@@ -436,13 +1279,20 @@ static void print_usage(int detail,const char *argerr,const char *err)
  fprintf(stderr,
          "Usage: planetsplitter [--help]\n"
          "                      [--dir=<dirname>] [--prefix=<name>]\n"
-         "                      [--sort-ram-size=<size>]\n"
+         "                      [--sort-ram-size=<size>] [--sort-threads=<number>]\n"
+         "                      [--sort-fan-in=<number>] [--sort-compress]\n"
          "                      [--tmpdir=<dirname>]\n"
          "                      [--parse-only | --process-only]\n"
+         "                      [--keep] [--changes]\n"
+         "                      [--bbox=<left,bottom,right,top> | --polygon=<filename>]\n"
+         "                      [--checkpoint] [--resume]\n"
+         "                      [--parse-threads=<number>]\n"
          "                      [--loggable] [--errorlog[=<name>]]\n"
-         "                      [--max-iterations=<number>]\n"
+         "                      [--max-iterations=<number>] [--super-threads=<number>]\n"
          "                      [--tagging=<filename>]\n"
-         "                      [<filename.osm> ...]\n");
+         "                      [--report=<filename>]\n"
+         "                      [<filename.osm> ... | <filename.osm.pbf> ...\n"
+         "                       | <filename.osc> ...]\n");
 
  if(argerr)
     fprintf(stderr,
@@ -468,11 +1318,30 @@ static void print_usage(int detail,const char *argerr,const char *err)
 #else
             "                          (defaults to 256MB otherwise.)\n"
 #endif
+            "--sort-threads=<number>   The number of threads to use for data sorting\n"
+            "                          (the RAM is shared between them, defaults to 1).\n"
+            "--sort-fan-in=<number>    The number of temporary files to merge at once\n"
+            "                          (defaults to the number that fits in the RAM).\n"
+            "--sort-compress           Compress the temporary files used for sorting.\n"
             "--tmpdir=<dirname>        The directory name for temporary files.\n"
             "                          (defaults to the '--dir' option directory.)\n"
             "\n"
             "--parse-only              Parse the input OSM files and store the results.\n"
             "--process-only            Process the stored results from previous option.\n"
+            "--keep                    Keep a copy of the parsed data in the '--tmpdir'\n"
+            "                          directory so that changes can be applied later.\n"
+            "--changes                 The files are OSM change files (.osc) to apply to\n"
+            "                          the kept data (the kept data is then updated).\n"
+            "--bbox=<left,bottom,right,top>\n"
+            "                          Only keep the data inside the bounding box given\n"
+            "                          in degrees (and the nodes of the ways crossing it).\n"
+            "--polygon=<filename>      Only keep the data inside the polygon in the file\n"
+            "                          (Osmosis '.poly' format) instead of a bounding box.\n"
+            "--checkpoint              Save the state after each major processing stage\n"
+            "                          in the '--tmpdir' directory.\n"
+            "--resume                  Continue processing from the last saved checkpoint.\n"
+            "--parse-threads=<number>  The number of threads to use for parsing the files\n"
+            "                          (not for files read from a pipe, defaults to 1).\n"
             "\n"
             "--loggable                Print progress messages suitable for logging to file.\n"
             "--errorlog[=<name>]       Log parsing errors to 'error.log' or the given name\n"
@@ -480,14 +1349,22 @@ static void print_usage(int detail,const char *argerr,const char *err)
             "\n"
             "--max-iterations=<number> The number of iterations for finding super-nodes\n"
             "                          (defaults to 5).\n"
+            "--super-threads=<number>  The number of threads to use for finding super-nodes\n"
+            "                          and super-segments (defaults to 1).\n"
             "\n"
             "--tagging=<filename>      The name of the XML file containing the tagging rules\n"
             "                          (defaults to 'tagging.xml' with '--dir' and\n"
             "                           '--prefix' options or the file installed in\n"
             "                           '" DATADIR "').\n"
             "\n"
+            "--report=<filename>       Write the time, file I/O, sorting and peak memory\n"
+            "                          for each processing stage to a file.\n"
+            "\n"
             "<filename.osm> ...        The name(s) of the file(s) to process (by default\n"
             "                          data is read from standard input).\n"
+            "<filename.osm.pbf> ...    The name(s) of PBF format file(s) to process.\n"
+            "<filename.osc> ...        The name(s) of change file(s) to apply (with the\n"
+            "                          '--changes' option, must not be compressed).\n"
             "\n"
             "<transport> defaults to all but can be set to:\n"
             "%s"
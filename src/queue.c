@@ -91,6 +91,11 @@ void InsertInQueue(Queue *queue,Result *result)
 {
  uint32_t index;
 
+#if RESULTS_STATISTICS
+ if(results_statistics_enabled)
+    results_statistics.pushed++;
+#endif
+
  if(result->queued==NOT_QUEUED)
    {
     queue->noccupied++;
@@ -151,6 +156,11 @@ Result *PopFromQueue(Queue *queue)
  if(queue->noccupied==0)
     return(NULL);
 
+#if RESULTS_STATISTICS
+ if(results_statistics_enabled)
+    results_statistics.popped++;
+#endif
+
  retval=queue->data[1];
  retval->queued=NOT_QUEUED;
 
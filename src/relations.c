@@ -71,6 +71,9 @@ Relations *LoadRelationList(const char *filename)
  for(i=0;i<sizeof(relations->cached)/sizeof(relations->cached[0]);i++)
     relations->incache[i]=NO_RELATION;
 
+ relations->cachehits=0;
+ relations->cachemisses=0;
+
 #endif
 
  if(relations->file.trnumber>0)
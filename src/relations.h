@@ -73,6 +73,9 @@ struct _Relations
  TurnRelation  cached[2];       /*+ Two cached relations read from the file in slim mode. +*/
  index_t       incache[2];      /*+ The indexes of the cached relations. +*/
 
+ uint32_t      cachehits;       /*+ The number of lookups found in the cache. +*/
+ uint32_t      cachemisses;     /*+ The number of lookups read from the file. +*/
+
 #endif
 
  index_t       via_start;       /*+ The first via node in the file. +*/
@@ -121,12 +124,16 @@ static inline TurnRelation *LookupTurnRelation(Relations *relations,index_t inde
 {
  if(relations->incache[position-1]!=index)
    {
+    relations->cachemisses++;
+
     SeekFile(relations->fd,relations->troffset+(off_t)index*sizeof(TurnRelation));
 
     ReadFile(relations->fd,&relations->cached[position-1],sizeof(TurnRelation));
 
     relations->incache[position-1]=index;
    }
+ else
+    relations->cachehits++;
 
  return(&relations->cached[position-1]);
 }
@@ -33,6 +33,7 @@
 #include "segmentsx.h"
 #include "waysx.h"
 #include "relationsx.h"
+#include "changesx.h"
 
 #include "files.h"
 #include "logging.h"
@@ -41,10 +42,14 @@
 
 /* Local functions */
 
-static int sort_by_id(TurnRestrictRelX *a,TurnRestrictRelX *b);
+static index_t count_route_relations(const char *filename);
+
+static void key_by_id(TurnRestrictRelX *relationx,uint32_t *key);
 static int deduplicate_by_id(TurnRestrictRelX *relationx,index_t index);
 
-static int sort_by_via(TurnRestrictRelX *a,TurnRestrictRelX *b);
+static void key_by_via(TurnRestrictRelX *relationx,uint32_t *key);
+
+static int sort_by_route_id(const index_t *a,const index_t *b);
 
 
 /* Variables */
@@ -54,6 +59,8 @@ extern char *option_tmpdirname;
 
 static RelationsX* sortrelationsx;
 
+static RouteRelX* sortrouterels;
+
 
 /*++++++++++++++++++++++++++++++++++++++
   Allocate a new relation list (create a new file or open an existing one).
@@ -83,27 +90,12 @@ RelationsX *NewRelationList(int append)
 
  if(append)
    {
-    off_t size,position=0;
-
-    relationsx->rfd=OpenFileAppend(relationsx->rfilename);
-
-    size=SizeFile(relationsx->rfilename);
-
-    while(position<size)
-      {
-       FILESORT_VARINT relationsize;
-
-       SeekFile(relationsx->rfd,position);
-       ReadFile(relationsx->rfd,&relationsize,FILESORT_VARSIZE);
-
-       relationsx->rnumber++;
-       position+=relationsize+FILESORT_VARSIZE;
-      }
+    relationsx->rfd=OpenFileBufferedAppend(relationsx->rfilename);
 
-    SeekFile(relationsx->rfd,size);
+    relationsx->rnumber=count_route_relations(relationsx->rfilename);
    }
  else
-    relationsx->rfd=OpenFileNew(relationsx->rfilename);
+    relationsx->rfd=OpenFileBufferedNew(relationsx->rfilename);
 
 
  /* Turn Restriction Relations */
@@ -119,14 +111,14 @@ RelationsX *NewRelationList(int append)
    {
     off_t size;
 
-    relationsx->trfd=OpenFileAppend(relationsx->trfilename);
+    relationsx->trfd=OpenFileBufferedAppend(relationsx->trfilename);
 
     size=SizeFile(relationsx->trfilename);
 
     relationsx->trnumber=size/sizeof(TurnRestrictRelX);
    }
  else
-    relationsx->trfd=OpenFileNew(relationsx->trfilename);
+    relationsx->trfd=OpenFileBufferedNew(relationsx->trfilename);
 
  return(relationsx);
 }
@@ -144,6 +136,9 @@ void FreeRelationList(RelationsX *relationsx,int keep)
 {
  /* Route relations */
 
+ if(relationsx->rfd!=-1)
+    relationsx->rfd=CloseFileBuffered(relationsx->rfd);
+
  if(!keep)
     DeleteFile(relationsx->rfilename);
 
@@ -152,15 +147,185 @@ void FreeRelationList(RelationsX *relationsx,int keep)
 
  /* Turn Restriction relations */
 
+ if(relationsx->trfd!=-1)
+    relationsx->trfd=CloseFileBuffered(relationsx->trfd);
+
  if(!keep)
     DeleteFile(relationsx->trfilename);
 
  free(relationsx->trfilename);
 
+ if(relationsx->changes)
+    FreeChangeList(relationsx->changes);
+
  free(relationsx);
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Count the relations in an unsorted route relation list file.
+
+  index_t count_route_relations Returns the number of route relations.
+
+  const char *filename The name of the file.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static index_t count_route_relations(const char *filename)
+{
+ off_t size,position=0;
+ index_t number=0;
+ int fd;
+
+ size=SizeFile(filename);
+
+ fd=ReOpenFileBuffered(filename);
+
+ while(position<size)
+   {
+    FILESORT_VARINT relationsize;
+
+    ReadFileBuffered(fd,&relationsize,FILESORT_VARSIZE);
+    SkipFileBuffered(fd,relationsize);
+
+    number++;
+    position+=relationsize+FILESORT_VARSIZE;
+   }
+
+ CloseFileBuffered(fd);
+
+ return(number);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Save a copy of the parsed (unsorted) relation lists so that they can be updated later.
+
+  RelationsX *relationsx The set of relations to save.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void SaveParsedRelationList(RelationsX *relationsx)
+{
+ char *filename=(char*)malloc(strlen(option_tmpdirname)+40);
+
+ /* Route Relations */
+
+ sprintf(filename,"%s/relationsx.route.parsed.mem",option_tmpdirname);
+
+ relationsx->rfd=CloseFileBuffered(relationsx->rfd);
+
+ CopyFile(relationsx->rfilename,filename);
+
+ relationsx->rfd=OpenFileBufferedAppend(relationsx->rfilename);
+
+ /* Turn Restriction Relations */
+
+ sprintf(filename,"%s/relationsx.turn.parsed.mem",option_tmpdirname);
+
+ relationsx->trfd=CloseFileBuffered(relationsx->trfd);
+
+ CopyFile(relationsx->trfilename,filename);
+
+ relationsx->trfd=OpenFileBufferedAppend(relationsx->trfilename);
+
+ free(filename);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Replace the relation lists with the copies of the parsed relation lists saved earlier.
+
+  RelationsX *relationsx The set of relations to replace.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void LoadParsedRelationList(RelationsX *relationsx)
+{
+ char *filename=(char*)malloc(strlen(option_tmpdirname)+40);
+
+ /* Route Relations */
+
+ sprintf(filename,"%s/relationsx.route.parsed.mem",option_tmpdirname);
+
+ relationsx->rfd=CloseFileBuffered(relationsx->rfd);
+
+ CopyFile(filename,relationsx->rfilename);
+
+ relationsx->rfd=OpenFileBufferedAppend(relationsx->rfilename);
+
+ relationsx->rnumber=count_route_relations(relationsx->rfilename);
+
+ /* Turn Restriction Relations */
+
+ sprintf(filename,"%s/relationsx.turn.parsed.mem",option_tmpdirname);
+
+ relationsx->trfd=CloseFileBuffered(relationsx->trfd);
+
+ CopyFile(filename,relationsx->trfilename);
+
+ relationsx->trfd=OpenFileBufferedAppend(relationsx->trfilename);
+
+ relationsx->trnumber=SizeFile(relationsx->trfilename)/sizeof(TurnRestrictRelX);
+
+ free(filename);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Save the state of the relation lists between two stages of processing so
+  that the processing can be resumed from here.
+
+  RelationsX *relationsx The set of relations to save.
+
+  int fd The file descriptor of the checkpoint file to write the state to.
+
+  const char *rfilename The name of the file to copy the route relation data to.
+
+  const char *trfilename The name of the file to copy the turn relation data to.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void CheckpointRelationList(RelationsX *relationsx,int fd,const char *rfilename,const char *trfilename)
+{
+ assert(relationsx->rfd==-1 && relationsx->trfd==-1); /* Only between processing stages. */
+
+ CopyFile(relationsx->rfilename,rfilename);
+ CopyFile(relationsx->trfilename,trfilename);
+
+ WriteFile(fd,&relationsx->rnumber,sizeof(index_t));
+ WriteFile(fd,&relationsx->trnumber,sizeof(index_t));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Restore the state of the relation lists that was saved by CheckpointRelationList().
+
+  int ResumeRelationList Returns 0 if OK or something else in case of an error.
+
+  RelationsX *relationsx The set of relations to restore (newly allocated).
+
+  int fd The file descriptor of the checkpoint file to read the state from.
+
+  const char *rfilename The name of the file to copy the route relation data from.
+
+  const char *trfilename The name of the file to copy the turn relation data from.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int ResumeRelationList(RelationsX *relationsx,int fd,const char *rfilename,const char *trfilename)
+{
+ if(relationsx->rfd!=-1)
+    relationsx->rfd=CloseFileBuffered(relationsx->rfd);
+ if(relationsx->trfd!=-1)
+    relationsx->trfd=CloseFileBuffered(relationsx->trfd);
+
+ CopyFile(rfilename,relationsx->rfilename);
+ CopyFile(trfilename,relationsx->trfilename);
+
+ if(ReadFile(fd,&relationsx->rnumber,sizeof(index_t)) ||
+    ReadFile(fd,&relationsx->trnumber,sizeof(index_t)))
+    return(1);
+
+ return(0);
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Append a single relation to an unsorted route relation list.
 
@@ -194,14 +359,14 @@ void AppendRouteRelation(RelationsX* relationsx,relation_t id,
 
  size=sizeof(RouteRelX)+(nways+1)*sizeof(way_t)+(nrelations+1)*sizeof(relation_t);
 
- WriteFile(relationsx->rfd,&size,FILESORT_VARSIZE);
- WriteFile(relationsx->rfd,&relationx,sizeof(RouteRelX));
+ WriteFileBuffered(relationsx->rfd,&size,FILESORT_VARSIZE);
+ WriteFileBuffered(relationsx->rfd,&relationx,sizeof(RouteRelX));
 
- WriteFile(relationsx->rfd,ways  ,nways*sizeof(way_t));
- WriteFile(relationsx->rfd,&noway,      sizeof(way_t));
+ WriteFileBuffered(relationsx->rfd,ways  ,nways*sizeof(way_t));
+ WriteFileBuffered(relationsx->rfd,&noway,      sizeof(way_t));
 
- WriteFile(relationsx->rfd,relations  ,nrelations*sizeof(relation_t));
- WriteFile(relationsx->rfd,&norelation,           sizeof(relation_t));
+ WriteFileBuffered(relationsx->rfd,relations  ,nrelations*sizeof(relation_t));
+ WriteFileBuffered(relationsx->rfd,&norelation,           sizeof(relation_t));
 
  relationsx->rnumber++;
 
@@ -240,7 +405,7 @@ void AppendTurnRestrictRelation(RelationsX* relationsx,relation_t id,
  relationx.restriction=restriction;
  relationx.except=except;
 
- WriteFile(relationsx->trfd,&relationx,sizeof(TurnRestrictRelX));
+ WriteFileBuffered(relationsx->trfd,&relationx,sizeof(TurnRestrictRelX));
 
  relationsx->trnumber++;
 
@@ -248,6 +413,129 @@ void AppendTurnRestrictRelation(RelationsX* relationsx,relation_t id,
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Remove the relations that have been replaced or deleted by the change files,
+  keeping only the latest version of each changed relation.
+
+  RelationsX *relationsx The set of relations to modify.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void ApplyRelationChanges(RelationsX *relationsx)
+{
+ FILESORT_VARINT relationsize;
+ void *data=NULL;
+ FILESORT_VARINT datasize=0;
+ TurnRestrictRelX relationx;
+ index_t total=0,rtotal,rkept=0,trkept=0;
+ int fd;
+
+ if(!relationsx->changes)
+    return;
+
+ /* Print the start message */
+
+ printf_first("Applying Relation Changes: Relations=0");
+
+ /* Sort the changes */
+
+ SortChangeList(relationsx->changes);
+
+ /* Route Relations */
+
+ relationsx->rfd=CloseFileBuffered(relationsx->rfd);
+
+ relationsx->rfd=ReOpenFileBuffered(relationsx->rfilename);
+
+ DeleteFile(relationsx->rfilename);
+
+ fd=OpenFileBufferedNew(relationsx->rfilename);
+
+ while(!ReadFileBuffered(relationsx->rfd,&relationsize,FILESORT_VARSIZE))
+   {
+    ChangeX *changex;
+
+    if(relationsize>datasize)
+      {
+       datasize=relationsize;
+       data=realloc(data,datasize);
+
+       assert(data); /* Check realloc() worked */
+      }
+
+    ReadFileBuffered(relationsx->rfd,data,relationsize);
+
+    changex=FindChange(relationsx->changes,((RouteRelX*)data)->id);
+
+    if(!changex || changex->index[0]==total)
+      {
+       WriteFileBuffered(fd,&relationsize,FILESORT_VARSIZE);
+       WriteFileBuffered(fd,data,relationsize);
+
+       rkept++;
+      }
+
+    total++;
+
+    if(!(total%1000))
+       printf_middle("Applying Relation Changes: Relations=%"Pindex_t" Kept=%"Pindex_t,total,rkept);
+   }
+
+ if(data)
+    free(data);
+
+ relationsx->rfd=CloseFileBuffered(relationsx->rfd);
+ CloseFileBuffered(fd);
+
+ relationsx->rfd=OpenFileBufferedAppend(relationsx->rfilename);
+
+ rtotal=total;
+
+ /* Turn Restriction Relations */
+
+ relationsx->trfd=CloseFileBuffered(relationsx->trfd);
+
+ relationsx->trfd=ReOpenFileBuffered(relationsx->trfilename);
+
+ DeleteFile(relationsx->trfilename);
+
+ fd=OpenFileBufferedNew(relationsx->trfilename);
+
+ while(!ReadFileBuffered(relationsx->trfd,&relationx,sizeof(TurnRestrictRelX)))
+   {
+    ChangeX *changex=FindChange(relationsx->changes,relationx.id);
+
+    if(!changex || changex->index[1]==(total-rtotal))
+      {
+       WriteFileBuffered(fd,&relationx,sizeof(TurnRestrictRelX));
+
+       trkept++;
+      }
+
+    total++;
+
+    if(!(total%1000))
+       printf_middle("Applying Relation Changes: Relations=%"Pindex_t" Kept=%"Pindex_t,total,rkept+trkept);
+   }
+
+ relationsx->trfd=CloseFileBuffered(relationsx->trfd);
+ CloseFileBuffered(fd);
+
+ relationsx->trfd=OpenFileBufferedAppend(relationsx->trfilename);
+
+ relationsx->rnumber=rkept;
+ relationsx->trnumber=trkept;
+
+ /* Free the changes */
+
+ FreeChangeList(relationsx->changes);
+ relationsx->changes=NULL;
+
+ /* Print the final message */
+
+ printf_last("Applied Relation Changes: Relations=%"Pindex_t" Kept=%"Pindex_t" Removed=%"Pindex_t,total,rkept+trkept,total-rkept-trkept);
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Sort the list of relations.
 
@@ -258,9 +546,9 @@ void SortRelationList(RelationsX* relationsx)
 {
  /* Close the files (finished appending) */
 
- relationsx->rfd=CloseFile(relationsx->rfd);
+ relationsx->rfd=CloseFileBuffered(relationsx->rfd);
 
- relationsx->trfd=CloseFile(relationsx->trfd);
+ relationsx->trfd=CloseFileBuffered(relationsx->trfd);
 
 
  /* Route Relations */
@@ -279,11 +567,11 @@ void SortRelationList(RelationsX* relationsx)
 
     /* Re-open the file read-only and a new file writeable */
 
-    relationsx->trfd=ReOpenFile(relationsx->trfilename);
+    relationsx->trfd=ReOpenFileBuffered(relationsx->trfilename);
 
     DeleteFile(relationsx->trfilename);
 
-    trfd=OpenFileNew(relationsx->trfilename);
+    trfd=OpenFileBufferedNew(relationsx->trfilename);
 
     /* Sort the relations */
 
@@ -292,12 +580,12 @@ void SortRelationList(RelationsX* relationsx)
 
     sortrelationsx=relationsx;
 
-    filesort_fixed(relationsx->trfd,trfd,sizeof(TurnRestrictRelX),(int (*)(const void*,const void*))sort_by_id,(int (*)(void*,index_t))deduplicate_by_id);
+    filesort_fixed_keyed(relationsx->trfd,trfd,sizeof(TurnRestrictRelX),1,(void (*)(const void*,uint32_t*))key_by_id,(int (*)(void*,index_t))deduplicate_by_id);
 
     /* Close the files */
 
-    relationsx->trfd=CloseFile(relationsx->trfd);
-    CloseFile(trfd);
+    relationsx->trfd=CloseFileBuffered(relationsx->trfd);
+    CloseFileBuffered(trfd);
 
     /* Print the final message */
 
@@ -307,26 +595,16 @@ void SortRelationList(RelationsX* relationsx)
 
 
 /*++++++++++++++++++++++++++++++++++++++
-  Sort the turn restriction relations into id order.
-
-  int sort_by_id Returns the comparison of the id fields.
+  Get the key to sort the turn restriction relations into id order.
 
-  TurnRestrictRelX *a The first extended relation.
+  TurnRestrictRelX *relationx The extended relation.
 
-  TurnRestrictRelX *b The second extended relation.
+  uint32_t *key Returns the key (the id).
   ++++++++++++++++++++++++++++++++++++++*/
 
-static int sort_by_id(TurnRestrictRelX *a,TurnRestrictRelX *b)
+static void key_by_id(TurnRestrictRelX *relationx,uint32_t *key)
 {
- relation_t a_id=a->id;
- relation_t b_id=b->id;
-
- if(a_id<b_id)
-    return(-1);
- else if(a_id>b_id)
-    return(1);
- else
-    return(0);
+ key[0]=relationx->id;
 }
 
 
@@ -380,20 +658,20 @@ void SortTurnRelationList(RelationsX* relationsx)
 
  /* Re-open the file read-only and a new file writeable */
 
- relationsx->trfd=ReOpenFile(relationsx->trfilename);
+ relationsx->trfd=ReOpenFileBuffered(relationsx->trfilename);
 
  DeleteFile(relationsx->trfilename);
 
- trfd=OpenFileNew(relationsx->trfilename);
+ trfd=OpenFileBufferedNew(relationsx->trfilename);
 
  /* Sort the relations */
 
- filesort_fixed(relationsx->trfd,trfd,sizeof(TurnRestrictRelX),(int (*)(const void*,const void*))sort_by_via,NULL);
+ filesort_fixed_keyed(relationsx->trfd,trfd,sizeof(TurnRestrictRelX),3,(void (*)(const void*,uint32_t*))key_by_via,NULL);
 
  /* Close the files */
 
- relationsx->trfd=CloseFile(relationsx->trfd);
- CloseFile(trfd);
+ relationsx->trfd=CloseFileBuffered(relationsx->trfd);
+ CloseFileBuffered(trfd);
 
  /* Print the final message */
 
@@ -402,51 +680,26 @@ void SortTurnRelationList(RelationsX* relationsx)
 
 
 /*++++++++++++++++++++++++++++++++++++++
-  Sort the turn restriction relations into via index order (then by from and to segments).
-
-  int sort_by_via Returns the comparison of the via, from and to fields.
+  Get the key to sort the turn restriction relations into via index order (then by from and to segments).
 
-  TurnRestrictRelX *a The first extended relation.
+  TurnRestrictRelX *relationx The extended relation.
 
-  TurnRestrictRelX *b The second extended relation.
+  uint32_t *key Returns the key (the via, from and to fields).
   ++++++++++++++++++++++++++++++++++++++*/
 
-static int sort_by_via(TurnRestrictRelX *a,TurnRestrictRelX *b)
+static void key_by_via(TurnRestrictRelX *relationx,uint32_t *key)
 {
- index_t a_id=a->via;
- index_t b_id=b->via;
-
- if(a_id<b_id)
-    return(-1);
- else if(a_id>b_id)
-    return(1);
- else
-   {
-    index_t a_id=a->from;
-    index_t b_id=b->from;
-
-    if(a_id<b_id)
-       return(-1);
-    else if(a_id>b_id)
-       return(1);
-    else
-      {
-       index_t a_id=a->to;
-       index_t b_id=b->to;
-
-       if(a_id<b_id)
-          return(-1);
-       else if(a_id>b_id)
-          return(1);
-       else
-          return(0);
-      }
-   }
+ key[0]=relationx->via;
+ key[1]=relationx->from;
+ key[2]=relationx->to;
 }
 
 
 /*++++++++++++++++++++++++++++++++++++++
-  Process the route relations and apply the information to the ways.
+  Process the route relations and apply the information to the ways.  The
+  relations and the ids of their child relations are read into memory, the types
+  of route are passed down from each relation to its children (using a list of
+  the relations that have changed) and then the ways are updated once.
 
   RelationsX *relationsx The set of relations to use.
 
@@ -455,161 +708,234 @@ static int sort_by_via(TurnRestrictRelX *a,TurnRestrictRelX *b)
 
 void ProcessRouteRelations(RelationsX *relationsx,WaysX *waysx)
 {
- RouteRelX *unmatched=NULL,*lastunmatched=NULL;
- int nunmatched=0,lastnunmatched=0,iteration=1;
-
- if(waysx->number==0)
+ RouteRelX *routerels;
+ index_t *sorted,*firstchild,*worklist;
+ relation_t *children;
+ char *queued;
+ index_t nchildren=0,nworklist=0,i;
+ index_t relations=0,ways=0;
+
+ if(waysx->number==0 || relationsx->rnumber==0)
     return;
 
- /* Map into memory / open the files */
+ /* Print the start message */
 
-#if !SLIM
- waysx->data=MapFileWriteable(waysx->filename);
-#else
- waysx->fd=ReOpenFileWriteable(waysx->filename);
-#endif
+ printf_first("Processing Route Relations: Relations=0 Modified Ways=0");
+
+ /* Allocate the arrays */
+
+ routerels=(RouteRelX*)malloc(relationsx->rnumber*sizeof(RouteRelX));
+ firstchild=(index_t*)malloc((relationsx->rnumber+1)*sizeof(index_t));
+
+ assert(routerels);  /* Check malloc() worked */
+ assert(firstchild); /* Check malloc() worked */
+
+ children=NULL;
 
  /* Re-open the file read-only */
 
- relationsx->rfd=ReOpenFile(relationsx->rfilename);
+ relationsx->rfd=ReOpenFileBuffered(relationsx->rfilename);
 
- /* Read through the file. */
+ /* Read the relations and their child relations */
 
- do
+ for(i=0;i<relationsx->rnumber;i++)
    {
-    int ways=0,relations=0;
-    index_t i;
+    FILESORT_VARINT size;
+    way_t wayid;
+    relation_t relationid;
 
-    SeekFile(relationsx->rfd,0);
+    ReadFileBuffered(relationsx->rfd,&size,FILESORT_VARSIZE);
+    ReadFileBuffered(relationsx->rfd,&routerels[i],sizeof(RouteRelX));
 
-    /* Print the start message */
+    do
+      {
+       ReadFileBuffered(relationsx->rfd,&wayid,sizeof(way_t));
+      }
+    while(wayid!=NO_WAY);
 
-    printf_first("Processing Route Relations (%d): Relations=0 Modified Ways=0",iteration);
+    firstchild[i]=nchildren;
 
-    for(i=0;i<relationsx->rnumber;i++)
+    do
       {
-       FILESORT_VARINT size;
-       RouteRelX relationx;
-       way_t wayid;
-       relation_t relationid;
-       transports_t routes=Transports_None;
+       ReadFileBuffered(relationsx->rfd,&relationid,sizeof(relation_t));
 
-       /* Read each route relation */
+       if(relationid==NO_RELATION)
+          continue;
 
-       ReadFile(relationsx->rfd,&size,FILESORT_VARSIZE);
-       ReadFile(relationsx->rfd,&relationx,sizeof(RouteRelX));
+       if(relationid==routerels[i].id)
+          logerror("Relation %"Prelation_t" contains itself.\n",routerels[i].id);
+       else
+         {
+          if(nchildren%256==0)
+            {
+             children=(relation_t*)realloc((void*)children,(nchildren+256)*sizeof(relation_t));
 
-       /* Decide what type of route it is */
+             assert(children); /* Check realloc() worked */
+            }
 
-       if(iteration==1)
-         {
-          relations++;
-          routes=relationx.routes;
+          children[nchildren++]=relationid;
          }
-       else
-         {
-          int j;
+      }
+    while(relationid!=NO_RELATION);
+   }
 
-          for(j=0;j<lastnunmatched;j++)
-             if(lastunmatched[j].id==relationx.id)
-               {
-                relations++;
+ firstchild[relationsx->rnumber]=nchildren;
 
-                if((lastunmatched[j].routes|relationx.routes)==relationx.routes)
-                   routes=0; /* Nothing new to add */
-                else
-                   routes=lastunmatched[j].routes;
+ /* Sort the relations by id so that the children can be found */
 
-                break;
-               }
-         }
+ sorted=(index_t*)malloc(relationsx->rnumber*sizeof(index_t));
 
-       /* Loop through the ways */
+ assert(sorted); /* Check malloc() worked */
 
-       do
-         {
-          ReadFile(relationsx->rfd,&wayid,sizeof(way_t));
+ for(i=0;i<relationsx->rnumber;i++)
+    sorted[i]=i;
 
-          /* Update the ways that are listed for the relation */
+ sortrouterels=routerels;
 
-          if(wayid==NO_WAY)
-             continue;
+ qsort(sorted,relationsx->rnumber,sizeof(index_t),(int (*)(const void*,const void*))sort_by_route_id);
 
-          if(routes)
-            {
-             index_t way=IndexWayX(waysx,wayid);
+ /* Pass the types of route down to the child relations until nothing changes */
 
-             if(way!=NO_WAY)
-               {
-                WayX *wayx=LookupWayX(waysx,way,1);
+ worklist=(index_t*)malloc(relationsx->rnumber*sizeof(index_t));
+ queued=(char*)calloc(relationsx->rnumber,sizeof(char));
+
+ assert(worklist); /* Check malloc() worked */
+ assert(queued);   /* Check calloc() worked */
+
+ for(i=0;i<relationsx->rnumber;i++)
+    if(routerels[i].routes)
+      {
+       worklist[nworklist++]=i;
+       queued[i]=1;
+      }
 
-                if(routes&Transports_Foot)
-                   wayx->way.props|=Properties_FootRoute;
+ while(nworklist)
+   {
+    index_t parent=worklist[--nworklist];
+    index_t c;
 
-                if(routes&Transports_Bicycle)
-                   wayx->way.props|=Properties_BicycleRoute;
+    queued[parent]=0;
+
+    for(c=firstchild[parent];c<firstchild[parent+1];c++)
+      {
+       index_t start=0,end=relationsx->rnumber,mid;
 
-                PutBackWayX(waysx,way,1);
+       /* Binary search for the first relation with the child id (there may be several) */
 
-                ways++;
+       while(start<end)
+         {
+          mid=start+(end-start)/2;
+
+          if(routerels[sorted[mid]].id<children[c])
+             start=mid+1;
+          else
+             end=mid;
+         }
+
+       for(;start<relationsx->rnumber && routerels[sorted[start]].id==children[c];start++)
+         {
+          index_t child=sorted[start];
+
+          if((routerels[child].routes|routerels[parent].routes)!=routerels[child].routes)
+            {
+             routerels[child].routes|=routerels[parent].routes;
+
+             if(!queued[child])
+               {
+                worklist[nworklist++]=child;
+                queued[child]=1;
                }
-             else
-                logerror("Route Relation %"Prelation_t" contains Way %"Pway_t" but it does not exist in the Routino database.\n",relationx.id,wayid);
             }
          }
-       while(wayid!=NO_WAY);
+      }
+   }
 
-       /* Loop through the relations */
+ free(worklist);
+ free(queued);
+ free(sorted);
+ free(firstchild);
 
-       do
-         {
-          ReadFile(relationsx->rfd,&relationid,sizeof(relation_t));
+ if(children)
+    free(children);
 
-          /* Add the relations that are listed for this relation to the list for next time */
+ /* Map into memory / open the files */
 
-          if(relationid==NO_RELATION)
-             continue;
+#if !SLIM
+ waysx->data=MapFileWriteable(waysx->filename);
+#else
+ waysx->fd=ReOpenFileWriteable(waysx->filename);
+#endif
 
-          if(relationid==relationx.id)
-             logerror("Relation %"Prelation_t" contains itself.\n",relationx.id);
-          else if(routes)
+ /* Read through the file again and update the ways */
+
+ SeekFileBuffered(relationsx->rfd,0);
+
+ for(i=0;i<relationsx->rnumber;i++)
+   {
+    FILESORT_VARINT size;
+    RouteRelX relationx;
+    way_t wayid;
+    relation_t relationid;
+    transports_t routes=routerels[i].routes;
+
+    ReadFileBuffered(relationsx->rfd,&size,FILESORT_VARSIZE);
+    ReadFileBuffered(relationsx->rfd,&relationx,sizeof(RouteRelX));
+
+    if(routes)
+       relations++;
+
+    /* Loop through the ways */
+
+    do
+      {
+       ReadFileBuffered(relationsx->rfd,&wayid,sizeof(way_t));
+
+       /* Update the ways that are listed for the relation */
+
+       if(wayid==NO_WAY)
+          continue;
+
+       if(routes)
+         {
+          index_t way=IndexWayX(waysx,wayid);
+
+          if(way!=NO_WAY)
             {
-             if(nunmatched%256==0)
-                unmatched=(RouteRelX*)realloc((void*)unmatched,(nunmatched+256)*sizeof(RouteRelX));
+             WayX *wayx=LookupWayX(waysx,way,1);
 
-             unmatched[nunmatched].id=relationid;
-             unmatched[nunmatched].routes=routes;
+             if(routes&Transports_Foot)
+                wayx->way.props|=Properties_FootRoute;
 
-             nunmatched++;
+             if(routes&Transports_Bicycle)
+                wayx->way.props|=Properties_BicycleRoute;
+
+             PutBackWayX(waysx,way,1);
+
+             ways++;
             }
+          else
+             logerror("Route Relation %"Prelation_t" contains Way %"Pway_t" but it does not exist in the Routino database.\n",relationx.id,wayid);
          }
-       while(relationid!=NO_RELATION);
-
-       if(!((i+1)%1000))
-          printf_middle("Processing Route Relations (%d): Relations=%"Pindex_t" Modified Ways=%"Pindex_t,iteration,relations,ways);
       }
+    while(wayid!=NO_WAY);
 
-    if(lastunmatched)
-       free(lastunmatched);
-
-    lastunmatched=unmatched;
-    lastnunmatched=nunmatched;
-
-    unmatched=NULL;
-    nunmatched=0;
+    /* Skip the relations */
 
-    /* Print the final message */
+    do
+      {
+       ReadFileBuffered(relationsx->rfd,&relationid,sizeof(relation_t));
+      }
+    while(relationid!=NO_RELATION);
 
-    printf_last("Processed Route Relations (%d): Relations=%"Pindex_t" Modified Ways=%"Pindex_t,iteration,relations,ways);
+    if(!((i+1)%1000))
+       printf_middle("Processing Route Relations: Relations=%"Pindex_t" Modified Ways=%"Pindex_t,relations,ways);
    }
- while(lastnunmatched && iteration++<8);
 
- if(lastunmatched)
-    free(lastunmatched);
+ free(routerels);
 
  /* Close the file */
 
- relationsx->rfd=CloseFile(relationsx->rfd);
+ relationsx->rfd=CloseFileBuffered(relationsx->rfd);
 
  /* Unmap from memory / close the files */
 
@@ -618,6 +944,38 @@ void ProcessRouteRelations(RelationsX *relationsx,WaysX *waysx)
 #else
  waysx->fd=CloseFile(waysx->fd);
 #endif
+
+ /* Print the final message */
+
+ printf_last("Processed Route Relations: Relations=%"Pindex_t" Modified Ways=%"Pindex_t,relations,ways);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Sort the route relations into id order (then by their position in the file).
+
+  int sort_by_route_id Returns the comparison of the id fields.
+
+  const index_t *a The index of the first route relation.
+
+  const index_t *b The index of the second route relation.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int sort_by_route_id(const index_t *a,const index_t *b)
+{
+ relation_t a_id=sortrouterels[*a].id;
+ relation_t b_id=sortrouterels[*b].id;
+
+ if(a_id<b_id)
+    return(-1);
+ else if(a_id>b_id)
+    return(1);
+ else if(*a<*b)
+    return(-1);
+ else if(*a>*b)
+    return(1);
+ else
+    return(0);
 }
 
 
@@ -642,11 +1000,11 @@ void ProcessTurnRelations1(RelationsX *relationsx,NodesX *nodesx,WaysX *waysx)
 
  /* Re-open the file read-only and a new file writeable */
 
- relationsx->trfd=ReOpenFile(relationsx->trfilename);
+ relationsx->trfd=ReOpenFileBuffered(relationsx->trfilename);
 
  DeleteFile(relationsx->trfilename);
 
- trfd=OpenFileNew(relationsx->trfilename);
+ trfd=OpenFileBufferedNew(relationsx->trfilename);
 
  /* Process all of the relations */
 
@@ -656,7 +1014,7 @@ void ProcessTurnRelations1(RelationsX *relationsx,NodesX *nodesx,WaysX *waysx)
     node_t via;
     way_t from,to;
 
-    ReadFile(relationsx->trfd,&relationx,sizeof(TurnRestrictRelX));
+    ReadFileBuffered(relationsx->trfd,&relationx,sizeof(TurnRestrictRelX));
 
     via =IndexNodeX(nodesx,relationx.via);
     from=IndexWayX(waysx,relationx.from);
@@ -678,7 +1036,7 @@ void ProcessTurnRelations1(RelationsX *relationsx,NodesX *nodesx,WaysX *waysx)
     if(relationx.via==NO_NODE || relationx.from==NO_WAY || relationx.to==NO_WAY)
        deleted++;
     else
-       WriteFile(trfd,&relationx,sizeof(TurnRestrictRelX));
+       WriteFileBuffered(trfd,&relationx,sizeof(TurnRestrictRelX));
 
     if(!((i+1)%1000))
        printf_middle("Processing Turn Relations (1): Relations=%"Pindex_t" Deleted=%"Pindex_t,i+1-deleted,deleted);
@@ -686,8 +1044,8 @@ void ProcessTurnRelations1(RelationsX *relationsx,NodesX *nodesx,WaysX *waysx)
 
  /* Close the files */
 
- relationsx->trfd=CloseFile(relationsx->trfd);
- CloseFile(trfd);
+ relationsx->trfd=CloseFileBuffered(relationsx->trfd);
+ CloseFileBuffered(trfd);
 
  /* Print the final message */
 
@@ -736,15 +1094,15 @@ void ProcessTurnRelations2(RelationsX *relationsx,NodesX *nodesx,SegmentsX *segm
 
  /* Re-open the file read-only and a new file writeable */
 
- relationsx->trfd=ReOpenFile(relationsx->trfilename);
+ relationsx->trfd=ReOpenFileBuffered(relationsx->trfilename);
 
  DeleteFile(relationsx->trfilename);
 
- trfd=OpenFileNew(relationsx->trfilename);
+ trfd=OpenFileBufferedNew(relationsx->trfilename);
 
  /* Process all of the relations */
 
- while(!ReadFile(relationsx->trfd,&relationx,sizeof(TurnRestrictRelX)))
+ while(!ReadFileBuffered(relationsx->trfd,&relationx,sizeof(TurnRestrictRelX)))
    {
     NodeX *nodex;
     SegmentX *segmentx;
@@ -835,7 +1193,7 @@ void ProcessTurnRelations2(RelationsX *relationsx,NodesX *nodesx,SegmentsX *segm
        relationx.from=node_from;
        relationx.to  =node_to;
 
-       WriteFile(trfd,&relationx,sizeof(TurnRestrictRelX));
+       WriteFileBuffered(trfd,&relationx,sizeof(TurnRestrictRelX));
 
        total++;
 
@@ -933,7 +1291,7 @@ void ProcessTurnRelations2(RelationsX *relationsx,NodesX *nodesx,SegmentsX *segm
           relationx.from=node_from;
           relationx.to  =node_other[i];
 
-          WriteFile(trfd,&relationx,sizeof(TurnRestrictRelX));
+          WriteFileBuffered(trfd,&relationx,sizeof(TurnRestrictRelX));
 
           total++;
 
@@ -966,8 +1324,8 @@ void ProcessTurnRelations2(RelationsX *relationsx,NodesX *nodesx,SegmentsX *segm
 
  /* Close the files */
 
- relationsx->trfd=CloseFile(relationsx->trfd);
- CloseFile(trfd);
+ relationsx->trfd=CloseFileBuffered(relationsx->trfd);
+ CloseFileBuffered(trfd);
 
  /* Unmap from memory / close the files */
 
@@ -1018,11 +1376,11 @@ void UpdateTurnRelations(RelationsX *relationsx,NodesX *nodesx,SegmentsX *segmen
 
  /* Re-open the file read-only and a new file writeable */
 
- relationsx->trfd=ReOpenFile(relationsx->trfilename);
+ relationsx->trfd=ReOpenFileBuffered(relationsx->trfilename);
 
  DeleteFile(relationsx->trfilename);
 
- trfd=OpenFileNew(relationsx->trfilename);
+ trfd=OpenFileBufferedNew(relationsx->trfilename);
 
  /* Process all of the relations */
 
@@ -1032,7 +1390,7 @@ void UpdateTurnRelations(RelationsX *relationsx,NodesX *nodesx,SegmentsX *segmen
     SegmentX *segmentx;
     index_t from_node,via_node,to_node;
 
-    ReadFile(relationsx->trfd,&relationx,sizeof(TurnRestrictRelX));
+    ReadFileBuffered(relationsx->trfd,&relationx,sizeof(TurnRestrictRelX));
 
     from_node=nodesx->gdata[relationx.from];
     via_node =nodesx->gdata[relationx.via];
@@ -1054,7 +1412,7 @@ void UpdateTurnRelations(RelationsX *relationsx,NodesX *nodesx,SegmentsX *segmen
 
     relationx.via=via_node;
 
-    WriteFile(trfd,&relationx,sizeof(TurnRestrictRelX));
+    WriteFileBuffered(trfd,&relationx,sizeof(TurnRestrictRelX));
 
     if(!(relationsx->trnumber%1000))
        printf_middle("Updating Turn Relations: Relations=%"Pindex_t,relationsx->trnumber);
@@ -1062,8 +1420,8 @@ void UpdateTurnRelations(RelationsX *relationsx,NodesX *nodesx,SegmentsX *segmen
 
  /* Close the files */
 
- relationsx->trfd=CloseFile(relationsx->trfd);
- CloseFile(trfd);
+ relationsx->trfd=CloseFileBuffered(relationsx->trfd);
+ CloseFileBuffered(trfd);
 
  /* Unmap from memory / close the files */
 
@@ -1099,27 +1457,27 @@ void SaveRelationList(RelationsX* relationsx,const char *filename)
 
  /* Re-open the file read-only */
 
- relationsx->trfd=ReOpenFile(relationsx->trfilename);
+ relationsx->trfd=ReOpenFileBuffered(relationsx->trfilename);
 
  /* Write out the relations data */
 
- fd=OpenFileNew(filename);
+ fd=OpenFileBufferedNew(filename);
 
- SeekFile(fd,sizeof(RelationsFile));
+ SeekFileBuffered(fd,sizeof(RelationsFile));
 
  for(i=0;i<relationsx->trnumber;i++)
    {
     TurnRestrictRelX relationx;
     TurnRelation relation;
 
-    ReadFile(relationsx->trfd,&relationx,sizeof(TurnRestrictRelX));
+    ReadFileBuffered(relationsx->trfd,&relationx,sizeof(TurnRestrictRelX));
 
     relation.from=relationx.from;
     relation.via=relationx.via;
     relation.to=relationx.to;
     relation.except=relationx.except;
 
-    WriteFile(fd,&relation,sizeof(TurnRelation));
+    WriteFileBuffered(fd,&relation,sizeof(TurnRelation));
 
     if(!((i+1)%1000))
        printf_middle("Writing Relations: Turn Relations=%"Pindex_t,i+1);
@@ -1129,14 +1487,14 @@ void SaveRelationList(RelationsX* relationsx,const char *filename)
 
  relationsfile.trnumber=relationsx->trnumber;
 
- SeekFile(fd,0);
- WriteFile(fd,&relationsfile,sizeof(RelationsFile));
+ SeekFileBuffered(fd,0);
+ WriteFileBuffered(fd,&relationsfile,sizeof(RelationsFile));
 
- CloseFile(fd);
+ CloseFileBuffered(fd);
 
  /* Close the file */
 
- relationsx->trfd=CloseFile(relationsx->trfd);
+ relationsx->trfd=CloseFileBuffered(relationsx->trfd);
 
  /* Print the final message */
 
@@ -72,6 +72,10 @@ struct _RelationsX
  int        trfd;              /*+ The file descriptor of the temporary file (for the TurnRestrictRelX). +*/
 
  index_t    trnumber;          /*+ The number of extended turn restriction relations. +*/
+
+ /* Changes */
+
+ ChangesX  *changes;           /*+ The relations that have been changed by the change files. +*/
 };
 
 
@@ -80,6 +84,12 @@ struct _RelationsX
 RelationsX *NewRelationList(int append);
 void FreeRelationList(RelationsX *relationsx,int keep);
 
+void SaveParsedRelationList(RelationsX *relationsx);
+void LoadParsedRelationList(RelationsX *relationsx);
+
+void CheckpointRelationList(RelationsX *relationsx,int fd,const char *rfilename,const char *trfilename);
+int ResumeRelationList(RelationsX *relationsx,int fd,const char *rfilename,const char *trfilename);
+
 void AppendRouteRelation(RelationsX* relationsx,relation_t id,
                          transports_t routes,
                          way_t *ways,int nways,
@@ -89,6 +99,8 @@ void AppendTurnRestrictRelation(RelationsX* relationsx,relation_t id,
                                 way_t from,way_t to,node_t via,
                                 TurnRestriction restriction,transports_t except);
 
+void ApplyRelationChanges(RelationsX *relationsx);
+
 void SortRelationList(RelationsX *relationsx);
 
 void SortTurnRelationList(RelationsX* relationsx);
@@ -32,6 +32,15 @@
 #define MAX_COLLISIONS 32
  
 
+/* Global variables */
+
+/*+ Set to true to count the operations on the results and queues. +*/
+int results_statistics_enabled=0;
+
+/*+ The number of operations on the results and queues. +*/
+ResultsStatistics results_statistics={0};
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Allocate a new results list.
 
@@ -210,6 +219,16 @@ Result *InsertResult(Results *results,index_t node,index_t segment)
 
  result->queued=NOT_QUEUED;
 
+#if RESULTS_STATISTICS
+ if(results_statistics_enabled)
+   {
+    results_statistics.inserted++;
+
+    if(results->number>results_statistics.maxnumber)
+       results_statistics.maxnumber=results->number;
+   }
+#endif
+
  return(result);
 }
 
@@ -231,6 +250,14 @@ Result *FindResult1(Results *results,index_t node)
  Result *best_result=NULL;
  int i;
 
+#if RESULTS_STATISTICS
+ if(results_statistics_enabled)
+   {
+    results_statistics.finds++;
+    results_statistics.probes+=results->count[bin];
+   }
+#endif
+
  for(i=results->count[bin]-1;i>=0;i--)
     if(results->point[i][bin]->node==node && results->point[i][bin]->score<best_score)
       {
@@ -259,9 +286,26 @@ Result *FindResult(Results *results,index_t node,index_t segment)
  int bin=node&results->mask;
  int i;
 
+#if RESULTS_STATISTICS
+ if(results_statistics_enabled)
+    results_statistics.finds++;
+#endif
+
  for(i=results->count[bin]-1;i>=0;i--)
     if(results->point[i][bin]->segment==segment && results->point[i][bin]->node==node)
+      {
+#if RESULTS_STATISTICS
+       if(results_statistics_enabled)
+          results_statistics.probes+=results->count[bin]-i;
+#endif
+
        return(results->point[i][bin]);
+      }
+
+#if RESULTS_STATISTICS
+ if(results_statistics_enabled)
+    results_statistics.probes+=results->count[bin];
+#endif
 
  return(NULL);
 }
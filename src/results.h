@@ -84,11 +84,32 @@ typedef struct _Results
  Results;
 
 
+/*+ The number of operations on the results and queues (for the router statistics, only
+    counted when compiled with RESULTS_STATISTICS and results_statistics_enabled is set). +*/
+typedef struct _ResultsStatistics
+{
+ uint64_t  inserted;            /*+ The number of results inserted. +*/
+ uint64_t  finds;               /*+ The number of times that a result was searched for. +*/
+ uint64_t  probes;              /*+ The number of results compared while searching. +*/
+ uint32_t  maxnumber;           /*+ The largest number of results in a list. +*/
+
+ uint64_t  pushed;              /*+ The number of results inserted (or moved up) in a queue. +*/
+ uint64_t  popped;              /*+ The number of results popped from a queue. +*/
+}
+ ResultsStatistics;
+
+
 /* Forward definition for opaque type */
 
 typedef struct _Queue Queue;
 
 
+/* Variables in results.c */
+
+extern int results_statistics_enabled;
+extern ResultsStatistics results_statistics;
+
+
 /* Results functions in results.c */
 
 Results *NewResultsList(int nbins);
@@ -20,16 +20,20 @@
  ***************************************/
 
 
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <time.h>
+#include <sys/time.h>
 
 #include "types.h"
 #include "nodes.h"
 #include "segments.h"
 #include "ways.h"
 #include "relations.h"
+#include "overlay.h"
 
 #include "files.h"
 #include "logging.h"
@@ -42,6 +46,41 @@
 /*+ The maximum distance from the specified point to search for a node or segment (in km). +*/
 #define MAXSEARCH  1
 
+/*+ The maximum number of alternative routes that can be calculated. +*/
+#define MAXALTERNATIVES 9
+
+
+/* Local types */
+
+/*+ The phases of the routing that statistics are collected for. +*/
+typedef enum _Phase
+ {
+  Phase_Snap        =0,         /*+ Finding the node or segment closest to each waypoint. +*/
+  Phase_Order       =1,         /*+ Optimising the order of the waypoints. +*/
+  Phase_Start       =2,         /*+ Finding the start of each route (FindStartRoutes). +*/
+  Phase_Finish      =3,         /*+ Finding the end of each route (FindFinishRoutes). +*/
+  Phase_Middle      =4,         /*+ Finding the super-route (FindMiddleRoute). +*/
+  Phase_Combine     =5,         /*+ Combining the parts of each route (CombineRoutes). +*/
+  Phase_Alternatives=6,         /*+ Finding the alternative routes. +*/
+  Phase_Output      =7,         /*+ Writing the output files. +*/
+
+  Phase_Count       =8          /*+ The number of phases. +*/
+ }
+ Phase;
+
+/*+ The statistics collected for a phase of the routing. +*/
+typedef struct _PhaseStatistics
+{
+ int               calls;       /*+ The number of times that the phase was run. +*/
+ double            time;        /*+ The elapsed time in the phase (seconds). +*/
+
+ ResultsStatistics results;     /*+ The number of operations on the results and queues. +*/
+
+ uint32_t          cachehits[4]; /*+ The slim mode cache hits for the nodes, segments, ways and relations. +*/
+ uint32_t          cachemisses[4]; /*+ The slim mode cache misses for the nodes, segments, ways and relations. +*/
+}
+ PhaseStatistics;
+
 
 /* Global variables */
 
@@ -54,9 +93,42 @@ int option_html=0,option_gpx_track=0,option_gpx_route=0,option_text=0,option_std
 /*+ The option to calculate the quickest route insted of the shortest. +*/
 int option_quickest=0;
 
+/*+ The number of alternative routes to calculate. +*/
+int option_alternatives=0;
+
+/*+ The option to print statistics about each phase of the routing. +*/
+int option_stats=0;
+
+
+/* Local variables */
+
+/*+ The routing database (kept here so that the statistics can use it). +*/
+static Nodes    *OSMNodes=NULL;
+static Segments *OSMSegments=NULL;
+static Ways     *OSMWays=NULL;
+static Relations*OSMRelations=NULL;
+
+/*+ The statistics for each phase of the routing. +*/
+static PhaseStatistics phase_stats[Phase_Count];
+
+/*+ The phase that is currently being run (or -1 for none). +*/
+static int phase_current=-1;
+
+/*+ The statistics and time when the current phase started. +*/
+static PhaseStatistics phase_begin;
+static struct timeval  phase_begin_time;
+
+/*+ Set to true once all of the routes have been found. +*/
+static int routed=0;
+
 
 /* Local functions */
 
+static void StartPhase(Phase phase);
+static void EndPhase(void);
+static void GetStatistics(PhaseStatistics *stats);
+static void PrintStatistics(void);
+
 static void print_usage(int detail,const char *argerr,const char *err);
 
 
@@ -66,11 +138,8 @@ static void print_usage(int detail,const char *argerr,const char *err);
 
 int main(int argc,char** argv)
 {
- Nodes    *OSMNodes;
- Segments *OSMSegments;
- Ways     *OSMWays;
- Relations*OSMRelations;
  Results  *results[NWAYPOINTS+1]={NULL};
+ Results  *altresults[MAXALTERNATIVES+1][NWAYPOINTS+1]={{NULL}};
  int       point_used[NWAYPOINTS+1]={0};
  double    point_lon[NWAYPOINTS+1],point_lat[NWAYPOINTS+1];
  double    heading=-999;
@@ -78,12 +147,13 @@ int main(int argc,char** argv)
  char     *dirname=NULL,*prefix=NULL;
  char     *profiles=NULL,*profilename=NULL;
  char     *translations=NULL,*language=NULL;
- int       exactnodes=0;
+ char     *overlayfile=NULL;
+ int       exactnodes=0,optimise_order=0,hour=-1;
  Transport transport=Transport_None;
  Profile  *profile=NULL;
  index_t   start_node=NO_NODE,finish_node=NO_NODE;
  index_t   join_segment=NO_SEGMENT;
- int       arg,point;
+ int       arg,point,alt;
 
  /* Parse the command line arguments */
 
@@ -112,12 +182,16 @@ int main(int argc,char** argv)
        profiles=&argv[arg][11];
     else if(!strncmp(argv[arg],"--translations=",15))
        translations=&argv[arg][15];
+    else if(!strncmp(argv[arg],"--overlay=",10))
+       overlayfile=&argv[arg][10];
     else if(!strcmp(argv[arg],"--exact-nodes-only"))
        exactnodes=1;
     else if(!strcmp(argv[arg],"--quiet"))
        option_quiet=1;
     else if(!strcmp(argv[arg],"--loggable"))
        option_loggable=1;
+    else if(!strcmp(argv[arg],"--stats"))
+       option_stats=1;
     else if(!strcmp(argv[arg],"--output-html"))
        option_html=1;
     else if(!strcmp(argv[arg],"--output-gpx-track"))
@@ -212,6 +286,24 @@ int main(int argc,char** argv)
        option_quickest=0;
     else if(!strcmp(argv[arg],"--quickest"))
        option_quickest=1;
+    else if(!strcmp(argv[arg],"--optimise-order"))
+       optimise_order=1;
+    else if(!strcmp(argv[arg],"--optimise-order-fixed-finish"))
+       optimise_order=2;
+    else if(!strncmp(argv[arg],"--alternatives=",15))
+      {
+       option_alternatives=atoi(&argv[arg][15]);
+
+       if(option_alternatives<0 || option_alternatives>MAXALTERNATIVES)
+          print_usage(0,argv[arg],NULL);
+      }
+    else if(!strncmp(argv[arg],"--hour=",7))
+      {
+       hour=atoi(&argv[arg][7]);
+
+       if(hour<0 || hour>=OVERLAY_HOURS)
+          print_usage(0,argv[arg],NULL);
+      }
     else if(isdigit(argv[arg][0]) ||
        ((argv[arg][0]=='-' || argv[arg][0]=='+') && isdigit(argv[arg][1])))
       {
@@ -427,12 +519,131 @@ int main(int argc,char** argv)
 
  OSMRelations=LoadRelationList(FileName(dirname,prefix,"relations.mem"));
 
+ /* Load in the overlay of segment overrides (the default one only if it exists) */
+
+ if(overlayfile)
+   {
+    if(!ExistsFile(overlayfile))
+      {
+       fprintf(stderr,"Error: The '--overlay' option specifies a file that does not exist.\n");
+       return(1);
+      }
+   }
+ else if(ExistsFile(FileName(dirname,prefix,"overlay.mem")))
+    overlayfile=FileName(dirname,prefix,"overlay.mem");
+
+ if(overlayfile)
+   {
+    OSMSegments->overlay=LoadOverlay(overlayfile,OSMNodes->file.number,OSMSegments->file.number,OSMWays->file.number);
+
+    if(!OSMSegments->overlay)
+       return(1);
+
+    if(hour<0)
+      {
+       time_t now=time(NULL);
+
+       hour=localtime(&now)->tm_hour;
+      }
+
+    OSMSegments->overlay->hour=hour;
+   }
+
  if(UpdateProfile(profile,OSMWays))
    {
     fprintf(stderr,"Error: Profile is invalid or not compatible with database.\n");
     return(1);
    }
 
+ /* Print the statistics however the program finishes (a failed route is the most interesting) */
+
+ if(option_stats)
+   {
+    results_statistics_enabled=1;
+
+    atexit(PrintStatistics);
+   }
+
+ /* Optimise the order of the waypoints (keeping the first one and optionally the last one in place) */
+
+ if(optimise_order)
+   {
+    index_t waypoints[NWAYPOINTS];
+    int     points[NWAYPOINTS],order[NWAYPOINTS];
+    double  lon[NWAYPOINTS],lat[NWAYPOINTS];
+    int     nwaypoints=0;
+
+    StartPhase(Phase_Order);
+
+    /* Find the node closest to each point */
+
+    for(point=1;point<=NWAYPOINTS;point++)
+      {
+       distance_t distmax=km_to_distance(MAXSEARCH);
+       distance_t distmin;
+       index_t node=NO_NODE;
+
+       if(point_used[point]!=3)
+          continue;
+
+       if(exactnodes)
+          node=FindClosestNode(OSMNodes,OSMSegments,OSMWays,point_lat[point],point_lon[point],distmax,profile,&distmin);
+       else
+         {
+          distance_t dist1,dist2;
+          index_t node1,node2;
+
+          if(FindClosestSegment(OSMNodes,OSMSegments,OSMWays,point_lat[point],point_lon[point],distmax,profile,&distmin,&node1,&node2,&dist1,&dist2)!=NO_SEGMENT)
+             node=(dist1<dist2)?node1:node2;
+         }
+
+       if(node==NO_NODE)
+         {
+          fprintf(stderr,"Error: Cannot find node close to specified point %d.\n",point);
+          return(1);
+         }
+
+       points[nwaypoints]=point;
+       lon[nwaypoints]=point_lon[point];
+       lat[nwaypoints]=point_lat[point];
+       waypoints[nwaypoints++]=node;
+      }
+
+    /* Calculate the scores between each pair of waypoints and choose the best order */
+
+    if(nwaypoints>(optimise_order==2?3:2))
+      {
+       score_t *scores;
+       int i;
+
+       scores=(score_t*)malloc(nwaypoints*nwaypoints*sizeof(score_t));
+
+       assert(scores); /* Check malloc() worked */
+
+       FindRouteScores(OSMNodes,OSMSegments,OSMWays,OSMRelations,profile,waypoints,nwaypoints,scores);
+
+       OptimiseWaypointOrder(scores,nwaypoints,optimise_order==2,order);
+
+       free(scores);
+
+       for(i=0;i<nwaypoints;i++)
+         {
+          point_lon[points[i]]=lon[order[i]];
+          point_lat[points[i]]=lat[order[i]];
+         }
+
+       if(!option_quiet)
+         {
+          printf("Waypoint order:");
+          for(i=0;i<nwaypoints;i++)
+             printf(" %d",points[order[i]]);
+          printf("\n");
+         }
+      }
+
+    EndPhase();
+   }
+
  /* Loop through all pairs of points */
 
  for(point=1;point<=NWAYPOINTS;point++)
@@ -450,6 +661,8 @@ int main(int argc,char** argv)
 
     /* Find the closest point */
 
+    StartPhase(Phase_Snap);
+
     start_node=finish_node;
 
     if(exactnodes)
@@ -491,17 +704,21 @@ int main(int argc,char** argv)
                  radians_to_degrees(lon),radians_to_degrees(lat),distance_to_km(distmin));
       }
 
+    if(start_node!=NO_NODE && start_node!=finish_node && heading!=-999 && join_segment==NO_SEGMENT)
+       join_segment=FindClosestSegmentHeading(OSMNodes,OSMSegments,OSMWays,start_node,heading,profile);
+
+    EndPhase();
+
     if(start_node==NO_NODE)
        continue;
 
     if(start_node==finish_node)
        continue;
 
-    if(heading!=-999 && join_segment==NO_SEGMENT)
-       join_segment=FindClosestSegmentHeading(OSMNodes,OSMSegments,OSMWays,start_node,heading,profile);
-
     /* Calculate the beginning of the route */
 
+    StartPhase(Phase_Start);
+
     begin=FindStartRoutes(OSMNodes,OSMSegments,OSMWays,OSMRelations,profile,start_node,join_segment,finish_node,&nsuper);
 
     if(!begin && join_segment!=NO_SEGMENT)
@@ -520,6 +737,8 @@ int main(int argc,char** argv)
        return(1);
       }
 
+    EndPhase();
+
     finish_result=FindResult1(begin,finish_node);
 
     if(nsuper || !finish_result)
@@ -531,6 +750,8 @@ int main(int argc,char** argv)
 
        /* Calculate the end of the route */
 
+       StartPhase(Phase_Finish);
+
        end=FindFinishRoutes(OSMNodes,OSMSegments,OSMWays,OSMRelations,profile,finish_node);
 
        if(!end)
@@ -539,10 +760,16 @@ int main(int argc,char** argv)
           return(1);
          }
 
+       EndPhase();
+
        /* Calculate the middle of the route */
 
+       StartPhase(Phase_Middle);
+
        middle=FindMiddleRoute(OSMNodes,OSMSegments,OSMWays,OSMRelations,profile,begin,end);
 
+       EndPhase();
+
        if(!middle && join_segment!=NO_SEGMENT && !finish_result)
          {
           /* Try again but allow a U-turn at the start waypoint -
@@ -550,12 +777,18 @@ int main(int argc,char** argv)
 
           FreeResultsList(begin);
 
+          StartPhase(Phase_Start);
+
           begin=FindStartRoutes(OSMNodes,OSMSegments,OSMWays,OSMRelations,profile,start_node,NO_SEGMENT,finish_node,&nsuper);
 
+          EndPhase();
+
+          StartPhase(Phase_Middle);
+
           middle=FindMiddleRoute(OSMNodes,OSMSegments,OSMWays,OSMRelations,profile,begin,end);
-         }
 
-       FreeResultsList(end);
+          EndPhase();
+         }
 
        if(!middle)
          {
@@ -567,6 +800,8 @@ int main(int argc,char** argv)
          }
        else
          {
+          StartPhase(Phase_Combine);
+
           results[point]=CombineRoutes(OSMNodes,OSMSegments,OSMWays,OSMRelations,profile,begin,middle);
 
           if(!results[point])
@@ -578,6 +813,8 @@ int main(int argc,char** argv)
                }
             }
 
+          EndPhase();
+
           if(results[point] && finish_result)
             {
              /* If the direct route without passing super-nodes is shorter than
@@ -592,8 +829,34 @@ int main(int argc,char** argv)
                }
             }
 
+          if(results[point] && option_alternatives)
+            {
+             /* Find the alternative routes that pass through super-nodes */
+
+             Results *altmiddle[MAXALTERNATIVES];
+             int nalternatives;
+
+             StartPhase(Phase_Alternatives);
+
+             nalternatives=FindAlternativeRoutes(OSMNodes,OSMSegments,OSMWays,OSMRelations,profile,begin,end,middle,altmiddle,option_alternatives);
+
+             for(alt=0;alt<nalternatives;alt++)
+               {
+                altresults[alt+1][point]=CombineRoutes(OSMNodes,OSMSegments,OSMWays,OSMRelations,profile,begin,altmiddle[alt]);
+
+                FreeResultsList(altmiddle[alt]);
+               }
+
+             EndPhase();
+
+             if(!option_quiet)
+                printf("Found %d alternative route%s to point %d\n",nalternatives,nalternatives==1?"":"s",point);
+            }
+
           FreeResultsList(middle);
          }
+
+       FreeResultsList(end);
       }
 
     if(finish_result && !results[point])
@@ -611,6 +874,8 @@ int main(int argc,char** argv)
     join_segment=results[point]->last_segment;
    }
 
+ routed=1;
+
  if(!option_quiet)
    {
     printf("Routed OK\n");
@@ -619,13 +884,182 @@ int main(int argc,char** argv)
 
  /* Print out the combined route */
 
+ StartPhase(Phase_Output);
+
  if(!option_none)
-    PrintRoute(results,NWAYPOINTS,OSMNodes,OSMSegments,OSMWays,profile);
+    PrintRoute(results,NWAYPOINTS,OSMNodes,OSMSegments,OSMWays,profile,0);
+
+ /* Print out the alternative routes (using the optimum route for any parts that have no alternative) */
+
+ for(alt=1;alt<=option_alternatives;alt++)
+   {
+    int found=0;
+
+    for(point=1;point<=NWAYPOINTS;point++)
+       if(altresults[alt][point])
+          found=1;
+
+    if(!found)
+       break;
+
+    for(point=1;point<=NWAYPOINTS;point++)
+       if(!altresults[alt][point])
+          altresults[alt][point]=results[point];
+
+    if(!option_none)
+       PrintRoute(altresults[alt],NWAYPOINTS,OSMNodes,OSMSegments,OSMWays,profile,alt);
+   }
+
+ EndPhase();
 
  return(0);
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Start collecting the statistics for a phase of the routing.
+
+  Phase phase The phase that is starting.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void StartPhase(Phase phase)
+{
+ if(!option_stats)
+    return;
+
+ phase_current=phase;
+
+ GetStatistics(&phase_begin);
+
+ results_statistics.maxnumber=0;
+
+ gettimeofday(&phase_begin_time,NULL);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Finish collecting the statistics for the current phase of the routing.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void EndPhase(void)
+{
+ PhaseStatistics now,*stats;
+ struct timeval now_time;
+ int i;
+
+ if(phase_current==-1)
+    return;
+
+ gettimeofday(&now_time,NULL);
+
+ GetStatistics(&now);
+
+ stats=&phase_stats[phase_current];
+
+ stats->calls++;
+ stats->time+=(double)(now_time.tv_sec-phase_begin_time.tv_sec)+(double)(now_time.tv_usec-phase_begin_time.tv_usec)/1000000.0;
+
+ stats->results.inserted+=now.results.inserted-phase_begin.results.inserted;
+ stats->results.finds   +=now.results.finds   -phase_begin.results.finds;
+ stats->results.probes  +=now.results.probes  -phase_begin.results.probes;
+ stats->results.pushed  +=now.results.pushed  -phase_begin.results.pushed;
+ stats->results.popped  +=now.results.popped  -phase_begin.results.popped;
+
+ if(now.results.maxnumber>stats->results.maxnumber)
+    stats->results.maxnumber=now.results.maxnumber;
+
+ for(i=0;i<4;i++)
+   {
+    stats->cachehits[i]  +=now.cachehits[i]  -phase_begin.cachehits[i];
+    stats->cachemisses[i]+=now.cachemisses[i]-phase_begin.cachemisses[i];
+   }
+
+ phase_current=-1;
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Get the current values of the counters that the statistics are calculated from.
+
+  PhaseStatistics *stats Returns the current counter values.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void GetStatistics(PhaseStatistics *stats)
+{
+ stats->results=results_statistics;
+
+#if SLIM
+ stats->cachehits[0]=OSMNodes->cachehits;         stats->cachemisses[0]=OSMNodes->cachemisses;
+ stats->cachehits[1]=OSMSegments->cachehits;      stats->cachemisses[1]=OSMSegments->cachemisses;
+ stats->cachehits[2]=OSMWays->cachehits;          stats->cachemisses[2]=OSMWays->cachemisses;
+ stats->cachehits[3]=OSMRelations->cachehits;     stats->cachemisses[3]=OSMRelations->cachemisses;
+#else
+ memset(stats->cachehits,0,sizeof(stats->cachehits));
+ memset(stats->cachemisses,0,sizeof(stats->cachemisses));
+#endif
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Print the statistics for each phase of the routing as JSON to stderr (called at exit).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void PrintStatistics(void)
+{
+ static const char *phase_names[Phase_Count]={"snap","order","start","finish","middle","combine","alternatives","output"};
+ static const char *cache_names[4]={"nodes","segments","ways","relations"};
+ int phase,i;
+
+ /* Include the phase that was running if the program stopped with an error */
+
+ EndPhase();
+
+ fprintf(stderr,"{\n");
+ fprintf(stderr,"  \"routed\": %s,\n",routed?"true":"false");
+ fprintf(stderr,"  \"slim\": %s,\n",SLIM?"true":"false");
+ fprintf(stderr,"  \"phases\": {\n");
+
+ for(phase=0;phase<Phase_Count;phase++)
+   {
+    PhaseStatistics *stats=&phase_stats[phase];
+
+    fprintf(stderr,"    \"%s\": {\n",phase_names[phase]);
+    fprintf(stderr,"      \"calls\": %d,\n",stats->calls);
+    fprintf(stderr,"      \"time\": %.6f,\n",stats->time);
+    fprintf(stderr,"      \"queue_pushes\": %llu,\n",(unsigned long long)stats->results.pushed);
+    fprintf(stderr,"      \"queue_pops\": %llu,\n",(unsigned long long)stats->results.popped);
+    fprintf(stderr,"      \"results_inserted\": %llu,\n",(unsigned long long)stats->results.inserted);
+    fprintf(stderr,"      \"results_finds\": %llu,\n",(unsigned long long)stats->results.finds);
+    fprintf(stderr,"      \"results_probes\": %llu,\n",(unsigned long long)stats->results.probes);
+    fprintf(stderr,"      \"results_peak\": %u",stats->results.maxnumber);
+
+    if(SLIM)
+      {
+       fprintf(stderr,",\n      \"cache\": {\n");
+
+       for(i=0;i<4;i++)
+         {
+          uint32_t lookups=stats->cachehits[i]+stats->cachemisses[i];
+
+          fprintf(stderr,"        \"%s\": { \"hits\": %u, \"misses\": %u, \"hit_rate\": ",cache_names[i],stats->cachehits[i],stats->cachemisses[i]);
+
+          if(lookups)
+             fprintf(stderr,"%.4f }%s\n",(double)stats->cachehits[i]/lookups,i==3?"":",");
+          else
+             fprintf(stderr,"null }%s\n",i==3?"":",");
+         }
+
+       fprintf(stderr,"      }");
+      }
+
+    fprintf(stderr,"\n    }%s\n",phase==(Phase_Count-1)?"":",");
+   }
+
+ fprintf(stderr,"  }\n");
+ fprintf(stderr,"}\n");
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Print out the usage information.
 
@@ -643,8 +1077,9 @@ static void print_usage(int detail,const char *argerr,const char *err)
          "                        --help-profile-json | --help-profile-perl ]\n"
          "              [--dir=<dirname>] [--prefix=<name>]\n"
          "              [--profiles=<filename>] [--translations=<filename>]\n"
+         "              [--overlay=<filename>]\n"
          "              [--exact-nodes-only]\n"
-         "              [--loggable | --quiet]\n"
+         "              [--loggable | --quiet] [--stats]\n"
          "              [--language=<lang>]\n"
          "              [--output-html]\n"
          "              [--output-gpx-track] [--output-gpx-route]\n"
@@ -654,6 +1089,9 @@ static void print_usage(int detail,const char *argerr,const char *err)
          "              [--profile=<name>]\n"
          "              [--transport=<transport>]\n"
          "              [--shortest | --quickest]\n"
+         "              [--optimise-order | --optimise-order-fixed-finish]\n"
+         "              [--alternatives=<number>]\n"
+         "              [--hour=<hour>]\n"
          "              --lon1=<longitude> --lat1=<latitude>\n"
          "              --lon2=<longitude> --lon2=<latitude>\n"
          "              [ ... --lon99=<longitude> --lon99=<latitude>]\n"
@@ -693,11 +1131,16 @@ static void print_usage(int detail,const char *argerr,const char *err)
             "                        (defaults to 'translations.xml' with '--dir' and\n"
             "                         '--prefix' options or the file installed in\n"
             "                         '" DATADIR "').\n"
+            "--overlay=<filename>    The name of the file containing the segment overrides\n"
+            "                        (defaults to 'overlay.mem' with '--dir' and\n"
+            "                         '--prefix' options if it exists).\n"
             "\n"
             "--exact-nodes-only      Only route between nodes (don't find closest segment).\n"
             "\n"
             "--loggable              Print progress messages suitable for logging to file.\n"
             "--quiet                 Don't print any screen output when running.\n"
+            "--stats                 Print statistics about each phase of the routing\n"
+            "                        to stderr in JSON format.\n"
             "\n"
             "--language=<lang>       Use the translations for specified language.\n"
             "--output-html           Write an HTML description of the route.\n"
@@ -715,6 +1158,15 @@ static void print_usage(int detail,const char *argerr,const char *err)
             "\n"
             "--shortest              Find the shortest route between the waypoints.\n"
             "--quickest              Find the quickest route between the waypoints.\n"
+            "--alternatives=<number> Also find up to this number of alternative routes.\n"
+            "--hour=<hour>           The hour of the day (0-23) for the segment overrides\n"
+            "                        (defaults to the current hour).\n"
+            "\n"
+            "--optimise-order        Visit the waypoints in the order that gives the best\n"
+            "                        route (starting at the lowest numbered waypoint).\n"
+            "--optimise-order-fixed-finish\n"
+            "                        Optimise the order but also finish at the highest\n"
+            "                        numbered waypoint.\n"
             "\n"
             "--lon<n>=<longitude>    Specify the longitude of the n'th waypoint.\n"
             "--lat<n>=<latitude>     Specify the latitude of the n'th waypoint.\n"
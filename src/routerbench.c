@@ -0,0 +1,722 @@
+/***************************************
+ Routing benchmark program.
+
+ Part of the Routino routing software.
+ ******************/ /******************
+ This file Copyright 2008-2011 Andrew M. Bishop
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU Affero General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Affero General Public License for more details.
+
+ You should have received a copy of the GNU Affero General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************/
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "types.h"
+#include "nodes.h"
+#include "segments.h"
+#include "ways.h"
+#include "relations.h"
+
+#include "files.h"
+#include "functions.h"
+#include "profiles.h"
+#include "results.h"
+
+
+/*+ The largest Dijkstra rank (as a power of 2) that can be used. +*/
+#define MAX_RANK 30
+
+
+/* Local types */
+
+/*+ The results of the queries in one group (random or a single Dijkstra rank). +*/
+typedef struct _Bucket
+{
+ int       nqueries;            /*+ The number of queries that were attempted. +*/
+ int       nfailed;             /*+ The number of queries that did not find a route. +*/
+
+ double   *times;               /*+ The time taken for each successful query (seconds). +*/
+}
+ Bucket;
+
+
+/* Global variables (required by the optimiser) */
+
+/*+ The option not to print any progress information. +*/
+int option_quiet=1;
+
+/*+ The option to calculate the quickest route insted of the shortest. +*/
+int option_quickest=0;
+
+/*+ The number of alternative routes to calculate. +*/
+int option_alternatives=0;
+
+
+/* Local variables */
+
+/*+ The state of the pseudo-random number generator. +*/
+static uint64_t random_state;
+
+
+/* Local functions */
+
+static index_t RandomNode(Nodes *nodes,Segments *segments,Ways *ways,Profile *profile);
+static int RankedNodes(Nodes *nodes,Segments *segments,Ways *ways,Profile *profile,index_t start_node,int maxrank,index_t *ranked);
+
+static int RouteQuery(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,index_t start_node,index_t finish_node,double *time);
+
+static void AddToBucket(Bucket *bucket,int success,double time);
+static void PrintBucket(const char *name,Bucket *bucket);
+
+static uint32_t RandomNumber(void);
+static int sort_by_time(const void *a,const void *b);
+
+static void print_usage(int detail,const char *argerr,const char *err);
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  The main program for the routing benchmark.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int main(int argc,char** argv)
+{
+ Nodes    *OSMNodes;
+ Segments *OSMSegments;
+ Ways     *OSMWays;
+ Relations*OSMRelations;
+ char     *dirname=NULL,*prefix=NULL;
+ char     *profiles=NULL,*profilename=NULL;
+ Transport transport=Transport_None;
+ Profile  *profile=NULL;
+ int       nqueries=1000,seed=1,ranks=0,maxrank=0;
+ Bucket    all={0,0,NULL},buckets[MAX_RANK+1];
+ double    total_time=0;
+ int       arg,query,rank;
+
+ /* Parse the command line arguments */
+
+ for(arg=1;arg<argc;arg++)
+   {
+    if(!strcmp(argv[arg],"--help"))
+       print_usage(1,NULL,NULL);
+    else if(!strncmp(argv[arg],"--dir=",6))
+       dirname=&argv[arg][6];
+    else if(!strncmp(argv[arg],"--prefix=",9))
+       prefix=&argv[arg][9];
+    else if(!strncmp(argv[arg],"--profiles=",11))
+       profiles=&argv[arg][11];
+    else if(!strncmp(argv[arg],"--profile=",10))
+       profilename=&argv[arg][10];
+    else if(!strncmp(argv[arg],"--transport=",12))
+      {
+       transport=TransportType(&argv[arg][12]);
+
+       if(transport==Transport_None)
+          print_usage(0,argv[arg],NULL);
+      }
+    else if(!strcmp(argv[arg],"--shortest"))
+       option_quickest=0;
+    else if(!strcmp(argv[arg],"--quickest"))
+       option_quickest=1;
+    else if(!strncmp(argv[arg],"--queries=",10))
+      {
+       nqueries=atoi(&argv[arg][10]);
+
+       if(nqueries<=0)
+          print_usage(0,argv[arg],NULL);
+      }
+    else if(!strncmp(argv[arg],"--seed=",7))
+       seed=atoi(&argv[arg][7]);
+    else if(!strcmp(argv[arg],"--ranks"))
+       ranks=1;
+    else if(!strncmp(argv[arg],"--ranks=",8))
+      {
+       ranks=1;
+       maxrank=atoi(&argv[arg][8]);
+
+       if(maxrank<1 || maxrank>MAX_RANK)
+          print_usage(0,argv[arg],NULL);
+      }
+    else
+       print_usage(0,argv[arg],NULL);
+   }
+
+ /* Load in the profiles */
+
+ if(transport==Transport_None)
+    transport=Transport_Motorcar;
+
+ if(profiles)
+   {
+    if(!ExistsFile(profiles))
+      {
+       fprintf(stderr,"Error: The '--profiles' option specifies a file that does not exist.\n");
+       return(1);
+      }
+   }
+ else
+   {
+    if(ExistsFile(FileName(dirname,prefix,"profiles.xml")))
+       profiles=FileName(dirname,prefix,"profiles.xml");
+    else if(ExistsFile(FileName(DATADIR,NULL,"profiles.xml")))
+       profiles=FileName(DATADIR,NULL,"profiles.xml");
+    else
+      {
+       fprintf(stderr,"Error: The '--profiles' option was not used and the default 'profiles.xml' does not exist.\n");
+       return(1);
+      }
+   }
+
+ if(ParseXMLProfiles(profiles))
+   {
+    fprintf(stderr,"Error: Cannot read the profiles in the file '%s'.\n",profiles);
+    return(1);
+   }
+
+ if(profilename)
+   {
+    profile=GetProfile(profilename);
+
+    if(!profile)
+      {
+       fprintf(stderr,"Error: Cannot find a profile called '%s' in '%s'.\n",profilename,profiles);
+       return(1);
+      }
+   }
+ else
+    profile=GetProfile(TransportName(transport));
+
+ if(!profile)
+   {
+    fprintf(stderr,"Error: Cannot find a profile for the '%s' transport in '%s'.\n",TransportName(transport),profiles);
+    return(1);
+   }
+
+ /* Load in the data - Note: No error checking because Load*List() will call exit() in case of an error. */
+
+ OSMNodes=LoadNodeList(FileName(dirname,prefix,"nodes.mem"));
+
+ OSMSegments=LoadSegmentList(FileName(dirname,prefix,"segments.mem"));
+
+ OSMWays=LoadWayList(FileName(dirname,prefix,"ways.mem"));
+
+ OSMRelations=LoadRelationList(FileName(dirname,prefix,"relations.mem"));
+
+ if(UpdateProfile(profile,OSMWays))
+   {
+    fprintf(stderr,"Error: Profile is invalid or not compatible with database.\n");
+    return(1);
+   }
+
+ /* The default largest rank is the largest one that the database can contain */
+
+ if(ranks && !maxrank)
+    while(maxrank<MAX_RANK && ((index_t)2<<maxrank)<=OSMNodes->file.number)
+       maxrank++;
+
+ for(rank=0;rank<=MAX_RANK;rank++)
+   {
+    buckets[rank].nqueries=0;
+    buckets[rank].nfailed=0;
+    buckets[rank].times=NULL;
+   }
+
+ /* Run the queries - the same seed always gives the same set of queries */
+
+ random_state=(uint64_t)seed;
+
+ for(query=0;query<nqueries;query++)
+   {
+    index_t start_node=RandomNode(OSMNodes,OSMSegments,OSMWays,profile);
+
+    if(start_node==NO_NODE)
+      {
+       fprintf(stderr,"Error: Cannot find any nodes compatible with profile.\n");
+       return(1);
+      }
+
+    if(ranks)
+      {
+       index_t ranked[MAX_RANK+1];
+       int found;
+
+       found=RankedNodes(OSMNodes,OSMSegments,OSMWays,profile,start_node,maxrank,ranked);
+
+       for(rank=1;rank<=found;rank++)
+         {
+          double time;
+          int success=RouteQuery(OSMNodes,OSMSegments,OSMWays,OSMRelations,profile,start_node,ranked[rank],&time);
+
+          AddToBucket(&buckets[rank],success,time);
+          AddToBucket(&all,success,time);
+
+          total_time+=time;
+         }
+      }
+    else
+      {
+       index_t finish_node;
+       double time;
+       int success;
+
+       do
+          finish_node=RandomNode(OSMNodes,OSMSegments,OSMWays,profile);
+       while(finish_node==start_node);
+
+       success=RouteQuery(OSMNodes,OSMSegments,OSMWays,OSMRelations,profile,start_node,finish_node,&time);
+
+       AddToBucket(&all,success,time);
+
+       total_time+=time;
+      }
+
+    if(!((query+1)%100))
+      {
+       fprintf(stderr,"\rQueries: %d",query+1);
+       fflush(stderr);
+      }
+   }
+
+ if(nqueries>=100)
+    fprintf(stderr,"\n");
+
+ /* Print the results */
+
+ printf("Database: %"Pindex_t" nodes, %"Pindex_t" segments, %"Pindex_t" ways\n",OSMNodes->file.number,OSMSegments->file.number,OSMWays->file.number);
+ printf("Profile: %s (%s), seed %d\n",TransportName(profile->transport),option_quickest?"quickest":"shortest",seed);
+ printf("Routes: %d (%d failed) in %.3f s = %.1f routes/s\n",all.nqueries,all.nfailed,total_time,total_time>0?(all.nqueries-all.nfailed)/total_time:0.0);
+ printf("\n");
+
+ printf("%-12s %8s %8s %9s %9s %9s %9s %9s\n","bucket","routes","failed","mean/ms","p50/ms","p90/ms","p99/ms","max/ms");
+
+ if(ranks)
+    for(rank=1;rank<=maxrank;rank++)
+      {
+       char name[32];
+
+       sprintf(name,"rank 2^%d",rank);
+
+       PrintBucket(name,&buckets[rank]);
+      }
+
+ PrintBucket("all",&all);
+
+ return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Choose a random node that can be used as the start or finish of a route.
+
+  index_t RandomNode Returns the index of the node or NO_NODE if none can be found.
+
+  Nodes *nodes The set of nodes to use.
+
+  Segments *segments The set of segments to use.
+
+  Ways *ways The set of ways to use.
+
+  Profile *profile The profile containing the transport type.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static index_t RandomNode(Nodes *nodes,Segments *segments,Ways *ways,Profile *profile)
+{
+ int tries;
+
+ for(tries=0;tries<1000;tries++)
+   {
+    index_t index=(index_t)(((uint64_t)RandomNumber()*nodes->file.number)>>32);
+    Node *node=LookupNode(nodes,index,1);
+    Segment *segment;
+
+    if(!(node->allow&profile->allow))
+       continue;
+
+    segment=FirstSegment(segments,nodes,index,1);
+
+    while(segment)
+      {
+       if(IsNormalSegment(segment))
+         {
+          Way *way=LookupWay(ways,segment->way,1);
+
+          if(way->allow&profile->allow)
+             return(index);
+         }
+
+       segment=NextSegment(segments,segment,index);
+      }
+   }
+
+ return(NO_NODE);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the nodes at each Dijkstra rank from a start node (the node that is
+  the 2^r th one to be settled by a search from the start node has rank r).
+
+  int RankedNodes Returns the largest rank that was found.
+
+  Nodes *nodes The set of nodes to use.
+
+  Segments *segments The set of segments to use.
+
+  Ways *ways The set of ways to use.
+
+  Profile *profile The profile containing the transport type and speeds.
+
+  index_t start_node The start node.
+
+  int maxrank The largest rank to find.
+
+  index_t *ranked Returns the node for each rank.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int RankedNodes(Nodes *nodes,Segments *segments,Ways *ways,Profile *profile,index_t start_node,int maxrank,index_t *ranked)
+{
+ Results *results;
+ Queue   *queue;
+ Result  *result1,*result2;
+ index_t settled=0;
+ int rank=0;
+
+ results=NewResultsList(64);
+
+ result1=InsertResult(results,start_node,NO_SEGMENT);
+
+ queue=NewQueueList();
+
+ InsertInQueue(queue,result1);
+
+ /* Loop across all nodes in the queue, they come out in the order that they are settled */
+
+ while((result1=PopFromQueue(queue)))
+   {
+    index_t node1=result1->node;
+    Segment *segment;
+
+    settled++;
+
+    if(settled==((index_t)1<<(rank+1)))
+      {
+       ranked[++rank]=node1;
+
+       if(rank==maxrank)
+          break;
+      }
+
+    segment=FirstSegment(segments,nodes,node1,1);
+
+    while(segment)
+      {
+       Way *way;
+       index_t node2;
+       score_t segment_score,cumulative_score;
+
+       if(!IsNormalSegment(segment))
+          goto endloop;
+
+       if(profile->oneway && IsOnewayTo(segment,node1))
+          goto endloop;
+
+       way=LookupWay(ways,segment->way,1);
+
+       if(!(way->allow&profile->allow))
+          goto endloop;
+
+       node2=OtherNode(segment,node1);
+
+       if(!(LookupNode(nodes,node2,2)->allow&profile->allow))
+          goto endloop;
+
+       if(option_quickest==0)
+          segment_score=(score_t)DISTANCE(segment->distance);
+       else
+          segment_score=(score_t)Duration(segment,way,profile);
+
+       cumulative_score=result1->score+segment_score;
+
+       result2=FindResult1(results,node2);
+
+       if(!result2)
+         {
+          result2=InsertResult(results,node2,NO_SEGMENT);
+          result2->score=cumulative_score;
+          result2->sortby=cumulative_score;
+
+          InsertInQueue(queue,result2);
+         }
+       else if(cumulative_score<result2->score && result2->queued!=NOT_QUEUED)
+         {
+          result2->score=cumulative_score;
+          result2->sortby=cumulative_score;
+
+          InsertInQueue(queue,result2);
+         }
+
+      endloop:
+
+       segment=NextSegment(segments,segment,node1);
+      }
+   }
+
+ FreeQueueList(queue);
+ FreeResultsList(results);
+
+ return(rank);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the route between two nodes in the same way as the router.
+
+  int RouteQuery Returns true if a route was found.
+
+  Nodes *nodes The set of nodes to use.
+
+  Segments *segments The set of segments to use.
+
+  Ways *ways The set of ways to use.
+
+  Relations *relations The set of relations to use.
+
+  Profile *profile The profile containing the transport type, speeds and allowed highways.
+
+  index_t start_node The start node.
+
+  index_t finish_node The finish node.
+
+  double *time Returns the time taken (seconds).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int RouteQuery(Nodes *nodes,Segments *segments,Ways *ways,Relations *relations,Profile *profile,index_t start_node,index_t finish_node,double *time)
+{
+ struct timeval start_time,finish_time;
+ Results *begin,*end,*middle,*route=NULL;
+ Result *finish_result;
+ int nsuper=0;
+
+ gettimeofday(&start_time,NULL);
+
+ begin=FindStartRoutes(nodes,segments,ways,relations,profile,start_node,NO_SEGMENT,finish_node,&nsuper);
+
+ if(begin)
+   {
+    finish_result=FindResult1(begin,finish_node);
+
+    if(nsuper || !finish_result)
+      {
+       end=FindFinishRoutes(nodes,segments,ways,relations,profile,finish_node);
+
+       if(end)
+         {
+          middle=FindMiddleRoute(nodes,segments,ways,relations,profile,begin,end);
+
+          if(middle)
+            {
+             route=CombineRoutes(nodes,segments,ways,relations,profile,begin,middle);
+
+             FreeResultsList(middle);
+            }
+
+          FreeResultsList(end);
+         }
+      }
+
+    if(finish_result && !route)
+       route=begin;
+    else
+       FreeResultsList(begin);
+   }
+
+ gettimeofday(&finish_time,NULL);
+
+ *time=(double)(finish_time.tv_sec-start_time.tv_sec)+(double)(finish_time.tv_usec-start_time.tv_usec)/1000000.0;
+
+ if(!route)
+    return(0);
+
+ FreeResultsList(route);
+
+ return(1);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Add the result of a query to a bucket.
+
+  Bucket *bucket The bucket to add to.
+
+  int success True if the query found a route.
+
+  double time The time taken by the query.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void AddToBucket(Bucket *bucket,int success,double time)
+{
+ if(success)
+   {
+    int ntimes=bucket->nqueries-bucket->nfailed;
+
+    if((ntimes%1024)==0)
+      {
+       bucket->times=(double*)realloc((void*)bucket->times,(ntimes+1024)*sizeof(double));
+
+       assert(bucket->times); /* Check realloc() worked */
+      }
+
+    bucket->times[ntimes]=time;
+   }
+ else
+    bucket->nfailed++;
+
+ bucket->nqueries++;
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Print the latency statistics for a bucket.
+
+  const char *name The name of the bucket.
+
+  Bucket *bucket The bucket to print.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void PrintBucket(const char *name,Bucket *bucket)
+{
+ int ntimes=bucket->nqueries-bucket->nfailed;
+ double total=0;
+ int i;
+
+ if(ntimes==0)
+   {
+    printf("%-12s %8d %8d %9s %9s %9s %9s %9s\n",name,bucket->nqueries,bucket->nfailed,"-","-","-","-","-");
+    return;
+   }
+
+ qsort(bucket->times,ntimes,sizeof(double),sort_by_time);
+
+ for(i=0;i<ntimes;i++)
+    total+=bucket->times[i];
+
+ printf("%-12s %8d %8d %9.3f %9.3f %9.3f %9.3f %9.3f\n",name,bucket->nqueries,bucket->nfailed,
+        1000*total/ntimes,
+        1000*bucket->times[(ntimes-1)*50/100],
+        1000*bucket->times[(ntimes-1)*90/100],
+        1000*bucket->times[(ntimes-1)*99/100],
+        1000*bucket->times[ntimes-1]);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Generate a pseudo-random number (the same sequence on all platforms for a given seed).
+
+  uint32_t RandomNumber Returns the random number.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static uint32_t RandomNumber(void)
+{
+ random_state=random_state*6364136223846793005ULL+1442695040888963407ULL;
+
+ return((uint32_t)(random_state>>32));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Sort the query times into order.
+
+  int sort_by_time Returns the comparison of the times.
+
+  const void *a The first time.
+
+  const void *b The second time.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int sort_by_time(const void *a,const void *b)
+{
+ double ta=*(const double*)a;
+ double tb=*(const double*)b;
+
+ if(ta<tb)
+    return(-1);
+ else if(ta>tb)
+    return(1);
+ else
+    return(0);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Print out the usage information.
+
+  int detail The level of detail to use - 0 = low, 1 = high.
+
+  const char *argerr The argument that gave the error (if there is one).
+
+  const char *err Other error message (if there is one).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void print_usage(int detail,const char *argerr,const char *err)
+{
+ fprintf(stderr,
+         "Usage: routerbench [--help]\n"
+         "                   [--dir=<dirname>] [--prefix=<name>]\n"
+         "                   [--profiles=<filename>]\n"
+         "                   [--transport=<transport> | --profile=<name>]\n"
+         "                   [--shortest | --quickest]\n"
+         "                   [--queries=<number>] [--seed=<number>]\n"
+         "                   [--ranks[=<max-rank>]]\n");
+
+ if(argerr)
+    fprintf(stderr,
+            "\n"
+            "Error with command line parameter: %s\n",argerr);
+
+ if(err)
+    fprintf(stderr,
+            "\n"
+            "Error: %s\n",err);
+
+ if(detail)
+    fprintf(stderr,
+            "\n"
+            "--help                  Prints this information.\n"
+            "\n"
+            "--dir=<dirname>         The directory containing the routing database.\n"
+            "--prefix=<name>         The filename prefix for the routing database.\n"
+            "\n"
+            "--profiles=<filename>   The name of the XML file containing the profiles\n"
+            "                        (defaults to 'profiles.xml' with '--dir' and\n"
+            "                         '--prefix' options or the file installed in\n"
+            "                         '" DATADIR "').\n"
+            "--transport=<transport> The type of transport to route for (defaults to motorcar).\n"
+            "--profile=<name>        The name of the profile to use (defaults to the transport).\n"
+            "\n"
+            "--shortest              Find the shortest routes.\n"
+            "--quickest              Find the quickest routes.\n"
+            "\n"
+            "--queries=<number>      The number of random start nodes (default 1000).\n"
+            "--seed=<number>         The seed for choosing the nodes (default 1); the same\n"
+            "                        seed and database always give the same queries.\n"
+            "--ranks[=<max-rank>]    Route from each start node to the nodes with Dijkstra\n"
+            "                        rank 2^1 to 2^max-rank and report each rank separately\n"
+            "                        (default is a random finish node for each start node).\n");
+
+ exit(!detail);
+}
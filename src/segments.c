@@ -74,8 +74,13 @@ Segments *LoadSegmentList(const char *filename)
  for(i=0;i<sizeof(segments->cached)/sizeof(segments->cached[0]);i++)
     segments->incache[i]=NO_SEGMENT;
 
+ segments->cachehits=0;
+ segments->cachemisses=0;
+
 #endif
 
+ segments->overlay=NULL;
+
  return(segments);
 }
 
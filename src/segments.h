@@ -65,6 +65,8 @@ struct _Segments
 {
  SegmentsFile file;             /*+ The header data from the file. +*/
 
+ Overlay     *overlay;          /*+ The runtime overrides for the segments (or NULL if none). +*/
+
 #if !SLIM
 
  void        *data;             /*+ The memory mapped data. +*/
@@ -78,6 +80,9 @@ struct _Segments
  Segment      cached[3];        /*+ Three cached segments read from the file in slim mode. +*/
  index_t      incache[3];       /*+ The indexes of the cached segments. +*/
 
+ uint32_t     cachehits;        /*+ The number of lookups found in the cache. +*/
+ uint32_t     cachemisses;      /*+ The number of lookups read from the file. +*/
+
 #endif
 };
 
@@ -180,12 +185,16 @@ static inline Segment *LookupSegment(Segments *segments,index_t index,int positi
 {
  if(segments->incache[position-1]!=index)
    {
+    segments->cachemisses++;
+
     SeekFile(segments->fd,sizeof(SegmentsFile)+(off_t)index*sizeof(Segment));
 
     ReadFile(segments->fd,&segments->cached[position-1],sizeof(Segment));
 
     segments->incache[position-1]=index;
    }
+ else
+    segments->cachehits++;
 
  return(&segments->cached[position-1]);
 }
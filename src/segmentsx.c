@@ -35,6 +35,7 @@
 #include "nodesx.h"
 #include "segmentsx.h"
 #include "waysx.h"
+#include "changesx.h"
 
 #include "types.h"
 
@@ -50,7 +51,7 @@ extern char *option_tmpdirname;
 
 /* Local functions */
 
-static int sort_by_id(SegmentX *a,SegmentX *b);
+static void key_by_id(SegmentX *segmentx,uint32_t *key);
 
 static distance_t DistanceX(NodeX *nodex1,NodeX *nodex2);
 
@@ -82,14 +83,14 @@ SegmentsX *NewSegmentList(int append)
    {
     off_t size;
 
-    segmentsx->fd=OpenFileAppend(segmentsx->filename);
+    segmentsx->fd=OpenFileBufferedAppend(segmentsx->filename);
 
     size=SizeFile(segmentsx->filename);
 
     segmentsx->number=size/sizeof(SegmentX);
    }
  else
-    segmentsx->fd=OpenFileNew(segmentsx->filename);
+    segmentsx->fd=OpenFileBufferedNew(segmentsx->filename);
 
  return(segmentsx);
 }
@@ -105,6 +106,9 @@ SegmentsX *NewSegmentList(int append)
 
 void FreeSegmentList(SegmentsX *segmentsx,int keep)
 {
+ if(segmentsx->fd!=-1)
+    segmentsx->fd=CloseFileBuffered(segmentsx->fd);
+
  if(!keep)
     DeleteFile(segmentsx->filename);
 
@@ -120,6 +124,62 @@ void FreeSegmentList(SegmentsX *segmentsx,int keep)
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Save the state of the segment list between two stages of processing so that
+  the processing can be resumed from here.
+
+  SegmentsX *segmentsx The set of segments to save.
+
+  NodesX *nodesx The set of nodes (that the segment index refers to).
+
+  int fd The file descriptor of the checkpoint file to write the state to.
+
+  const char *filename The name of the file to copy the segment data to.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void CheckpointSegmentList(SegmentsX *segmentsx,NodesX *nodesx,int fd,const char *filename)
+{
+ assert(segmentsx->fd==-1); /* Only between processing stages. */
+
+ CopyFile(segmentsx->filename,filename);
+
+ WriteFile(fd,&segmentsx->number,sizeof(index_t));
+
+ WriteFileArray(fd,segmentsx->firstnode,nodesx->number*sizeof(index_t));
+ WriteFileArray(fd,segmentsx->usednode,(1+nodesx->number/8)*sizeof(char));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Restore the state of the segment list that was saved by CheckpointSegmentList().
+
+  int ResumeSegmentList Returns 0 if OK or something else in case of an error.
+
+  SegmentsX *segmentsx The set of segments to restore (newly allocated).
+
+  int fd The file descriptor of the checkpoint file to read the state from.
+
+  const char *filename The name of the file to copy the segment data from.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int ResumeSegmentList(SegmentsX *segmentsx,int fd,const char *filename)
+{
+ if(segmentsx->fd!=-1)
+    segmentsx->fd=CloseFileBuffered(segmentsx->fd);
+
+ CopyFile(filename,segmentsx->filename);
+
+ if(ReadFile(fd,&segmentsx->number,sizeof(index_t)))
+    return(1);
+
+ if(ReadFileArray(fd,(void**)&segmentsx->firstnode) ||
+    ReadFileArray(fd,(void**)&segmentsx->usednode))
+    return(1);
+
+ return(0);
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Append a single segment to an unsorted segment list.
 
@@ -156,7 +216,7 @@ void AppendSegment(SegmentsX *segmentsx,way_t way,node_t node1,node_t node2,dist
  segmentx.way=way;
  segmentx.distance=distance;
 
- WriteFile(segmentsx->fd,&segmentx,sizeof(SegmentX));
+ WriteFileBuffered(segmentsx->fd,&segmentx,sizeof(SegmentX));
 
  segmentsx->number++;
 
@@ -164,6 +224,124 @@ void AppendSegment(SegmentsX *segmentsx,way_t way,node_t node1,node_t node2,dist
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Save a copy of the parsed (unsorted) segment list so that it can be updated later.
+
+  SegmentsX *segmentsx The set of segments to save.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void SaveParsedSegmentList(SegmentsX *segmentsx)
+{
+ char *filename=(char*)malloc(strlen(option_tmpdirname)+32);
+
+ sprintf(filename,"%s/segmentsx.parsed.mem",option_tmpdirname);
+
+ segmentsx->fd=CloseFileBuffered(segmentsx->fd);
+
+ CopyFile(segmentsx->filename,filename);
+
+ segmentsx->fd=OpenFileBufferedAppend(segmentsx->filename);
+
+ free(filename);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Replace the segment list with the copy of the parsed segment list saved earlier.
+
+  SegmentsX *segmentsx The set of segments to replace.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void LoadParsedSegmentList(SegmentsX *segmentsx)
+{
+ char *filename=(char*)malloc(strlen(option_tmpdirname)+32);
+
+ sprintf(filename,"%s/segmentsx.parsed.mem",option_tmpdirname);
+
+ segmentsx->fd=CloseFileBuffered(segmentsx->fd);
+
+ CopyFile(filename,segmentsx->filename);
+
+ segmentsx->fd=OpenFileBufferedAppend(segmentsx->filename);
+
+ segmentsx->number=SizeFile(segmentsx->filename)/sizeof(SegmentX);
+
+ free(filename);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Remove the segments that belong to ways that have been replaced or deleted by
+  the change files (must be called before the way changes are applied).
+
+  SegmentsX *segmentsx The set of segments to modify.
+
+  WaysX *waysx The set of ways (containing the list of changes).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void ApplySegmentChanges(SegmentsX *segmentsx,WaysX *waysx)
+{
+ SegmentX segmentx;
+ index_t total=0,kept=0;
+ int fd;
+
+ if(!waysx->changes)
+    return;
+
+ /* Print the start message */
+
+ printf_first("Applying Segment Changes: Segments=0");
+
+ /* Sort the changes */
+
+ SortChangeList(waysx->changes);
+
+ /* Close the file (finished appending) */
+
+ segmentsx->fd=CloseFileBuffered(segmentsx->fd);
+
+ /* Re-open the file read-only and a new file writeable */
+
+ segmentsx->fd=ReOpenFileBuffered(segmentsx->filename);
+
+ DeleteFile(segmentsx->filename);
+
+ fd=OpenFileBufferedNew(segmentsx->filename);
+
+ /* Copy the segments whose ways have not been replaced since they were stored */
+
+ while(!ReadFileBuffered(segmentsx->fd,&segmentx,sizeof(SegmentX)))
+   {
+    ChangeX *changex=FindChange(waysx->changes,segmentx.way);
+
+    if(!changex || total>=changex->index[1])
+      {
+       WriteFileBuffered(fd,&segmentx,sizeof(SegmentX));
+
+       kept++;
+      }
+
+    total++;
+
+    if(!(total%10000))
+       printf_middle("Applying Segment Changes: Segments=%"Pindex_t" Kept=%"Pindex_t,total,kept);
+   }
+
+ segmentsx->number=kept;
+
+ /* Close the files and re-open for appending */
+
+ segmentsx->fd=CloseFileBuffered(segmentsx->fd);
+ CloseFileBuffered(fd);
+
+ segmentsx->fd=OpenFileBufferedAppend(segmentsx->filename);
+
+ /* Print the final message */
+
+ printf_last("Applied Segment Changes: Segments=%"Pindex_t" Kept=%"Pindex_t" Removed=%"Pindex_t,total,kept,total-kept);
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Sort the segment list.
 
@@ -181,24 +359,24 @@ void SortSegmentList(SegmentsX *segmentsx)
  /* Close the file (finished appending) */
 
  if(segmentsx->fd!=-1)
-    segmentsx->fd=CloseFile(segmentsx->fd);
+    segmentsx->fd=CloseFileBuffered(segmentsx->fd);
 
  /* Re-open the file read-only and a new file writeable */
 
- segmentsx->fd=ReOpenFile(segmentsx->filename);
+ segmentsx->fd=ReOpenFileBuffered(segmentsx->filename);
 
  DeleteFile(segmentsx->filename);
 
- fd=OpenFileNew(segmentsx->filename);
+ fd=OpenFileBufferedNew(segmentsx->filename);
 
  /* Sort by node indexes */
 
- filesort_fixed(segmentsx->fd,fd,sizeof(SegmentX),(int (*)(const void*,const void*))sort_by_id,NULL);
+ filesort_fixed_keyed(segmentsx->fd,fd,sizeof(SegmentX),3,(void (*)(const void*,uint32_t*))key_by_id,NULL);
 
  /* Close the files */
 
- segmentsx->fd=CloseFile(segmentsx->fd);
- CloseFile(fd);
+ segmentsx->fd=CloseFileBuffered(segmentsx->fd);
+ CloseFileBuffered(fd);
 
  /* Print the final message */
 
@@ -207,46 +385,18 @@ void SortSegmentList(SegmentsX *segmentsx)
 
 
 /*++++++++++++++++++++++++++++++++++++++
-  Sort the segments into id order, first by node1 then by node2, finally by distance.
+  Get the key to sort the segments into id order (first by node1 then by node2 then by distance).
 
-  int sort_by_id Returns the comparison of the node fields.
+  SegmentX *segmentx The extended segment.
 
-  SegmentX *a The first segment.
-
-  SegmentX *b The second segment.
+  uint32_t *key Returns the key (the node fields and the distance).
   ++++++++++++++++++++++++++++++++++++++*/
 
-static int sort_by_id(SegmentX *a,SegmentX *b)
+static void key_by_id(SegmentX *segmentx,uint32_t *key)
 {
- node_t a_id1=a->node1;
- node_t b_id1=b->node1;
-
- if(a_id1<b_id1)
-    return(-1);
- else if(a_id1>b_id1)
-    return(1);
- else /* if(a_id1==b_id1) */
-   {
-    node_t a_id2=a->node2;
-    node_t b_id2=b->node2;
-
-    if(a_id2<b_id2)
-       return(-1);
-    else if(a_id2>b_id2)
-       return(1);
-    else
-      {
-       distance_t a_distance=a->distance;
-       distance_t b_distance=b->distance;
-
-       if(a_distance<b_distance)
-          return(-1);
-       else if(a_distance>b_distance)
-          return(1);
-       else
-          return(0);
-      }
-   }
+ key[0]=segmentx->node1;
+ key[1]=segmentx->node2;
+ key[2]=segmentx->distance;
 }
 
 
@@ -353,15 +503,15 @@ void RemoveBadSegments(NodesX *nodesx,SegmentsX *segmentsx)
 
  /* Re-open the file read-only and a new file writeable */
 
- segmentsx->fd=ReOpenFile(segmentsx->filename);
+ segmentsx->fd=ReOpenFileBuffered(segmentsx->filename);
 
  DeleteFile(segmentsx->filename);
 
- fd=OpenFileNew(segmentsx->filename);
+ fd=OpenFileBufferedNew(segmentsx->filename);
 
  /* Modify the on-disk image */
 
- while(!ReadFile(segmentsx->fd,&segmentx,sizeof(SegmentX)))
+ while(!ReadFileBuffered(segmentsx->fd,&segmentx,sizeof(SegmentX)))
    {
     index_t index1=IndexNodeX(nodesx,segmentx.node1);
     index_t index2=IndexNodeX(nodesx,segmentx.node2);
@@ -393,7 +543,7 @@ void RemoveBadSegments(NodesX *nodesx,SegmentsX *segmentsx)
       }
     else
       {
-       WriteFile(fd,&segmentx,sizeof(SegmentX));
+       WriteFileBuffered(fd,&segmentx,sizeof(SegmentX));
 
        SetBit(segmentsx->usednode,index1);
        SetBit(segmentsx->usednode,index2);
@@ -414,8 +564,8 @@ void RemoveBadSegments(NodesX *nodesx,SegmentsX *segmentsx)
 
  /* Close the files */
 
- segmentsx->fd=CloseFile(segmentsx->fd);
- CloseFile(fd);
+ segmentsx->fd=CloseFileBuffered(segmentsx->fd);
+ CloseFileBuffered(fd);
 
  /* Print the final message */
 
@@ -453,15 +603,15 @@ void MeasureSegments(SegmentsX *segmentsx,NodesX *nodesx,WaysX *waysx)
 
  /* Re-open the file read-only and a new file writeable */
 
- segmentsx->fd=ReOpenFile(segmentsx->filename);
+ segmentsx->fd=ReOpenFileBuffered(segmentsx->filename);
 
  DeleteFile(segmentsx->filename);
 
- fd=OpenFileNew(segmentsx->filename);
+ fd=OpenFileBufferedNew(segmentsx->filename);
 
  /* Modify the on-disk image */
 
- while(!ReadFile(segmentsx->fd,&segmentx,sizeof(SegmentX)))
+ while(!ReadFileBuffered(segmentsx->fd,&segmentx,sizeof(SegmentX)))
    {
     index_t node1=IndexNodeX(nodesx,segmentx.node1);
     index_t node2=IndexNodeX(nodesx,segmentx.node2);
@@ -482,7 +632,7 @@ void MeasureSegments(SegmentsX *segmentsx,NodesX *nodesx,WaysX *waysx)
 
     /* Write the modified segment */
 
-    WriteFile(fd,&segmentx,sizeof(SegmentX));
+    WriteFileBuffered(fd,&segmentx,sizeof(SegmentX));
 
     index++;
 
@@ -492,17 +642,27 @@ void MeasureSegments(SegmentsX *segmentsx,NodesX *nodesx,WaysX *waysx)
 
  /* Close the files */
 
- segmentsx->fd=CloseFile(segmentsx->fd);
- CloseFile(fd);
+ segmentsx->fd=CloseFileBuffered(segmentsx->fd);
+ CloseFileBuffered(fd);
 
  /* Free the other now-unneeded indexes */
 
- free(nodesx->idata);
+ if(nodesx->idata)
+    free(nodesx->idata);
  nodesx->idata=NULL;
 
- free(waysx->idata);
+ if(nodesx->idindex)
+    FreeIdIndex(nodesx->idindex);
+ nodesx->idindex=NULL;
+
+ if(waysx->idata)
+    free(waysx->idata);
  waysx->idata=NULL;
 
+ if(waysx->idindex)
+    FreeIdIndex(waysx->idindex);
+ waysx->idindex=NULL;
+
  /* Unmap from memory / close the file */
 
 #if !SLIM
@@ -550,15 +710,15 @@ void DeduplicateSegments(SegmentsX *segmentsx,NodesX *nodesx,WaysX *waysx)
 
  /* Re-open the file read-only and a new file writeable */
 
- segmentsx->fd=ReOpenFile(segmentsx->filename);
+ segmentsx->fd=ReOpenFileBuffered(segmentsx->filename);
 
  DeleteFile(segmentsx->filename);
 
- fd=OpenFileNew(segmentsx->filename);
+ fd=OpenFileBufferedNew(segmentsx->filename);
 
  /* Modify the on-disk image */
 
- while(!ReadFile(segmentsx->fd,&segmentx,sizeof(SegmentX)))
+ while(!ReadFileBuffered(segmentsx->fd,&segmentx,sizeof(SegmentX)))
    {
     WayX *wayx=LookupWayX(waysx,segmentx.way,1);
     int isduplicate=0;
@@ -610,7 +770,7 @@ void DeduplicateSegments(SegmentsX *segmentsx,NodesX *nodesx,WaysX *waysx)
        duplicate++;
     else
       {
-       WriteFile(fd,&segmentx,sizeof(SegmentX));
+       WriteFileBuffered(fd,&segmentx,sizeof(SegmentX));
 
        good++;
       }
@@ -625,8 +785,8 @@ void DeduplicateSegments(SegmentsX *segmentsx,NodesX *nodesx,WaysX *waysx)
 
  /* Close the files */
 
- segmentsx->fd=CloseFile(segmentsx->fd);
- CloseFile(fd);
+ segmentsx->fd=CloseFileBuffered(segmentsx->fd);
+ CloseFileBuffered(fd);
 
  /* Unmap from memory / close the file */
 
@@ -741,11 +901,11 @@ void UpdateSegments(SegmentsX *segmentsx,NodesX *nodesx,WaysX *waysx)
 
  /* Re-open the file read-only and a new file writeable */
 
- segmentsx->fd=ReOpenFile(segmentsx->filename);
+ segmentsx->fd=ReOpenFileBuffered(segmentsx->filename);
 
  DeleteFile(segmentsx->filename);
 
- fd=OpenFileNew(segmentsx->filename);
+ fd=OpenFileBufferedNew(segmentsx->filename);
 
  /* Modify the on-disk image */
 
@@ -754,7 +914,7 @@ void UpdateSegments(SegmentsX *segmentsx,NodesX *nodesx,WaysX *waysx)
     SegmentX segmentx;
     WayX *wayx;
 
-    ReadFile(segmentsx->fd,&segmentx,sizeof(SegmentX));
+    ReadFileBuffered(segmentsx->fd,&segmentx,sizeof(SegmentX));
 
     segmentx.node1=nodesx->gdata[segmentx.node1];
     segmentx.node2=nodesx->gdata[segmentx.node2];
@@ -775,7 +935,7 @@ void UpdateSegments(SegmentsX *segmentsx,NodesX *nodesx,WaysX *waysx)
 
     segmentx.way=wayx->prop;
 
-    WriteFile(fd,&segmentx,sizeof(SegmentX));
+    WriteFileBuffered(fd,&segmentx,sizeof(SegmentX));
 
     if(!((i+1)%10000))
        printf_middle("Updating Segments: Segments=%"Pindex_t,i+1);
@@ -783,8 +943,8 @@ void UpdateSegments(SegmentsX *segmentsx,NodesX *nodesx,WaysX *waysx)
 
  /* Close the files */
 
- segmentsx->fd=CloseFile(segmentsx->fd);
- CloseFile(fd);
+ segmentsx->fd=CloseFileBuffered(segmentsx->fd);
+ CloseFileBuffered(fd);
 
  /* Unmap from memory / close the files */
 
@@ -821,20 +981,20 @@ void SaveSegmentList(SegmentsX *segmentsx,const char *filename)
 
  /* Re-open the file */
 
- segmentsx->fd=ReOpenFile(segmentsx->filename);
+ segmentsx->fd=ReOpenFileBuffered(segmentsx->filename);
 
  /* Write out the segments data */
 
- fd=OpenFileNew(filename);
+ fd=OpenFileBufferedNew(filename);
 
- SeekFile(fd,sizeof(SegmentsFile));
+ SeekFileBuffered(fd,sizeof(SegmentsFile));
 
  for(i=0;i<segmentsx->number;i++)
    {
     SegmentX segmentx;
     Segment  segment;
 
-    ReadFile(segmentsx->fd,&segmentx,sizeof(SegmentX));
+    ReadFileBuffered(segmentsx->fd,&segmentx,sizeof(SegmentX));
 
     segment.node1   =segmentx.node1;
     segment.node2   =segmentx.node2;
@@ -847,7 +1007,7 @@ void SaveSegmentList(SegmentsX *segmentsx,const char *filename)
     if(IsNormalSegment(&segment))
        normal_number++;
 
-    WriteFile(fd,&segment,sizeof(Segment));
+    WriteFileBuffered(fd,&segment,sizeof(Segment));
 
     if(!((i+1)%10000))
        printf_middle("Writing Segments: Segments=%"Pindex_t,i+1);
@@ -859,14 +1019,14 @@ void SaveSegmentList(SegmentsX *segmentsx,const char *filename)
  segmentsfile.snumber=super_number;
  segmentsfile.nnumber=normal_number;
 
- SeekFile(fd,0);
- WriteFile(fd,&segmentsfile,sizeof(SegmentsFile));
+ SeekFileBuffered(fd,0);
+ WriteFileBuffered(fd,&segmentsfile,sizeof(SegmentsFile));
 
- CloseFile(fd);
+ CloseFileBuffered(fd);
 
  /* Close the file */
 
- segmentsx->fd=CloseFile(segmentsx->fd);
+ segmentsx->fd=CloseFileBuffered(segmentsx->fd);
 
  /* Print the final message */
 
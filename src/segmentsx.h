@@ -83,11 +83,19 @@ void FreeSegmentList(SegmentsX *segmentsx,int keep);
 
 void SaveSegmentList(SegmentsX *segmentsx,const char *filename);
 
+void SaveParsedSegmentList(SegmentsX *segmentsx);
+void LoadParsedSegmentList(SegmentsX *segmentsx);
+
+void CheckpointSegmentList(SegmentsX *segmentsx,NodesX *nodesx,int fd,const char *filename);
+int ResumeSegmentList(SegmentsX *segmentsx,int fd,const char *filename);
+
 SegmentX *FirstSegmentX(SegmentsX *segmentsx,index_t nodeindex,int position);
 SegmentX *NextSegmentX(SegmentsX *segmentsx,SegmentX *segmentx,index_t nodeindex,int position);
 
 void AppendSegment(SegmentsX *segmentsx,way_t way,node_t node1,node_t node2,distance_t distance);
 
+void ApplySegmentChanges(SegmentsX *segmentsx,WaysX *waysx);
+
 void SortSegmentList(SegmentsX *segmentsx);
 
 void RemoveBadSegments(NodesX *nodesx,SegmentsX *segmentsx);
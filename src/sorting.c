@@ -24,6 +24,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 
 #include "types.h"
 
@@ -31,6 +34,57 @@
 #include "sorting.h"
 
 
+/*+ The number of items that are sorted with an insertion sort before merging. +*/
+#define FILESORT_INSERTION 16
+
+/*+ The number of file descriptors to leave for files other than the temporary files when merging. +*/
+#define FILESORT_RESERVED_FILES 32
+
+/*+ The marker for a temporary file that has been completely read while merging. +*/
+#define FILESORT_FINISHED (~(uint32_t)0)
+
+/*+ The length of the name of a temporary file (with the longest possible file number). +*/
+#define FILESORT_FILENAME_LENGTH (strlen(option_tmpdirname)+sizeof("/filesort.-2147483648.tmp"))
+
+
+/* Local types */
+
+/*+ The sort key for an item (when sorting using a key) and the position of the item (or the temporary file that it came from). +*/
+typedef struct _SortKey
+{
+ uint32_t   key[FILESORT_MAXKEY]; /*+ The key, most significant word first. +*/
+ uint32_t   index;              /*+ The index of the item in the buffer (or the temporary file number when merging). +*/
+}
+ SortKey;
+
+/*+ A buffer of data that is sorted and written to a temporary file as one run (possibly in a separate thread). +*/
+typedef struct _SortBuffer
+{
+ void      *data;               /*+ The memory allocated for the data. +*/
+ void     **datap;              /*+ The pointers to the data items. +*/
+ void     **temp;               /*+ The temporary pointers used by the merge sort. +*/
+
+ size_t     n;                  /*+ The number of data items. +*/
+ size_t     itemsize;           /*+ The size of each data item (or 0 for variable length items). +*/
+
+ int      (*compare)(const void*,const void*); /*+ The comparison function. +*/
+
+ SortKey   *keys;               /*+ The keys for the data items (when sorting using a key). +*/
+ SortKey   *tempkeys;           /*+ The temporary keys used by the radix sort. +*/
+ int        nkeys;              /*+ The number of words in each key. +*/
+ void     (*getkey)(const void*,uint32_t*); /*+ The function to get the key for an item (or NULL to use the comparison function). +*/
+
+ size_t     size;               /*+ The size of the memory allocated for the data (for variable length items). +*/
+ size_t     largest;            /*+ The space needed for the largest item when merging (for variable length items). +*/
+
+ char      *filename;           /*+ The name of the temporary file to write. +*/
+
+ pthread_t  thread;             /*+ The thread that is sorting and writing the data. +*/
+ int        running;            /*+ Set to true if the thread is running. +*/
+}
+ SortBuffer;
+
+
 /* Global variables */
 
 /*+ The command line '--tmpdir' option or its default value. +*/
@@ -39,6 +93,52 @@ extern char *option_tmpdirname;
 /*+ The amount of RAM to use for filesorting. +*/
 extern size_t option_filesort_ramsize;
 
+/*+ The number of threads to use for filesorting. +*/
+extern int option_filesort_threads;
+
+/*+ The number of temporary files to merge at once (or 0 to choose automatically). +*/
+extern int option_filesort_fanin;
+
+/*+ Set to true if the temporary files of fixed length items are to be compressed. +*/
+extern int option_filesort_compress;
+
+/*+ The number of files that have been sorted. +*/
+index_t filesort_nsorts=0;
+
+/*+ The number of temporary files (sorted runs) that have been written while sorting. +*/
+index_t filesort_nruns=0;
+
+/*+ The number of extra merge passes that were needed because there were too many temporary files. +*/
+index_t filesort_npasses=0;
+
+
+/* Local functions */
+
+static SortBuffer *new_buffers(int nbuffers,size_t itemsize,int (*compare)(const void*,const void*));
+static void free_buffers(SortBuffer *buffers,int nbuffers);
+
+static void start_run(SortBuffer *buffer,int nbuffers);
+static void finish_run(SortBuffer *buffer);
+static void *sort_and_write_run(void *arg);
+
+static inline int compare_runs(int (*compare)(const void*,const void*),void **datap,int a,int b);
+
+static int merge_fanin(size_t slotsize,size_t maxslots);
+static int cascade_runs(SortBuffer *buffer,int nfiles,int fanin);
+static int *open_runs(char *filename,int first,int nfiles);
+static void close_runs(int *fds,int nfiles);
+static void merge_runs(SortBuffer *buffer,int *fds,int nfiles,int fd_out,int run,int (*buildindex)(void*,index_t),index_t *count);
+static void merge_fixed(SortBuffer *buffer,int *fds,int nfiles,int fd_out,int run,int (*buildindex)(void*,index_t),index_t *count);
+static void merge_keyed(SortBuffer *buffer,int *fds,int nfiles,int fd_out,int run,int (*buildindex)(void*,index_t),index_t *count);
+static void merge_vary(SortBuffer *buffer,int *fds,int nfiles,int fd_out,int (*buildindex)(void*,index_t),index_t *count);
+
+static int write_run_item(int fd,const void *item,void *prev,size_t itemsize);
+static int read_run_item(int fd,void *item,void *prev,size_t itemsize);
+
+static void radix_sort_keys(SortKey *keys,SortKey *temp,size_t n,int nkeys);
+static void replay_tree(int *tree,SortKey *runkeys,int nkeys,int nfiles,int s);
+static inline int key_wins(SortKey *runkeys,int nkeys,int nfiles,int a,int b);
+
 
 /*++++++++++++++++++++++++++++++++++++++
   A function to sort the contents of a file of fixed length objects using a
@@ -46,13 +146,15 @@ extern size_t option_filesort_ramsize;
 
   The data is sorted using a "Merge sort" http://en.wikipedia.org/wiki/Merge_sort
   and in particular an "external sort" http://en.wikipedia.org/wiki/External_sorting.
-  The individual sort steps and the merge step both use a "Heap sort"
-  http://en.wikipedia.org/wiki/Heapsort.  The combination of the two should work well
-  if the data is already partially sorted.
+  The individual sort steps use an in-memory merge sort (several at once in
+  separate threads if '--sort-threads' is used) and the merge step uses a "Heap
+  sort" http://en.wikipedia.org/wiki/Heapsort (in several passes if there are
+  too many temporary files to merge at once).  Both steps are stable so items
+  that compare equal stay in the order that they were in the input file.
 
-  int fd_in The file descriptor of the input file (opened for reading and at the beginning).
+  int fd_in The file descriptor of the input file (opened for buffered reading and at the beginning).
 
-  int fd_out The file descriptor of the output file (opened for writing and empty).
+  int fd_out The file descriptor of the output file (opened for buffered writing and empty).
 
   size_t itemsize The size of each item in the file that needs sorting.
 
@@ -65,26 +167,45 @@ extern size_t option_filesort_ramsize;
 
 void filesort_fixed(int fd_in,int fd_out,size_t itemsize,int (*compare)(const void*,const void*),int (*buildindex)(void*,index_t))
 {
- int *fds=NULL,*heap=NULL;
- int nfiles=0,ndata=0;
+ int *fds;
+ int nfiles=0;
  index_t count=0,total=0;
- size_t nitems=option_filesort_ramsize/(itemsize+sizeof(void*));
+ int nbuffers=(option_filesort_threads>1)?option_filesort_threads:1;
+ size_t nitems=option_filesort_ramsize/nbuffers/(itemsize+2*sizeof(void*));
+ SortBuffer *buffers,*buffer;
  void *data=NULL,**datap=NULL;
- char *filename;
  int i,more=1;
 
- /* Allocate the RAM buffer and other bits */
+ /* Allocate the RAM buffers and other bits */
+
+ buffers=new_buffers(nbuffers,itemsize,compare);
+
+ for(i=0;i<nbuffers;i++)
+   {
+    buffers[i].data=malloc(nitems*itemsize);
+    buffers[i].datap=malloc(2*nitems*sizeof(void*));
+
+    assert(buffers[i].data && buffers[i].datap); /* Check malloc() worked */
 
- data=malloc(nitems*itemsize);
- datap=malloc(nitems*sizeof(void*));
+    buffers[i].temp=buffers[i].datap+nitems;
+   }
 
- filename=(char*)malloc(strlen(option_tmpdirname)+24);
+ filesort_nsorts++;
 
- /* Loop around, fill the buffer, sort the data and write a temporary file */
+ /* Loop around, fill a buffer, sort the data and write a temporary file */
 
  do
    {
-    int fd,n=0;
+    int n=0;
+
+    /* Wait until the buffer is no longer being sorted or written */
+
+    buffer=&buffers[nfiles%nbuffers];
+
+    finish_run(buffer);
+
+    data=buffer->data;
+    datap=buffer->datap;
 
     /* Read in the data and create pointers */
 
@@ -92,7 +213,7 @@ void filesort_fixed(int fd_in,int fd_out,size_t itemsize,int (*compare)(const vo
       {
        datap[i]=data+i*itemsize;
 
-       if(ReadFile(fd_in,datap[i],itemsize))
+       if(ReadFileBuffered(fd_in,datap[i],itemsize))
          {
           more=0;
           break;
@@ -113,19 +234,17 @@ void filesort_fixed(int fd_in,int fd_out,size_t itemsize,int (*compare)(const vo
     if(n==0)
        break;
 
-    /* Sort the data pointers using a heap sort */
-
-    filesort_heapsort(datap,n,compare);
-
     /* Shortcut if all read in and sorted at once */
 
     if(nfiles==0 && !more)
       {
+       filesort_mergesort(datap,n,compare,buffer->temp);
+
        for(i=0;i<n;i++)
          {
           if(!buildindex || buildindex(datap[i],count))
             {
-             WriteFile(fd_out,datap[i],itemsize);
+             WriteFileBuffered(fd_out,datap[i],itemsize);
              count++;
             }
          }
@@ -133,173 +252,251 @@ void filesort_fixed(int fd_in,int fd_out,size_t itemsize,int (*compare)(const vo
        goto tidy_and_exit;
       }
 
-    /* Create a temporary file and write the result */
-
-    sprintf(filename,"%s/filesort.%d.tmp",option_tmpdirname,nfiles);
+    /* Sort the data and write a temporary file (while the next buffer is filled) */
 
-    fd=OpenFileNew(filename);
+    buffer->n=n;
 
-    for(i=0;i<n;i++)
-       WriteFile(fd,datap[i],itemsize);
+    sprintf(buffer->filename,"%s/filesort.%d.tmp",option_tmpdirname,nfiles);
 
-    CloseFile(fd);
+    start_run(buffer,nbuffers);
 
     nfiles++;
+    filesort_nruns++;
    }
  while(more);
 
+ for(i=0;i<nbuffers;i++)
+    finish_run(&buffers[i]);
+
  /* Shortcut if only one file (unlucky for us there must have been exactly
     nitems, lucky for us we still have the data in RAM) */
 
  if(nfiles==1)
    {
-    for(i=0;i<nitems;i++)
+    buffer=&buffers[0];
+
+    for(i=0;i<buffer->n;i++)
       {
-       if(!buildindex || buildindex(datap[i],count))
+       if(!buildindex || buildindex(buffer->datap[i],count))
          {
-          WriteFile(fd_out,datap[i],itemsize);
+          WriteFileBuffered(fd_out,buffer->datap[i],itemsize);
           count++;
          }
       }
 
-    DeleteFile(filename);
+    DeleteFile(buffer->filename);
 
     goto tidy_and_exit;
    }
 
- /* Check that number of files is less than file size */
+ /* Merge the temporary files in several passes if there are too many to merge at once */
 
- assert(nfiles<nitems);
+ nfiles=cascade_runs(&buffers[0],nfiles,merge_fanin(itemsize,nitems-1));
 
- /* Open all of the temporary files */
+ /* Merge the remaining temporary files into the output file */
 
- fds=(int*)malloc(nfiles*sizeof(int));
+ fds=open_runs(buffers[0].filename,0,nfiles);
 
- for(i=0;i<nfiles;i++)
-   {
-    sprintf(filename,"%s/filesort.%d.tmp",option_tmpdirname,i);
+ merge_runs(&buffers[0],fds,nfiles,fd_out,0,buildindex,&count);
 
-    fds[i]=ReOpenFile(filename);
+ close_runs(fds,nfiles);
 
-    DeleteFile(filename);
+ /* Tidy up */
+
+ tidy_and_exit:
+
+ for(i=0;i<nbuffers;i++)
+   {
+    free(buffers[i].data);
+    free(buffers[i].datap);
    }
 
- /* Perform an n-way merge using a binary heap */
+ free_buffers(buffers,nbuffers);
+}
 
- heap=(int*)malloc((1+nfiles)*sizeof(int));
 
- /* Fill the heap to start with */
+/*++++++++++++++++++++++++++++++++++++++
+  A function to sort the contents of a file of fixed length objects that are
+  ordered by an integer key using a limited amount of RAM.
 
- for(i=0;i<nfiles;i++)
-   {
-    int index;
+  This works in the same way as filesort_fixed() except that the individual sort
+  steps use an in-memory "Radix sort" http://en.wikipedia.org/wiki/Radix_sort
+  of the keys and the merge step uses a "Tree of losers"
+  http://en.wikipedia.org/wiki/K-way_merge_algorithm so that no comparison
+  function is called.  Items with equal keys stay in the order that they were in
+  the input file.
 
-    datap[i]=data+i*itemsize;
+  int fd_in The file descriptor of the input file (opened for buffered reading and at the beginning).
 
-    ReadFile(fds[i],datap[i],itemsize);
+  int fd_out The file descriptor of the output file (opened for buffered writing and empty).
 
-    index=i+1;
+  size_t itemsize The size of each item in the file that needs sorting.
 
-    heap[index]=i;
+  int nkeys The number of 32-bit words in the key (at most FILESORT_MAXKEY).
 
-    /* Bubble up the new value */
+  void (*getkey)(const void*,uint32_t*) The function to get the key for an item (most significant word first).
 
-    while(index>1)
-      {
-       int newindex;
-       int temp;
+  int (*buildindex)(void *,index_t) If non-NULL then this function is called for each item, if it
+                                    returns 1 then it is written to the output file.
+  ++++++++++++++++++++++++++++++++++++++*/
 
-       newindex=index/2;
+void filesort_fixed_keyed(int fd_in,int fd_out,size_t itemsize,int nkeys,void (*getkey)(const void*,uint32_t*),int (*buildindex)(void*,index_t))
+{
+ int *fds;
+ int nfiles=0;
+ index_t count=0,total=0;
+ int nbuffers=(option_filesort_threads>1)?option_filesort_threads:1;
+ size_t nitems=option_filesort_ramsize/nbuffers/(itemsize+2*sizeof(SortKey));
+ SortBuffer *buffers,*buffer;
+ void *data=NULL;
+ SortKey *keys=NULL;
+ int i,more=1;
 
-       if(compare(datap[heap[index]],datap[heap[newindex]])>=0)
-          break;
+ assert(nkeys>0 && nkeys<=FILESORT_MAXKEY);
 
-       temp=heap[index];
-       heap[index]=heap[newindex];
-       heap[newindex]=temp;
+ /* Allocate the RAM buffers and other bits */
 
-       index=newindex;
-      }
+ buffers=new_buffers(nbuffers,itemsize,NULL);
+
+ for(i=0;i<nbuffers;i++)
+   {
+    buffers[i].data=malloc(nitems*itemsize);
+    buffers[i].keys=(SortKey*)malloc(2*nitems*sizeof(SortKey));
+
+    assert(buffers[i].data && buffers[i].keys); /* Check malloc() worked */
+
+    buffers[i].tempkeys=buffers[i].keys+nitems;
+    buffers[i].nkeys=nkeys;
+    buffers[i].getkey=getkey;
    }
 
- /* Repeatedly pull out the root of the heap and refill from the same file */
+ filesort_nsorts++;
 
- ndata=nfiles;
+ /* Loop around, fill a buffer, sort the data and write a temporary file */
 
  do
    {
-    int index=1;
+    int n=0;
+
+    /* Wait until the buffer is no longer being sorted or written */
+
+    buffer=&buffers[nfiles%nbuffers];
+
+    finish_run(buffer);
 
-    if(!buildindex || buildindex(datap[heap[index]],count))
+    data=buffer->data;
+    keys=buffer->keys;
+
+    /* Read in the data and get the keys */
+
+    for(i=0;i<nitems;i++)
       {
-       WriteFile(fd_out,datap[heap[index]],itemsize);
-       count++;
+       if(ReadFileBuffered(fd_in,data+i*itemsize,itemsize))
+         {
+          more=0;
+          break;
+         }
+
+       getkey(data+i*itemsize,keys[i].key);
+       keys[i].index=i;
+
+       total++;
       }
 
-    if(ReadFile(fds[heap[index]],datap[heap[index]],itemsize))
+    n=i;
+
+    /* Shortcut if there is no data and no previous files (i.e. no data at all) */
+
+    if(nfiles==0 && n==0)
+       goto tidy_and_exit;
+
+    /* No new data read in this time round */
+
+    if(n==0)
+       break;
+
+    /* Shortcut if all read in and sorted at once */
+
+    if(nfiles==0 && !more)
       {
-       heap[index]=heap[ndata];
-       ndata--;
+       radix_sort_keys(keys,buffer->tempkeys,n,nkeys);
+
+       for(i=0;i<n;i++)
+         {
+          void *item=data+keys[i].index*itemsize;
+
+          if(!buildindex || buildindex(item,count))
+            {
+             WriteFileBuffered(fd_out,item,itemsize);
+             count++;
+            }
+         }
+
+       goto tidy_and_exit;
       }
 
-    /* Bubble down the new value */
+    /* Sort the data and write a temporary file (while the next buffer is filled) */
 
-    while((2*index)<ndata)
-      {
-       int newindex;
-       int temp;
+    buffer->n=n;
 
-       newindex=2*index;
+    sprintf(buffer->filename,"%s/filesort.%d.tmp",option_tmpdirname,nfiles);
 
-       if(compare(datap[heap[newindex]],datap[heap[newindex+1]])>=0)
-          newindex=newindex+1;
+    start_run(buffer,nbuffers);
 
-       if(compare(datap[heap[index]],datap[heap[newindex]])<=0)
-          break;
+    nfiles++;
+    filesort_nruns++;
+   }
+ while(more);
 
-       temp=heap[newindex];
-       heap[newindex]=heap[index];
-       heap[index]=temp;
+ for(i=0;i<nbuffers;i++)
+    finish_run(&buffers[i]);
 
-       index=newindex;
-      }
+ /* Shortcut if only one file (unlucky for us there must have been exactly
+    nitems, lucky for us we still have the data in RAM) */
 
-    if((2*index)==ndata)
-      {
-       int newindex;
-       int temp;
+ if(nfiles==1)
+   {
+    buffer=&buffers[0];
 
-       newindex=2*index;
+    for(i=0;i<buffer->n;i++)
+      {
+       void *item=buffer->data+buffer->keys[i].index*itemsize;
 
-       if(compare(datap[heap[index]],datap[heap[newindex]])<=0)
-          ; /* break */
-       else
+       if(!buildindex || buildindex(item,count))
          {
-          temp=heap[newindex];
-          heap[newindex]=heap[index];
-          heap[index]=temp;
+          WriteFileBuffered(fd_out,item,itemsize);
+          count++;
          }
       }
+
+    DeleteFile(buffer->filename);
+
+    goto tidy_and_exit;
    }
- while(ndata>0);
+
+ /* Merge the temporary files in several passes if there are too many to merge at once */
+
+ nfiles=cascade_runs(&buffers[0],nfiles,merge_fanin(itemsize+sizeof(SortKey),nitems-1));
+
+ /* Merge the remaining temporary files into the output file */
+
+ fds=open_runs(buffers[0].filename,0,nfiles);
+
+ merge_runs(&buffers[0],fds,nfiles,fd_out,0,buildindex,&count);
+
+ close_runs(fds,nfiles);
 
  /* Tidy up */
 
  tidy_and_exit:
 
- if(fds)
+ for(i=0;i<nbuffers;i++)
    {
-    for(i=0;i<nfiles;i++)
-       CloseFile(fds[i]);
-    free(fds);
+    free(buffers[i].data);
+    free(buffers[i].keys);
    }
 
- if(heap)
-    free(heap);
-
- free(data);
- free(datap);
- free(filename);
+ free_buffers(buffers,nbuffers);
 }
 
 
@@ -309,13 +506,15 @@ void filesort_fixed(int fd_in,int fd_out,size_t itemsize,int (*compare)(const vo
 
   The data is sorted using a "Merge sort" http://en.wikipedia.org/wiki/Merge_sort
   and in particular an "external sort" http://en.wikipedia.org/wiki/External_sorting.
-  The individual sort steps and the merge step both use a "Heap sort"
-  http://en.wikipedia.org/wiki/Heapsort.  The combination of the two should work well
-  if the data is already partially sorted.
+  The individual sort steps use an in-memory merge sort (several at once in
+  separate threads if '--sort-threads' is used) and the merge step uses a "Heap
+  sort" http://en.wikipedia.org/wiki/Heapsort (in several passes if there are
+  too many temporary files to merge at once).  Both steps are stable so items
+  that compare equal stay in the order that they were in the input file.
 
-  int fd_in The file descriptor of the input file (opened for reading and at the beginning).
+  int fd_in The file descriptor of the input file (opened for buffered reading and at the beginning).
 
-  int fd_out The file descriptor of the output file (opened for writing and empty).
+  int fd_out The file descriptor of the output file (opened for buffered writing and empty).
 
   int (*compare)(const void*, const void*) The comparison function (identical to qsort if the
                                            data to be sorted is an array of things not pointers).
@@ -326,35 +525,53 @@ void filesort_fixed(int fd_in,int fd_out,size_t itemsize,int (*compare)(const vo
 
 void filesort_vary(int fd_in,int fd_out,int (*compare)(const void*,const void*),int (*buildindex)(void*,index_t))
 {
- int *fds=NULL,*heap=NULL;
- int nfiles=0,ndata=0;
+ int *fds;
+ int nfiles=0;
  index_t count=0,total=0;
  FILESORT_VARINT nextitemsize,largestitemsize=0;
+ int nbuffers=(option_filesort_threads>1)?option_filesort_threads:1;
+ size_t ramsize=FILESORT_VARALIGN*(option_filesort_ramsize/nbuffers/FILESORT_VARALIGN);
+ SortBuffer *buffers,*buffer;
  void *data=NULL,**datap=NULL;
- char *filename;
  int i,more=1;
 
- /* Allocate the RAM buffer and other bits */
+ /* Allocate the RAM buffers and other bits */
+
+ buffers=new_buffers(nbuffers,0,compare);
+
+ for(i=0;i<nbuffers;i++)
+   {
+    buffers[i].data=malloc(ramsize);
+
+    assert(buffers[i].data); /* Check malloc() worked */
 
- data=malloc(option_filesort_ramsize);
+    buffers[i].size=ramsize;
+   }
 
- filename=(char*)malloc(strlen(option_tmpdirname)+24);
+ filesort_nsorts++;
 
- /* Loop around, fill the buffer, sort the data and write a temporary file */
+ /* Loop around, fill a buffer, sort the data and write a temporary file */
 
- if(ReadFile(fd_in,&nextitemsize,FILESORT_VARSIZE))    /* Always have the next item size known in advance */
+ if(ReadFileBuffered(fd_in,&nextitemsize,FILESORT_VARSIZE))    /* Always have the next item size known in advance */
     goto tidy_and_exit;
 
  do
    {
-    int fd,n=0;
+    int n=0;
     size_t ramused=FILESORT_VARALIGN-FILESORT_VARSIZE;
 
-    datap=data+option_filesort_ramsize;
+    /* Wait until the buffer is no longer being sorted or written */
 
-    /* Read in the data and create pointers */
+    buffer=&buffers[nfiles%nbuffers];
+
+    finish_run(buffer);
+
+    data=buffer->data;
+    datap=data+ramsize;
 
-    while((ramused+FILESORT_VARSIZE+nextitemsize)<=((void*)datap-sizeof(void*)-data))
+    /* Read in the data and create pointers (leaving space for the same number of temporary pointers) */
+
+    while((ramused+FILESORT_VARSIZE+nextitemsize)<=((void*)datap-(n+2)*sizeof(void*)-data))
       {
        FILESORT_VARINT itemsize=nextitemsize;
 
@@ -365,7 +582,7 @@ void filesort_vary(int fd_in,int fd_out,int (*compare)(const void*,const void*),
 
        ramused+=FILESORT_VARSIZE;
 
-       ReadFile(fd_in,data+ramused,itemsize);
+       ReadFileBuffered(fd_in,data+ramused,itemsize);
 
        *--datap=data+ramused; /* points to real data */
 
@@ -377,7 +594,7 @@ void filesort_vary(int fd_in,int fd_out,int (*compare)(const void*,const void*),
        total++;
        n++;
 
-       if(ReadFile(fd_in,&nextitemsize,FILESORT_VARSIZE))
+       if(ReadFileBuffered(fd_in,&nextitemsize,FILESORT_VARSIZE))
          {
           more=0;
           break;
@@ -389,21 +606,31 @@ void filesort_vary(int fd_in,int fd_out,int (*compare)(const void*,const void*),
     if(n==0)
        break;
 
-    /* Sort the data pointers using a heap sort */
+    /* Put the pointers into the same order as the data in the file (the sort is stable) */
+
+    for(i=0;i<n/2;i++)
+      {
+       void *temp=datap[i];
+       datap[i]=datap[n-1-i];
+       datap[n-1-i]=temp;
+      }
 
-    filesort_heapsort(datap,n,compare);
+    buffer->datap=datap;
+    buffer->temp=datap-n;
 
     /* Shortcut if all read in and sorted at once */
 
     if(nfiles==0 && !more)
       {
+       filesort_mergesort(datap,n,compare,buffer->temp);
+
        for(i=0;i<n;i++)
          {
           if(!buildindex || buildindex(datap[i],count))
             {
              FILESORT_VARINT itemsize=*(FILESORT_VARINT*)(datap[i]-FILESORT_VARSIZE);
 
-             WriteFile(fd_out,datap[i]-FILESORT_VARSIZE,itemsize+FILESORT_VARSIZE);
+             WriteFileBuffered(fd_out,datap[i]-FILESORT_VARSIZE,itemsize+FILESORT_VARSIZE);
              count++;
             }
          }
@@ -411,116 +638,435 @@ void filesort_vary(int fd_in,int fd_out,int (*compare)(const void*,const void*),
        goto tidy_and_exit;
       }
 
-    /* Create a temporary file and write the result */
-
-    sprintf(filename,"%s/filesort.%d.tmp",option_tmpdirname,nfiles);
+    /* Sort the data and write a temporary file (while the next buffer is filled) */
 
-    fd=OpenFileNew(filename);
-
-    for(i=0;i<n;i++)
-      {
-       FILESORT_VARINT itemsize=*(FILESORT_VARINT*)(datap[i]-FILESORT_VARSIZE);
+    buffer->n=n;
 
-       WriteFile(fd,datap[i]-FILESORT_VARSIZE,itemsize+FILESORT_VARSIZE);
-      }
+    sprintf(buffer->filename,"%s/filesort.%d.tmp",option_tmpdirname,nfiles);
 
-    CloseFile(fd);
+    start_run(buffer,nbuffers);
 
     nfiles++;
+    filesort_nruns++;
    }
  while(more);
 
- /* Check that number of files is less than file size */
+ for(i=0;i<nbuffers;i++)
+    finish_run(&buffers[i]);
+
+ /* Merge the temporary files in several passes if there are too many to merge at once */
 
  largestitemsize=FILESORT_VARALIGN*(1+(largestitemsize+FILESORT_VARALIGN-FILESORT_VARSIZE)/FILESORT_VARALIGN);
 
- assert(nfiles<((option_filesort_ramsize-nfiles*sizeof(void*))/largestitemsize));
+ buffers[0].largest=largestitemsize;
 
- /* Open all of the temporary files */
+ nfiles=cascade_runs(&buffers[0],nfiles,merge_fanin(largestitemsize+sizeof(void*),ramsize/(largestitemsize+sizeof(void*))-1));
 
- fds=(int*)malloc(nfiles*sizeof(int));
+ /* Merge the remaining temporary files into the output file */
 
- for(i=0;i<nfiles;i++)
-   {
-    sprintf(filename,"%s/filesort.%d.tmp",option_tmpdirname,i);
+ fds=open_runs(buffers[0].filename,0,nfiles);
 
-    fds[i]=ReOpenFile(filename);
+ merge_runs(&buffers[0],fds,nfiles,fd_out,0,buildindex,&count);
 
-    DeleteFile(filename);
-   }
+ close_runs(fds,nfiles);
 
- /* Perform an n-way merge using a binary heap */
+ /* Tidy up */
 
- heap=(int*)malloc((1+nfiles)*sizeof(int));
+ tidy_and_exit:
 
- datap=data+option_filesort_ramsize-nfiles*sizeof(void*);
+ for(i=0;i<nbuffers;i++)
+    free(buffers[i].data);
 
- /* Fill the heap to start with */
+ free_buffers(buffers,nbuffers);
+}
 
- for(i=0;i<nfiles;i++)
-   {
-    int index;
-    FILESORT_VARINT itemsize;
 
-    datap[i]=data+FILESORT_VARALIGN-FILESORT_VARSIZE+i*largestitemsize;
+/*++++++++++++++++++++++++++++++++++++++
+  A function to sort an array of pointers efficiently.
 
-    ReadFile(fds[i],&itemsize,FILESORT_VARSIZE);
+  The data is sorted using a "Merge sort" http://en.wikipedia.org/wiki/Merge_sort
+  that starts with an insertion sort of small groups of items.  It is stable
+  (items that compare equal keep their original order) and uses fewer
+  comparisons than a heap sort, but needs a second array of pointers.
 
-    *(FILESORT_VARINT*)(datap[i]-FILESORT_VARSIZE)=itemsize;
+  void **datap A pointer to the array of pointers to sort.
 
-    ReadFile(fds[i],datap[i],itemsize);
+  size_t nitems The number of items of data to sort.
 
-    index=i+1;
+  int(*compare)(const void *, const void *) The comparison function (identical to qsort if the
+                                            data to be sorted was an array of things not pointers).
 
-    heap[index]=i;
+  void **temp A pointer to an array of pointers the same size as the one being sorted.
+  ++++++++++++++++++++++++++++++++++++++*/
 
-    /* Bubble up the new value */
+void filesort_mergesort(void **datap,size_t nitems,int(*compare)(const void*, const void*),void **temp)
+{
+ void **from=datap,**to=temp;
+ size_t i,width;
 
-    while(index>1)
-      {
-       int newindex;
-       int temp;
+ /* Sort small groups of items using an insertion sort */
 
-       newindex=index/2;
+ for(i=0;i<nitems;i+=FILESORT_INSERTION)
+   {
+    size_t end=(i+FILESORT_INSERTION)<nitems?(i+FILESORT_INSERTION):nitems;
+    size_t j;
 
-       if(compare(datap[heap[index]],datap[heap[newindex]])>=0)
-          break;
+    for(j=i+1;j<end;j++)
+      {
+       void *item=datap[j];
+       size_t k=j;
 
-       temp=heap[index];
-       heap[index]=heap[newindex];
-       heap[newindex]=temp;
+       while(k>i && compare(datap[k-1],item)>0)
+         {
+          datap[k]=datap[k-1];
+          k--;
+         }
 
-       index=newindex;
+       datap[k]=item;
       }
    }
 
- /* Repeatedly pull out the root of the heap and refill from the same file */
-
- ndata=nfiles;
+ /* Merge pairs of sorted groups, swapping between the two arrays */
 
- do
+ for(width=FILESORT_INSERTION;width<nitems;width*=2)
    {
-    int index=1;
-    FILESORT_VARINT itemsize;
+    void **swap;
 
-    if(!buildindex || buildindex(datap[heap[index]],count))
+    for(i=0;i<nitems;i+=2*width)
       {
-       itemsize=*(FILESORT_VARINT*)(datap[heap[index]]-FILESORT_VARSIZE);
+       size_t mid=(i+width)<nitems?(i+width):nitems;
+       size_t end=(i+2*width)<nitems?(i+2*width):nitems;
+       size_t a=i,b=mid,k=i;
 
-       WriteFile(fd_out,datap[heap[index]]-FILESORT_VARSIZE,itemsize+FILESORT_VARSIZE);
-       count++;
-      }
+       while(a<mid && b<end)
+         {
+          if(compare(from[a],from[b])<=0)
+             to[k++]=from[a++];
+          else
+             to[k++]=from[b++];
+         }
 
-    if(ReadFile(fds[heap[index]],&itemsize,FILESORT_VARSIZE))
-      {
-       heap[index]=heap[ndata];
-       ndata--;
+       while(a<mid)
+          to[k++]=from[a++];
+
+       while(b<end)
+          to[k++]=from[b++];
       }
-    else
+
+    swap=from;
+    from=to;
+    to=swap;
+   }
+
+ if(from!=datap)
+    memcpy(datap,from,nitems*sizeof(void*));
+}
+
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Work out how many temporary files to merge at once.  This is limited by the
+  amount of RAM (each file needs space for an item and two file buffers), the
+  space for items in the sort buffer and the number of files that can be open.
+
+  int merge_fanin Returns the number of files to merge at once.
+
+  size_t slotsize The amount of memory needed for one item from each file.
+
+  size_t maxslots The number of items that will fit into the sort buffer.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int merge_fanin(size_t slotsize,size_t maxslots)
+{
+ struct rlimit limit;
+ size_t fanin;
+
+ if(option_filesort_fanin>0)
+    fanin=option_filesort_fanin;
+ else
+    fanin=option_filesort_ramsize/(slotsize+2*FILEBUFFER_SIZE);
+
+ if(!getrlimit(RLIMIT_NOFILE,&limit) && limit.rlim_cur!=RLIM_INFINITY)
+   {
+    if(limit.rlim_cur<(FILESORT_RESERVED_FILES+2))
+       fanin=2;
+    else if(fanin>(limit.rlim_cur-FILESORT_RESERVED_FILES))
+       fanin=limit.rlim_cur-FILESORT_RESERVED_FILES;
+   }
+
+ if(fanin>maxslots)
+    fanin=maxslots;
+
+ if(fanin<2)
+    fanin=2;
+
+ return(fanin);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Merge groups of temporary files into new (larger) temporary files until there
+  are few enough to merge at once.  The groups are made from consecutive files
+  so that the merge stays stable.
+
+  int cascade_runs Returns the new number of temporary files.
+
+  SortBuffer *buffer The buffer to use for merging.
+
+  int nfiles The number of temporary files.
+
+  int fanin The number of files to merge at once.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int cascade_runs(SortBuffer *buffer,int nfiles,int fanin)
+{
+ char *newfilename;
+
+ newfilename=(char*)malloc(FILESORT_FILENAME_LENGTH);
+
+ assert(newfilename); /* Check malloc() worked */
+
+ while(nfiles>fanin)
+   {
+    int first,nnewfiles=0;
+
+    for(first=0;first<nfiles;first+=fanin)
       {
-       *(FILESORT_VARINT*)(datap[heap[index]]-FILESORT_VARSIZE)=itemsize;
+       int n=(nfiles-first)<fanin?(nfiles-first):fanin;
+
+       sprintf(newfilename,"%s/filesort.%d.tmp",option_tmpdirname,nnewfiles);
+
+       if(n==1)
+         {
+          sprintf(buffer->filename,"%s/filesort.%d.tmp",option_tmpdirname,first);
+
+          rename(buffer->filename,newfilename);
+         }
+       else
+         {
+          int *fds,fd;
+          index_t count=0;
+
+          /* The input files are deleted when opened so the new file can re-use one of the names */
+
+          fds=open_runs(buffer->filename,first,n);
+
+          fd=OpenFileBufferedNew(newfilename);
+
+          merge_runs(buffer,fds,n,fd,1,NULL,&count);
+
+          CloseFileBuffered(fd);
+
+          close_runs(fds,n);
+         }
+
+       nnewfiles++;
+      }
+
+    nfiles=nnewfiles;
+
+    filesort_npasses++;
+   }
+
+ free(newfilename);
+
+ return(nfiles);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Open a set of consecutive temporary files (and delete them), starting to read ahead from each one.
+
+  int *open_runs Returns an allocated array of file descriptors.
+
+  char *filename The space to use for the file names.
+
+  int first The number of the first file.
+
+  int nfiles The number of files.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int *open_runs(char *filename,int first,int nfiles)
+{
+ int *fds;
+ int i;
+
+ fds=(int*)malloc(nfiles*sizeof(int));
+
+ assert(fds); /* Check malloc() worked */
+
+ for(i=0;i<nfiles;i++)
+   {
+    sprintf(filename,"%s/filesort.%d.tmp",option_tmpdirname,first+i);
+
+    fds[i]=ReOpenFileBuffered(filename);
+
+    DeleteFile(filename);
+
+    AsyncFileBuffered(fds[i]);
+   }
+
+ return(fds);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Close a set of temporary files opened by open_runs().
+
+  int *fds The array of file descriptors (freed).
+
+  int nfiles The number of files.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void close_runs(int *fds,int nfiles)
+{
+ int i;
+
+ for(i=0;i<nfiles;i++)
+    CloseFileBuffered(fds[i]);
+
+ free(fds);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Merge a set of temporary files into an output file (written in the background).
+
+  SortBuffer *buffer The buffer to use for merging (the type of sort is taken from this).
+
+  int *fds The file descriptors of the temporary files.
+
+  int nfiles The number of temporary files.
+
+  int fd_out The file descriptor of the output file.
+
+  int run Set to true if the output file is another temporary file.
+
+  int (*buildindex)(void *,index_t) If non-NULL then this function is called for each item, if it
+                                    returns 1 then it is written to the output file.
+
+  index_t *count The number of items written to the output file (updated).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void merge_runs(SortBuffer *buffer,int *fds,int nfiles,int fd_out,int run,int (*buildindex)(void*,index_t),index_t *count)
+{
+ AsyncFileBuffered(fd_out);
+
+ if(buffer->getkey)
+    merge_keyed(buffer,fds,nfiles,fd_out,run,buildindex,count);
+ else if(buffer->itemsize)
+    merge_fixed(buffer,fds,nfiles,fd_out,run,buildindex,count);
+ else
+    merge_vary(buffer,fds,nfiles,fd_out,buildindex,count);
+
+ SyncFileBuffered(fd_out);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Merge temporary files of fixed length items using a binary heap.
+
+  SortBuffer *buffer The buffer to use for merging.
+
+  int *fds The file descriptors of the temporary files.
+
+  int nfiles The number of temporary files.
+
+  int fd_out The file descriptor of the output file.
+
+  int run Set to true if the output file is another temporary file (compressed if they are being compressed).
+
+  int (*buildindex)(void *,index_t) The function to call for each item (or NULL).
+
+  index_t *count The number of items written to the output file (updated).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void merge_fixed(SortBuffer *buffer,int *fds,int nfiles,int fd_out,int run,int (*buildindex)(void*,index_t),index_t *count)
+{
+ int (*compare)(const void*,const void*)=buffer->compare;
+ size_t itemsize=buffer->itemsize;
+ void *data,**datap;
+ void *prev=NULL,*outprev=NULL;
+ int *heap;
+ int i,ndata;
+
+ /* The previous item from each file and for the output file if the temporary files are compressed */
+
+ if(option_filesort_compress)
+   {
+    prev=calloc(nfiles,itemsize);
+
+    assert(prev); /* Check calloc() worked */
+
+    if(run)
+      {
+       outprev=calloc(1,itemsize);
+
+       assert(outprev); /* Check calloc() worked */
+      }
+   }
+
+ /* Perform an n-way merge using a binary heap */
+
+ heap=(int*)malloc((1+nfiles)*sizeof(int));
+
+ assert(heap); /* Check malloc() worked */
+
+ data=buffer->data;
+ datap=buffer->datap;
+
+ /* Fill the heap to start with */
+
+ for(i=0;i<nfiles;i++)
+   {
+    int index;
+
+    datap[i]=data+i*itemsize;
+
+    read_run_item(fds[i],datap[i],prev?prev+i*itemsize:NULL,itemsize);
+
+    index=i+1;
+
+    heap[index]=i;
+
+    /* Bubble up the new value */
+
+    while(index>1)
+      {
+       int newindex;
+       int temp;
+
+       newindex=index/2;
+
+       if(compare_runs(compare,datap,heap[index],heap[newindex])>=0)
+          break;
+
+       temp=heap[index];
+       heap[index]=heap[newindex];
+       heap[newindex]=temp;
+
+       index=newindex;
+      }
+   }
 
-       ReadFile(fds[heap[index]],datap[heap[index]],itemsize);
+ /* Repeatedly pull out the root of the heap and refill from the same file */
+
+ ndata=nfiles;
+
+ do
+   {
+    int index=1;
+
+    if(!buildindex || buildindex(datap[heap[index]],*count))
+      {
+       write_run_item(fd_out,datap[heap[index]],outprev,itemsize);
+       (*count)++;
+      }
+
+    if(read_run_item(fds[heap[index]],datap[heap[index]],prev?prev+heap[index]*itemsize:NULL,itemsize))
+      {
+       heap[index]=heap[ndata];
+       ndata--;
       }
 
     /* Bubble down the new value */
@@ -532,10 +1078,10 @@ void filesort_vary(int fd_in,int fd_out,int (*compare)(const void*,const void*),
 
        newindex=2*index;
 
-       if(compare(datap[heap[newindex]],datap[heap[newindex+1]])>=0)
+       if(compare_runs(compare,datap,heap[newindex],heap[newindex+1])>=0)
           newindex=newindex+1;
 
-       if(compare(datap[heap[index]],datap[heap[newindex]])<=0)
+       if(compare_runs(compare,datap,heap[index],heap[newindex])<=0)
           break;
 
        temp=heap[newindex];
@@ -552,7 +1098,7 @@ void filesort_vary(int fd_in,int fd_out,int (*compare)(const void*,const void*),
 
        newindex=2*index;
 
-       if(compare(datap[heap[index]],datap[heap[newindex]])<=0)
+       if(compare_runs(compare,datap,heap[index],heap[newindex])<=0)
           ; /* break */
        else
          {
@@ -564,119 +1110,680 @@ void filesort_vary(int fd_in,int fd_out,int (*compare)(const void*,const void*),
    }
  while(ndata>0);
 
- /* Tidy up */
+ free(heap);
 
- tidy_and_exit:
+ if(prev)
+    free(prev);
+ if(outprev)
+    free(outprev);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Merge temporary files of fixed length items with integer keys using a tree of losers.
+
+  SortBuffer *buffer The buffer to use for merging.
+
+  int *fds The file descriptors of the temporary files.
+
+  int nfiles The number of temporary files.
+
+  int fd_out The file descriptor of the output file.
+
+  int run Set to true if the output file is another temporary file (compressed if they are being compressed).
+
+  int (*buildindex)(void *,index_t) The function to call for each item (or NULL).
+
+  index_t *count The number of items written to the output file (updated).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void merge_keyed(SortBuffer *buffer,int *fds,int nfiles,int fd_out,int run,int (*buildindex)(void*,index_t),index_t *count)
+{
+ void (*getkey)(const void*,uint32_t*)=buffer->getkey;
+ size_t itemsize=buffer->itemsize;
+ int nkeys=buffer->nkeys;
+ void *data;
+ void *prev=NULL,*outprev=NULL;
+ SortKey *keys;
+ int *tree;
+ int i;
+
+ /* The previous item from each file and for the output file if the temporary files are compressed */
 
- if(fds)
+ if(option_filesort_compress)
    {
-    for(i=0;i<nfiles;i++)
-       CloseFile(fds[i]);
-    free(fds);
+    prev=calloc(nfiles,itemsize);
+
+    assert(prev); /* Check calloc() worked */
+
+    if(run)
+      {
+       outprev=calloc(1,itemsize);
+
+       assert(outprev); /* Check calloc() worked */
+      }
+   }
+
+ /* Perform an n-way merge using a tree of losers */
+
+ tree=(int*)calloc(nfiles,sizeof(int));
+
+ assert(tree); /* Check calloc() worked */
+
+ data=buffer->data;
+ keys=buffer->keys;
+
+ /* Read the first item from each file and fill the tree to start with */
+
+ for(i=0;i<nfiles;i++)
+   {
+    read_run_item(fds[i],data+i*itemsize,prev?prev+i*itemsize:NULL,itemsize);
+
+    getkey(data+i*itemsize,keys[i].key);
+    keys[i].index=i;
+
+    tree[i]=nfiles;
    }
 
- if(heap)
-    free(heap);
+ for(i=nfiles-1;i>=0;i--)
+    replay_tree(tree,keys,nkeys,nfiles,i);
 
- free(data);
- free(filename);
+ /* Repeatedly write out the winner and refill from the same file */
+
+ while(keys[tree[0]].index!=FILESORT_FINISHED)
+   {
+    int winner=tree[0];
+    void *item=data+winner*itemsize;
+
+    if(!buildindex || buildindex(item,*count))
+      {
+       write_run_item(fd_out,item,outprev,itemsize);
+       (*count)++;
+      }
+
+    if(read_run_item(fds[winner],item,prev?prev+winner*itemsize:NULL,itemsize))
+       keys[winner].index=FILESORT_FINISHED;
+    else
+       getkey(item,keys[winner].key);
+
+    replay_tree(tree,keys,nkeys,nfiles,winner);
+   }
+
+ free(tree);
+
+ if(prev)
+    free(prev);
+ if(outprev)
+    free(outprev);
 }
 
 
 /*++++++++++++++++++++++++++++++++++++++
-  A function to sort an array of pointers efficiently.
+  Merge temporary files of variable length items using a binary heap.
 
-  The data is sorted using a "Heap sort" http://en.wikipedia.org/wiki/Heapsort,
-  in particular, this is good because it can operate in-place and doesn't
-  allocate more memory like using qsort() does.
+  SortBuffer *buffer The buffer to use for merging.
 
-  void **datap A pointer to the array of pointers to sort.
+  int *fds The file descriptors of the temporary files.
 
-  size_t nitems The number of items of data to sort.
+  int nfiles The number of temporary files.
 
-  int(*compare)(const void *, const void *) The comparison function (identical to qsort if the
-                                            data to be sorted was an array of things not pointers).
+  int fd_out The file descriptor of the output file.
+
+  int (*buildindex)(void *,index_t) The function to call for each item (or NULL).
+
+  index_t *count The number of items written to the output file (updated).
   ++++++++++++++++++++++++++++++++++++++*/
 
-void filesort_heapsort(void **datap,size_t nitems,int(*compare)(const void*, const void*))
+static void merge_vary(SortBuffer *buffer,int *fds,int nfiles,int fd_out,int (*buildindex)(void*,index_t),index_t *count)
 {
- void **datap1=&datap[-1];
- int i;
+ int (*compare)(const void*,const void*)=buffer->compare;
+ void *data,**datap;
+ int *heap;
+ int i,ndata;
+
+ /* Perform an n-way merge using a binary heap */
+
+ heap=(int*)malloc((1+nfiles)*sizeof(int));
+
+ assert(heap); /* Check malloc() worked */
 
- /* Fill the heap by pretending to insert the data that is already there */
+ data=buffer->data;
+ datap=data+buffer->size-nfiles*sizeof(void*);
 
- for(i=2;i<=nitems;i++)
+ /* Fill the heap to start with */
+
+ for(i=0;i<nfiles;i++)
    {
-    int index=i;
+    int index;
+    FILESORT_VARINT itemsize;
+
+    datap[i]=data+FILESORT_VARALIGN-FILESORT_VARSIZE+i*buffer->largest;
 
-    /* Bubble up the new value (upside-down, put largest at top) */
+    ReadFileBuffered(fds[i],&itemsize,FILESORT_VARSIZE);
+
+    *(FILESORT_VARINT*)(datap[i]-FILESORT_VARSIZE)=itemsize;
+
+    ReadFileBuffered(fds[i],datap[i],itemsize);
+
+    index=i+1;
+
+    heap[index]=i;
+
+    /* Bubble up the new value */
 
     while(index>1)
       {
        int newindex;
-       void *temp;
+       int temp;
 
        newindex=index/2;
 
-       if(compare(datap1[index],datap1[newindex])<=0) /* reversed compared to filesort_fixed() above */
+       if(compare_runs(compare,datap,heap[index],heap[newindex])>=0)
           break;
 
-       temp=datap1[index];
-       datap1[index]=datap1[newindex];
-       datap1[newindex]=temp;
+       temp=heap[index];
+       heap[index]=heap[newindex];
+       heap[newindex]=temp;
 
        index=newindex;
       }
    }
 
- /* Repeatedly pull out the root of the heap and swap with the bottom item */
+ /* Repeatedly pull out the root of the heap and refill from the same file */
+
+ ndata=nfiles;
 
- for(i=nitems;i>1;i--)
+ do
    {
     int index=1;
-    void *temp;
+    FILESORT_VARINT itemsize;
+
+    if(!buildindex || buildindex(datap[heap[index]],*count))
+      {
+       itemsize=*(FILESORT_VARINT*)(datap[heap[index]]-FILESORT_VARSIZE);
+
+       WriteFileBuffered(fd_out,datap[heap[index]]-FILESORT_VARSIZE,itemsize+FILESORT_VARSIZE);
+       (*count)++;
+      }
+
+    if(ReadFileBuffered(fds[heap[index]],&itemsize,FILESORT_VARSIZE))
+      {
+       heap[index]=heap[ndata];
+       ndata--;
+      }
+    else
+      {
+       *(FILESORT_VARINT*)(datap[heap[index]]-FILESORT_VARSIZE)=itemsize;
 
-    temp=datap1[index];
-    datap1[index]=datap1[i];
-    datap1[i]=temp;
+       ReadFileBuffered(fds[heap[index]],datap[heap[index]],itemsize);
+      }
 
-    /* Bubble down the new value (upside-down, put largest at top) */
+    /* Bubble down the new value */
 
-    while((2*index)<(i-1))
+    while((2*index)<ndata)
       {
        int newindex;
-       void *temp;
+       int temp;
 
        newindex=2*index;
 
-       if(compare(datap1[newindex],datap1[newindex+1])<=0) /* reversed compared to filesort_fixed() above */
+       if(compare_runs(compare,datap,heap[newindex],heap[newindex+1])>=0)
           newindex=newindex+1;
 
-       if(compare(datap1[index],datap1[newindex])>=0) /* reversed compared to filesort_fixed() above */
+       if(compare_runs(compare,datap,heap[index],heap[newindex])<=0)
           break;
 
-       temp=datap1[newindex];
-       datap1[newindex]=datap1[index];
-       datap1[index]=temp;
+       temp=heap[newindex];
+       heap[newindex]=heap[index];
+       heap[index]=temp;
 
        index=newindex;
       }
 
-    if((2*index)==(i-1))
+    if((2*index)==ndata)
       {
        int newindex;
-       void *temp;
+       int temp;
 
        newindex=2*index;
 
-       if(compare(datap1[index],datap1[newindex])>=0) /* reversed compared to filesort_fixed() above */
+       if(compare_runs(compare,datap,heap[index],heap[newindex])<=0)
           ; /* break */
        else
          {
-          temp=datap1[newindex];
-          datap1[newindex]=datap1[index];
-          datap1[index]=temp;
+          temp=heap[newindex];
+          heap[newindex]=heap[index];
+          heap[index]=temp;
          }
       }
    }
+ while(ndata>0);
+
+ free(heap);
+}
+
+/*++++++++++++++++++++++++++++++++++++++
+  Allocate the buffers used for sorting (except for the data and pointers themselves).
+
+  SortBuffer *new_buffers Returns the array of buffers.
+
+  int nbuffers The number of buffers.
+
+  size_t itemsize The size of each item (or 0 for variable length items).
+
+  int (*compare)(const void*, const void*) The comparison function.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static SortBuffer *new_buffers(int nbuffers,size_t itemsize,int (*compare)(const void*,const void*))
+{
+ SortBuffer *buffers;
+ int i;
+
+ buffers=(SortBuffer*)calloc(nbuffers,sizeof(SortBuffer));
+
+ assert(buffers); /* Check calloc() worked */
+
+ for(i=0;i<nbuffers;i++)
+   {
+    buffers[i].itemsize=itemsize;
+    buffers[i].compare=compare;
+
+    buffers[i].filename=(char*)malloc(FILESORT_FILENAME_LENGTH);
+
+    assert(buffers[i].filename); /* Check malloc() worked */
+   }
+
+ return(buffers);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Free the buffers used for sorting (except for the data and pointers themselves).
+
+  SortBuffer *buffers The array of buffers.
+
+  int nbuffers The number of buffers.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void free_buffers(SortBuffer *buffers,int nbuffers)
+{
+ int i;
+
+ for(i=0;i<nbuffers;i++)
+   {
+    finish_run(&buffers[i]);
+
+    free(buffers[i].filename);
+   }
+
+ free(buffers);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Sort the data in a buffer and write it to a temporary file, in a new thread
+  if there is more than one buffer.
+
+  SortBuffer *buffer The buffer to sort and write.
+
+  int nbuffers The number of buffers.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void start_run(SortBuffer *buffer,int nbuffers)
+{
+ if(nbuffers>1 && !pthread_create(&buffer->thread,NULL,sort_and_write_run,buffer))
+    buffer->running=1;
+ else
+    sort_and_write_run(buffer);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Wait for the thread sorting and writing a buffer to finish (if there is one).
+
+  SortBuffer *buffer The buffer to wait for.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void finish_run(SortBuffer *buffer)
+{
+ if(buffer->running)
+   {
+    pthread_join(buffer->thread,NULL);
+
+    buffer->running=0;
+   }
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Sort the data in a buffer and write it to a temporary file.
+
+  void *sort_and_write_run Returns NULL (required for a thread function).
+
+  void *arg The buffer to sort and write.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void *sort_and_write_run(void *arg)
+{
+ SortBuffer *buffer=(SortBuffer*)arg;
+ void *prev=NULL;
+ size_t i;
+ int fd;
+
+ /* Sort the keys using a radix sort or the data pointers using a merge sort */
+
+ if(buffer->getkey)
+    radix_sort_keys(buffer->keys,buffer->tempkeys,buffer->n,buffer->nkeys);
+ else
+    filesort_mergesort(buffer->datap,buffer->n,buffer->compare,buffer->temp);
+
+ /* Create a temporary file and write the result */
+
+ fd=OpenFileBufferedNew(buffer->filename);
+
+ if(buffer->itemsize && option_filesort_compress)
+   {
+    prev=calloc(1,buffer->itemsize);
+
+    assert(prev); /* Check calloc() worked */
+   }
+
+ if(buffer->getkey)
+    for(i=0;i<buffer->n;i++)
+       write_run_item(fd,buffer->data+buffer->keys[i].index*buffer->itemsize,prev,buffer->itemsize);
+ else if(buffer->itemsize)
+    for(i=0;i<buffer->n;i++)
+       write_run_item(fd,buffer->datap[i],prev,buffer->itemsize);
+ else
+    for(i=0;i<buffer->n;i++)
+      {
+       FILESORT_VARINT itemsize=*(FILESORT_VARINT*)(buffer->datap[i]-FILESORT_VARSIZE);
+
+       WriteFileBuffered(fd,buffer->datap[i]-FILESORT_VARSIZE,itemsize+FILESORT_VARSIZE);
+      }
+
+ CloseFileBuffered(fd);
+
+ if(prev)
+    free(prev);
+
+ return(NULL);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Compare the current items from two of the temporary files when merging them
+  (if they are equal the one from the earlier file comes first to keep the sort stable).
+
+  int compare_runs Returns the comparison of the items.
+
+  int (*compare)(const void*, const void*) The comparison function.
+
+  void **datap The current item from each file.
+
+  int a The first file.
+
+  int b The second file.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static inline int compare_runs(int (*compare)(const void*,const void*),void **datap,int a,int b)
+{
+ int result=compare(datap[a],datap[b]);
+
+ if(result==0)
+    result=a-b;
+
+ return(result);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Write a fixed length item to a temporary file, compressed if a previous item
+  is given.  Each 32-bit word is stored as the difference from the same word of
+  the previous item, zig-zag encoded into a variable length integer (7 bits per
+  byte); any remaining bytes are stored unchanged.
+
+  int write_run_item Returns 0 if OK or something else in case of an error.
+
+  int fd The file descriptor of the temporary file.
+
+  const void *item The item to write.
+
+  void *prev The previous item written to the file (updated) or NULL to write the item uncompressed.
+
+  size_t itemsize The size of the item.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int write_run_item(int fd,const void *item,void *prev,size_t itemsize)
+{
+ unsigned char bytes[64];
+ size_t i,n=0;
+
+ if(!prev)
+    return(WriteFileBuffered(fd,item,itemsize));
+
+ for(i=0;(i+4)<=itemsize;i+=4)
+   {
+    uint32_t word,prevword,diff,zigzag;
+
+    memcpy(&word,(const char*)item+i,4);
+    memcpy(&prevword,(char*)prev+i,4);
+
+    diff=word-prevword;
+    zigzag=(diff<<1)^((diff&0x80000000)?0xffffffff:0);
+
+    while(zigzag>=0x80)
+      {
+       bytes[n++]=(zigzag&0x7f)|0x80;
+       zigzag>>=7;
+      }
+
+    bytes[n++]=zigzag;
+
+    if(n>(sizeof(bytes)-5))
+      {
+       if(WriteFileBuffered(fd,bytes,n))
+          return(-1);
+       n=0;
+      }
+   }
+
+ for(;i<itemsize;i++)
+    bytes[n++]=((const unsigned char*)item)[i];
+
+ memcpy(prev,item,itemsize);
+
+ return(WriteFileBuffered(fd,bytes,n));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Read a fixed length item from a temporary file that was written using write_run_item().
+
+  int read_run_item Returns 0 if OK or something else in case of an error (or the end of the file).
+
+  int fd The file descriptor of the temporary file.
+
+  void *item The item to read into.
+
+  void *prev The previous item read from the file (updated) or NULL to read the item uncompressed.
+
+  size_t itemsize The size of the item.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int read_run_item(int fd,void *item,void *prev,size_t itemsize)
+{
+ size_t i;
+
+ if(!prev)
+    return(ReadFileBuffered(fd,item,itemsize));
+
+ for(i=0;(i+4)<=itemsize;i+=4)
+   {
+    uint32_t word,zigzag=0;
+    unsigned char byte;
+    int shift=0;
+
+    do
+      {
+       if(ReadFileBuffered(fd,&byte,1))
+          return(-1);
+
+       zigzag|=(uint32_t)(byte&0x7f)<<shift;
+       shift+=7;
+      }
+    while(byte&0x80);
+
+    memcpy(&word,(char*)prev+i,4);
+
+    word+=(zigzag>>1)^(-(zigzag&1));
+
+    memcpy((char*)item+i,&word,4);
+   }
+
+ if(i<itemsize)
+    if(ReadFileBuffered(fd,(char*)item+i,itemsize-i))
+       return(-1);
+
+ memcpy(prev,item,itemsize);
+
+ return(0);
+}
+
+/*++++++++++++++++++++++++++++++++++++++
+  Sort an array of keys using a (least significant digit first) radix sort
+  with 8-bit digits.  The sort is stable and passes for digits that are the
+  same for all of the keys are skipped.
+
+  SortKey *keys The array of keys to sort.
+
+  SortKey *temp A temporary array of keys the same size as the one being sorted.
+
+  size_t n The number of keys.
+
+  int nkeys The number of words in each key.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void radix_sort_keys(SortKey *keys,SortKey *temp,size_t n,int nkeys)
+{
+ size_t counts[4*FILESORT_MAXKEY][256];
+ SortKey *from=keys,*to=temp;
+ int npasses=4*nkeys;
+ int pass;
+ size_t i;
+
+ if(n==0)
+    return;
+
+ /* Count the digits for all of the passes at once */
+
+ memset(counts,0,sizeof(counts));
+
+ for(i=0;i<n;i++)
+    for(pass=0;pass<npasses;pass++)
+       counts[pass][(keys[i].key[nkeys-1-pass/4]>>(8*(pass%4)))&0xff]++;
+
+ /* Sort by each digit in turn starting with the least significant */
+
+ for(pass=0;pass<npasses;pass++)
+   {
+    int word=nkeys-1-pass/4,shift=8*(pass%4);
+    size_t offset=0;
+    SortKey *swap;
+    int d;
+
+    if(counts[pass][(from[0].key[word]>>shift)&0xff]==n)
+       continue;
+
+    for(d=0;d<256;d++)
+      {
+       size_t count=counts[pass][d];
+       counts[pass][d]=offset;
+       offset+=count;
+      }
+
+    for(i=0;i<n;i++)
+       to[counts[pass][(from[i].key[word]>>shift)&0xff]++]=from[i];
+
+    swap=from;
+    from=to;
+    to=swap;
+   }
+
+ if(from!=keys)
+    memcpy(keys,from,n*sizeof(SortKey));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Replay the matches in a tree of losers after a new item has been read from one of the temporary files.
+
+  int *tree The tree of losers (the overall winner in element 0).
+
+  SortKey *runkeys The key of the current item from each file.
+
+  int nkeys The number of words in each key.
+
+  int nfiles The number of files (and the virtual file that beats all others while filling the tree).
+
+  int s The file that has a new item.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void replay_tree(int *tree,SortKey *runkeys,int nkeys,int nfiles,int s)
+{
+ int t=(s+nfiles)/2;
+
+ while(t>0)
+   {
+    if(key_wins(runkeys,nkeys,nfiles,tree[t],s))
+      {
+       int temp=tree[t];
+       tree[t]=s;
+       s=temp;
+      }
+
+    t/=2;
+   }
+
+ tree[0]=s;
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Decide whether the current item from one temporary file comes before the one
+  from another (if the keys are equal the one from the earlier file wins to keep
+  the sort stable).
+
+  int key_wins Returns true if the first file wins.
+
+  SortKey *runkeys The key of the current item from each file.
+
+  int nkeys The number of words in each key.
+
+  int nfiles The number of files (and the virtual file that beats all others).
+
+  int a The first file.
+
+  int b The second file.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static inline int key_wins(SortKey *runkeys,int nkeys,int nfiles,int a,int b)
+{
+ int i;
+
+ if(a==nfiles)
+    return(1);
+ if(b==nfiles)
+    return(0);
+
+ if(runkeys[a].index==FILESORT_FINISHED)
+    return(0);
+ if(runkeys[b].index==FILESORT_FINISHED)
+    return(1);
+
+ for(i=0;i<nkeys;i++)
+    if(runkeys[a].key[i]!=runkeys[b].key[i])
+       return(runkeys[a].key[i]<runkeys[b].key[i]);
+
+ return(a<b);
 }
@@ -24,10 +24,18 @@
 #define SORTING_H    /*+ To stop multiple inclusions. +*/
 
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "types.h"
 
 
+/* Variables in sorting.c */
+
+extern index_t filesort_nsorts;
+extern index_t filesort_nruns;
+extern index_t filesort_npasses;
+
+
 /* Functions in sorting.c */
 
 /*+ The type, size and alignment of variable to store the variable length +*/
@@ -35,11 +43,16 @@
 #define FILESORT_VARSIZE  sizeof(FILESORT_VARINT)
 #define FILESORT_VARALIGN sizeof(void*)
 
+/*+ The largest number of 32-bit words in the key for filesort_fixed_keyed(). +*/
+#define FILESORT_MAXKEY   3
+
 void filesort_fixed(int fd_in,int fd_out,size_t itemsize,int (*compare)(const void*,const void*),int (*buildindex)(void*,index_t));
 
+void filesort_fixed_keyed(int fd_in,int fd_out,size_t itemsize,int nkeys,void (*getkey)(const void*,uint32_t*),int (*buildindex)(void*,index_t));
+
 void filesort_vary(int fd_in,int fd_out,int (*compare)(const void*,const void*),int (*buildindex)(void*,index_t));
 
-void filesort_heapsort(void **datap,size_t nitems,int(*compare)(const void*, const void*));
+void filesort_mergesort(void **datap,size_t nitems,int(*compare)(const void*, const void*),void **temp);
 
 
 #endif /* SORTING_H */
@@ -23,6 +23,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #include "ways.h"
 
@@ -36,8 +37,65 @@
 #include "results.h"
 
 
+/* Global variables */
+
+/*+ The number of threads to use for finding super-nodes and creating super-segments. +*/
+extern int option_super_threads;
+
+
+/* Local types */
+
+/*+ The data used by each thread that is finding super-nodes or creating super-segments. +*/
+typedef struct _superthread
+{
+ pthread_t  thread;             /*+ The thread. +*/
+
+ NodesX     nodesx;             /*+ A copy of the nodes that has its own cache and file descriptor in slim mode. +*/
+ SegmentsX  segmentsx;          /*+ A copy of the segments that has its own cache and file descriptor in slim mode. +*/
+ WaysX      waysx;              /*+ A copy of the ways that has its own cache and file descriptor in slim mode. +*/
+
+ SegmentX  *segments;           /*+ The super-segments created for the current block of nodes. +*/
+ index_t    nsegments;          /*+ The number of super-segments. +*/
+ index_t    segments_size;      /*+ The allocated number of super-segments. +*/
+}
+ superthread;
+
+
+/* Local variables */
+
+/*+ The number of nodes in each block that is given to a thread (a multiple of 8). +*/
+#define SUPER_BLOCK 10000
+
+/*+ The number of nodes. +*/
+static index_t super_number;
+
+/*+ The super-segments that are being created. +*/
+static SegmentsX *super_supersegmentsx;
+
+/*+ The mutex that protects the counters below. +*/
+static pthread_mutex_t super_mutex=PTHREAD_MUTEX_INITIALIZER;
+
+/*+ The condition that is signalled when a block of super-segments has been stored. +*/
+static pthread_cond_t super_cond=PTHREAD_COND_INITIALIZER;
+
+/*+ The index of the next node to give to a thread and of the first node whose super-segments are not yet stored. +*/
+static index_t super_next,super_stored;
+
+/*+ The number of nodes or super-nodes finished and the number of super-nodes or super-segments found. +*/
+static index_t super_done,super_found;
+
+
 /* Local functions */
 
+static void run_super_threads(NodesX *nodesx,SegmentsX *segmentsx,WaysX *waysx,void *(*function)(void*));
+static int next_super_block(index_t *start,index_t *end);
+
+static void *choose_super_nodes_thread(void *arg);
+static int is_super_node(NodesX *nodesx,SegmentsX *segmentsx,WaysX *waysx,index_t i);
+
+static void *create_super_segments_thread(void *arg);
+static void create_super_segments(superthread *thread,index_t i);
+
 static Results *FindRoutesWay(NodesX *nodesx,SegmentsX *segmentsx,WaysX *waysx,node_t start,Way *match);
 
 
@@ -53,9 +111,6 @@ static Results *FindRoutesWay(NodesX *nodesx,SegmentsX *segmentsx,WaysX *waysx,n
 
 void ChooseSuperNodes(NodesX *nodesx,SegmentsX *segmentsx,WaysX *waysx)
 {
- index_t i;
- index_t nnodes=0;
-
  if(nodesx->number==0 || segmentsx->number==0 || waysx->number==0)
     return;
 
@@ -77,105 +132,144 @@ void ChooseSuperNodes(NodesX *nodesx,SegmentsX *segmentsx,WaysX *waysx)
 
  /* Find super-nodes */
 
- for(i=0;i<nodesx->number;i++)
+ super_done=0;
+ super_found=0;
+
+ run_super_threads(nodesx,segmentsx,waysx,choose_super_nodes_thread);
+
+ /* Unmap from memory / close the files */
+
+#if !SLIM
+ nodesx->data=UnmapFile(nodesx->filename);
+ segmentsx->data=UnmapFile(segmentsx->filename);
+ waysx->data=UnmapFile(waysx->filename);
+#else
+ nodesx->fd=CloseFile(nodesx->fd);
+ segmentsx->fd=CloseFile(segmentsx->fd);
+ waysx->fd=CloseFile(waysx->fd);
+#endif
+
+ /* Print the final message */
+
+ printf_last("Found Super-Nodes: Nodes=%"Pindex_t" Super-Nodes=%"Pindex_t,nodesx->number,super_found);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  The function that is run in each thread to select super-nodes from blocks of
+  nodes until there are none left.
+
+  void *choose_super_nodes_thread Returns NULL.
+
+  void *arg The thread's data.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void *choose_super_nodes_thread(void *arg)
+{
+ superthread *thread=(superthread*)arg;
+ index_t start,end;
+
+ while(next_super_block(&start,&end))
    {
-    if(IsBitSet(nodesx->super,i))
-      {
-       int issuper=0;
-       NodeX *nodex=LookupNodeX(nodesx,i,1);
+    index_t i,nnodes=0;
 
-       if(nodex->flags&(NODE_TURNRSTRCT|NODE_TURNRSTRCT2))
-          issuper=1;
-       else
+    /* The blocks are a multiple of 8 nodes so each thread modifies different bytes of the bit-mask */
+
+    for(i=start;i<end;i++)
+       if(IsBitSet(thread->nodesx.super,i))
          {
-          int count=0,j;
-          Way segmentway[MAX_SEG_PER_NODE];
-          int segmentweight[MAX_SEG_PER_NODE];
-          SegmentX *segmentx=FirstSegmentX(segmentsx,i,1);
+          if(is_super_node(&thread->nodesx,&thread->segmentsx,&thread->waysx,i))
+             nnodes++;
+          else
+             ClearBit(thread->nodesx.super,i);
+         }
 
-          while(segmentx)
-            {
-             WayX *wayx=LookupWayX(waysx,segmentx->way,1);
-             int nsegments;
+    pthread_mutex_lock(&super_mutex);
 
-             /* Segments that are loops count twice */
+    super_done+=end-start;
+    super_found+=nnodes;
 
-             assert(count<MAX_SEG_PER_NODE); /* Only a limited amount of information stored. */
+    if(!(super_done%SUPER_BLOCK))
+       printf_middle("Finding Super-Nodes: Nodes=%"Pindex_t" Super-Nodes=%"Pindex_t,super_done,super_found);
 
-             if(segmentx->node1==segmentx->node2)
-                segmentweight[count]=2;
-             else
-                segmentweight[count]=1;
+    pthread_mutex_unlock(&super_mutex);
+   }
 
-             segmentway[count]=wayx->way;
+ return(NULL);
+}
 
-             /* If the node allows less traffic types than any connecting way then it is super */
 
-             if((wayx->way.allow&nodex->allow)!=wayx->way.allow)
-               {
-                issuper=1;
-                break;
-               }
+/*++++++++++++++++++++++++++++++++++++++
+  Decide if a node is a super-node.
 
-             nsegments=segmentweight[count];
+  int is_super_node Returns 1 if the node is a super-node.
 
-             for(j=0;j<count;j++)
-                if(wayx->way.allow & segmentway[j].allow)
-                  {
-                   /* If two ways are different in any attribute and there is a type of traffic that can use both then it is super */
+  NodesX *nodesx The set of nodes to use.
 
-                   if(WaysCompare(&segmentway[j],&wayx->way))
-                     {
-                      issuper=1;
-                      break;
-                     }
+  SegmentsX *segmentsx The set of segments to use.
 
-                   /* If there are two other segments that can be used by the same types of traffic as this one then it is super */
+  WaysX *waysx The set of ways to use.
 
-                   nsegments+=segmentweight[j];
-                   if(nsegments>2)
-                     {
-                      issuper=1;
-                      break;
-                     }
-                  }
+  index_t i The index of the node.
+  ++++++++++++++++++++++++++++++++++++++*/
 
-             if(issuper)
-                break;
+static int is_super_node(NodesX *nodesx,SegmentsX *segmentsx,WaysX *waysx,index_t i)
+{
+ int count=0,j;
+ Way segmentway[MAX_SEG_PER_NODE];
+ int segmentweight[MAX_SEG_PER_NODE];
+ NodeX *nodex=LookupNodeX(nodesx,i,1);
+ SegmentX *segmentx;
 
-             segmentx=NextSegmentX(segmentsx,segmentx,i,1);
+ if(nodex->flags&(NODE_TURNRSTRCT|NODE_TURNRSTRCT2))
+    return(1);
 
-             count++;
-            }
-         }
+ segmentx=FirstSegmentX(segmentsx,i,1);
 
-       /* Mark the node as super if it is. */
+ while(segmentx)
+   {
+    WayX *wayx=LookupWayX(waysx,segmentx->way,1);
+    int nsegments;
 
-       if(issuper)
-          nnodes++;
-       else
-          ClearBit(nodesx->super,i);
-      }
+    /* Segments that are loops count twice */
 
-    if(!((i+1)%10000))
-       printf_middle("Finding Super-Nodes: Nodes=%"Pindex_t" Super-Nodes=%"Pindex_t,i+1,nnodes);
-   }
+    assert(count<MAX_SEG_PER_NODE); /* Only a limited amount of information stored. */
 
- /* Unmap from memory / close the files */
+    if(segmentx->node1==segmentx->node2)
+       segmentweight[count]=2;
+    else
+       segmentweight[count]=1;
 
-#if !SLIM
- nodesx->data=UnmapFile(nodesx->filename);
- segmentsx->data=UnmapFile(segmentsx->filename);
- waysx->data=UnmapFile(waysx->filename);
-#else
- nodesx->fd=CloseFile(nodesx->fd);
- segmentsx->fd=CloseFile(segmentsx->fd);
- waysx->fd=CloseFile(waysx->fd);
-#endif
+    segmentway[count]=wayx->way;
 
- /* Print the final message */
+    /* If the node allows less traffic types than any connecting way then it is super */
+
+    if((wayx->way.allow&nodex->allow)!=wayx->way.allow)
+       return(1);
+
+    nsegments=segmentweight[count];
+
+    for(j=0;j<count;j++)
+       if(wayx->way.allow & segmentway[j].allow)
+         {
+          /* If two ways are different in any attribute and there is a type of traffic that can use both then it is super */
+
+          if(WaysCompare(&segmentway[j],&wayx->way))
+             return(1);
 
- printf_last("Found Super-Nodes: Nodes=%"Pindex_t" Super-Nodes=%"Pindex_t,nodesx->number,nnodes);
+          /* If there are two other segments that can be used by the same types of traffic as this one then it is super */
+
+          nsegments+=segmentweight[j];
+          if(nsegments>2)
+             return(1);
+         }
+
+    segmentx=NextSegmentX(segmentsx,segmentx,i,1);
+
+    count++;
+   }
+
+ return(0);
 }
 
 
@@ -193,9 +287,7 @@ void ChooseSuperNodes(NodesX *nodesx,SegmentsX *segmentsx,WaysX *waysx)
 
 SegmentsX *CreateSuperSegments(NodesX *nodesx,SegmentsX *segmentsx,WaysX *waysx)
 {
- index_t i;
  SegmentsX *supersegmentsx;
- index_t sn=0,ss=0;
 
  supersegmentsx=NewSegmentList(0);
 
@@ -216,92 +308,285 @@ SegmentsX *CreateSuperSegments(NodesX *nodesx,SegmentsX *segmentsx,WaysX *waysx)
  waysx->fd=ReOpenFile(waysx->filename);
 #endif
 
- /* Create super-segments for each super-node. */
+ /* Create super-segments for each super-node (they are stored in the same order whatever the number of threads). */
+
+ super_supersegmentsx=supersegmentsx;
+
+ super_stored=0;
+ super_done=0;
+ super_found=0;
+
+ run_super_threads(nodesx,segmentsx,waysx,create_super_segments_thread);
+
+ /* Unmap from memory / close the files */
+
+#if !SLIM
+ segmentsx->data=UnmapFile(segmentsx->filename);
+ waysx->data=UnmapFile(waysx->filename);
+#else
+ segmentsx->fd=CloseFile(segmentsx->fd);
+ waysx->fd=CloseFile(waysx->fd);
+#endif
+
+ /* Print the final message */
+
+ printf_last("Created Super-Segments: Super-Nodes=%"Pindex_t" Super-Segments=%"Pindex_t,super_done,super_found);
+
+ return(supersegmentsx);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  The function that is run in each thread to create the super-segments for
+  blocks of nodes until there are none left.  The super-segments for each block
+  are stored once those for all of the previous blocks have been stored.
+
+  void *create_super_segments_thread Returns NULL.
 
- for(i=0;i<nodesx->number;i++)
+  void *arg The thread's data.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void *create_super_segments_thread(void *arg)
+{
+ superthread *thread=(superthread*)arg;
+ index_t start,end;
+
+ while(next_super_block(&start,&end))
    {
-    if(IsBitSet(nodesx->super,i))
-      {
-       SegmentX *segmentx;
-       int count=0,match;
-       Way prevway[MAX_SEG_PER_NODE];
+    index_t i,j,nnodes=0;
 
-       segmentx=FirstSegmentX(segmentsx,i,1);
+    thread->nsegments=0;
 
-       while(segmentx)
+    for(i=start;i<end;i++)
+       if(IsBitSet(thread->nodesx.super,i))
          {
-          WayX *wayx=LookupWayX(waysx,segmentx->way,1);
+          create_super_segments(thread,i);
+
+          nnodes++;
+         }
+
+    pthread_mutex_lock(&super_mutex);
+
+    while(super_stored!=start)
+       pthread_cond_wait(&super_cond,&super_mutex);
+
+    for(j=0;j<thread->nsegments;j++)
+       AppendSegment(super_supersegmentsx,thread->segments[j].way,thread->segments[j].node1,thread->segments[j].node2,thread->segments[j].distance);
+
+    super_stored=end;
+    super_done+=nnodes;
+    super_found+=thread->nsegments;
+
+    printf_middle("Creating Super-Segments: Super-Nodes=%"Pindex_t" Super-Segments=%"Pindex_t,super_done,super_found);
+
+    pthread_cond_broadcast(&super_cond);
+
+    pthread_mutex_unlock(&super_mutex);
+   }
 
-          /* Check that this type of way hasn't already been routed */
+ return(NULL);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Create the super-segments for one super-node and keep them in the thread's
+  list.
+
+  superthread *thread The thread's data.
+
+  index_t i The index of the super-node.
+  ++++++++++++++++++++++++++++++++++++++*/
 
-          match=0;
+static void create_super_segments(superthread *thread,index_t i)
+{
+ SegmentX *segmentx;
+ int count=0,match;
+ Way prevway[MAX_SEG_PER_NODE];
+
+ segmentx=FirstSegmentX(&thread->segmentsx,i,1);
+
+ while(segmentx)
+   {
+    WayX *wayx=LookupWayX(&thread->waysx,segmentx->way,1);
 
-          if(count>0)
+    /* Check that this type of way hasn't already been routed */
+
+    match=0;
+
+    if(count>0)
+      {
+       int j;
+
+       for(j=0;j<count;j++)
+          if(!WaysCompare(&prevway[j],&wayx->way))
             {
-             int j;
-
-             for(j=0;j<count;j++)
-                if(!WaysCompare(&prevway[j],&wayx->way))
-                  {
-                   match=1;
-                   break;
-                  }
+             match=1;
+             break;
             }
+      }
 
-          assert(count<MAX_SEG_PER_NODE); /* Only a limited amount of history stored. */
+    assert(count<MAX_SEG_PER_NODE); /* Only a limited amount of history stored. */
 
-          prevway[count++]=wayx->way;
+    prevway[count++]=wayx->way;
 
-          /* Route the way and store the super-segments. */
+    /* Route the way and store the super-segments. */
+
+    if(!match)
+      {
+       Results *results=FindRoutesWay(&thread->nodesx,&thread->segmentsx,&thread->waysx,i,&wayx->way);
+       Result *result=FirstResult(results);
 
-          if(!match)
+       while(result)
+         {
+          if(IsBitSet(thread->nodesx.super,result->node) && result->segment!=NO_SEGMENT)
             {
-             Results *results=FindRoutesWay(nodesx,segmentsx,waysx,i,&wayx->way);
-             Result *result=FirstResult(results);
+             SegmentX *supersegmentx;
 
-             while(result)
+             if(thread->nsegments==thread->segments_size)
                {
-                if(IsBitSet(nodesx->super,result->node) && result->segment!=NO_SEGMENT)
-                  {
-                   if(wayx->way.type&Way_OneWay && result->node!=i)
-                      AppendSegment(supersegmentsx,segmentx->way,i,result->node,DISTANCE((distance_t)result->score)|ONEWAY_1TO2);
-                   else
-                      AppendSegment(supersegmentsx,segmentx->way,i,result->node,DISTANCE((distance_t)result->score));
-
-                   ss++;
-                  }
+                thread->segments_size+=256;
+                thread->segments=(SegmentX*)realloc((void*)thread->segments,thread->segments_size*sizeof(SegmentX));
 
-                result=NextResult(results,result);
+                assert(thread->segments); /* Check realloc() worked */
                }
 
-             FreeResultsList(results);
+             supersegmentx=&thread->segments[thread->nsegments++];
+
+             supersegmentx->way=segmentx->way;
+             supersegmentx->node1=i;
+             supersegmentx->node2=result->node;
+
+             if(wayx->way.type&Way_OneWay && result->node!=i)
+                supersegmentx->distance=DISTANCE((distance_t)result->score)|ONEWAY_1TO2;
+             else
+                supersegmentx->distance=DISTANCE((distance_t)result->score);
             }
 
-          segmentx=NextSegmentX(segmentsx,segmentx,i,1);
+          result=NextResult(results,result);
          }
 
-       sn++;
+       FreeResultsList(results);
+      }
+
+    segmentx=NextSegmentX(&thread->segmentsx,segmentx,i,1);
+   }
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Run a function in several threads (including this one) to process all of the
+  nodes in blocks.  Each thread has its own copy of the nodes, segments and ways
+  so that the slim mode lookups (which use a cache in each of them) are thread
+  safe.
+
+  NodesX *nodesx The set of nodes to use.
+
+  SegmentsX *segmentsx The set of segments to use.
+
+  WaysX *waysx The set of ways to use.
+
+  void *(*function)(void*) The function to run in each thread.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void run_super_threads(NodesX *nodesx,SegmentsX *segmentsx,WaysX *waysx,void *(*function)(void*))
+{
+ int nthreads=(option_super_threads>1)?option_super_threads:1;
+ superthread *threads;
+ int i;
+
+ threads=(superthread*)calloc(nthreads,sizeof(superthread));
 
-       if(!(sn%10000))
-          printf_middle("Creating Super-Segments: Super-Nodes=%"Pindex_t" Super-Segments=%"Pindex_t,sn,ss);
+ assert(threads); /* Check calloc() worked */
+
+ for(i=0;i<nthreads;i++)
+   {
+    threads[i].nodesx=*nodesx;
+    threads[i].segmentsx=*segmentsx;
+    threads[i].waysx=*waysx;
+
+#if SLIM
+    if(i>0)
+      {
+       if(nodesx->fd!=-1)
+          threads[i].nodesx.fd=ReOpenFile(nodesx->filename);
+       if(segmentsx->fd!=-1)
+          threads[i].segmentsx.fd=ReOpenFile(segmentsx->filename);
+       if(waysx->fd!=-1)
+          threads[i].waysx.fd=ReOpenFile(waysx->filename);
       }
+#endif
    }
 
- /* Unmap from memory / close the files */
+ super_number=nodesx->number;
+ super_next=0;
 
-#if !SLIM
- segmentsx->data=UnmapFile(segmentsx->filename);
- waysx->data=UnmapFile(waysx->filename);
-#else
- segmentsx->fd=CloseFile(segmentsx->fd);
- waysx->fd=CloseFile(waysx->fd);
+ /* Start the other threads and then run the function in this one */
+
+ for(i=1;i<nthreads;i++)
+    if(pthread_create(&threads[i].thread,NULL,function,&threads[i]))
+       break;
+
+ function(&threads[0]);
+
+ while(--i>0)
+    pthread_join(threads[i].thread,NULL);
+
+ /* Tidy up */
+
+ for(i=0;i<nthreads;i++)
+   {
+#if SLIM
+    if(i>0)
+      {
+       if(nodesx->fd!=-1)
+          CloseFile(threads[i].nodesx.fd);
+       if(segmentsx->fd!=-1)
+          CloseFile(threads[i].segmentsx.fd);
+       if(waysx->fd!=-1)
+          CloseFile(threads[i].waysx.fd);
+      }
 #endif
 
- /* Print the final message */
+    if(threads[i].segments)
+       free(threads[i].segments);
+   }
 
- printf_last("Created Super-Segments: Super-Nodes=%"Pindex_t" Super-Segments=%"Pindex_t,sn,ss);
+ free(threads);
+}
 
- return(supersegmentsx);
+
+/*++++++++++++++++++++++++++++++++++++++
+  Get the next block of nodes for a thread to process.
+
+  int next_super_block Returns 1 if there is a block or 0 if all nodes have been given out.
+
+  index_t *start Returns the index of the first node in the block.
+
+  index_t *end Returns the index after the last node in the block.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int next_super_block(index_t *start,index_t *end)
+{
+ pthread_mutex_lock(&super_mutex);
+
+ *start=super_next;
+
+ if(*start>=super_number)
+   {
+    pthread_mutex_unlock(&super_mutex);
+    return(0);
+   }
+
+ if((super_number-*start)>SUPER_BLOCK)
+    *end=*start+SUPER_BLOCK;
+ else
+    *end=super_number;
+
+ super_next=*end;
+
+ pthread_mutex_unlock(&super_mutex);
+
+ return(1);
 }
 
 
@@ -20,9 +20,11 @@
  ***************************************/
 
 
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "files.h"
 #include "tagging.h"
@@ -31,11 +33,50 @@
 #include "typesx.h"
 
 
+/* Local types */
+
+/*+ The rules that match a key (with any value) or a key and value. +*/
+typedef struct _TaggingRuleIndexEntry
+{
+ char     *k;                   /*+ The tag key. +*/
+ char     *v;                   /*+ The tag value (or NULL for rules that match any value). +*/
+ uint32_t  hash;                /*+ The hash of the key and value. +*/
+
+ int      *rules;               /*+ The rule numbers (in increasing order). +*/
+ int       nrules;              /*+ The number of rules. +*/
+}
+ TaggingRuleIndexEntry;
+
+/*+ The tagging rules indexed by key and value so that only the rules that can match are tested. +*/
+struct _TaggingRuleIndex
+{
+ TaggingRuleIndexEntry *entries; /*+ The hash table of entries (empty if the key is NULL). +*/
+ uint32_t               mask;    /*+ The size of the hash table minus one (a power of two minus one). +*/
+
+ int  *others;                   /*+ The rule numbers of the rules without a key (in increasing order). +*/
+ int   nothers;                  /*+ The number of rules without a key. +*/
+
+ int  *nsets;                    /*+ For each rule the number of entries for the tags that it sets (or -1 if unknown). +*/
+ int  *firstset;                 /*+ For each rule the first of its entries for the tags that it sets. +*/
+ TaggingRuleIndexEntry **sets;   /*+ The entries for the tags that are set by each rule. +*/
+ int   nallsets;                 /*+ The total number of entries for the tags that are set. +*/
+};
+
+/*+ The position in one of the lists of rule numbers while applying the rules. +*/
+typedef struct _TaggingRuleCursor
+{
+ const int *rules;              /*+ The rule numbers. +*/
+ int        nrules;             /*+ The number of rules. +*/
+ int        position;           /*+ The position of the next rule number. +*/
+}
+ TaggingRuleCursor;
+
+
 /* Global variables */
 
-TaggingRuleList NodeRules={NULL,0};
-TaggingRuleList WayRules={NULL,0};
-TaggingRuleList RelationRules={NULL,0};
+TaggingRuleList NodeRules={NULL,0,NULL};
+TaggingRuleList WayRules={NULL,0,NULL};
+TaggingRuleList RelationRules={NULL,0,NULL};
 
 
 /* Local variables */
@@ -43,11 +84,25 @@ TaggingRuleList RelationRules={NULL,0};
 TaggingRuleList *current_list=NULL;
 TaggingRule     *current_rule=NULL;
 
+/*+ The shared copies of the tag keys that are used in the tagging rules (a hash table). +*/
+static char   **keys=NULL;
+static uint32_t nkeys=0,keys_size=0;
+
 
 /* Local functions */
 
+static void free_index(TaggingRuleList *rules);
+static int apply_rule(TaggingRuleList *rules,TaggingRule *rule,TagList *input,TagList *output,node_t id);
 static void apply_actions(TaggingRuleList *rules,TaggingRule *rule,int match,TagList *input,TagList *output,node_t id);
 
+static char *copy_string(TagList *tags,const char *str);
+static char *intern_key(const char *k);
+static char *find_key(const char *k);
+
+static uint32_t hash_tag(const char *k,const char *v);
+static TaggingRuleIndexEntry *find_index_entry(TaggingRuleIndex *index,const char *k,const char *v);
+static int find_cursors(TaggingRuleIndex *index,TagList *tags,TaggingRuleCursor *cursors);
+
 
 /* The XML tag processing function prototypes */
 
@@ -385,6 +440,10 @@ int ParseXMLTaggingRules(const char *filename)
  if(retval)
     return(1);
 
+ CompileTaggingRuleList(&NodeRules);
+ CompileTaggingRuleList(&WayRules);
+ CompileTaggingRuleList(&RelationRules);
+
  return(0);
 }
 
@@ -415,13 +474,16 @@ void DeleteXMLTaggingRules(void)
 
 TaggingRule *AppendTaggingRule(TaggingRuleList *rules,const char *k,const char *v)
 {
+ if(rules->index)
+    free_index(rules);
+
  if((rules->nrules%16)==0)
     rules->rules=(TaggingRule*)realloc((void*)rules->rules,(rules->nrules+16)*sizeof(TaggingRule));
 
  rules->nrules++;
 
  if(k)
-    rules->rules[rules->nrules-1].k=strcpy(malloc(strlen(k)+1),k);
+    rules->rules[rules->nrules-1].k=intern_key(k);
  else
     rules->rules[rules->nrules-1].k=NULL;
 
@@ -459,7 +521,7 @@ void AppendTaggingAction(TaggingRule *rule,const char *k,const char *v,int actio
  rule->actions[rule->nactions-1].action=action;
 
  if(k)
-    rule->actions[rule->nactions-1].k=strcpy(malloc(strlen(k)+1),k);
+    rule->actions[rule->nactions-1].k=intern_key(k);
  else
     rule->actions[rule->nactions-1].k=NULL;
 
@@ -482,15 +544,11 @@ void DeleteTaggingRuleList(TaggingRuleList *rules)
 
  for(i=0;i<rules->nrules;i++)
    {
-    if(rules->rules[i].k)
-       free(rules->rules[i].k);
     if(rules->rules[i].v)
        free(rules->rules[i].v);
 
     for(j=0;j<rules->rules[i].nactions;j++)
       {
-       if(rules->rules[i].actions[j].k)
-          free(rules->rules[i].actions[j].k);
        if(rules->rules[i].actions[j].v)
           free(rules->rules[i].actions[j].v);
       }
@@ -501,6 +559,219 @@ void DeleteTaggingRuleList(TaggingRuleList *rules)
 
  if(rules->rules)
     free(rules->rules);
+
+ if(rules->index)
+    free_index(rules);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Compile a list of tagging rules into an index by key and value so that only
+  the rules that can match the tags need to be tested.
+
+  TaggingRuleList *rules The list of rules to compile.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void CompileTaggingRuleList(TaggingRuleList *rules)
+{
+ TaggingRuleIndex *index;
+ uint32_t size=16;
+ int i;
+
+ if(rules->index)
+    free_index(rules);
+
+ index=(TaggingRuleIndex*)calloc(1,sizeof(TaggingRuleIndex));
+
+ assert(index); /* Check calloc() worked */
+
+ /* The hash table is kept less than half full */
+
+ while(size<2*(uint32_t)rules->nrules)
+    size<<=1;
+
+ index->entries=(TaggingRuleIndexEntry*)calloc(size,sizeof(TaggingRuleIndexEntry));
+
+ assert(index->entries); /* Check calloc() worked */
+
+ index->mask=size-1;
+
+ for(i=0;i<rules->nrules;i++)
+   {
+    TaggingRuleIndexEntry *entry;
+
+    if(!rules->rules[i].k)
+      {
+       if((index->nothers%16)==0)
+         {
+          index->others=(int*)realloc((void*)index->others,(index->nothers+16)*sizeof(int));
+
+          assert(index->others); /* Check realloc() worked */
+         }
+
+       index->others[index->nothers++]=i;
+
+       continue;
+      }
+
+    entry=find_index_entry(index,rules->rules[i].k,rules->rules[i].v);
+
+    if(!entry->k)
+      {
+       entry->k=rules->rules[i].k;
+       entry->v=rules->rules[i].v;
+       entry->hash=hash_tag(entry->k,entry->v);
+      }
+
+    if((entry->nrules%16)==0)
+      {
+       entry->rules=(int*)realloc((void*)entry->rules,(entry->nrules+16)*sizeof(int));
+
+       assert(entry->rules); /* Check realloc() worked */
+      }
+
+    entry->rules[entry->nrules++]=i;
+   }
+
+ /* Find the entries for the tags that each rule sets (the rules that can match after it) */
+
+ index->nsets=(int*)calloc(rules->nrules,sizeof(int));
+ index->firstset=(int*)calloc(rules->nrules,sizeof(int));
+
+ assert(index->nsets && index->firstset); /* Check calloc() worked */
+
+ for(i=0;i<rules->nrules;i++)
+   {
+    TaggingRule *rule=&rules->rules[i];
+    int j,k;
+
+    for(j=0;j<rule->nactions;j++)
+      {
+       TaggingRuleIndexEntry *entries[2];
+
+       if(rule->actions[j].action!=TAGACTION_SET)
+          continue;
+
+       if(!rule->actions[j].k || !rule->actions[j].v)
+         {
+          index->nsets[i]=-1;
+          break;
+         }
+
+       entries[0]=find_index_entry(index,rule->actions[j].k,NULL);
+       entries[1]=find_index_entry(index,rule->actions[j].k,rule->actions[j].v);
+
+       for(k=0;k<2;k++)
+          if(entries[k]->k)
+            {
+             if(!index->nsets[i])
+                index->firstset[i]=index->nallsets;
+
+             if((index->nallsets%16)==0)
+               {
+                index->sets=(TaggingRuleIndexEntry**)realloc((void*)index->sets,(index->nallsets+16)*sizeof(TaggingRuleIndexEntry*));
+
+                assert(index->sets); /* Check realloc() worked */
+               }
+
+             index->sets[index->nallsets++]=entries[k];
+             index->nsets[i]++;
+            }
+      }
+   }
+
+ rules->index=index;
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Free the index of a list of tagging rules.
+
+  TaggingRuleList *rules The list of rules.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void free_index(TaggingRuleList *rules)
+{
+ uint32_t i;
+
+ for(i=0;i<=rules->index->mask;i++)
+    if(rules->index->entries[i].rules)
+       free(rules->index->entries[i].rules);
+
+ free(rules->index->entries);
+
+ if(rules->index->others)
+    free(rules->index->others);
+
+ free(rules->index->nsets);
+ free(rules->index->firstset);
+
+ if(rules->index->sets)
+    free(rules->index->sets);
+
+ free(rules->index);
+
+ rules->index=NULL;
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Calculate the hash of a tag key and value.
+
+  uint32_t hash_tag Returns the hash value.
+
+  const char *k The tag key.
+
+  const char *v The tag value (or NULL).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static uint32_t hash_tag(const char *k,const char *v)
+{
+ uint32_t hash=2166136261U;     /* FNV-1a */
+
+ while(*k)
+    hash=(hash^(unsigned char)*k++)*16777619U;
+
+ if(v)
+   {
+    hash=(hash^0xff)*16777619U;
+
+    while(*v)
+       hash=(hash^(unsigned char)*v++)*16777619U;
+   }
+
+ return(hash);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the entry in the index for a tag key and value.
+
+  TaggingRuleIndexEntry *find_index_entry Returns the matching entry or the empty entry where it would be.
+
+  TaggingRuleIndex *index The index to search.
+
+  const char *k The tag key.
+
+  const char *v The tag value (or NULL for the rules that match any value).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static TaggingRuleIndexEntry *find_index_entry(TaggingRuleIndex *index,const char *k,const char *v)
+{
+ uint32_t hash=hash_tag(k,v);
+ uint32_t i=hash&index->mask;
+
+ while(index->entries[i].k)
+   {
+    TaggingRuleIndexEntry *entry=&index->entries[i];
+
+    if(entry->hash==hash && !strcmp(entry->k,k) && (v?(entry->v && !strcmp(entry->v,v)):!entry->v))
+       return(entry);
+
+    i=(i+1)&index->mask;
+   }
+
+ return(&index->entries[i]);
 }
 
 
@@ -524,24 +795,53 @@ TagList *NewTagList(void)
 
 void DeleteTagList(TagList *tags)
 {
- int i;
-
- for(i=0;i<tags->ntags;i++)
+ while(tags->arena)
    {
-    if(tags->k[i]) free(tags->k[i]);
-    if(tags->v[i]) free(tags->v[i]);
+    TagArena *next=tags->arena->next;
+
+    free(tags->arena);
+
+    tags->arena=next;
    }
 
- if(tags->ntags)
-   {
+ if(tags->k)
     free(tags->k);
-    free(tags->v);
-   }
 
  free(tags);
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Empty a tag list so that it can be used again without allocating more memory.
+
+  TagList *tags The list of tags to empty.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void ResetTagList(TagList *tags)
+{
+ /* Only the newest (and largest) block of memory is kept */
+
+ if(tags->arena)
+   {
+    TagArena *arena=tags->arena->next;
+
+    while(arena)
+      {
+       TagArena *next=arena->next;
+
+       free(arena);
+
+       arena=next;
+      }
+
+    tags->arena->next=NULL;
+    tags->arena->used=0;
+   }
+
+ tags->ntags=0;
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Append a tag to the list of tags.
 
@@ -554,19 +854,39 @@ void DeleteTagList(TagList *tags)
 
 void AppendTag(TagList *tags,const char *k,const char *v)
 {
- if((tags->ntags%16)==0)
+ char *key;
+
+ if(tags->ntags==tags->size)
    {
-    int i;
+    char **k=(char**)malloc(2*(tags->size+16)*sizeof(char*));
+
+    assert(k); /* Check malloc() worked */
+
+    /* The keys and values are stored in the two halves of one allocation */
 
-    tags->k=(char**)realloc((void*)tags->k,(tags->ntags+16)*sizeof(char*));
-    tags->v=(char**)realloc((void*)tags->v,(tags->ntags+16)*sizeof(char*));
+    if(tags->ntags)
+      {
+       memcpy(k,tags->k,tags->ntags*sizeof(char*));
+       memcpy(k+tags->size+16,tags->v,tags->ntags*sizeof(char*));
+
+       free(tags->k);
+      }
 
-    for(i=tags->ntags;i<(tags->ntags+16);i++)
-       tags->k[i]=tags->v[i]=NULL;
+    tags->size+=16;
+
+    tags->k=k;
+    tags->v=k+tags->size;
    }
 
- tags->k[tags->ntags]=strcpy(realloc(tags->k[tags->ntags],strlen(k)+1),k);
- tags->v[tags->ntags]=strcpy(realloc(tags->v[tags->ntags],strlen(v)+1),v);
+ /* The keys that are used in the tagging rules are shared, the others are copied */
+
+ key=find_key(k);
+
+ if(!key)
+    key=copy_string(tags,k);
+
+ tags->k[tags->ntags]=key;
+ tags->v[tags->ntags]=copy_string(tags,v);
 
  tags->ntags++;
 }
@@ -587,9 +907,17 @@ void ModifyTag(TagList *tags,const char *k,const char *v)
  int i;
 
  for(i=0;i<tags->ntags;i++)
-    if(!strcmp(tags->k[i],k))
+    if(tags->k[i]==k || !strcmp(tags->k[i],k))
       {
-       tags->v[i]=strcpy(realloc(tags->v[i],strlen(v)+1),v);
+       size_t oldlength=strlen(tags->v[i]),newlength=strlen(v);
+
+       /* The value is replaced in place if the new one is not longer */
+
+       if(newlength<=oldlength)
+          memmove(tags->v[i],v,newlength+1);
+       else
+          tags->v[i]=copy_string(tags,v);
+
        return;
       }
 
@@ -610,11 +938,8 @@ void DeleteTag(TagList *tags,const char *k)
  int i,j;
 
  for(i=0;i<tags->ntags;i++)
-    if(!strcmp(tags->k[i],k))
+    if(tags->k[i]==k || !strcmp(tags->k[i],k))
       {
-       if(tags->k[i]) free(tags->k[i]);
-       if(tags->v[i]) free(tags->v[i]);
-
        for(j=i+1;j<tags->ntags;j++)
          {
           tags->k[j-1]=tags->k[j];
@@ -631,6 +956,125 @@ void DeleteTag(TagList *tags,const char *k)
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Copy a string into the memory that belongs to a tag list.
+
+  char *copy_string Returns a pointer to the copy.
+
+  TagList *tags The list of tags.
+
+  const char *str The string to copy.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static char *copy_string(TagList *tags,const char *str)
+{
+ size_t length=strlen(str)+1;
+ char *copy;
+
+ if(!tags->arena || (tags->arena->size-tags->arena->used)<length)
+   {
+    size_t size=tags->arena?2*tags->arena->size:256;
+    TagArena *arena;
+
+    if(size<length)
+       size=length;
+
+    arena=(TagArena*)malloc(sizeof(TagArena)+size);
+
+    assert(arena); /* Check malloc() worked */
+
+    arena->next=tags->arena;
+    arena->size=size;
+    arena->used=0;
+
+    tags->arena=arena;
+   }
+
+ copy=tags->arena->data+tags->arena->used;
+
+ memcpy(copy,str,length);
+
+ tags->arena->used+=length;
+
+ return(copy);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the shared copy of a tag key that is used in the tagging rules, creating
+  one if needed.  New keys can only be added while the rules are being loaded
+  (the keys can be found by several threads at the same time after that).
+
+  char *intern_key Returns a pointer to the shared copy.
+
+  const char *k The tag key.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static char *intern_key(const char *k)
+{
+ uint32_t hash,i;
+
+ if((2*(nkeys+1))>keys_size)
+   {
+    char **oldkeys=keys;
+    uint32_t oldsize=keys_size;
+
+    keys_size=keys_size?2*keys_size:256;
+    keys=(char**)calloc(keys_size,sizeof(char*));
+
+    assert(keys); /* Check calloc() worked */
+
+    for(i=0;i<oldsize;i++)
+       if(oldkeys[i])
+         {
+          uint32_t j=hash_tag(oldkeys[i],NULL)&(keys_size-1);
+
+          while(keys[j])
+             j=(j+1)&(keys_size-1);
+
+          keys[j]=oldkeys[i];
+         }
+
+    if(oldkeys)
+       free(oldkeys);
+   }
+
+ hash=hash_tag(k,NULL);
+
+ for(i=hash&(keys_size-1);keys[i];i=(i+1)&(keys_size-1))
+    if(!strcmp(keys[i],k))
+       return(keys[i]);
+
+ keys[i]=strcpy(malloc(strlen(k)+1),k);
+ nkeys++;
+
+ return(keys[i]);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the shared copy of a tag key that is used in the tagging rules.
+
+  char *find_key Returns a pointer to the shared copy or NULL if the key is not used in the rules.
+
+  const char *k The tag key.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static char *find_key(const char *k)
+{
+ uint32_t i;
+
+ if(!nkeys)
+    return(NULL);
+
+ for(i=hash_tag(k,NULL)&(keys_size-1);keys[i];i=(i+1)&(keys_size-1))
+    if(!strcmp(keys[i],k))
+       return(keys[i]);
+
+ return(NULL);
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Apply a set of tagging rules to a set of tags.
 
@@ -646,36 +1090,218 @@ void DeleteTag(TagList *tags,const char *k)
 TagList *ApplyTaggingRules(TaggingRuleList *rules,TagList *tags,node_t id)
 {
  TagList *result=NewTagList();
+ TaggingRuleCursor local_cursors[33],*cursors=local_cursors;
+ int ncursors,maxcursors=sizeof(local_cursors)/sizeof(local_cursors[0]);
  int i,j;
 
- for(i=0;i<rules->nrules;i++)
+ /* Without an index every rule is tested */
+
+ if(!rules->index)
+   {
+    for(i=0;i<rules->nrules;i++)
+       apply_rule(rules,&rules->rules[i],tags,result,id);
+
+    return(result);
+   }
+
+ /* With an index only the rules for the keys and values of the tags (and the
+    rules without a key) are tested, still in the same order. */
+
+ if((2*tags->ntags+1)>maxcursors)
+   {
+    maxcursors=2*tags->ntags+1;
+    cursors=(TaggingRuleCursor*)malloc(maxcursors*sizeof(TaggingRuleCursor));
+
+    assert(cursors); /* Check malloc() worked */
+   }
+
+ ncursors=find_cursors(rules->index,tags,cursors);
+
+ i=-1;
+
+ while(1)
    {
-    if(rules->rules[i].k && rules->rules[i].v)
+    int next=rules->nrules,nsets;
+
+    for(j=0;j<ncursors;j++)
       {
-       for(j=0;j<tags->ntags;j++)
-          if(!strcmp(tags->k[j],rules->rules[i].k) && !strcmp(tags->v[j],rules->rules[i].v))
-             apply_actions(rules,&rules->rules[i],j,tags,result,id);
+       TaggingRuleCursor *cursor=&cursors[j];
+
+       while(cursor->position<cursor->nrules && cursor->rules[cursor->position]<=i)
+          cursor->position++;
+
+       if(cursor->position<cursor->nrules && cursor->rules[cursor->position]<next)
+          next=cursor->rules[cursor->position];
+      }
+
+    if(next==rules->nrules)
+       break;
+
+    i=next;
+
+    if(!apply_rule(rules,&rules->rules[i],tags,result,id))
+       continue;
+
+    /* If the rule set any tags then the rules that match them must be tested
+       too (the rules for tags that have been changed or unset are still tested
+       but can no longer match). */
+
+    nsets=rules->index->nsets[i];
+
+    if(nsets==0)
+       continue;
+
+    if(nsets<0 && (2*tags->ntags+1)>maxcursors)
+       maxcursors=2*tags->ntags+1;
+    else if(nsets>0 && (ncursors+nsets)>maxcursors)
+       maxcursors=ncursors+nsets+16;
+
+    if(cursors==local_cursors && maxcursors>(int)(sizeof(local_cursors)/sizeof(local_cursors[0])))
+      {
+       cursors=(TaggingRuleCursor*)malloc(maxcursors*sizeof(TaggingRuleCursor));
+
+       assert(cursors); /* Check malloc() worked */
+
+       memcpy(cursors,local_cursors,ncursors*sizeof(TaggingRuleCursor));
+      }
+    else if(cursors!=local_cursors)
+      {
+       cursors=(TaggingRuleCursor*)realloc((void*)cursors,maxcursors*sizeof(TaggingRuleCursor));
+
+       assert(cursors); /* Check realloc() worked */
       }
-    else if(rules->rules[i].k && !rules->rules[i].v)
+
+    if(nsets<0)
+       ncursors=find_cursors(rules->index,tags,cursors);
+    else
+       for(j=0;j<nsets;j++)
+         {
+          TaggingRuleIndexEntry *entry=rules->index->sets[rules->index->firstset[i]+j];
+
+          cursors[ncursors].rules=entry->rules;
+          cursors[ncursors].nrules=entry->nrules;
+          cursors[ncursors].position=0;
+          ncursors++;
+         }
+   }
+
+ if(cursors!=local_cursors)
+    free(cursors);
+
+ return(result);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Find the lists of rules in the index that can match a set of tags.
+
+  int find_cursors Returns the number of lists of rules.
+
+  TaggingRuleIndex *index The index of the rules.
+
+  TagList *tags The tags to be matched.
+
+  TaggingRuleCursor *cursors Returns the lists of rules (at most two per tag plus one).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int find_cursors(TaggingRuleIndex *index,TagList *tags,TaggingRuleCursor *cursors)
+{
+ int i,ncursors=0;
+
+ if(index->nothers)
+   {
+    cursors[ncursors].rules=index->others;
+    cursors[ncursors].nrules=index->nothers;
+    cursors[ncursors].position=0;
+    ncursors++;
+   }
+
+ for(i=0;i<tags->ntags;i++)
+   {
+    TaggingRuleIndexEntry *entry;
+
+    entry=find_index_entry(index,tags->k[i],NULL);
+
+    if(entry->k)
       {
-       for(j=0;j<tags->ntags;j++)
-          if(!strcmp(tags->k[j],rules->rules[i].k))
-             apply_actions(rules,&rules->rules[i],j,tags,result,id);
+       cursors[ncursors].rules=entry->rules;
+       cursors[ncursors].nrules=entry->nrules;
+       cursors[ncursors].position=0;
+       ncursors++;
       }
-    else if(!rules->rules[i].k && rules->rules[i].v)
+
+    entry=find_index_entry(index,tags->k[i],tags->v[i]);
+
+    if(entry->k)
       {
-       for(j=0;j<tags->ntags;j++)
-          if(!strcmp(tags->v[j],rules->rules[i].v))
-             apply_actions(rules,&rules->rules[i],j,tags,result,id);
+       cursors[ncursors].rules=entry->rules;
+       cursors[ncursors].nrules=entry->nrules;
+       cursors[ncursors].position=0;
+       ncursors++;
       }
-    else /* if(!rules->rules[i].k && !rules->rules[i].v) */
+   }
+
+ return(ncursors);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Apply a single tagging rule to a set of tags.
+
+  int apply_rule Returns the number of times that the rule matched.
+
+  TaggingRuleList *rules The tagging rules being applied.
+
+  TaggingRule *rule The rule to apply.
+
+  TagList *input The input tags.
+
+  TagList *output The output tags.
+
+  node_t id The ID of the node, way or relation.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static int apply_rule(TaggingRuleList *rules,TaggingRule *rule,TagList *input,TagList *output,node_t id)
+{
+ int j,matches=0;
+
+ if(rule->k && rule->v)
+   {
+    for(j=0;j<input->ntags;j++)
+       if(!strcmp(input->k[j],rule->k) && !strcmp(input->v[j],rule->v))
+         {
+          apply_actions(rules,rule,j,input,output,id);
+          matches++;
+         }
+   }
+ else if(rule->k && !rule->v)
+   {
+    for(j=0;j<input->ntags;j++)
+       if(!strcmp(input->k[j],rule->k))
+         {
+          apply_actions(rules,rule,j,input,output,id);
+          matches++;
+         }
+   }
+ else if(!rule->k && rule->v)
+   {
+    for(j=0;j<input->ntags;j++)
+       if(!strcmp(input->v[j],rule->v))
+         {
+          apply_actions(rules,rule,j,input,output,id);
+          matches++;
+         }
+   }
+ else /* if(!rule->k && !rule->v) */
+   {
+    for(j=0;j<input->ntags;j++)
       {
-       for(j=0;j<tags->ntags;j++)
-          apply_actions(rules,&rules->rules[i],j,tags,result,id);
+       apply_actions(rules,rule,j,input,output,id);
+       matches++;
       }
    }
 
- return(result);
+ return(matches);
 }
 
 
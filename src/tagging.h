@@ -58,15 +58,34 @@ typedef struct _TaggingRule
  TaggingRule;
 
 
+/*+ A structure to contain the rules indexed by key and value (the contents are private). +*/
+typedef struct _TaggingRuleIndex TaggingRuleIndex;
+
+
 /*+ A structure to contain the list of rules and associated information. +*/
 typedef struct _TaggingRuleList
 {
  TaggingRule *rules;            /*+ The array of rules. +*/
  int          nrules;           /*+ The number of rules. +*/
+
+ TaggingRuleIndex *index;       /*+ The rules indexed by key and value (or NULL if not compiled). +*/
 }
  TaggingRuleList;
 
 
+/*+ A block of memory that holds the strings of a list of tags. +*/
+typedef struct _TagArena
+{
+ struct _TagArena *next;        /*+ The previous (smaller) block. +*/
+
+ size_t size;                   /*+ The size of the data. +*/
+ size_t used;                   /*+ The amount of the data that is used. +*/
+
+ char   data[];                 /*+ The strings. +*/
+}
+ TagArena;
+
+
 /*+ A structure to hold a list of tags to be processed. +*/
 typedef struct _TagList
 {
@@ -74,6 +93,9 @@ typedef struct _TagList
 
  char **k;                      /*+ The list of tag keys. +*/
  char **v;                      /*+ The list of tag values. +*/
+
+ int       size;                /*+ The allocated number of tags. +*/
+ TagArena *arena;               /*+ The memory that holds the tag values and the keys that are not in the tagging rules. +*/
 }
  TagList;
 
@@ -94,8 +116,11 @@ TaggingRule *AppendTaggingRule(TaggingRuleList *rules,const char *k,const char *
 void AppendTaggingAction(TaggingRule *rule,const char *k,const char *v,int action);
 void DeleteTaggingRuleList(TaggingRuleList *rules);
 
+void CompileTaggingRuleList(TaggingRuleList *rules);
+
 TagList *NewTagList(void);
 void DeleteTagList(TagList *tags);
+void ResetTagList(TagList *tags);
 
 void AppendTag(TagList *tags,const char *k,const char *v);
 void ModifyTag(TagList *tags,const char *k,const char *v);
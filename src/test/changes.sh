@@ -0,0 +1,108 @@
+#!/bin/sh
+
+# Exit on error
+
+set -e
+
+# Test name
+
+name=`basename $0 .sh`
+
+# Slim or non-slim
+
+if [ "$1" = "slim" ]; then
+    slim="-slim"
+    dir="slim"
+else
+    slim=""
+    dir="fat"
+fi
+
+[ -d $dir ] || mkdir $dir
+
+# Run the programs under a run-time debugger
+
+debugger=valgrind
+debugger=
+
+# Name related options
+
+osm=$name.osm
+osc=$name.osc
+log=$name$slim.log
+
+option_prefix="--prefix=$name"
+option_dir="--dir=$dir"
+
+# Generic program options
+
+option_planetsplitter="--loggable --tagging=../../xml/routino-tagging.xml --errorlog"
+option_filedumper="--dump-osm"
+option_router="--loggable --transport=motorcar --profiles=../../xml/routino-profiles.xml --translations=copyright.xml"
+
+# The changes turn the network into the one from the turns test
+
+expected=turns
+
+# Run planetsplitter (keeping the parsed data) and then again to apply the changes
+
+echo "Running planetsplitter"
+
+echo ../planetsplitter$slim $option_dir $option_prefix $option_planetsplitter --keep $osm > $log
+$debugger ../planetsplitter$slim $option_dir $option_prefix $option_planetsplitter --keep $osm >> $log
+
+echo "Running planetsplitter (changes)"
+
+echo ../planetsplitter$slim $option_dir $option_prefix $option_planetsplitter --changes $osc >> $log
+$debugger ../planetsplitter$slim $option_dir $option_prefix $option_planetsplitter --changes $osc >> $log
+
+# Run planetsplitter on the changed network and compare the databases
+
+echo "Running planetsplitter (changed network)"
+
+echo ../planetsplitter$slim $option_dir --prefix=$name-$expected $option_planetsplitter $expected.osm >> $log
+$debugger ../planetsplitter$slim $option_dir --prefix=$name-$expected $option_planetsplitter $expected.osm >> $log
+
+for file in nodes segments ways relations; do
+
+    echo cmp $dir/$name-$file.mem $dir/$name-$expected-$file.mem >> $log
+    cmp $dir/$name-$file.mem $dir/$name-$expected-$file.mem >> $log
+
+done
+
+# Run filedumper
+
+echo "Running filedumper"
+
+echo ../filedumper$slim $option_dir $option_prefix $option_filedumper >> $log
+$debugger ../filedumper$slim $option_dir $option_prefix $option_filedumper > $dir/$osm
+
+# Waypoints
+
+waypoints=`perl waypoints.pl $osm list`
+
+waypoint_start=`perl waypoints.pl $osm WPstart 1`
+waypoint_finish=`perl waypoints.pl $osm WPfinish 3`
+
+# Run the router for each waypoint
+
+for waypoint in $waypoints; do
+
+    [ ! $waypoint = "WPstart"  ] || continue
+    [ ! $waypoint = "WPfinish" ] || continue
+
+    echo "Running router : $waypoint"
+
+    waypoint_test=`perl waypoints.pl $osm $waypoint 2`
+
+    [ -d $dir/$name-$waypoint ] || mkdir $dir/$name-$waypoint
+
+    echo ../router$slim $option_dir $option_prefix $option_osm $option_router $waypoint_start $waypoint_test $waypoint_finish >> $log
+    $debugger ../router$slim $option_dir $option_prefix $option_osm $option_router $waypoint_start $waypoint_test $waypoint_finish >> $log
+
+    mv shortest* $dir/$name-$waypoint
+
+    echo cmp $dir/$name-$waypoint/shortest-all.txt expected/$expected-$waypoint.txt >> $log
+    cmp $dir/$name-$waypoint/shortest-all.txt expected/$expected-$waypoint.txt >> $log
+
+done
@@ -0,0 +1,77 @@
+#!/bin/sh
+
+# Exit on error
+
+set -e
+
+# Test name
+
+name=`basename $0 .sh`
+
+# Slim or non-slim
+
+if [ "$1" = "slim" ]; then
+    slim="-slim"
+    dir="slim"
+else
+    slim=""
+    dir="fat"
+fi
+
+[ -d $dir ] || mkdir $dir
+
+# Run the programs under a run-time debugger
+
+debugger=valgrind
+debugger=
+
+# Name related options
+
+osm=$name.osm
+poly=$name.poly
+log=$name$slim.log
+
+option_prefix="--prefix=$name"
+option_dir="--dir=$dir"
+
+# Generic program options
+
+option_planetsplitter="--loggable --tagging=../../xml/routino-tagging.xml --errorlog"
+option_filedumper="--dump-osm"
+
+# The area to clip the data to (the polygon file contains the same rectangle,
+# the left and bottom edges pass through nodes)
+
+option_bbox="--bbox=-0.5194891951207509,-0.2207386134847756,-0.5170,-0.2185"
+option_polygon="--polygon=$poly"
+
+# Run planetsplitter with the bounding box and with the polygon
+
+echo "Running planetsplitter"
+
+echo ../planetsplitter$slim $option_dir $option_prefix $option_planetsplitter $option_bbox $osm > $log
+$debugger ../planetsplitter$slim $option_dir $option_prefix $option_planetsplitter $option_bbox $osm >> $log
+
+echo "Running planetsplitter (polygon)"
+
+echo ../planetsplitter$slim $option_dir --prefix=$name-polygon $option_planetsplitter $option_polygon $osm >> $log
+$debugger ../planetsplitter$slim $option_dir --prefix=$name-polygon $option_planetsplitter $option_polygon $osm >> $log
+
+# Run filedumper
+
+echo "Running filedumper"
+
+echo ../filedumper$slim $option_dir $option_prefix $option_filedumper >> $log
+$debugger ../filedumper$slim $option_dir $option_prefix $option_filedumper > $dir/$osm
+
+# Compare the clipped data with the expected data and the two clipped databases
+
+echo cmp $dir/$osm expected/$osm >> $log
+cmp $dir/$osm expected/$osm >> $log
+
+for file in nodes segments ways relations; do
+
+    echo cmp $dir/$name-$file.mem $dir/$name-polygon-$file.mem >> $log
+    cmp $dir/$name-$file.mem $dir/$name-polygon-$file.mem >> $log
+
+done
@@ -0,0 +1,89 @@
+#!/bin/sh
+
+# Exit on error
+
+set -e
+
+# Test name
+
+name=`basename $0 .sh`
+
+# Slim or non-slim
+
+if [ "$1" = "slim" ]; then
+    slim="-slim"
+    dir="slim"
+else
+    slim=""
+    dir="fat"
+fi
+
+[ -d $dir ] || mkdir $dir
+
+# Run the programs under a run-time debugger
+
+debugger=valgrind
+debugger=
+
+# Name related options
+
+osm=$name.osm
+pbf=$name.osm.pbf
+log=$name$slim.log
+
+option_prefix="--prefix=$name"
+option_dir="--dir=$dir"
+
+# Generic program options
+
+option_planetsplitter="--loggable --tagging=../../xml/routino-tagging.xml --errorlog"
+option_filedumper="--dump-osm"
+option_router="--loggable --transport=motorcar --profiles=../../xml/routino-profiles.xml --translations=copyright.xml"
+
+# The network is the one from the turns test (the waypoints are read from the XML file)
+
+expected=turns
+
+# Run planetsplitter (reading the PBF file)
+
+echo "Running planetsplitter"
+
+echo ../planetsplitter$slim $option_dir $option_prefix $option_planetsplitter $pbf > $log
+$debugger ../planetsplitter$slim $option_dir $option_prefix $option_planetsplitter $pbf >> $log
+
+# Run filedumper
+
+echo "Running filedumper"
+
+echo ../filedumper$slim $option_dir $option_prefix $option_filedumper >> $log
+$debugger ../filedumper$slim $option_dir $option_prefix $option_filedumper > $dir/$osm
+
+# Waypoints
+
+waypoints=`perl waypoints.pl $osm list`
+
+waypoint_start=`perl waypoints.pl $osm WPstart 1`
+waypoint_finish=`perl waypoints.pl $osm WPfinish 3`
+
+# Run the router for each waypoint
+
+for waypoint in $waypoints; do
+
+    [ ! $waypoint = "WPstart"  ] || continue
+    [ ! $waypoint = "WPfinish" ] || continue
+
+    echo "Running router : $waypoint"
+
+    waypoint_test=`perl waypoints.pl $osm $waypoint 2`
+
+    [ -d $dir/$name-$waypoint ] || mkdir $dir/$name-$waypoint
+
+    echo ../router$slim $option_dir $option_prefix $option_osm $option_router $waypoint_start $waypoint_test $waypoint_finish >> $log
+    $debugger ../router$slim $option_dir $option_prefix $option_osm $option_router $waypoint_start $waypoint_test $waypoint_finish >> $log
+
+    mv shortest* $dir/$name-$waypoint
+
+    echo cmp $dir/$name-$waypoint/shortest-all.txt expected/$expected-$waypoint.txt >> $log
+    cmp $dir/$name-$waypoint/shortest-all.txt expected/$expected-$waypoint.txt >> $log
+
+done
@@ -0,0 +1,91 @@
+#!/bin/sh
+
+# Exit on error
+
+set -e
+
+# Test name
+
+name=`basename $0 .sh`
+
+# Slim or non-slim
+
+if [ "$1" = "slim" ]; then
+    slim="-slim"
+    dir="slim"
+else
+    slim=""
+    dir="fat"
+fi
+
+[ -d $dir ] || mkdir $dir
+
+# Run the programs under a run-time debugger
+
+debugger=valgrind
+debugger=
+
+# Name related options
+
+osm=$name.osm
+log=$name$slim.log
+
+option_prefix="--prefix=$name"
+option_dir="--dir=$dir"
+
+# Generic program options
+
+option_planetsplitter="--loggable --tagging=../../xml/routino-tagging.xml --errorlog"
+option_filedumper="--dump-osm"
+option_router="--loggable --transport=motorcar --profiles=../../xml/routino-profiles.xml --translations=copyright.xml"
+
+# Run planetsplitter
+
+echo "Running planetsplitter"
+
+echo ../planetsplitter$slim $option_dir $option_prefix $option_planetsplitter $osm > $log
+$debugger ../planetsplitter$slim $option_dir $option_prefix $option_planetsplitter $osm >> $log
+
+# Run filedumper
+
+echo "Running filedumper"
+
+echo ../filedumper$slim $option_dir $option_prefix $option_filedumper >> $log
+$debugger ../filedumper$slim $option_dir $option_prefix $option_filedumper > $dir/$osm
+
+# Waypoints (given in a poor order)
+
+waypoints="WPstart WP07 WP02 WP09 WP04 WPfinish"
+
+waypoint_args=""
+number=1
+
+for waypoint in $waypoints; do
+
+    waypoint_args="$waypoint_args `perl waypoints.pl $osm $waypoint $number`"
+    number=`expr $number + 1`
+
+done
+
+# Run the router with each way of optimising the order of the waypoints
+
+for order in fixed-finish any-finish; do
+
+    case $order in
+        fixed-finish) option_order="--optimise-order-fixed-finish" ;;
+        any-finish)   option_order="--optimise-order" ;;
+    esac
+
+    echo "Running router : $order"
+
+    [ -d $dir/$name-$order ] || mkdir $dir/$name-$order
+
+    echo ../router$slim $option_dir $option_prefix $option_osm $option_router $option_order $waypoint_args >> $log
+    $debugger ../router$slim $option_dir $option_prefix $option_osm $option_router $option_order $waypoint_args >> $log
+
+    mv shortest* $dir/$name-$order
+
+    echo cmp $dir/$name-$order/shortest-all.txt expected/$name-$order.txt >> $log
+    cmp $dir/$name-$order/shortest-all.txt expected/$name-$order.txt >> $log
+
+done
@@ -399,6 +399,8 @@ typedef struct _TurnRelation TurnRelation;
 
 typedef struct _Relations Relations;
 
+typedef struct _Overlay Overlay;
+
 
 /* Functions in types.c */
 
@@ -109,5 +109,11 @@ typedef struct _TurnRestrictRelX TurnRestrictRelX;
 
 typedef struct _RelationsX RelationsX;
 
+typedef struct _ChangeX ChangeX;
+
+typedef struct _ChangesX ChangesX;
+
+typedef struct _AreaX AreaX;
+
 
 #endif /* TYPESX_H */
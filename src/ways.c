@@ -68,6 +68,9 @@ Ways *LoadWayList(const char *filename)
  for(i=0;i<sizeof(ways->cached)/sizeof(ways->cached[0]);i++)
     ways->incache[i]=NO_WAY;
 
+ ways->cachehits=0;
+ ways->cachemisses=0;
+
  ways->namesoffset=sizeof(WaysFile)+ways->file.number*sizeof(Way);
 
  ways->ncached=NULL;
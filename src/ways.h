@@ -87,6 +87,9 @@ struct _Ways
  Way        cached[2];          /*+ Two cached nodes read from the file in slim mode. +*/
  index_t    incache[2];         /*+ The indexes of the cached ways. +*/
 
+ uint32_t   cachehits;          /*+ The number of lookups found in the cache. +*/
+ uint32_t   cachemisses;        /*+ The number of lookups read from the file. +*/
+
  char      *ncached;            /*+ The cached way name. +*/
  int        nalloc;             /*+ The amount of memory allocated for the way name. +*/
 
@@ -134,12 +137,16 @@ static inline Way *LookupWay(Ways *ways,index_t index,int position)
 {
  if(ways->incache[position-1]!=index)
    {
+    ways->cachemisses++;
+
     SeekFile(ways->fd,sizeof(WaysFile)+(off_t)index*sizeof(Way));
 
     ReadFile(ways->fd,&ways->cached[position-1],sizeof(Way));
 
     ways->incache[position-1]=index;
    }
+ else
+    ways->cachehits++;
 
  return(&ways->cached[position-1]);
 }
@@ -29,6 +29,7 @@
 #include "ways.h"
 
 #include "waysx.h"
+#include "changesx.h"
 
 #include "files.h"
 #include "logging.h"
@@ -49,6 +50,9 @@ static WaysX *sortwaysx;
 
 /* Functions */
 
+static index_t count_ways(const char *filename);
+
+static void key_by_id(WayX *wayx,uint32_t *key);
 static int sort_by_id(WayX *a,WayX *b);
 static int sort_by_name_and_id(WayX *a,WayX *b);
 static int sort_by_name_and_prop_and_id(WayX *a,WayX *b);
@@ -81,32 +85,98 @@ WaysX *NewWayList(int append)
 
  if(append)
    {
-    off_t size,position=0;
+    waysx->fd=OpenFileBufferedAppend(waysx->filename);
 
-    waysx->fd=OpenFileAppend(waysx->filename);
+    waysx->number=count_ways(waysx->filename);
+   }
+ else
+    waysx->fd=OpenFileBufferedNew(waysx->filename);
 
-    size=SizeFile(waysx->filename);
+ waysx->nfilename=(char*)malloc(strlen(option_tmpdirname)+32);
+ sprintf(waysx->nfilename,"%s/waynames.%p.tmp",option_tmpdirname,(void*)waysx);
 
-    while(position<size)
-      {
-       FILESORT_VARINT waysize;
+ return(waysx);
+}
 
-       SeekFile(waysx->fd,position);
-       ReadFile(waysx->fd,&waysize,FILESORT_VARSIZE);
 
-       waysx->number++;
-       position+=waysize+FILESORT_VARSIZE;
-      }
+/*++++++++++++++++++++++++++++++++++++++
+  Count the ways in an unsorted way list file.
+
+  index_t count_ways Returns the number of ways.
 
-    SeekFile(waysx->fd,size);
+  const char *filename The name of the file.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static index_t count_ways(const char *filename)
+{
+ off_t size,position=0;
+ index_t number=0;
+ int fd;
+
+ size=SizeFile(filename);
+
+ fd=ReOpenFileBuffered(filename);
+
+ while(position<size)
+   {
+    FILESORT_VARINT waysize;
+
+    ReadFileBuffered(fd,&waysize,FILESORT_VARSIZE);
+    SkipFileBuffered(fd,waysize);
+
+    number++;
+    position+=waysize+FILESORT_VARSIZE;
    }
- else
-    waysx->fd=OpenFileNew(waysx->filename);
 
- waysx->nfilename=(char*)malloc(strlen(option_tmpdirname)+32);
- sprintf(waysx->nfilename,"%s/waynames.%p.tmp",option_tmpdirname,(void*)waysx);
+ CloseFileBuffered(fd);
 
- return(waysx);
+ return(number);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Save a copy of the parsed (unsorted) way list so that it can be updated later.
+
+  WaysX *waysx The set of ways to save.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void SaveParsedWayList(WaysX *waysx)
+{
+ char *filename=(char*)malloc(strlen(option_tmpdirname)+32);
+
+ sprintf(filename,"%s/waysx.parsed.mem",option_tmpdirname);
+
+ waysx->fd=CloseFileBuffered(waysx->fd);
+
+ CopyFile(waysx->filename,filename);
+
+ waysx->fd=OpenFileBufferedAppend(waysx->filename);
+
+ free(filename);
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Replace the way list with the copy of the parsed way list saved earlier.
+
+  WaysX *waysx The set of ways to replace.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void LoadParsedWayList(WaysX *waysx)
+{
+ char *filename=(char*)malloc(strlen(option_tmpdirname)+32);
+
+ sprintf(filename,"%s/waysx.parsed.mem",option_tmpdirname);
+
+ waysx->fd=CloseFileBuffered(waysx->fd);
+
+ CopyFile(filename,waysx->filename);
+
+ waysx->fd=OpenFileBufferedAppend(waysx->filename);
+
+ waysx->number=count_ways(waysx->filename);
+
+ free(filename);
 }
 
 
@@ -120,6 +190,9 @@ WaysX *NewWayList(int append)
 
 void FreeWayList(WaysX *waysx,int keep)
 {
+ if(waysx->fd!=-1)
+    waysx->fd=CloseFileBuffered(waysx->fd);
+
  if(!keep)
     DeleteFile(waysx->filename);
 
@@ -128,14 +201,82 @@ void FreeWayList(WaysX *waysx,int keep)
  if(waysx->idata)
     free(waysx->idata);
 
+ if(waysx->idindex)
+    FreeIdIndex(waysx->idindex);
+
  DeleteFile(waysx->nfilename);
 
  free(waysx->nfilename);
 
+ if(waysx->changes)
+    FreeChangeList(waysx->changes);
+
  free(waysx);
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Save the state of the way list between two stages of processing so that the
+  processing can be resumed from here.
+
+  WaysX *waysx The set of ways to save.
+
+  int fd The file descriptor of the checkpoint file to write the state to.
+
+  const char *filename The name of the file to copy the way data to.
+
+  const char *nfilename The name of the file to copy the way names to.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void CheckpointWayList(WaysX *waysx,int fd,const char *filename,const char *nfilename)
+{
+ assert(waysx->fd==-1 && !waysx->idindex); /* Only between processing stages after the ids are replaced. */
+
+ CopyFile(waysx->filename,filename);
+ CopyFile(waysx->nfilename,nfilename);
+
+ WriteFile(fd,&waysx->number,sizeof(index_t));
+ WriteFile(fd,&waysx->cnumber,sizeof(index_t));
+ WriteFile(fd,&waysx->nlength,sizeof(uint32_t));
+
+ WriteFileArray(fd,waysx->idata,waysx->number*sizeof(way_t));
+}
+
+
+/*++++++++++++++++++++++++++++++++++++++
+  Restore the state of the way list that was saved by CheckpointWayList().
+
+  int ResumeWayList Returns 0 if OK or something else in case of an error.
+
+  WaysX *waysx The set of ways to restore (newly allocated).
+
+  int fd The file descriptor of the checkpoint file to read the state from.
+
+  const char *filename The name of the file to copy the way data from.
+
+  const char *nfilename The name of the file to copy the way names from.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+int ResumeWayList(WaysX *waysx,int fd,const char *filename,const char *nfilename)
+{
+ if(waysx->fd!=-1)
+    waysx->fd=CloseFileBuffered(waysx->fd);
+
+ CopyFile(filename,waysx->filename);
+ CopyFile(nfilename,waysx->nfilename);
+
+ if(ReadFile(fd,&waysx->number,sizeof(index_t)) ||
+    ReadFile(fd,&waysx->cnumber,sizeof(index_t)) ||
+    ReadFile(fd,&waysx->nlength,sizeof(uint32_t)))
+    return(1);
+
+ if(ReadFileArray(fd,(void**)&waysx->idata))
+    return(1);
+
+ return(0);
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Append a single way to an unsorted way list.
 
@@ -159,9 +300,9 @@ void AppendWay(WaysX *waysx,way_t id,Way *way,const char *name)
 
  size=sizeof(WayX)+strlen(name)+1;
 
- WriteFile(waysx->fd,&size,FILESORT_VARSIZE);
- WriteFile(waysx->fd,&wayx,sizeof(WayX));
- WriteFile(waysx->fd,name,strlen(name)+1);
+ WriteFileBuffered(waysx->fd,&size,FILESORT_VARSIZE);
+ WriteFileBuffered(waysx->fd,&wayx,sizeof(WayX));
+ WriteFileBuffered(waysx->fd,name,strlen(name)+1);
 
  waysx->number++;
 
@@ -169,6 +310,99 @@ void AppendWay(WaysX *waysx,way_t id,Way *way,const char *name)
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Remove the ways that have been replaced or deleted by the change files,
+  keeping only the latest version of each changed way.
+
+  WaysX *waysx The set of ways to modify.
+  ++++++++++++++++++++++++++++++++++++++*/
+
+void ApplyWayChanges(WaysX *waysx)
+{
+ FILESORT_VARINT waysize;
+ void *data=NULL;
+ FILESORT_VARINT datasize=0;
+ index_t total=0,kept=0;
+ int fd;
+
+ if(!waysx->changes)
+    return;
+
+ /* Print the start message */
+
+ printf_first("Applying Way Changes: Ways=0");
+
+ /* Sort the changes */
+
+ SortChangeList(waysx->changes);
+
+ /* Close the file (finished appending) */
+
+ waysx->fd=CloseFileBuffered(waysx->fd);
+
+ /* Re-open the file read-only and a new file writeable */
+
+ waysx->fd=ReOpenFileBuffered(waysx->filename);
+
+ DeleteFile(waysx->filename);
+
+ fd=OpenFileBufferedNew(waysx->filename);
+
+ /* Copy the ways that have not been replaced */
+
+ while(!ReadFileBuffered(waysx->fd,&waysize,FILESORT_VARSIZE))
+   {
+    ChangeX *changex;
+
+    if(waysize>datasize)
+      {
+       datasize=waysize;
+       data=realloc(data,datasize);
+
+       assert(data); /* Check realloc() worked */
+      }
+
+    ReadFileBuffered(waysx->fd,data,waysize);
+
+    changex=FindChange(waysx->changes,((WayX*)data)->id);
+
+    if(!changex || changex->index[0]==total)
+      {
+       WriteFileBuffered(fd,&waysize,FILESORT_VARSIZE);
+       WriteFileBuffered(fd,data,waysize);
+
+       kept++;
+      }
+
+    total++;
+
+    if(!(total%1000))
+       printf_middle("Applying Way Changes: Ways=%"Pindex_t" Kept=%"Pindex_t,total,kept);
+   }
+
+ waysx->number=kept;
+
+ if(data)
+    free(data);
+
+ /* Close the files and re-open for appending */
+
+ waysx->fd=CloseFileBuffered(waysx->fd);
+ CloseFileBuffered(fd);
+
+ waysx->fd=OpenFileBufferedAppend(waysx->filename);
+
+ /* Free the changes */
+
+ FreeChangeList(waysx->changes);
+ waysx->changes=NULL;
+
+ /* Print the final message */
+
+ printf_last("Applied Way Changes: Ways=%"Pindex_t" Kept=%"Pindex_t" Removed=%"Pindex_t,total,kept,total-kept);
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Sort the list of ways.
 
@@ -190,15 +424,15 @@ void SortWayList(WaysX *waysx)
 
  /* Close the file (finished appending) */
 
- waysx->fd=CloseFile(waysx->fd);
+ waysx->fd=CloseFileBuffered(waysx->fd);
 
  /* Re-open the file read-only and a new file writeable */
 
- waysx->fd=ReOpenFile(waysx->filename);
+ waysx->fd=ReOpenFileBuffered(waysx->filename);
 
  DeleteFile(waysx->filename);
 
- fd=OpenFileNew(waysx->filename);
+ fd=OpenFileBufferedNew(waysx->filename);
 
  /* Sort the ways to allow separating the names */
 
@@ -206,8 +440,8 @@ void SortWayList(WaysX *waysx)
 
  /* Close the files */
 
- waysx->fd=CloseFile(waysx->fd);
- CloseFile(fd);
+ waysx->fd=CloseFileBuffered(waysx->fd);
+ CloseFileBuffered(fd);
 
  /* Print the final message */
 
@@ -220,13 +454,13 @@ void SortWayList(WaysX *waysx)
 
  /* Re-open the file read-only and new files writeable */
 
- waysx->fd=ReOpenFile(waysx->filename);
+ waysx->fd=ReOpenFileBuffered(waysx->filename);
 
  DeleteFile(waysx->filename);
 
- fd=OpenFileNew(waysx->filename);
+ fd=OpenFileBufferedNew(waysx->filename);
 
- waysx->nfd=OpenFileNew(waysx->nfilename);
+ waysx->nfd=OpenFileBufferedNew(waysx->nfilename);
 
  /* Copy from the single file into two files */
 
@@ -235,17 +469,17 @@ void SortWayList(WaysX *waysx)
     WayX wayx;
     FILESORT_VARINT size;
 
-    ReadFile(waysx->fd,&size,FILESORT_VARSIZE);
+    ReadFileBuffered(waysx->fd,&size,FILESORT_VARSIZE);
 
     if(namelen[nnames%2]<size)
        names[nnames%2]=(char*)realloc((void*)names[nnames%2],namelen[nnames%2]=size);
 
-    ReadFile(waysx->fd,&wayx,sizeof(WayX));
-    ReadFile(waysx->fd,names[nnames%2],size-sizeof(WayX));
+    ReadFileBuffered(waysx->fd,&wayx,sizeof(WayX));
+    ReadFileBuffered(waysx->fd,names[nnames%2],size-sizeof(WayX));
 
     if(nnames==0 || strcmp(names[0],names[1]))
       {
-       WriteFile(waysx->nfd,names[nnames%2],size-sizeof(WayX));
+       WriteFileBuffered(waysx->nfd,names[nnames%2],size-sizeof(WayX));
 
        lastlength=waysx->nlength;
        waysx->nlength+=size-sizeof(WayX);
@@ -255,7 +489,7 @@ void SortWayList(WaysX *waysx)
 
     wayx.way.name=lastlength;
 
-    WriteFile(fd,&wayx,sizeof(WayX));
+    WriteFileBuffered(fd,&wayx,sizeof(WayX));
 
     if(!((i+1)%1000))
        printf_middle("Separating Way Names: Ways=%"Pindex_t" Names=%"Pindex_t,i+1,nnames);
@@ -266,10 +500,10 @@ void SortWayList(WaysX *waysx)
 
  /* Close the files */
 
- waysx->fd=CloseFile(waysx->fd);
- CloseFile(fd);
+ waysx->fd=CloseFileBuffered(waysx->fd);
+ CloseFileBuffered(fd);
 
- waysx->nfd=CloseFile(waysx->nfd);
+ waysx->nfd=CloseFileBuffered(waysx->nfd);
 
  /* Print the final message */
 
@@ -282,11 +516,11 @@ void SortWayList(WaysX *waysx)
 
  /* Re-open the file read-only and a new file writeable */
 
- waysx->fd=ReOpenFile(waysx->filename);
+ waysx->fd=ReOpenFileBuffered(waysx->filename);
 
  DeleteFile(waysx->filename);
 
- fd=OpenFileNew(waysx->filename);
+ fd=OpenFileBufferedNew(waysx->filename);
 
  /* Allocate the array of indexes */
 
@@ -301,12 +535,22 @@ void SortWayList(WaysX *waysx)
 
  sortwaysx=waysx;
 
- filesort_fixed(waysx->fd,fd,sizeof(WayX),(int (*)(const void*,const void*))sort_by_id,(int (*)(void*,index_t))deduplicate_and_index_by_id);
+ filesort_fixed_keyed(waysx->fd,fd,sizeof(WayX),1,(void (*)(const void*,uint32_t*))key_by_id,(int (*)(void*,index_t))deduplicate_and_index_by_id);
 
  /* Close the files */
 
- waysx->fd=CloseFile(waysx->fd);
- CloseFile(fd);
+ waysx->fd=CloseFileBuffered(waysx->fd);
+ CloseFileBuffered(fd);
+
+ /* Replace the list of indexes with a direct-mapped index if possible */
+
+ waysx->idindex=NewIdIndex(waysx->idata,waysx->number);
+
+ if(waysx->idindex)
+   {
+    free(waysx->idata);
+    waysx->idata=NULL;
+   }
 
  /* Print the final message */
 
@@ -332,11 +576,11 @@ void CompactWayList(WaysX *waysx)
 
  /* Re-open the file read-only and a new file writeable */
 
- waysx->fd=ReOpenFile(waysx->filename);
+ waysx->fd=ReOpenFileBuffered(waysx->filename);
 
  DeleteFile(waysx->filename);
 
- fd=OpenFileNew(waysx->filename);
+ fd=OpenFileBufferedNew(waysx->filename);
 
  /* Sort the ways to allow compacting according to he properties */
 
@@ -344,8 +588,8 @@ void CompactWayList(WaysX *waysx)
 
  /* Close the files */
 
- waysx->fd=CloseFile(waysx->fd);
- CloseFile(fd);
+ waysx->fd=CloseFileBuffered(waysx->fd);
+ CloseFileBuffered(fd);
 
  /* Print the final message */
 
@@ -358,11 +602,11 @@ void CompactWayList(WaysX *waysx)
 
  /* Re-open the file read-only and a new file writeable */
 
- waysx->fd=ReOpenFile(waysx->filename);
+ waysx->fd=ReOpenFileBuffered(waysx->filename);
 
  DeleteFile(waysx->filename);
 
- fd=OpenFileNew(waysx->filename);
+ fd=OpenFileBufferedNew(waysx->filename);
 
  /* Update the way as we go using the sorted index */
 
@@ -372,7 +616,7 @@ void CompactWayList(WaysX *waysx)
    {
     WayX wayx;
 
-    ReadFile(waysx->fd,&wayx,sizeof(WayX));
+    ReadFileBuffered(waysx->fd,&wayx,sizeof(WayX));
 
     if(waysx->cnumber==0 || wayx.way.name!=lastway.name || WaysCompare(&lastway,&wayx.way))
       {
@@ -383,7 +627,7 @@ void CompactWayList(WaysX *waysx)
 
     wayx.prop=waysx->cnumber-1;
 
-    WriteFile(fd,&wayx,sizeof(WayX));
+    WriteFileBuffered(fd,&wayx,sizeof(WayX));
 
     if(!((i+1)%1000))
        printf_middle("Compacting Ways: Ways=%"Pindex_t" Properties=%"Pindex_t,i+1,waysx->cnumber);
@@ -391,8 +635,8 @@ void CompactWayList(WaysX *waysx)
 
  /* Close the files */
 
- waysx->fd=CloseFile(waysx->fd);
- CloseFile(fd);
+ waysx->fd=CloseFileBuffered(waysx->fd);
+ CloseFileBuffered(fd);
 
  /* Print the final message */
 
@@ -405,20 +649,20 @@ void CompactWayList(WaysX *waysx)
 
  /* Re-open the file read-only and a new file writeable */
 
- waysx->fd=ReOpenFile(waysx->filename);
+ waysx->fd=ReOpenFileBuffered(waysx->filename);
 
  DeleteFile(waysx->filename);
 
- fd=OpenFileNew(waysx->filename);
+ fd=OpenFileBufferedNew(waysx->filename);
 
  /* Sort the ways by index */
 
- filesort_fixed(waysx->fd,fd,sizeof(WayX),(int (*)(const void*,const void*))sort_by_id,NULL);
+ filesort_fixed_keyed(waysx->fd,fd,sizeof(WayX),1,(void (*)(const void*,uint32_t*))key_by_id,NULL);
 
  /* Close the files */
 
- waysx->fd=CloseFile(waysx->fd);
- CloseFile(fd);
+ waysx->fd=CloseFileBuffered(waysx->fd);
+ CloseFileBuffered(fd);
 
  /* Print the final message */
 
@@ -426,6 +670,20 @@ void CompactWayList(WaysX *waysx)
 }
 
 
+/*++++++++++++++++++++++++++++++++++++++
+  Get the key to sort the ways into id order.
+
+  WayX *wayx The extended way.
+
+  uint32_t *key Returns the key (the id).
+  ++++++++++++++++++++++++++++++++++++++*/
+
+static void key_by_id(WayX *wayx,uint32_t *key)
+{
+ key[0]=wayx->id;
+}
+
+
 /*++++++++++++++++++++++++++++++++++++++
   Sort the ways into id order.
 
@@ -554,6 +812,9 @@ index_t IndexWayX(WaysX *waysx,way_t id)
  index_t end=waysx->number-1;
  index_t mid;
 
+ if(waysx->idindex)              /* Direct-mapped lookup */
+    return(LookupIdIndex(waysx->idindex,id));
+
  /* Binary search - search key exact match only is required.
   *
   *  # <- start  |  Check mid and move start or end if it doesn't match
@@ -629,9 +890,9 @@ void SaveWayList(WaysX *waysx,const char *filename)
 
  /* Write out the ways data */
 
- fd=OpenFileNew(filename);
+ fd=OpenFileBufferedNew(filename);
 
- SeekFile(fd,sizeof(WaysFile));
+ SeekFileBuffered(fd,sizeof(WaysFile));
 
  for(i=0;i<waysx->number;i++)
    {
@@ -641,8 +902,8 @@ void SaveWayList(WaysX *waysx,const char *filename)
     allow   |=wayx->way.allow;
     props   |=wayx->way.props;
 
-    SeekFile(fd,sizeof(WaysFile)+(off_t)wayx->prop*sizeof(Way));
-    WriteFile(fd,&wayx->way,sizeof(Way));
+    SeekFileBuffered(fd,sizeof(WaysFile)+(off_t)wayx->prop*sizeof(Way));
+    WriteFileBuffered(fd,&wayx->way,sizeof(Way));
 
     if(!((i+1)%1000))
        printf_middle("Writing Ways: Ways=%"Pindex_t,i+1);
@@ -658,9 +919,9 @@ void SaveWayList(WaysX *waysx,const char *filename)
 
  /* Write out the ways names */
 
- SeekFile(fd,sizeof(WaysFile)+(off_t)waysx->cnumber*sizeof(Way));
+ SeekFileBuffered(fd,sizeof(WaysFile)+(off_t)waysx->cnumber*sizeof(Way));
 
- waysx->nfd=ReOpenFile(waysx->nfilename);
+ waysx->nfd=ReOpenFileBuffered(waysx->nfilename);
 
  while(position<waysx->nlength)
    {
@@ -670,15 +931,15 @@ void SaveWayList(WaysX *waysx,const char *filename)
     if((waysx->nlength-position)<1024)
        len=waysx->nlength-position;
 
-    ReadFile(waysx->nfd,temp,len);
-    WriteFile(fd,temp,len);
+    ReadFileBuffered(waysx->nfd,temp,len);
+    WriteFileBuffered(fd,temp,len);
 
     position+=len;
    }
 
  /* Close the file */
 
- waysx->nfd=CloseFile(waysx->nfd);
+ waysx->nfd=CloseFileBuffered(waysx->nfd);
 
  /* Write out the header structure */
 
@@ -689,10 +950,10 @@ void SaveWayList(WaysX *waysx,const char *filename)
  waysfile.allow   =allow;
  waysfile.props   =props;
 
- SeekFile(fd,0);
- WriteFile(fd,&waysfile,sizeof(WaysFile));
+ SeekFileBuffered(fd,0);
+ WriteFileBuffered(fd,&waysfile,sizeof(WaysFile));
 
- CloseFile(fd);
+ CloseFileBuffered(fd);
 
  /* Print the final message */
 
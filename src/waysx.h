@@ -31,6 +31,7 @@
 #include "ways.h"
 
 #include "files.h"
+#include "idindex.h"
 
 
 /* Data structures */
@@ -55,6 +56,8 @@ struct _WaysX
 
  index_t  number;               /*+ The number of extended ways still being considered. +*/
 
+ ChangesX *changes;             /*+ The ways that have been changed by the change files. +*/
+
 #if !SLIM
 
  WayX    *data;                 /*+ The extended ways data (when mapped into memory). +*/
@@ -68,6 +71,7 @@ struct _WaysX
  index_t  cnumber;              /*+ The number of entries after compacting. +*/
 
  way_t   *idata;                /*+ The extended way IDs (sorted by ID). +*/
+ IdIndex *idindex;              /*+ The direct-mapped index of the extended way IDs (replaces idata if not too sparse). +*/
 
  char    *nfilename;            /*+ The name of the temporary file (for the names). +*/
  int      nfd;                  /*+ The file descriptor of the temporary file (for the names). +*/
@@ -84,10 +88,18 @@ void FreeWayList(WaysX *waysx,int keep);
 
 void SaveWayList(WaysX *waysx,const char *filename);
 
+void SaveParsedWayList(WaysX *waysx);
+void LoadParsedWayList(WaysX *waysx);
+
+void CheckpointWayList(WaysX *waysx,int fd,const char *filename,const char *nfilename);
+int ResumeWayList(WaysX *waysx,int fd,const char *filename,const char *nfilename);
+
 index_t IndexWayX(WaysX *waysx,way_t id);
 
 void AppendWay(WaysX *waysx,way_t id,Way *way,const char *name);
 
+void ApplyWayChanges(WaysX *waysx);
+
 void SortWayList(WaysX *waysx);
 
 void CompactWayList(WaysX *waysx);
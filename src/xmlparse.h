@@ -74,6 +74,7 @@ unsigned long long ParseXML_LineNumber(void);
 
 char *ParseXML_Decode_Entity_Ref(const char *string);
 char *ParseXML_Decode_Char_Ref(const char *string);
+char *ParseXML_Decode_Char_Ref_r(const char *string,char *result);
 char *ParseXML_Encode_Safe_XML(const char *string);
 
 int ParseXML_IsInteger(const char *string);